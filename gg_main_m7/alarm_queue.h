@@ -0,0 +1,228 @@
+/*****************************************
+*   Alarm Queue
+      - Small priority queue of alarms (Over / under temperature, sensor
+        faults, anomalies) sent on their own compact POST, ahead of the bulk uploads
+      - A second alarm of the same type and subject while one is pending is
+        coalesced into it (Count and latest value)
+      - Rate limited per type and subject: after a send the next one waits
+        alarmRateLimits of its type, alarms raised meanwhile coalesce
+      - When the queue is full a new alarm replaces the pending one with the
+        lowest priority, or is dropped if it ranks lowest itself
+      - The body holds a full queue of the longest records. Should it still
+        run out, the alarms that fit go and the rest wait for the next POST
+      - A failed POST backs the lane off: ALARM_RETRY_BASE, doubled for each
+        failure in a row up to ALARM_MAX_BACKOFF doublings
+      - Latency measured by tools/alarm_latency_sim.cpp
+*****************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ALARM_QUEUE_SIZE 8
+#define ALARM_SUBJECTS 16    // Sensor ids per type (Zone, SensorFaultId in event_trace.h, AnomalyChannelId)
+#define ALARM_DEVICE_ID_MAX 15    // Characters of deviceId (runtime_config.h)
+#define ALARM_VALUE_LIMIT 999999  // Sent values are clamped to +- this
+#define ALARM_RECORD_MAX 93       // ,{"Type":"under_temperature","Subject":15,"Value":-999999.00,"Time":4294967295,"Count":65535}
+#define ALARM_BODY_SIZE (28 + ALARM_DEVICE_ID_MAX + ALARM_QUEUE_SIZE * ALARM_RECORD_MAX)  // A full queue in the compact JSON
+#define ALARM_RETRY_BASE 5000     // ms after the first failed POST
+#define ALARM_MAX_BACKOFF 6       // Failures in a row that still double the wait (5 min 20 s at most)
+
+//Alarm types, in priority order (First is the most urgent)
+enum AlarmType : uint8_t {
+  ALARM_OVER_TEMPERATURE,
+  ALARM_SENSOR_FAULT,
+  ALARM_UNDER_TEMPERATURE,
+  ALARM_ANOMALY,  // Subject: AnomalyChannelId (anomaly_detector.h)
+  ALARM_TYPES
+};
+
+const char* const alarmTypeNames[ALARM_TYPES] = { "over_temperature", "sensor_fault", "under_temperature", "anomaly" };
+const uint32_t alarmRateLimits[ALARM_TYPES] = { 60000, 600000, 300000, 300000 };  // ms between two sends of the same type and subject
+
+enum AlarmRaise {
+  ALARM_QUEUED,     // New pending alarm
+  ALARM_COALESCED,  // Merged into the pending alarm of the same type and subject
+  ALARM_DROPPED,    // Queue full of more urgent alarms
+};
+
+struct Alarm {
+  uint8_t type;
+  uint8_t subject;
+  uint16_t count;       // Raises coalesced into this alarm
+  float value;          // Latest value
+  uint32_t raisedAt;    // ms (millis()) of the first raise, for the latency
+  uint32_t unixTime;    // Of the latest raise, sent to the server
+};
+
+struct AlarmQueue {
+  Alarm pending[ALARM_QUEUE_SIZE];
+  int count;
+
+  uint32_t lastSent[ALARM_TYPES][ALARM_SUBJECTS];  // ms of the last send, valid when sentOnce is set
+  bool sentOnce[ALARM_TYPES][ALARM_SUBJECTS];
+
+  uint32_t failStreak;  // Failed POSTs in a row
+  uint32_t retryAt;     // ms, nothing is sent before it while failStreak is set
+
+  //Statistics
+  uint32_t raised;
+  uint32_t coalesced;
+  uint32_t dropped;
+  uint32_t sent;
+  uint32_t failedPosts;
+};
+
+
+void initAlarmQueue(AlarmQueue& queue) {
+  memset(&queue, 0, sizeof(queue));
+}
+
+// Queue an alarm, or coalesce it into the pending one of the same type and subject
+AlarmRaise raiseAlarm(AlarmQueue& queue, AlarmType type, uint8_t subject, float value, uint32_t now, uint32_t unixTime) {
+  queue.raised++;
+  subject = subject < ALARM_SUBJECTS ? subject : ALARM_SUBJECTS - 1;
+
+  for (int i = 0; i < queue.count; i++) {
+    Alarm& alarm = queue.pending[i];
+    if (alarm.type == type && alarm.subject == subject) {
+      alarm.count = alarm.count < 0xFFFF ? alarm.count + 1 : 0xFFFF;
+      alarm.value = value;
+      alarm.unixTime = unixTime;
+      queue.coalesced++;
+      return ALARM_COALESCED;
+    }
+  }
+
+  int slot = queue.count;
+  if (queue.count == ALARM_QUEUE_SIZE) {
+    //Replace the least urgent pending alarm (Latest raised among equals) if the new one is more urgent
+    slot = 0;
+    for (int i = 1; i < queue.count; i++) {
+      const Alarm& alarm = queue.pending[i];
+      const Alarm& worst = queue.pending[slot];
+      if (alarm.type > worst.type || (alarm.type == worst.type && (int32_t)(alarm.raisedAt - worst.raisedAt) > 0)) {
+        slot = i;
+      }
+    }
+    queue.dropped++;  // The new alarm or the one it replaces
+    if (queue.pending[slot].type <= type) {
+      return ALARM_DROPPED;
+    }
+  } else {
+    queue.count++;
+  }
+
+  Alarm& alarm = queue.pending[slot];
+  alarm.type = type;
+  alarm.subject = subject;
+  alarm.count = 1;
+  alarm.value = value;
+  alarm.raisedAt = now;
+  alarm.unixTime = unixTime;
+  return ALARM_QUEUED;
+}
+
+// ms until the alarm may be sent (0 if it may go now)
+uint32_t alarmWait(const AlarmQueue& queue, const Alarm& alarm, uint32_t now) {
+  if (!queue.sentOnce[alarm.type][alarm.subject]) {
+    return 0;
+  }
+  uint32_t since = now - queue.lastSent[alarm.type][alarm.subject];
+  uint32_t limit = alarmRateLimits[alarm.type];
+  return since >= limit ? 0 : limit - since;
+}
+
+// ms until the lane may post again after a failure (0 if it may post now)
+uint32_t alarmBackoffWait(const AlarmQueue& queue, uint32_t now) {
+  int32_t wait = (int32_t)(queue.retryAt - now);
+  return queue.failStreak > 0 && wait > 0 ? wait : 0;
+}
+
+// Indexes of the alarms that may be sent now, most urgent first, returns the number
+int collectReadyAlarms(const AlarmQueue& queue, uint32_t now, int* ready, int maxReady) {
+  if (alarmBackoffWait(queue, now) > 0) {
+    return 0;
+  }
+
+  int count = 0;
+  for (int type = 0; type < ALARM_TYPES; type++) {
+    for (int i = 0; i < queue.count && count < maxReady; i++) {
+      if (queue.pending[i].type == type && alarmWait(queue, queue.pending[i], now) == 0) {
+        ready[count++] = i;
+      }
+    }
+  }
+  return count;
+}
+
+// ms until the next pending alarm may be sent (0xFFFFFFFF if none is pending)
+uint32_t nextAlarmDue(const AlarmQueue& queue, uint32_t now) {
+  uint32_t due = 0xFFFFFFFF;
+  for (int i = 0; i < queue.count; i++) {
+    uint32_t wait = alarmWait(queue, queue.pending[i], now);
+    due = wait < due ? wait : due;
+  }
+  uint32_t backoff = alarmBackoffWait(queue, now);
+  return due != 0xFFFFFFFF && backoff > due ? backoff : due;
+}
+
+// The POST of the collected alarms failed, they stay queued and the lane waits before the next try
+void alarmPostFailed(AlarmQueue& queue, uint32_t now) {
+  uint32_t doublings = queue.failStreak < ALARM_MAX_BACKOFF ? queue.failStreak : ALARM_MAX_BACKOFF;
+  queue.retryAt = now + (ALARM_RETRY_BASE << doublings);
+  queue.failStreak++;
+  queue.failedPosts++;
+}
+
+// The collected alarms reached the server: remove them and start their rate limit
+void completeAlarms(AlarmQueue& queue, uint32_t now, const int* ready, int count) {
+  bool done[ALARM_QUEUE_SIZE] = { false };
+  for (int i = 0; i < count; i++) {
+    const Alarm& alarm = queue.pending[ready[i]];
+    queue.lastSent[alarm.type][alarm.subject] = now;
+    queue.sentOnce[alarm.type][alarm.subject] = true;
+    done[ready[i]] = true;
+  }
+
+  int kept = 0;
+  for (int i = 0; i < queue.count; i++) {
+    if (!done[i]) {
+      queue.pending[kept++] = queue.pending[i];
+    }
+  }
+  queue.sent += queue.count - kept;
+  queue.count = kept;
+  queue.failStreak = 0;
+}
+
+// Compact POST body: {"DeviceID":"..","Alarms":[{"Type":"..","Subject":n,"Value":v,"Time":t,"Count":n},..]}
+//  - Alarms are written in the order of ready until the next one would not fit with the closing "]}",
+//    count is cut to the alarms written. Returns the length, 0 if not even one fits
+size_t formatAlarmJSON(char* body, size_t size, const char* deviceId, const AlarmQueue& queue, const int* ready, int& count) {
+  int length = snprintf(body, size, "{\"DeviceID\":\"%s\",\"Alarms\":[", deviceId);
+  if (length < 0 || (size_t)length + 2 >= size) {
+    count = 0;
+    return 0;
+  }
+
+  int written = 0;
+  for (; written < count; written++) {
+    const Alarm& alarm = queue.pending[ready[written]];
+    float value = alarm.value > ALARM_VALUE_LIMIT ? ALARM_VALUE_LIMIT : alarm.value < -ALARM_VALUE_LIMIT ? -ALARM_VALUE_LIMIT : alarm.value;
+    int record = snprintf(body + length, size - length, "%s{\"Type\":\"%s\",\"Subject\":%u,\"Value\":%.2f,\"Time\":%lu,\"Count\":%u}",
+                          written > 0 ? "," : "", alarmTypeNames[alarm.type], alarm.subject, value,
+                          (unsigned long)alarm.unixTime, alarm.count);
+    if (record < 0 || (size_t)(length + record) + 2 >= size) {
+      break;  // Cut off, "]}" goes where it started
+    }
+    length += record;
+  }
+  count = written;
+  if (written == 0) {
+    return 0;
+  }
+
+  length += snprintf(body + length, size - length, "]}");
+  return length;
+}
@@ -0,0 +1,190 @@
+/*****************************************
+*   Anomaly Detector
+      - Streaming statistics per Sensor channel, updated at sample time in
+        constant memory: mean and variance (Welford while warming up, then
+        exponentially weighted so the baseline follows the seasons), and the
+        smoothed rate of change per minute
+      - A sample is anomalous when its z-score against the baseline, or the
+        rate of change, is past the channel's limit. ANOMALY_PERSIST samples
+        in a row start an anomaly, as many normal ones clear it
+      - Anomalous samples are kept out of the baseline so a failed heater or a
+        probe out of the tank is not learned as normal. A new level that
+        lasts ANOMALY_REBASE samples is accepted and the channel warms up again
+      - Limits checked on labelled traces by tools/anomaly_eval.cpp
+*****************************************/
+
+#include <math.h>
+#include <stdint.h>
+
+#define ANOMALY_WARMUP 20        // Samples of plain Welford statistics before detection starts
+#define ANOMALY_ALPHA 0.005      // Weight of a sample in the baseline after the warm up (~100 min at 30 s)
+#define ANOMALY_RATE_ALPHA 0.3   // Weight of a sample in the rate of change
+#define ANOMALY_Z_LIMIT 4.0
+#define ANOMALY_CLIP 2.5         // Deviations past which a sample only nudges the mean
+#define ANOMALY_PERSIST 3        // Samples in a row that start or clear an anomaly
+#define ANOMALY_REBASE 240       // Anomalous samples in a row after which the level is the new normal (2 h at 30 s)
+#define ANOMALY_MAX_GAP 600      // s between samples past which the rate starts over
+
+enum AnomalyChannelId : uint8_t {
+  ANOMALY_GROW_TEMP,
+  ANOMALY_HUMIDITY,
+  ANOMALY_AMBIENT_TEMP,
+  ANOMALY_WATER_TEMP,
+  ANOMALY_TDS,
+  ANOMALY_CHANNELS
+};
+
+const char* const anomalyChannelNames[ANOMALY_CHANNELS] = { "Grow Temp", "Humidity", "Room Temp", "Water Temp", "TDS" };
+
+//What made a sample anomalous, the flags of an anomaly are those of the sample that started it
+enum AnomalyFlags : uint8_t {
+  ANOMALY_LEVEL = 1,  // z-score past ANOMALY_Z_LIMIT
+  ANOMALY_RATE = 2,   // Rate of change past maxRate
+};
+
+struct AnomalyLimits {
+  float minDeviation;  // Floor of the standard deviation, in the channel's unit (Sensor resolution and normal noise)
+  float maxRate;       // Unit per minute
+};
+
+//Per channel, in AnomalyChannelId order
+const AnomalyLimits anomalyLimits[ANOMALY_CHANNELS] = {
+  { 0.5, 1.0 },   // Grow Temp, C
+  { 3.0, 5.0 },   // Humidity, %
+  { 0.5, 1.0 },   // Room Temp, C
+  { 0.2, 0.3 },   // Water Temp, C (The tank changes slowly)
+  { 15.0, 40.0 }, // TDS, ppm
+};
+
+enum AnomalyChange {
+  ANOMALY_UNCHANGED,
+  ANOMALY_STARTED,
+  ANOMALY_CLEARED,
+};
+
+struct AnomalyChannel {
+  uint32_t count;     // Samples in the baseline since the last warm up
+  float mean;
+  float variance;     // m2 (Sum of squared differences) while warming up
+  float lastValue;
+  uint32_t lastTime;  // s, 0 before the first sample
+  float rate;         // Unit per minute, smoothed
+  float z;            // Of the latest sample
+
+  uint8_t flags;      // Of the latest sample
+  bool active;        // An anomaly is in progress
+  uint8_t activeFlags;
+  uint8_t streak;     // Samples in a row that disagree with active
+  uint16_t anomalous; // Anomalous samples in a row
+};
+
+
+void initAnomalyChannel(AnomalyChannel& channel) {
+  channel.count = 0;
+  channel.mean = 0;
+  channel.variance = 0;
+  channel.lastValue = 0;
+  channel.lastTime = 0;
+  channel.rate = 0;
+  channel.z = 0;
+  channel.flags = 0;
+  channel.active = false;
+  channel.activeFlags = 0;
+  channel.streak = 0;
+  channel.anomalous = 0;
+}
+
+inline bool anomalyWarmedUp(const AnomalyChannel& channel) {
+  return channel.count >= ANOMALY_WARMUP;
+}
+
+inline float anomalyDeviation(const AnomalyChannel& channel, const AnomalyLimits& limits) {
+  float deviation = sqrtf(channel.variance);
+  return deviation > limits.minDeviation ? deviation : limits.minDeviation;
+}
+
+// Add value to the baseline: Welford until ANOMALY_WARMUP, exponentially weighted after
+//  - After the warm up a sample past ANOMALY_CLIP deviations moves the mean by the clipped
+//    difference and leaves the variance alone, or a slow drift would widen the variance as
+//    fast as it moves away and never reach the z limit
+void addAnomalyBaseline(AnomalyChannel& channel, const AnomalyLimits& limits, float value) {
+  float difference = value - channel.mean;
+
+  if (channel.count < ANOMALY_WARMUP) {
+    channel.count++;
+    channel.mean += difference / channel.count;
+    channel.variance += difference * (value - channel.mean);
+    if (channel.count == ANOMALY_WARMUP) {
+      channel.variance /= ANOMALY_WARMUP - 1;  // m2 to the sample variance
+    }
+    return;
+  }
+
+  float clip = ANOMALY_CLIP * anomalyDeviation(channel, limits);
+  channel.count++;
+  if (fabsf(difference) > clip) {
+    channel.mean += ANOMALY_ALPHA * (difference > 0 ? clip : -clip);
+    return;
+  }
+
+  float increment = ANOMALY_ALPHA * difference;
+  channel.mean += increment;
+  channel.variance = (1 - ANOMALY_ALPHA) * (channel.variance + difference * increment);
+}
+
+// Add one sample taken at time (s), returns whether an anomaly started or cleared with it
+AnomalyChange addAnomalySample(AnomalyChannel& channel, const AnomalyLimits& limits, float value, uint32_t time) {
+  //Rate of change
+  uint32_t elapsed = time - channel.lastTime;
+  if (channel.lastTime == 0 || elapsed > ANOMALY_MAX_GAP) {
+    channel.rate = 0;
+  } else if (elapsed > 0) {
+    float rate = (value - channel.lastValue) * 60 / elapsed;
+    channel.rate += ANOMALY_RATE_ALPHA * (rate - channel.rate);
+  }
+  bool rateKnown = channel.lastTime != 0 && elapsed <= ANOMALY_MAX_GAP;
+  channel.lastValue = value;
+  channel.lastTime = time;
+
+  //Check against the baseline before the sample joins it
+  channel.flags = 0;
+  channel.z = 0;
+  if (anomalyWarmedUp(channel)) {
+    channel.z = (value - channel.mean) / anomalyDeviation(channel, limits);
+    if (fabsf(channel.z) > ANOMALY_Z_LIMIT) {
+      channel.flags |= ANOMALY_LEVEL;
+    }
+    if (rateKnown && fabsf(channel.rate) > limits.maxRate) {
+      channel.flags |= ANOMALY_RATE;
+    }
+  }
+
+  if (channel.flags == 0) {
+    channel.anomalous = 0;
+    addAnomalyBaseline(channel, limits, value);
+  } else if (++channel.anomalous >= ANOMALY_REBASE) {
+    //Not a passing fault, learn the new level
+    channel.count = 0;
+    channel.mean = 0;
+    channel.variance = 0;
+    channel.anomalous = 0;
+  }
+
+  //Debounce
+  bool anomalous = channel.flags != 0;
+  if (anomalous == channel.active) {
+    channel.streak = 0;
+    return ANOMALY_UNCHANGED;
+  }
+  if (anomalous && channel.streak == 0) {
+    channel.activeFlags = 0;
+  }
+  channel.activeFlags |= channel.flags;
+  if (++channel.streak < ANOMALY_PERSIST) {
+    return ANOMALY_UNCHANGED;
+  }
+
+  channel.streak = 0;
+  channel.active = anomalous;
+  return anomalous ? ANOMALY_STARTED : ANOMALY_CLEARED;
+}
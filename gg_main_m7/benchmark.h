@@ -0,0 +1,141 @@
+/*****************************************
+*   Benchmark Harness
+      - Times the hot functions on the board, enabled by building with
+        GG_BENCHMARK defined (The cases are in gg_main_m7.ino)
+      - Cycle counts from the DWT cycle counter (profiler.h) when the core
+        has one, wall time from micros(). The host build (tools/firmware_bench.cpp)
+        has no cycles and takes the wall time from the monotonic clock
+      - One JSON line per result on the Serial Monitor, prefixed with "BENCH "
+        so a script can collect them and compare firmware builds:
+          BENCH {"build":"...","name":"convertToJSON","rows":10,"iterations":20,"cycles":123456,"ns":641.2}
+      - The cases that need no board (Conversions, convertTimeStamp() and
+        the sample columns) are here, so the board and the host run the
+        same code. Those that need the sketch's state are in gg_main_m7.ino
+*****************************************/
+
+#ifndef FIRMWARE_VERSION
+#define FIRMWARE_VERSION "dev"
+#endif
+
+#define BENCHMARK_BUILD FIRMWARE_VERSION " " __DATE__ " " __TIME__
+
+#define BENCHMARK_MEDIAN_SAMPLES 30  // SCOUNT of gg_main_m7.ino, the TDS median window
+
+//Written by the cases so the compiler keeps the work being timed
+volatile float benchmarkSink;
+
+
+// Run fn iterations times after one warm up call and print the mean cost per call
+//  - rows is the buffer fill the case was set up with, 0 when it does not apply
+//  - Returns the mean cycles per call, 0 without the cycle counter
+uint32_t runBenchmark(const char* name, int rows, void (*fn)(), int iterations) {
+  fn();
+
+  unsigned long startMicros = micros();
+  uint32_t startCycles = readCycleCounter();
+  for (int i = 0; i < iterations; i++) {
+    fn();
+  }
+  uint32_t cycles = readCycleCounter() - startCycles;
+  unsigned long elapsed = micros() - startMicros;
+
+  uint32_t perCall = cycleCounterRunning ? cycles / iterations : 0;
+#if !defined(ARDUINO)
+  //micros() is the virtual clock of the host shim, the ticks are ns of the monotonic clock (Wraps after 4.2 s)
+  double ns = (double)cycles / iterations;
+  (void)elapsed;
+#else
+  double ns = elapsed * 1000.0 / iterations;
+#endif
+
+  char line[192];
+  snprintf(line, sizeof(line),
+           "BENCH {\"build\":\"%s\",\"name\":\"%s\",\"rows\":%d,\"iterations\":%d,\"cycles\":%lu,\"ns\":%.1f}",
+           BENCHMARK_BUILD, name, rows, iterations, (unsigned long)perCall, ns);
+  Serial.println(line);
+  return perCall;
+}
+
+
+/*****************************************
+*   Cases Without the Board
+*****************************************/
+
+int benchmarkAdc[BENCHMARK_MEDIAN_SAMPLES];
+int benchmarkStep = 0;
+
+//Columns the sample cases work on, the sketch passes its own (Left empty afterwards)
+SampleColumns* benchmarkColumns = NULL;
+int benchmarkFill = 0;
+
+// Fill the first rows of every sample column with plausible readings
+void fillBenchmarkRows(SampleColumns& columns, int rows) {
+  clearSampleColumns(columns);
+
+  for (int channel = 0; channel < SAMPLE_CHANNELS; channel++) {
+    for (int row = 0; row < rows; row++) {
+      addSample(columns, channel, 1700000000UL + row * 30, 20.0 + (channel * 7 + row) % 50 * 0.1);
+    }
+  }
+}
+
+void benchMedian() {
+  benchmarkSink = getMedianNum(benchmarkAdc, BENCHMARK_MEDIAN_SAMPLES);
+}
+
+void benchTdsConversion() {
+  benchmarkStep = (benchmarkStep + 1) % 100;
+  benchmarkSink = tdsFromVoltage(0.5 + benchmarkStep * 0.02, 20.0);
+}
+
+void benchNtcConversion() {
+  benchmarkStep = (benchmarkStep + 1) % 100;
+  benchmarkSink = ntcTemperature(300 + benchmarkStep * 4);
+}
+
+void benchConvertTimeStamp() {
+  benchmarkStep = (benchmarkStep + 1) % 100;
+  benchmarkSink = convertTimeStamp(1700000000UL + benchmarkStep * 3599UL).length();
+}
+
+// The samples of one sensing pass on top of benchmarkFill rows, the counts go back so every call sees the same fill
+//  - A full column (100 rows) refuses the sample, the sensing functions then wipe the columns
+void benchAddSample() {
+  SampleColumns& columns = *benchmarkColumns;
+  bool added = true;
+  for (int channel = 0; channel < SAMPLE_CHANNELS; channel++) {
+    added = addSample(columns, channel, 1700003000UL, 21.5) && added;
+  }
+  for (int channel = 0; channel < SAMPLE_CHANNELS; channel++) {
+    columns.count[channel] = benchmarkFill;
+  }
+  benchmarkSink = added;
+}
+
+// Oldest and newest sample, a pass over every row held (addUploadRollups() runs it for every upload)
+void benchSampleTimeRange() {
+  uint32_t oldest, newest;
+  sampleTimeRange(*benchmarkColumns, oldest, newest);
+  benchmarkSink = newest - oldest;
+}
+
+// The cases above, columns is empty afterwards
+void runPortableBenchmarks(SampleColumns& columns) {
+  for (int i = 0; i < BENCHMARK_MEDIAN_SAMPLES; i++) {
+    benchmarkAdc[i] = (i * 379) % 1024;
+  }
+  runBenchmark("getMedianNum", BENCHMARK_MEDIAN_SAMPLES, benchMedian, 1000);
+  runBenchmark("tdsFromVoltage", 0, benchTdsConversion, 1000);
+  runBenchmark("ntcTemperature", 0, benchNtcConversion, 1000);
+  runBenchmark("convertTimeStamp", 0, benchConvertTimeStamp, 200);
+
+  benchmarkColumns = &columns;
+  const int fills[] = { 0, 10, SAMPLE_ROWS };
+  for (int fill : fills) {
+    fillBenchmarkRows(columns, fill);
+    benchmarkFill = fill;
+    runBenchmark("addSample", fill, benchAddSample, 1000);
+    runBenchmark("sampleTimeRange", fill, benchSampleTimeRange, 1000);
+  }
+  clearSampleColumns(columns);
+}
@@ -0,0 +1,156 @@
+/*****************************************
+*   Binary Log
+      - Log sites write a format id and the raw arguments into a ring, the
+        text is never formatted on the board and the log site never waits
+        for the port
+      - The "log" task drains the ring to Serial in the background, only the
+        whole frames the port takes without blocking. A full port is left
+        for the next run
+      - tools/log_bench.cpp times the loop() cost of the log against the text
+        prints it replaced, on the host
+      - Frame: 0xA5, format id, argument count, millis() (4 bytes), arguments
+        (4 bytes each, little endian), text output on the same port is
+        plain ASCII so the two can be mixed
+      - tools/log_decoder.py reads the format table below out of this file and
+        turns the frames back into text
+      - Single producer (Tasks, not interrupts) and single consumer, no locks
+*****************************************/
+
+#define LOG_RING_SIZE 4096  // Power of two
+#define LOG_FRAME_SYNC 0xA5
+#define LOG_MAX_ARGS 8
+
+//Format table, ids are the position in the list, add new formats at the end
+//  %f arguments are floats, %d / %u 32 bit integers, no strings
+#define LOG_FORMATS(X) \
+  X(LOG_SENSING, "Reading Temerature") \
+  X(LOG_READINGS, "Ambient %.2f C, Grow %.2f C %.2f %%, Water %.2f C, pH %.2f, TDS %.0f ppm, Heater on %u") \
+  X(LOG_GET_START, "GET request") \
+  X(LOG_POST_START, "POST %u bytes, sequence %u") \
+  X(LOG_HTTP_STATUS, "HTTP Response Status Code: %d, Content-Length %d") \
+  X(LOG_HTTP_ACK, "Ack: %u") \
+  X(LOG_HTTP_CONFIG, "Config update received") \
+  X(LOG_HTTP_FAILED, "HTTP Request failed") \
+  X(LOG_CONNECT_FAILED, "Failed to Connect to API Server") \
+  X(LOG_RESPONSE_TIMEOUT, "Server Response Timeout") \
+  X(LOG_NOT_ACKNOWLEDGED, "Upload %u not acknowledged (Ack %u)") \
+  X(LOG_UPLOAD_TOO_BIG, "Sensor data does not fit the upload buffer") \
+  X(LOG_DROPPED, "%u log frames dropped") \
+  X(LOG_UPLOAD_INTERVAL, "Next upload in %u ms (Link quality %.2f, RSSI %.0f dBm, success %.2f)") \
+  X(LOG_ALARMS_SENT, "%u alarms sent") \
+  X(LOG_ANOMALY, "Anomaly on channel %u: %.2f (z %.1f, %.2f per min)") \
+  X(LOG_ANOMALY_CLEARED, "Anomaly on channel %u cleared") \
+  X(LOG_ZONE_READINGS, "Zone %u: %.2f C %.2f %%, target %.2f, heater on %u") \
+  X(LOG_UPLOAD_COMPRESSED, "Upload body %u bytes deflated to %u in %u us") \
+  X(LOG_UPLOAD_ENCODING, "Upload deflate %u (Server encodings, rejected %u)")
+
+#define LOG_FORMAT_ID(id, format) id,
+enum LogFormatId : uint8_t {
+  LOG_FORMATS(LOG_FORMAT_ID)
+  LOG_FORMAT_COUNT
+};
+
+uint8_t logRing[LOG_RING_SIZE];
+volatile uint32_t logHead = 0;  // Written by the log sites
+volatile uint32_t logTail = 0;  // Written by the drain
+uint32_t logDropped = 0;
+
+
+inline uint32_t logWord(float value) {
+  uint32_t word;
+  memcpy(&word, &value, sizeof(word));
+  return word;
+}
+inline uint32_t logWord(double value) {
+  return logWord((float)value);
+}
+inline uint32_t logWord(int value) {
+  return (uint32_t)value;
+}
+inline uint32_t logWord(unsigned int value) {
+  return value;
+}
+inline uint32_t logWord(long value) {
+  return (uint32_t)value;
+}
+inline uint32_t logWord(unsigned long value) {
+  return (uint32_t)value;
+}
+inline uint32_t logWord(bool value) {
+  return value ? 1 : 0;
+}
+
+void logPutWord(uint32_t position, uint32_t word) {
+  for (int i = 0; i < 4; i++) {
+    logRing[(position + i) & (LOG_RING_SIZE - 1)] = word >> (8 * i);
+  }
+}
+
+void writeLogFrame(LogFormatId id, const uint32_t* args, int count) {
+  uint32_t size = 7 + 4 * count;
+  uint32_t head = logHead;
+
+  if (LOG_RING_SIZE - (head - logTail) < size) {
+    logDropped++;
+    return;
+  }
+
+  logRing[head & (LOG_RING_SIZE - 1)] = LOG_FRAME_SYNC;
+  logRing[(head + 1) & (LOG_RING_SIZE - 1)] = id;
+  logRing[(head + 2) & (LOG_RING_SIZE - 1)] = count;
+  logPutWord(head + 3, millis());
+  for (int i = 0; i < count; i++) {
+    logPutWord(head + 7 + 4 * i, args[i]);
+  }
+
+  logHead = head + size;  // Publish the frame once it is complete
+}
+
+// Log an event, arguments are stored raw and formatted by the decoder
+template<typename... Args>
+void logEvent(LogFormatId id, Args... args) {
+  static_assert(sizeof...(args) <= LOG_MAX_ARGS, "Too many log arguments");
+  uint32_t words[sizeof...(args) + 1] = { logWord(args)... };
+  writeLogFrame(id, words, sizeof...(args));
+}
+
+// Write the ring to Serial up to end (A frame boundary)
+void writeLogFrames(uint32_t end) {
+  while (logTail != end) {
+    uint32_t start = logTail & (LOG_RING_SIZE - 1);
+    uint32_t count = min(end - logTail, (uint32_t)(LOG_RING_SIZE - start));  // Up to the end of the ring
+    Serial.write(logRing + start, count);
+    logTail += count;
+  }
+}
+
+// Send what the port takes without blocking, called by the log task
+void drainLog() {
+  if (logDropped > 0) {
+    uint32_t dropped = logDropped;
+    logDropped = 0;
+    logEvent(LOG_DROPPED, dropped);
+  }
+
+  //No room, the next run drains
+  int available = Serial.availableForWrite();
+  if (available <= 0) {
+    return;
+  }
+
+  //Whole frames only, so text printed between two drains never splits a frame
+  uint32_t end = logTail;
+  while (end != logHead) {
+    uint32_t size = 7 + 4 * logRing[(end + 2) & (LOG_RING_SIZE - 1)];
+    if (end - logTail + size > (uint32_t)available) {
+      break;
+    }
+    end += size;
+  }
+  writeLogFrames(end);
+}
+
+// Send everything still in the ring, waiting for the port (Before a reset or a blocking wait)
+void flushLog() {
+  writeLogFrames(logHead);
+}
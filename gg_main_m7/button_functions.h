@@ -0,0 +1,168 @@
+/*****************************************
+*   Rotary Button functions
+      - Interrupt driven Button Edges (No Polling in the Loop)
+      - Settle time Debouncing: every edge restarts a one shot timer, the level
+        is accepted once it held for BUTTON_DEBOUNCE_MS, a press shorter than
+        that is dropped whole
+      - Click, Long Press and Double Click Events queued for the UI
+*****************************************/
+
+#include <mbed.h>
+
+#define BUTTON_DEBOUNCE_MS 30       // Level must hold this long before it is accepted
+#define BUTTON_LONG_PRESS_MS 800    // Hold time before a Long Press is reported
+#define BUTTON_DOUBLE_CLICK_MS 350  // Max gap between two clicks to count as a Double Click
+#define BUTTON_QUEUE_SIZE 8         // Must be a power of 2
+
+enum ButtonEvent {
+  BUTTON_NONE,
+  BUTTON_CLICK,
+  BUTTON_LONG_PRESS,
+  BUTTON_DOUBLE_CLICK
+};
+
+//Debounced edges written by the Interrupt and read by updateButton()
+struct ButtonEdge {
+  unsigned long time;
+  bool pressed;
+};
+
+int buttonPin;
+void (*buttonWakeCallback)() = NULL;  // Called from the timer interrupt on every accepted edge
+
+volatile ButtonEdge buttonEdges[BUTTON_QUEUE_SIZE];
+volatile unsigned int buttonEdgeHead = 0;
+volatile unsigned int buttonEdgeTail = 0;
+volatile bool buttonStableState = false;  // true while the button is held down
+volatile unsigned long buttonLastEdgeTime = 0;  // Raw edge, the accepted level starts here
+mbed::Timeout buttonSettleTimer;
+
+//Events produced by updateButton() and consumed by getButtonEvent()
+ButtonEvent buttonEvents[BUTTON_QUEUE_SIZE];
+unsigned int buttonEventHead = 0;
+unsigned int buttonEventTail = 0;
+
+//State Machine Variables
+unsigned long buttonPressTime = 0;
+unsigned long buttonReleaseTime = 0;
+bool buttonHeld = false;  // Pressed state as seen by the state machine
+bool buttonLongPressSent = false;
+bool buttonClickPending = false;
+
+
+// Timer interrupt: the level held for BUTTON_DEBOUNCE_MS, queue it if it differs from the accepted one
+void settleButton() {
+  bool pressed = (digitalRead(buttonPin) == LOW);  // Button is wired with INPUT_PULLUP
+
+  if (pressed == buttonStableState) {
+    return;
+  }
+
+  buttonStableState = pressed;
+
+  //Drop the edge if the queue is full, the state machine will resync on the next one
+  unsigned int next = (buttonEdgeHead + 1) & (BUTTON_QUEUE_SIZE - 1);
+  if (next == buttonEdgeTail) {
+    return;
+  }
+
+  buttonEdges[buttonEdgeHead].time = buttonLastEdgeTime;
+  buttonEdges[buttonEdgeHead].pressed = pressed;
+  buttonEdgeHead = next;
+
+  if (buttonWakeCallback != NULL) {
+    buttonWakeCallback();
+  }
+}
+
+// Interrupt: every raw edge, bounce included, restarts the settle timer
+void handleButtonISR() {
+  buttonLastEdgeTime = millis();
+  buttonSettleTimer.attach(settleButton, std::chrono::milliseconds(BUTTON_DEBOUNCE_MS));
+}
+
+//Set the Button pin and attach the Interrupt
+//  - wakeCallback lets the interrupt wake whoever runs updateButton() (Optional)
+void initButton(int pin, void (*wakeCallback)() = NULL) {
+  buttonPin = pin;
+  buttonWakeCallback = wakeCallback;
+  pinMode(buttonPin, INPUT_PULLUP);
+
+  buttonStableState = (digitalRead(buttonPin) == LOW);
+  attachInterrupt(digitalPinToInterrupt(buttonPin), handleButtonISR, CHANGE);
+}
+
+void pushButtonEvent(ButtonEvent event) {
+  unsigned int next = (buttonEventHead + 1) & (BUTTON_QUEUE_SIZE - 1);
+  if (next == buttonEventTail) {
+    return;  // UI has not caught up, drop the newest event
+  }
+
+  buttonEvents[buttonEventHead] = event;
+  buttonEventHead = next;
+}
+
+// Runs the Click / Long Press / Double Click State Machine
+//  - Consumes the debounced edges from the interrupt
+//  - Uses the current time to fire Long Presses and to close the Double Click window
+void updateButton() {
+  unsigned long now = millis();
+
+  while (buttonEdgeTail != buttonEdgeHead) {
+    ButtonEdge edge;
+    edge.time = buttonEdges[buttonEdgeTail].time;
+    edge.pressed = buttonEdges[buttonEdgeTail].pressed;
+    buttonEdgeTail = (buttonEdgeTail + 1) & (BUTTON_QUEUE_SIZE - 1);
+    buttonHeld = edge.pressed;
+
+    if (edge.pressed) {
+      buttonPressTime = edge.time;
+      buttonLongPressSent = false;
+      continue;
+    }
+
+    //Released after a Long Press, the event was already sent while held
+    if (buttonLongPressSent || edge.time - buttonPressTime >= BUTTON_LONG_PRESS_MS) {
+      if (!buttonLongPressSent) {
+        pushButtonEvent(BUTTON_LONG_PRESS);
+      }
+      buttonLongPressSent = false;
+      buttonClickPending = false;
+      continue;
+    }
+
+    //Second short press inside the window
+    if (buttonClickPending && edge.time - buttonReleaseTime <= BUTTON_DOUBLE_CLICK_MS) {
+      buttonClickPending = false;
+      pushButtonEvent(BUTTON_DOUBLE_CLICK);
+      continue;
+    }
+
+    buttonClickPending = true;
+    buttonReleaseTime = edge.time;
+  }
+
+  //Fire the Long Press while the button is still held
+  if (buttonHeld && !buttonLongPressSent && now - buttonPressTime >= BUTTON_LONG_PRESS_MS) {
+    buttonLongPressSent = true;
+    buttonClickPending = false;
+    pushButtonEvent(BUTTON_LONG_PRESS);
+  }
+
+  //No second press arrived, report the single Click
+  if (buttonClickPending && !buttonHeld && now - buttonReleaseTime > BUTTON_DOUBLE_CLICK_MS) {
+    buttonClickPending = false;
+    pushButtonEvent(BUTTON_CLICK);
+  }
+}
+
+// Returns the next queued event, or BUTTON_NONE when the queue is empty
+ButtonEvent getButtonEvent() {
+  if (buttonEventTail == buttonEventHead) {
+    return BUTTON_NONE;
+  }
+
+  ButtonEvent event = buttonEvents[buttonEventTail];
+  buttonEventTail = (buttonEventTail + 1) & (BUTTON_QUEUE_SIZE - 1);
+  return event;
+}
@@ -0,0 +1,157 @@
+/*****************************************
+*   Heap and Stack Diagnostics
+      - Heap: in use, free, largest free block and the blocks allocated
+        (mbed alloc_cnt, read before the free block probe so its tries never
+        count)
+      - Stack: the unused part of the loop() thread stack is painted at boot,
+        the high water mark is the deepest word no longer holding the paint
+      - Other RTOS threads (WiFi driver, timers) report their free stack when
+        the RTOS keeps a watermark
+      - Sent with the ping (Heartbeat), printed with the task statistics and
+        shown on the hidden diagnostics pages (Long Press on a page without
+        an edit page)
+*****************************************/
+
+#include <malloc.h>
+
+#if defined(ARDUINO_GIGA)
+#include <rtx_os.h>
+#endif
+
+#define STACK_PAINT 0xA5A5A5A5
+#define STACK_PAINT_MARGIN 64      // Words left alone under the stack pointer when painting
+#define HEAP_PROBE_LIMIT (512 * 1024)  // Largest block the free block probe tries
+
+struct HeapStats {
+  size_t used;          // Bytes allocated
+  size_t free;          // Free bytes inside the heap the C library has claimed
+  size_t freeChunks;    // Number of free chunks, grows with fragmentation
+  size_t largestFree;   // Largest block malloc() can return right now
+  long allocCount;      // Blocks allocated now (Grows with a leak), -1 when the core does not count them
+};
+
+HeapStats heapStats;
+
+//Painted part of the loop() thread stack
+uint32_t* stackBottom = NULL;
+size_t stackSize = 0;
+size_t stackHighWater = 0;  // Deepest use seen, bytes
+
+//Shown on the diagnostics pages (LcdValue rows take floats)
+float diagnosticHeapUsedKB;
+float diagnosticHeapFreeKB;
+float diagnosticLargestFreeKB;
+float diagnosticAllocCount;
+float diagnosticStackUsedKB;
+float diagnosticStackSizeKB;
+
+
+// Paint the unused part of the current thread's stack, call once early in setup()
+void paintStack() {
+#if defined(ARDUINO_GIGA)
+  osRtxThread_t* thread = (osRtxThread_t*)osThreadGetId();
+  stackBottom = (uint32_t*)thread->stack_mem;
+  stackSize = thread->stack_size;
+
+  //Word 0 is the RTOS overflow check word, leave it
+  uint32_t* limit = (uint32_t*)__get_PSP() - STACK_PAINT_MARGIN;
+  for (uint32_t* word = stackBottom + 1; word < limit; word++) {
+    *word = STACK_PAINT;
+  }
+#endif
+}
+
+// Deepest stack use of the loop() thread since boot, in bytes
+size_t measureStackHighWater() {
+  if (stackBottom == NULL) {
+    return 0;
+  }
+
+  uint32_t* word = stackBottom + 1;
+  uint32_t* top = stackBottom + stackSize / sizeof(uint32_t);
+  while (word < top && *word == STACK_PAINT) {
+    word++;
+  }
+  return (top - word) * sizeof(uint32_t);
+}
+
+// Largest block malloc() can return, found by trying sizes (Each try is freed at once)
+size_t probeLargestFreeBlock() {
+  size_t low = 0;
+  size_t high = HEAP_PROBE_LIMIT;
+
+  while (high - low > 64) {
+    size_t size = low + (high - low) / 2;
+    void* block = malloc(size);
+    if (block != NULL) {
+      free(block);
+      low = size;
+    } else {
+      high = size;
+    }
+  }
+  return low;
+}
+
+void readHeapStats(HeapStats& stats) {
+  struct mallinfo info = mallinfo();
+
+  stats.used = info.uordblks;
+  stats.free = info.fordblks;
+  stats.freeChunks = info.ordblks;
+
+#if defined(MBED_HEAP_STATS_ENABLED) && MBED_HEAP_STATS_ENABLED
+  mbed_stats_heap_t mbedStats;
+  mbed_stats_heap_get(&mbedStats);
+  stats.allocCount = mbedStats.alloc_cnt;
+#else
+  stats.allocCount = -1;
+#endif
+
+  //Last, its malloc() / free() pairs go through the counters above
+  stats.largestFree = probeLargestFreeBlock();
+}
+
+// Refresh the heap and stack figures, and the values on the diagnostics pages
+void updateDiagnostics() {
+  readHeapStats(heapStats);
+  stackHighWater = measureStackHighWater();
+
+  diagnosticHeapUsedKB = heapStats.used / 1024.0;
+  diagnosticHeapFreeKB = heapStats.free / 1024.0;
+  diagnosticLargestFreeKB = heapStats.largestFree / 1024.0;
+  diagnosticAllocCount = heapStats.allocCount;
+  diagnosticStackUsedKB = stackHighWater / 1024.0;
+  diagnosticStackSizeKB = stackSize / 1024.0;
+}
+
+// Heartbeat query parameters, appended to the ping request
+int diagnosticsQuery(char* buffer, size_t size) {
+  return snprintf(buffer, size, "&uptime=%lu&heapUsed=%u&heapFree=%u&heapLargest=%u&heapChunks=%u&allocs=%ld&stackUsed=%u&stackSize=%u",
+                  millis() / 1000, (unsigned int)heapStats.used, (unsigned int)heapStats.free,
+                  (unsigned int)heapStats.largestFree, (unsigned int)heapStats.freeChunks, heapStats.allocCount,
+                  (unsigned int)stackHighWater, (unsigned int)stackSize);
+}
+
+void printHeapStats() {
+  char line[128];
+
+  snprintf(line, sizeof(line), "Heap: %u used, %u free in %u chunks, largest free block %u, allocations %ld",
+           (unsigned int)heapStats.used, (unsigned int)heapStats.free, (unsigned int)heapStats.freeChunks,
+           (unsigned int)heapStats.largestFree, heapStats.allocCount);
+  Serial.println(line);
+
+  snprintf(line, sizeof(line), "Stack (loop): %u of %u bytes used at most", (unsigned int)stackHighWater, (unsigned int)stackSize);
+  Serial.println(line);
+
+  //Threads of the core and the WiFi driver, free space is 0 when the RTOS keeps no watermark
+  osThreadId_t threads[16];
+  uint32_t count = osThreadEnumerate(threads, 16);
+  for (uint32_t i = 0; i < count; i++) {
+    const char* name = osThreadGetName(threads[i]);
+    snprintf(line, sizeof(line), "Stack (%s): %lu bytes, %lu never used",
+             name != NULL ? name : "?",
+             (unsigned long)osThreadGetStackSize(threads[i]), (unsigned long)osThreadGetStackSpace(threads[i]));
+    Serial.println(line);
+  }
+}
@@ -0,0 +1,242 @@
+/*****************************************
+*   Event Trace (Post-mortem)
+      - Fixed ring of 8 byte timestamped events: task start / stop, HTTP
+        state changes, relay toggles, sensor faults, WiFi status changes,
+        alarms and anomalies
+      - On the GIGA the ring lives in the 4 KB backup SRAM, which the startup
+        code never clears, so it survives a warm reset (Reset button,
+        watchdog, fault). Other boards keep it in a .noinit section
+      - At boot the previous ring is copied out before the new one starts,
+        dumped to the Serial Monitor as "EVENTS <hex>" lines and added to the
+        next upload as "PostMortem"
+      - tools/event_trace_to_chrome.py turns a dump into Chrome trace JSON
+        (chrome://tracing or ui.perfetto.dev)
+      - Written by the Tasks only (Not interrupts), no locks
+*****************************************/
+
+#define EVENT_TRACE_MAGIC 0x47475452  // "GGTR"
+#define EVENT_TRACE_CAPACITY 510      // Events in the ring, the header and ring fill the 4 KB backup SRAM
+#define EVENT_TRACE_PER_LINE 16       // Events per "EVENTS" line of the dump
+
+//Event kinds, the tool reads this table, add new kinds at the end
+#define EVENT_KINDS(X) \
+  X(EVENT_BOOT) /* value: reset flags >> 16 (RCC RSR) */ \
+  X(EVENT_TASK_START) /* id: task id, value: earlier runs folded into this one */ \
+  X(EVENT_TASK_STOP) /* id: task id */ \
+  X(EVENT_HTTP) /* id: HttpEventState, value: status code (Response) or body bytes (Post) */ \
+  X(EVENT_RELAY) /* id: pin, value: 1 on, 0 off */ \
+  X(EVENT_SENSOR_FAULT) /* id: SensorFaultId */ \
+  X(EVENT_WIFI) /* value: WiFi.status() */ \
+  X(EVENT_ALARM) /* id: AlarmType, value: subject */ \
+  X(EVENT_ANOMALY) /* id: AnomalyChannelId, value: AnomalyFlags when it starts, 0 when it clears */
+
+#define EVENT_KIND_ID(kind) kind,
+enum EventKind : uint8_t {
+  EVENT_KINDS(EVENT_KIND_ID)
+  EVENT_KINDS_COUNT
+};
+
+enum HttpEventState : uint8_t {
+  HTTP_GET_START,
+  HTTP_POST_START,
+  HTTP_RESPONSE,
+  HTTP_CONNECT_FAILED,
+  HTTP_TIMEOUT,
+  HTTP_FAILED,
+};
+
+//FAULT_DHT is the DHT of Zone 1, the DHT of zone n (2 and up) is FAULT_ZONE_DHT + n - 2
+enum SensorFaultId : uint8_t {
+  FAULT_DHT,
+  FAULT_WATER_TEMP,
+  FAULT_NTC,
+  FAULT_PH,
+  FAULT_ZONE_DHT,
+};
+
+struct TraceEvent {
+  uint32_t time;  // micros()
+  uint8_t kind;
+  uint8_t id;
+  uint16_t value;
+};
+
+struct EventTraceArea {
+  uint32_t magic;
+  uint32_t head;  // Events written this boot, the ring holds the last EVENT_TRACE_CAPACITY
+  uint32_t bootCount;
+  uint32_t resetFlags;
+  TraceEvent events[EVENT_TRACE_CAPACITY];
+};
+
+#if defined(ARDUINO_GIGA)
+#define BACKUP_SRAM_BASE 0x38800000
+EventTraceArea* const eventTrace = (EventTraceArea*)BACKUP_SRAM_BASE;
+#else
+EventTraceArea eventTraceBacking __attribute__((section(".noinit")));
+EventTraceArea* const eventTrace = &eventTraceBacking;
+#endif
+
+//Ring of the previous boot, copied out at boot (NULL when there was none)
+TraceEvent* postMortemEvents = NULL;
+uint32_t postMortemCount = 0;
+uint32_t postMortemBoot = 0;
+uint32_t postMortemResetFlags = 0;
+char* postMortemHex = NULL;  // Events as one hex string for the upload
+
+//Set at boot when there is a post-mortem, cleared once an upload carried it
+bool postMortemDue = false;
+
+
+// Write the cache lines holding [address, address + size) to the RAM, so a reset does not lose them
+inline void eventTraceClean(void* address, int32_t size) {
+#if defined(ARDUINO_GIGA)
+  SCB_CleanDCache_by_Addr((uint32_t*)((uintptr_t)address & ~31U), size + ((uintptr_t)address & 31U));
+#else
+  (void)address;  // No data cache to clean
+  (void)size;
+#endif
+}
+
+void recordEvent(EventKind kind, uint8_t id = 0, uint16_t value = 0) {
+  uint32_t head = eventTrace->head;
+  TraceEvent& event = eventTrace->events[head % EVENT_TRACE_CAPACITY];
+  event.time = micros();
+  event.kind = kind;
+  event.id = id;
+  event.value = value;
+  eventTrace->head = head + 1;  // Publish the event once it is complete
+
+  eventTraceClean(&event, sizeof(event));
+  eventTraceClean(&eventTrace->head, sizeof(eventTrace->head));
+}
+
+// Task start / stop, called by runTask() in scheduler.h
+//  - A run that follows a run of the same task with nothing in between replaces
+//    it, the start event counts the runs it replaced
+void recordTaskEvent(int id, bool start) {
+  if (!start) {
+    recordEvent(EVENT_TASK_STOP, id);
+    return;
+  }
+
+  uint32_t head = eventTrace->head;
+  uint16_t folded = 0;
+  if (head >= 2) {
+    const TraceEvent& lastStart = eventTrace->events[(head - 2) % EVENT_TRACE_CAPACITY];
+    const TraceEvent& lastStop = eventTrace->events[(head - 1) % EVENT_TRACE_CAPACITY];
+    if (lastStart.kind == EVENT_TASK_START && lastStart.id == id && lastStop.kind == EVENT_TASK_STOP && lastStop.id == id) {
+      folded = lastStart.value < 0xFFFF ? lastStart.value + 1 : 0xFFFF;
+      eventTrace->head = head - 2;
+    }
+  }
+  recordEvent(EVENT_TASK_START, id, folded);
+}
+
+// Record a WiFi status, only when it differs from the last one recorded
+void recordWifiStatus(int status) {
+  static int lastStatus = -1;
+  if (status != lastStatus) {
+    lastStatus = status;
+    recordEvent(EVENT_WIFI, 0, status);
+  }
+}
+
+// Copy out the previous boot's ring (if the header is valid) and start a new one
+//  - Call early in setup(), after initMemoryRegions() and before anything records
+void initEventTrace() {
+  uint32_t resetFlags = 0;
+
+#if defined(ARDUINO_GIGA)
+  //Backup SRAM clock and write access to the backup domain
+  RCC->AHB4ENR |= RCC_AHB4ENR_BKPRAMEN;
+  PWR->CR1 |= PWR_CR1_DBP;
+  __DSB();
+
+  resetFlags = RCC->RSR;
+  RCC->RSR |= RCC_RSR_RMVF;  // Clear the flags so the next boot sees only its own cause
+#endif
+
+  //After a power up the RAM holds noise, only a valid header means there is a previous ring
+  bool valid = eventTrace->magic == EVENT_TRACE_MAGIC;
+  uint32_t bootCount = valid ? eventTrace->bootCount + 1 : 1;
+
+  if (valid && eventTrace->head > 0) {
+    postMortemCount = min(eventTrace->head, (uint32_t)EVENT_TRACE_CAPACITY);
+    postMortemEvents = (TraceEvent*)coldAlloc(postMortemCount * sizeof(TraceEvent));
+    postMortemHex = (char*)coldAlloc(postMortemCount * 2 * sizeof(TraceEvent) + 1);
+
+    if (postMortemEvents != NULL && postMortemHex != NULL) {
+      //Oldest first
+      uint32_t first = eventTrace->head - postMortemCount;
+      for (uint32_t i = 0; i < postMortemCount; i++) {
+        postMortemEvents[i] = eventTrace->events[(first + i) % EVENT_TRACE_CAPACITY];
+      }
+      postMortemBoot = eventTrace->bootCount;
+      postMortemResetFlags = resetFlags;
+      postMortemDue = true;
+    } else {
+      postMortemCount = 0;
+    }
+  }
+
+  eventTrace->magic = EVENT_TRACE_MAGIC;
+  eventTrace->head = 0;
+  eventTrace->bootCount = bootCount;
+  eventTrace->resetFlags = resetFlags;
+  eventTraceClean(eventTrace, sizeof(EventTraceArea));
+
+  recordEvent(EVENT_BOOT, 0, resetFlags >> 16);
+}
+
+// Event as 16 hex digits: time, kind, id, value
+void formatEventHex(const TraceEvent& event, char* hex) {
+  snprintf(hex, 17, "%08lX%02X%02X%04X", (unsigned long)event.time, event.kind, event.id, event.value);
+}
+
+// Dump the previous boot's events, with the task names so the tool can label them
+void dumpPostMortem(Print& out) {
+  if (postMortemCount == 0) {
+    return;
+  }
+
+  out.print("EVENTS BOOT ");
+  out.print(postMortemBoot);
+  out.print(" RESET ");
+  out.println(postMortemResetFlags, HEX);
+
+  out.print("EVENTS TASKS ");
+  for (int i = 0; i < taskCount; i++) {
+    out.print(i > 0 ? "," : "");
+    out.print(tasks[i].name);
+  }
+  out.println();
+
+  for (uint32_t i = 0; i < postMortemCount; i += EVENT_TRACE_PER_LINE) {
+    out.print("EVENTS ");
+    for (uint32_t j = i; j < postMortemCount && j < i + EVENT_TRACE_PER_LINE; j++) {
+      char hex[17];
+      formatEventHex(postMortemEvents[j], hex);
+      out.print(hex);
+    }
+    out.println();
+  }
+  out.println("EVENTS END");
+}
+
+// Add the previous boot's events to an upload as { boot, reset, tasks: [...], events: "<hex>" }
+void addPostMortemToJSON(JsonObject postMortem) {
+  for (uint32_t i = 0; i < postMortemCount; i++) {
+    formatEventHex(postMortemEvents[i], postMortemHex + 16 * i);
+  }
+  postMortemHex[16 * postMortemCount] = '\0';
+
+  postMortem["boot"] = postMortemBoot;
+  postMortem["reset"] = postMortemResetFlags;
+
+  JsonArray taskNames = postMortem.createNestedArray("tasks");
+  for (int i = 0; i < taskCount; i++) {
+    taskNames.add(tasks[i].name);
+  }
+  postMortem["events"] = (const char*)postMortemHex;  // Stored by pointer, the buffer outlives the document
+}
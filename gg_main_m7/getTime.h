@@ -9,6 +9,9 @@
 WiFiUDP ntpUDP;
 NTPClient timeClient(ntpUDP, "pool.ntp.org");
 
+//Set once the NTP Client has received the time at least once
+bool timeSynced = false;
+
 //Converts the unix Timestamp into a readable format.
 String convertTimeStamp(unsigned long timestamp) {
   // Convert timestamp to time_t
@@ -22,23 +25,28 @@ String convertTimeStamp(unsigned long timestamp) {
   char dateTimeString[20];
 
   // Format the date and time
-  sprintf(dateTimeString, "%04d-%02d-%02d %02d:%02d:%02d",
-          timeinfo->tm_year + 1900, timeinfo->tm_mon + 1, timeinfo->tm_mday,
-          timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
+  strftime(dateTimeString, sizeof(dateTimeString), "%Y-%m-%d %H:%M:%S", timeinfo);
 
   // Convert the char array to a String and return it
   return String(dateTimeString);
 }
 
+// Keeps the NTP Client in sync, called periodically by the scheduler
+//  - The client only goes to the network once its update interval has passed
+void syncTime() {
+  if (timeClient.update()) {
+    timeSynced = true;
+  }
+}
+
 // Returns the current time as a Unix Timestamp For the Influx Database
+//  - Returns 0 until the first NTP sync (No network access here, so sensor reads never hang)
 unsigned long getCurrentTime() {
 
+  if (!timeSynced) {
+    return 0;
+  }
 
-//Added to test if it stops hang on no internet connection
-if (!timeClient.update ()){
-  return 0;
-}
-  timeClient.update();
   unsigned long timestamp = timeClient.getEpochTime();
 
   // String convertedTimeString = convertTimeStamp(timestamp);
@@ -30,10 +30,35 @@ LiquidCrystal_I2C lcd(0x27, 20, 4);  // I2C address 0x27
 
 //import Directory Files
 #include "custom_char.h"
+#include "trend_functions.h"
 #include "lcd_functions.h"
+#include "sensor_math.h"
 #include "relay_control.h"
 #include "buzzer_functions.h"
+#include "button_functions.h"
+#include "power_management.h"
+#include "scheduler.h"
 #include "getTime.h"
+#include "zones.h"
+#include "runtime_config.h"
+#include "memory_regions.h"
+#include "event_trace.h"
+#include "rollup_store.h"
+#include "sample_columns.h"
+#include "sensor_trace.h"
+#include "binary_log.h"
+#include "upload_arena.h"
+#include "diagnostics.h"
+#include "response_parser.h"
+#include "deflate.h"
+#include "network_metrics.h"
+#include "upload_policy.h"
+#include "alarm_queue.h"
+#include "anomaly_detector.h"
+#include "profiler.h"
+#include "sensing.h"
+#include "upload_body.h"
+#include "benchmark.h"
 // #include "tdsFunctions.h"
 
 /*****************************************
@@ -52,6 +77,7 @@ const char* serverRoute = "/sensors/sendData";
 const char* serverRouteGet = "/sensors/retrieve";
 const char* serverTest = "/sensors/testconnection";
 const char* ping = "/sensors/ping";
+const char* serverAlarmRoute = "/sensors/alarm";
 
 HttpClient client(wifi, serverAddress, serverPort);
 
@@ -61,12 +87,20 @@ HttpClient client(wifi, serverAddress, serverPort);
 *   Define sensor pins for Digital and Analog Here
 *****************************************/
 
-// Defined DHT pins
+// Defined DHT pins, one per zone (Zone 1 first, only the first GG_ZONES are read)
 #define DHTPIN1 2
 #define DHTPIN2 1
 #define DHTTYPE DHT11
-DHT dht1(DHTPIN1, DHTTYPE);
-DHT dht2(DHTPIN2, DHTTYPE);
+DHT zoneDht[ZONE_MAX] = {
+  { DHTPIN1, DHTTYPE },
+  { DHTPIN2, DHTTYPE },
+  { 22, DHTTYPE },  // Zones 3 to 8, change to the actual pins
+  { 24, DHTTYPE },
+  { 26, DHTTYPE },
+  { 28, DHTTYPE },
+  { 30, DHTTYPE },
+  { 32, DHTTYPE },
+};
 
 #define TdsSensorPin A5
 #define VREF 5.0   // analog reference voltage(Volt) of the ADC
@@ -78,15 +112,12 @@ MicroDS18B20<3> sensor;
 //Defined Buzzer Pins
 #define BUZZER_PIN 9
 
-// Defined Relay pins
+// Defined Relay pins, one heater relay per zone (Zone 1 first)
 #define HEATER_RELAY_PIN 7
+const uint8_t zoneRelayPins[ZONE_MAX] = { HEATER_RELAY_PIN, 8, 23, 25, 27, 29, 31, 33 };  // Zones 2 to 8, change to the actual pins
 
-// Defined Ambient Temp Sensor
+// Defined Ambient Temp Sensor (Thermistor constants in sensor_math.h)
 byte NTCPin = A0;
-#define SERIESRESISTOR 10000
-#define NOMINAL_RESISTANCE 10000
-#define NOMINAL_TEMPERATURE 25
-#define BCOEFFICIENT 3950
 
 // Define Rotary Encoder pins
 #define ROTARY_PIN_A 52   // Change to the actual pin
@@ -94,7 +125,7 @@ byte NTCPin = A0;
 #define ROTARY_BUTTON 51  // Change to the actual pin
 
 // Define the initial target temperature
-#define INITIAL_TEMP 20
+#define INITIAL_TEMP DEFAULT_TARGET_TEMPERATURE
 
 /*****************************************
 *   GLOBAL VARIABLES
@@ -102,91 +133,231 @@ byte NTCPin = A0;
 //ID Variables
 String device_id;
 
-//Temperature Variables
-float temperature1;
-float humidity1;
-float ambientTemp;
-float waterTemp;
-
-// Defined Relay Temp threshold
-float targetTemperature = INITIAL_TEMP;
-
-// Define the current page variable and the number of pages
+// Define the current page variable, true while the edit page of the current page is shown
 int currentPage = 0;
-int lastPage = 0;
-int numPages = 5;  // DHT Temp, Relay, Ambient Temp, Water Flow, Water Temp
 volatile bool pageChangeDisabled = false;
 
-// Define the variable to store the switch state
-bool switchState = false;
-bool lastSwitchState = LOW;
+//Latest anomaly, shown on the Alert page (alertChannel -1 until the first)
+int alertChannel = -1;
+float alertValue;
+float alertRate;
+
+/*****************************************
+*   LCD Page Table
+      - Pages shown in rotation by the encoder, in order
+      - Add a row here to add a page, numPages follows the table
+*****************************************/
+const char* heaterTitle(int zone);
+const char* alertTitle(int zone);
+
+// Grow Area and Heater pages of one zone, the values are the zone's slots in the zone arrays
+#define ZONE_PAGES(zone, number) \
+  { "Grow Area Temp. #" number, NULL, { { "Temperature: ", zones.temperature, " C", 2 }, { "Humidity: ", zones.humidity, " %", 2 } }, -1, NULL, 0, 0, NULL, zone, true }, \
+  { NULL, heaterTitle, { { "Temp: ", zones.temperature, " C", 2 }, { "Target: ", zones.target, " C", 2 } }, 0, NULL, 0, 0, NULL, zone, true },
+
+constexpr LcdPage lcdPages[] = {
+  ZONE_PAGES(0, "1")
+#if GG_ZONES > 1
+  ZONE_PAGES(1, "2")
+#endif
+#if GG_ZONES > 2
+  ZONE_PAGES(2, "3")
+#endif
+#if GG_ZONES > 3
+  ZONE_PAGES(3, "4")
+#endif
+#if GG_ZONES > 4
+  ZONE_PAGES(4, "5")
+#endif
+#if GG_ZONES > 5
+  ZONE_PAGES(5, "6")
+#endif
+#if GG_ZONES > 6
+  ZONE_PAGES(6, "7")
+#endif
+#if GG_ZONES > 7
+  ZONE_PAGES(7, "8")
+#endif
+  { "Room Temperature", NULL, { { "Temperature: ", &ambientTemp, " C", 2 }, { NULL } }, -1 },
+  { "Water Flow Monitor", NULL, { { NULL }, { NULL } }, -1 },
+  { "Water Temp Monitor", NULL, { { "Temperature: ", &waterTemp, " C", 2 }, { NULL } }, -1 },
+  { "Grow Temp Trend", NULL, { { NULL }, { NULL } }, -1, NULL, 0, 0, &growTempTrend },
+  { "Humidity Trend", NULL, { { NULL }, { NULL } }, -1, NULL, 0, 0, &humidityTrend },
+  { "Water Temp Trend", NULL, { { NULL }, { NULL } }, -1, NULL, 0, 0, &waterTempTrend },
+  { NULL, alertTitle, { { "Value: ", &alertValue, "", 2 }, { "Rate: ", &alertRate, " /min", 2 } }, -1 },
+};
+constexpr int numPages = sizeof(lcdPages) / sizeof(lcdPages[0]);
+constexpr int alertPage = numPages - 1;  // Shown when an anomaly starts
+
+// Hidden diagnostics pages, a Long Press on a page without an edit page steps through them
+constexpr LcdPage lcdDiagnosticPages[] = {
+  { "Diagnostics: Heap", NULL, { { "Free KB: ", &diagnosticHeapFreeKB, "", 1 }, { "Largest KB: ", &diagnosticLargestFreeKB, "", 1 } }, -1 },
+  { "Diagnostics: Use", NULL, { { "Heap KB: ", &diagnosticHeapUsedKB, "", 1 }, { "Allocs: ", &diagnosticAllocCount, "", 0 } }, -1 },
+  { "Diagnostics: Stack", NULL, { { "Used KB: ", &diagnosticStackUsedKB, "", 1 }, { "Size KB: ", &diagnosticStackSizeKB, "", 1 } }, -1 },
+};
+constexpr int numDiagnosticPages = sizeof(lcdDiagnosticPages) / sizeof(lcdDiagnosticPages[0]);
+int diagnosticsPage = -1;  // -1 while no diagnostics page is shown
+
+// Edit pages, shown instead of a page when its editPage is selected with a Button Click
+//  - Zoned edit pages change the slot of the zone of the page they were selected from
+constexpr LcdPage lcdEditPages[] = {
+  { "Set Temperature", NULL, { { "Temperature: ", zones.target, " C", 2 }, { NULL } }, -1, zones.target, INITIAL_TEMP, 1, NULL, 0, true },
+};
 
 //Encoder prositions
 volatile int encoderPos = 0;
 volatile int lastEncoderPos = 0;
 
-//Track time for Sensor updates
-unsigned long previousMillis = 0;
-const long interval = 30000;  //1000 per second
-
-//Track time for sending Sensor data to server
-unsigned long sendDataPreviousMillis = 0;
-const long sendDataInterval = 30000;  //1000 per second
-
-//Track time for sending pings to the server (Used to track device status)
-unsigned long sendPingPreviousMillis = 0;
-const long sendPingInterval = 60000;
+//Intervals for Sensor updates, sending Sensor data and pings come from the runtime config (runtime_config.h)
+
+//Intervals for the remaining scheduler tasks
+const long controlInterval = 1000;
+const long uiInterval = 100;           // Input handling
+const long uiSleepInterval = 1000;     // Input handling while the backlight is off
+const long uiRefreshInterval = 500;    // LCD redraw when nothing changed
+const long tdsSampleInterval = 20;     // getTDSReading() keeps its own 40ms sample clock
+const long timeSyncInterval = 10000;   // NTPClient only goes to the network once its update interval has passed
+const long taskStatsInterval = 300000;
+const long logDrainInterval = 50;       // Binary log frames to Serial
+const long diagnosticsInterval = 10000;  // Heap and stack figures, the ping sends the latest
+const long traceDumpInterval = 10000;  // Only with GG_TRACE_RECORD
+const long metricsInterval = 250;      // Polls for a /metrics scrape
+const long alarmInterval = 1000;       // Sends the rate limited alarms once they are due, new alarms post an event
+
+//Scheduler task ids (Used to post events from interrupts and to apply the runtime config)
+int controlTaskId;
+int uiTaskId;
+int sensingTaskId = -1;  // -1 until setup() registers the task
+int uploadTaskId = -1;
+int pingTaskId = -1;
+int alarmTaskId = -1;
+
+//Set when the LCD must be redrawn before the next refresh
+volatile bool uiRedraw = true;
+unsigned long lastUiRedraw = 0;
+
+//Set by the encoder interrupt, counts as user activity for the backlight
+volatile bool encoderMoved = false;
+
+//Upload staging buffer, the serialized JSON body (SDRAM)
+#define UPLOAD_STAGING_SIZE 65536
+char* uploadStaging = NULL;
+
+//Upload State for the Rollups (upload_body.h)
+UploadBatch uploadBatch;
+size_t uploadBytes = 0;  // Body bytes of the last upload on the wire (Compressed when it was)
+
+//Compressed upload body (SDRAM) and the compressor's hash table (deflate.h)
+//  - The JSON deflates about 10x, a body that does not fit is sent as it is
+#define UPLOAD_DEFLATE_SIZE 16384
+uint8_t* uploadDeflated = NULL;
+DeflateState deflateState;
+bool uploadDeflate = false;    // The server listed deflate in "encodings"
+bool deflateRejected = false;  // The server answered a compressed body with 415, plain JSON until reboot
+
+//Link estimate the upload interval follows (upload_policy.h)
+LinkEstimate uploadLink;
+
+//Alarms waiting for their own POST (alarm_queue.h)
+#define ALARM_TEMPERATURE_MARGIN 5  // C from the target temperature that raises a temperature alarm
+AlarmQueue alarmQueue;
+
+//Streaming statistics per Sensor channel (anomaly_detector.h)
+#define ANOMALY_BEEP_FREQUENCY NOTE_A5
+#define ANOMALY_BEEP_MS 300
+AnomalyChannel anomalyChannels[ANOMALY_CHANNELS];
 
 //Debug Messages
 char heaterStatus;
 
-//Storage Variables for Sensor Data
-struct sensorData {
-  String name;
-  String sensorName;
-  unsigned long timestamp;
-  String sensorType;
-  String sensorLocation;
-  String dataType;
-  float data;
-};
-
 // pH Sensor Module + pH Electrode Probe BNC
 int analogPin = A1;  // Analog input pin for pH sensor
-float phValue;       // Variable to store pH value
 
 
 int analogBuffer[SCOUNT];  // store the analog value in the array, read from ADC
 int analogBufferTemp[SCOUNT];
 int analogBufferIndex = 0, copyIndex = 0;
-float averageVoltage = 0, tdsValue = 0, temperature = 25;
+float averageVoltage = 0, temperature = 25;
 
 
 /*****************************************
 *   SETUP FUNCTION
 *****************************************/
 void setup() {
-  Serial.begin(9600);
+  Serial.begin(115200);
 
-  //set/get ID's
-  device_id = "GG-001";
+  //Paint the stack first so the high water mark covers all of setup()
+  paintStack();
 
-  //Initialize Heater Pin and Relay Pin
-  pinMode(HEATER_RELAY_PIN, OUTPUT);    // Set pinMode for the Heater Relay Pin
-  digitalWrite(HEATER_RELAY_PIN, LOW);  // Initially, turn the relay off
+  //Load the runtime config, then set/get ID's
+  initRuntimeConfig();
+  device_id = runtimeConfig().deviceId;
+  initZones(zones, GG_ZONES, zoneRelayPins);
+  applyZoneConfig(runtimeConfig(), 0xFF);  // Every zone
+
+  //Initialize the Heater Relay Pin of every zone, initially off
+  for (int zone = 0; zone < zones.count; zone++) {
+    pinMode(zones.relayPin[zone], OUTPUT);
+    setRelay(zones.relayPin[zone], false);
+  }
 
   //initialize Buzzer Pin
   pinMode(BUZZER_PIN, OUTPUT);
 
-  //Initilaize DHT Sensors
-  dht1.begin();
-  dht2.begin();
+  //Start the cycle counter for the profiler and the benchmarks
+  initProfiler();
+
+  //Set up the Internal and SDRAM regions before anything allocates from them
+  initMemoryRegions();
+  printMemoryRegions();
+
+  //Keep the previous boot's event trace before anything records into the new one
+  initEventTrace();
+
+  uploadStaging = (char*)coldAlloc(UPLOAD_STAGING_SIZE);
+  uploadDeflated = (uint8_t*)coldAlloc(UPLOAD_DEFLATE_SIZE);
+
+  //Arena for the temporary objects of each upload cycle, hot so it stays in the Internal region
+  void* arenaBuffer = regionAlloc(REGION_INTERNAL, UPLOAD_ARENA_SIZE);
+  if (arenaBuffer == NULL) {
+    arenaBuffer = malloc(UPLOAD_ARENA_SIZE);
+  }
+  initArena(uploadArena, arenaBuffer, UPLOAD_ARENA_SIZE);
+
+  //Initialize the Rollup Store, one channel per sample column (upload_body.h)
+  initUploadChannels(zones.count);
+  initUploadBatch(uploadBatch);
+
+  //Anomaly statistics per channel, learned from the first samples
+  for (AnomalyChannel& channel : anomalyChannels) {
+    initAnomalyChannel(channel);
+  }
+
+#if defined(GG_TRACE_RECORD)
+  initTrace(true, false);
+#elif defined(GG_TRACE_REPLAY)
+  //Replay a recorded trace instead of running, nothing touches the hardware
+  initTrace(false, true);
+  if (loadTraceFromSerial() > 0) {
+    replayTrace();
+  }
+  Serial.println("REPLAY END");
+  while (true) {
+    idleFor(1000);
+  }
+#endif
+
+  //Initilaize the DHT Sensor of every zone
+  for (int zone = 0; zone < zones.count; zone++) {
+    zoneDht[zone].begin();
+  }
 
   //Initialize the TDS Pin
   pinMode(TdsSensorPin, INPUT);
 
   // Initialize the rotary encoder pins
   initEncoder();
+  initButton(ROTARY_BUTTON, wakeUiTask);
 
   //Start LCD Screen --> Show boot Screen
   useLCD();
@@ -198,9 +369,41 @@ void setup() {
   // Initialize NTP Client
   timeClient.begin();
 
+  //Serve /metrics on the local network
+  initMetricsServer();
+  initLinkEstimate(uploadLink);
+  initAlarmQueue(alarmQueue);
+
 
   //Test Connection with API
-  makeGetRequest(serverTest);
+  makeGetRequest(serverTest, "");
+
+#if defined(GG_BENCHMARK)
+  runBenchmarks();
+#endif
+
+  //Sleep between tasks from now on
+  initPowerManagement();
+
+  //Register the scheduler tasks
+  addTask("timesync", timeSyncTask, timeSyncInterval, 0);
+  sensingTaskId = addTask("sensing", sensingTask, runtimeConfig().sampleInterval, 0);
+  controlTaskId = addTask("control", controlTask, controlInterval, 0);
+  uiTaskId = addTask("ui", uiTask, uiInterval, 0);
+  setTaskTraced(addTask("tds", tdsTask, tdsSampleInterval, 0), false);
+  uploadTaskId = addTask("upload", uploadTask, runtimeConfig().sendDataInterval, runtimeConfig().sendDataInterval);
+  pingTaskId = addTask("ping", pingTask, runtimeConfig().pingInterval, runtimeConfig().pingInterval);
+  alarmTaskId = addTask("alarm", alarmTask, alarmInterval, alarmInterval);
+  addTask("stats", statsTask, taskStatsInterval, taskStatsInterval);
+  addTask("diag", diagnosticsTask, diagnosticsInterval, 0);
+  setTaskTraced(addTask("log", logTask, logDrainInterval, 0), false);
+  addTask("metrics", metricsTask, metricsInterval, 0);
+#if defined(GG_TRACE_RECORD)
+  addTask("trace", traceTask, traceDumpInterval, traceDumpInterval);
+#endif
+
+  //The task names are known now, dump the previous boot's events
+  dumpPostMortem(Serial);
 }
 
 
@@ -209,362 +412,369 @@ void setup() {
 *****************************************/
 
 void loop() {
+  runScheduler();
+}
 
-  //Timer for Sensor Readings
-  unsigned long currentMillis = millis();
-  if (currentMillis - previousMillis >= interval) {
-    previousMillis = currentMillis;
 
-    Serial.println("Reading Temerature");
+/*****************************************
+*   Scheduler Tasks
+*****************************************/
 
-    readDHT();
-    readAmbientTemp();
-    readWaterTemps();
-    readPH();
-    readTDS();
+//Read every Sensor and store the readings for the next upload
+void sensingTask() {
+  logEvent(LOG_SENSING);
 
-    setRelay1(HEATER_RELAY_PIN, temperature1, targetTemperature);
+  sampleTime = tracedInt(TRACE_CLOCK, []() -> int32_t { return getCurrentTime(); });
 
-    debugInfo();
+  readSensors();
 
+  debugInfo();
 
-    lcd.clear();
-  }
-
-  //Timer for sending sensor data to the server
-  unsigned long sendDataCurrentMillis = millis();
-  if (sendDataCurrentMillis - sendDataPreviousMillis >= sendDataInterval) {
-    sendDataPreviousMillis = sendDataCurrentMillis;
-    postSensorData(serverRoute);
-  }
+  postTaskEvent(controlTaskId);
+  uiRedraw = true;
+  lcd.clear();
+}
 
-  //Timer for Sending Pings to the server
-  unsigned long sendPingCurrentMillis = millis();
-  if (sendPingCurrentMillis - sendPingPreviousMillis >= sendPingInterval) {
-    sendPingPreviousMillis = sendPingCurrentMillis;
+//Update the Heater Relay of every zone from its latest reading
+void controlTask() {
+  ZoneDecisions decisions = controlZones(zones, ALARM_TEMPERATURE_MARGIN);
 
-    //Send the Ping To the Server
-    makeGetRequest(ping);
-  }
-
-  // Check if the button is pressed
-  switchState = digitalRead(ROTARY_BUTTON);  // Read the switch state
-  if (switchState == LOW && lastSwitchState == HIGH) {
+  for (int zone = 0; zone < zones.count; zone++) {
+    uint8_t bit = 1 << zone;
+    setRelay(zones.relayPin[zone], zones.heaterOn[zone]);
+    if (decisions.changed & bit) {
+      recordEvent(EVENT_RELAY, zones.relayPin[zone], zones.heaterOn[zone]);
+    }
 
-    // If the Button is pressed on set page, Toggle alternate Page (Used for settings, etc)
-    switch (currentPage) {
-      case 1:  // Heater Page
-        // Toggle the mode when the button is pressed
-        pageChangeDisabled = !pageChangeDisabled;  // Switch between true and false
-        break;
+    //The alarm subject is the zone, a failed DHT leaves the heater as it was and keeps its fault alarm raised
+    if (decisions.over & bit) {
+      queueAlarm(ALARM_OVER_TEMPERATURE, zone, zones.temperature[zone]);
+    } else if (decisions.under & bit) {
+      queueAlarm(ALARM_UNDER_TEMPERATURE, zone, zones.temperature[zone]);
+    } else if (decisions.failed & bit) {
+      queueAlarm(ALARM_SENSOR_FAULT, zoneDhtFault(zone), 0);
     }
+  }
+}
 
-    // Print a message to indicate the change
-    Serial.print("Button pressed, pageChangeDisabled is now ");
-    Serial.println(pageChangeDisabled ? "ON" : "OFF");
+//Handle user input and redraw the LCD
+void uiTask() {
 
-    setRelay1(HEATER_RELAY_PIN, temperature1, targetTemperature);
+  // Handle the Button events queued by the interrupt
+  updateButton();
+  ButtonEvent buttonEvent;
+  while ((buttonEvent = getButtonEvent()) != BUTTON_NONE) {
+    noteUserActivity();
+    handleButtonEvent(buttonEvent);
+  }
 
-    lcd.clear();
+  if (encoderMoved) {
+    encoderMoved = false;
+    noteUserActivity();
   }
 
-  // Remember the current switch state for the next loop iteration
-  lastSwitchState = switchState;
+  // Poll the input less often while nobody is looking at the display
+  updateBacklight();
+  setTaskInterval(uiTaskId, isDisplayAsleep() ? uiSleepInterval : uiInterval);
 
+  if (!uiRedraw && millis() - lastUiRedraw < uiRefreshInterval) {
+    return;
+  }
+  uiRedraw = false;
+  lastUiRedraw = millis();
 
   // Displays the LCD Pages
   if (pageChangeDisabled == false) {
-
     getEncoderPosition();
-
-    // Display the appropriate page data based on the current page
-    switch (currentPage) {
-      case 0:
-        displayDHTData(temperature1, humidity1, currentPage, lastPage);
-        lastPage = currentPage;
-        break;
-      case 1:
-        displayHeaterStatus(HEATER_RELAY_PIN, temperature1, targetTemperature, currentPage, lastPage);
-        lastPage = currentPage;
-        break;
-      case 2:
-        displayAmbientTemp(ambientTemp, currentPage, lastPage);
-        lastPage = currentPage;
-        break;
-      case 3:
-        displayWaterFlow(currentPage, lastPage);
-        lastPage = currentPage;
-        break;
-      case 4:
-        displayWaterTemp(waterTemp, currentPage, lastPage);
-        lastPage = currentPage;
-        break;
-    }
-  } else {
-
-    // Display the appropriate Button Press Page Data
-    switch (currentPage) {
-      case 0:
-        break;
-      case 1:
-        displayTempChange(targetTemperature, currentPage, lastPage);
-        break;
-      case 2:
-        break;
-      case 3:
-        break;
-      case 4:
-        break;
-    }
   }
+  ProfileScope profile(PROFILE_LCD);
+  renderPage(currentLcdPage(), currentLcdZone());
+}
 
-  delay(500);
-
+//Sample the TDS sensor into its median filter buffer
+void tdsTask() {
   getTDSReading();
 }
 
+//Send the stored sensor data to the server, the interval follows the link
+void uploadTask() {
+  recordWifiStatus(WiFi.status());
+  adaptiveUpload();
+}
 
-
-/*************************************************
-*       Debug and Com Message Functions Below
-************************************************/
-
-
-void debugInfo() {
-  Serial.print("Ambient Temperature: ");
-  Serial.println(ambientTemp);
-  Serial.print("DHT Temp Sensor 1: ");
-  Serial.println(temperature1);
-  Serial.print("DHT Humidity Sensor 1: ");
-  Serial.println(humidity1);
-  Serial.print("Water Temperature Sensor 1: ");
-  Serial.println(waterTemp);
-  Serial.print("pH: ");
-  Serial.println(phValue, 2);  // Print the pH value with two decimal places
-  Serial.print("TDS Value:");
-  Serial.print(tdsValue, 0);
-  Serial.println("ppm");
-
-
-  int relayStatus = digitalRead(HEATER_RELAY_PIN);
-
-  if (relayStatus == LOW) {
-    Serial.println("Heater is ON");
-  } else {
-    Serial.println("Heater is OFF");
+//Send the Ping To the Server, with the heap, stack and network figures as the heartbeat
+void pingTask() {
+  char heartbeat[1024];
+  int length = diagnosticsQuery(heartbeat, sizeof(heartbeat));
+  if (length > 0 && (size_t)length < sizeof(heartbeat)) {
+    netMetricsQuery(heartbeat + length, sizeof(heartbeat) - length);
   }
+  recordWifiStatus(WiFi.status());
+  makeGetRequest(ping, heartbeat);
 }
 
+//Keep the NTP clock in sync
+void timeSyncTask() {
+  ProfileScope profile(PROFILE_NTP);
+  syncTime();
+}
 
-/*************************************************
-*       Sensor Reading Functions Below
-************************************************/
-
-const int sensorArray_Size = 100;
-
-//Read the Temperature and Humidity
-sensorData tempData[sensorArray_Size];
-sensorData humidityData[sensorArray_Size];
-int currentIndexForDHT = 0;
+//Print the scheduler and power statistics
+void statsTask() {
+  printTaskStats();
+  printProfile();
+  printPowerStats();
+  printMemoryRegions();
+  printHeapStats();
+  printArenaStats();
+  printNetMetrics();
+  profileReportDue = true;
+}
 
-void readDHT() {
+//Send the binary log to the Serial Monitor
+void logTask() {
+  drainLog();
+}
 
-  if (isnan(dht1.readTemperature())) {
-    temperature1 = 0;
-    humidity1 = 0;
-    return;
-  }
+//Refresh the heap and stack figures
+void diagnosticsTask() {
+  updateDiagnostics();
+}
 
-  temperature1 = dht1.readTemperature();
-  humidity1 = dht1.readHumidity();
+//Send the alarms whose rate limit has passed
+void alarmTask() {
+  sendPendingAlarms();
+}
 
-  if (currentIndexForDHT < sensorArray_Size) {
+//Answer a scrape of /metrics
+void metricsTask() {
+  serveMetrics();
+}
 
-    //Sensor Information
-    tempData[currentIndexForDHT].name = "Temperature Sensor";
-    tempData[currentIndexForDHT].sensorName = "Sensor 1";
-    tempData[currentIndexForDHT].sensorType = "DHT";
-    tempData[currentIndexForDHT].sensorLocation = "Greenhouse 1";
-    tempData[currentIndexForDHT].dataType = "Temperature";
+#if defined(GG_TRACE_RECORD)
+//Stream the new trace records to the Serial Monitor
+void traceTask() {
+  dumpTrace(Serial);
+}
+#endif
+
+//Copy the locations of the zones from the config, and the target temperatures of the zones in targets (Bit per zone)
+//  - A target changed on the encoder stays until the server sends a target for its zone
+void applyZoneConfig(const RuntimeConfig& config, uint8_t targets) {
+  for (int zone = 0; zone < zones.count; zone++) {
+    if (targets & (1 << zone)) {
+      zones.target[zone] = config.zoneTargets[zone];
+    }
+    setZoneName(zones, zone, config.zoneLocations[zone]);
+  }
+}
 
-    //Sensor Data
-    tempData[currentIndexForDHT].data = temperature1;
-    tempData[currentIndexForDHT].timestamp = getCurrentTime();
+//Apply the live runtime config to the tasks, the zones and the device id
+void applyRuntimeConfig() {
+  const RuntimeConfig& config = runtimeConfig();
 
-    //Sensor Information
-    humidityData[currentIndexForDHT].name = "Humidity Sensor";
-    humidityData[currentIndexForDHT].sensorName = "Sensor 1";
-    humidityData[currentIndexForDHT].sensorType = "DHT";
-    humidityData[currentIndexForDHT].sensorLocation = "Greenhouse 1";
-    humidityData[currentIndexForDHT].dataType = "Humidity";
+  device_id = config.deviceId;
+  applyZoneConfig(config, pushedZoneTargets);
 
-    //Sensor Data
-    humidityData[currentIndexForDHT].data = humidity1;
-    humidityData[currentIndexForDHT].timestamp = getCurrentTime();
+  setTaskInterval(sensingTaskId, config.sampleInterval);
+  setTaskInterval(uploadTaskId, config.sendDataInterval);
+  setTaskInterval(pingTaskId, config.pingInterval);
 
+  postTaskEvent(controlTaskId);
+  uiRedraw = true;
+}
 
-    currentIndexForDHT++;
-  } else {
-    resetSensorArray();
+//Queue an alarm, the alarm task runs right away if it may be sent now
+void queueAlarm(AlarmType type, uint8_t subject, float value) {
+  if (raiseAlarm(alarmQueue, type, subject, value, millis(), getCurrentTime()) == ALARM_QUEUED) {
+    recordEvent(EVENT_ALARM, type, subject);
+  }
+  if (nextAlarmDue(alarmQueue, millis()) == 0) {
+    postTaskEvent(alarmTaskId);
   }
 }
 
-//Read the Device Temperature
-sensorData deviceTempData[sensorArray_Size];
-int currentIndexForTemp = 0;
+//Record a sensor fault and raise its alarm
+void sensorFault(SensorFaultId id) {
+  recordEvent(EVENT_SENSOR_FAULT, id);
+  queueAlarm(ALARM_SENSOR_FAULT, id, 0);
+}
 
-void readAmbientTemp() {
+//Add a reading to the channel's statistics, an anomaly that starts beeps, shows the Alert page and raises an alarm
+void checkAnomaly(AnomalyChannelId id, float value) {
+  AnomalyChannel& channel = anomalyChannels[id];
+  AnomalyChange change = addAnomalySample(channel, anomalyLimits[id], value, sampleTime);
+  if (change == ANOMALY_UNCHANGED) {
+    return;
+  }
 
-  if (!analogRead(NTCPin)) {
-    ambientTemp = 0;
+  bool started = change == ANOMALY_STARTED;
+  if (traceReplaying) {
+    printReplayAnomaly(Serial, sampleTime, anomalyChannelNames[id], started, value);
     return;
   }
 
-//Read the Analog Signal and convert it to Readable Temperate
-  float ADCvalue;
-  float Resistance;
-
-  ADCvalue = analogRead(NTCPin);
-  Resistance = (1023.0 / ADCvalue) - 1.0;
-  Resistance = SERIESRESISTOR / Resistance;
-  ambientTemp = Resistance / NOMINAL_RESISTANCE;        // (R/Ro)
-  ambientTemp = log(ambientTemp);                       // ln(R/Ro)
-  ambientTemp /= BCOEFFICIENT;                          // 1/B * ln(R/Ro)
-  ambientTemp += 1.0 / (NOMINAL_TEMPERATURE + 273.15);  // + (1/To)
-  ambientTemp = 1.0 / ambientTemp;                      // Invert
-  ambientTemp -= 273.15;                                // convert to C
-
-  if (currentIndexForTemp < sensorArray_Size) {
-
-    //Sensor information
-    deviceTempData[currentIndexForTemp].name = "Device Temperature";
-    deviceTempData[currentIndexForTemp].sensorName = "Sensor 1";
-    deviceTempData[currentIndexForTemp].sensorType = "Internal";
-    deviceTempData[currentIndexForTemp].sensorLocation = "Default";
-    deviceTempData[currentIndexForTemp].dataType = "Temperature";
-
-    //Sensor Data
-    deviceTempData[currentIndexForTemp].data = ambientTemp;
-    deviceTempData[currentIndexForTemp].timestamp = getCurrentTime();
-    currentIndexForTemp++;
-  } else {
-    resetSensorArray();
+  recordEvent(EVENT_ANOMALY, id, started ? channel.activeFlags : 0);
+  if (!started) {
+    logEvent(LOG_ANOMALY_CLEARED, id);
+    uiRedraw = true;
+    return;
+  }
+  logEvent(LOG_ANOMALY, id, value, channel.z, channel.rate);
+  queueAlarm(ALARM_ANOMALY, id, value);
+
+  //Local alert
+  tone(BUZZER_PIN, ANOMALY_BEEP_FREQUENCY, ANOMALY_BEEP_MS);
+  alertChannel = id;
+  alertValue = value;
+  alertRate = channel.rate;
+  if (!pageChangeDisabled) {
+    diagnosticsPage = -1;
+    currentPage = alertPage;
   }
+  noteUserActivity();
+  uiRedraw = true;
 }
 
-//Read the water Temperature
-sensorData waterTempData[sensorArray_Size];
-int currentIndexForWaterTemp = 0;
+//Run the UI task now (Called from the button interrupt)
+void wakeUiTask() {
+  postTaskEvent(uiTaskId);
+}
 
-void readWaterTemps() {
-  sensor.requestTemp();
 
-  if (!sensor.readTemp()) {
-    waterTemp = 0;
-    return;
+/*************************************************
+*       LCD Page Helpers
+************************************************/
+
+// The page to draw, the edit page while pageChangeDisabled is set, a diagnostics page while one is selected
+const LcdPage& currentLcdPage() {
+  if (diagnosticsPage >= 0) {
+    return lcdDiagnosticPages[diagnosticsPage];
   }
+  if (pageChangeDisabled && lcdPages[currentPage].editPage >= 0) {
+    return lcdEditPages[lcdPages[currentPage].editPage];
+  }
+  return lcdPages[currentPage];
+}
 
-  //Read the Sensor
-  float data = sensor.getTemp();
-  waterTemp = data;
+// The zone shown by the current page, an edit page changes the zone of the page it was opened from
+int currentLcdZone() {
+  return diagnosticsPage < 0 ? lcdPages[currentPage].zone : 0;
+}
 
-  if (currentIndexForWaterTemp < sensorArray_Size) {
-    //Sensor Information
-    waterTempData[currentIndexForWaterTemp].name = "Water Temperature";
-    waterTempData[currentIndexForWaterTemp].sensorName = "Sensor 1";
-    waterTempData[currentIndexForWaterTemp].sensorType = "ds18b20";
-    waterTempData[currentIndexForWaterTemp].sensorLocation = "Greenhouse 1";
-    waterTempData[currentIndexForWaterTemp].dataType = "Temperature";
+// Title of the Alert page, the channel of the latest anomaly while it lasts
+const char* alertTitle(int zone) {
+  static char title[19];
 
-    waterTempData[currentIndexForWaterTemp].data = waterTemp;
-    waterTempData[currentIndexForWaterTemp].timestamp = getCurrentTime();
-    currentIndexForWaterTemp++;
-  } else {
-    resetSensorArray();
+  if (alertChannel < 0) {
+    return "No Alerts";
   }
+  snprintf(title, sizeof(title), "%s: %s", anomalyChannels[alertChannel].active ? "Alert" : "Was", anomalyChannelNames[alertChannel]);
+  return title;
 }
 
-//Read the PH Sensor
-sensorData phData[sensorArray_Size];
-int currentIndexForPH = 0;
+// Title of the Heater page of a zone, follows the relay state
+const char* heaterTitle(int zone) {
+  static char title[19];
 
-void readPH() {
-
-  //Default to PH 0 If sensor is not connected - Values of 0 are excluded from JSON Document
-  if (!analogRead(analogPin)) {
-    phValue = 0;
-    return;
+  if (zones.count == 1) {
+    return zones.heaterOn[zone] ? "Heater is ON" : "Heater is OFF";
   }
+  snprintf(title, sizeof(title), "Heater #%d is %s", zone + 1, zones.heaterOn[zone] ? "ON" : "OFF");
+  return title;
+}
 
-  //Read The Sensor
-  phValue = analogRead(analogPin);         // Read the analog value from sensor
-  phValue = 3.5 * (phValue * 5.0 / 1024);  // Convert the analog value to pH value
 
-  //Temporry disable for PH Sensor Recordings
-  phValue = 0;
+/*************************************************
+*       Button Event Handling
+          - Click: Toggle the alternate Page (Used for settings, etc)
+          - Long Press: Reset the setting shown on the alternate Page, or step
+            through the hidden diagnostics Pages on a Page without one
+          - Double Click: Leave the alternate Page and return to the first Page
+************************************************/
 
-  if (currentIndexForPH < sensorArray_Size) {
-    //Sensor Information
-    phData[currentIndexForPH].name = "PH";
-    phData[currentIndexForPH].sensorName = "PH Sensor 1";
-    phData[currentIndexForPH].sensorType = "BNC PH Probe";
-    phData[currentIndexForPH].sensorLocation = "Greenhouse 1";
-    phData[currentIndexForPH].dataType = "PH";
+void handleButtonEvent(ButtonEvent event) {
 
-    phData[currentIndexForPH].data = phValue;
-    phData[currentIndexForPH].timestamp = getCurrentTime();
-    currentIndexForPH++;
-  } else {
-    resetSensorArray();
+  switch (event) {
+    case BUTTON_CLICK:
+      // Toggle the mode when the button is pressed on a page with an edit page
+      if (lcdPages[currentPage].editPage >= 0) {
+        pageChangeDisabled = !pageChangeDisabled;  // Switch between true and false
+      }
+      break;
+
+    case BUTTON_LONG_PRESS: {
+      const LcdPage& page = currentLcdPage();
+      if (pageChangeDisabled && page.setting != NULL) {
+        page.setting[page.zoned ? currentLcdZone() : 0] = page.settingDefault;
+      } else if (!pageChangeDisabled && lcdPages[currentPage].editPage < 0) {
+        // Step through the hidden diagnostics pages, then back to the page
+        diagnosticsPage = diagnosticsPage + 1 < numDiagnosticPages ? diagnosticsPage + 1 : -1;
+        updateDiagnostics();
+      }
+      break;
+    }
+
+    case BUTTON_DOUBLE_CLICK:
+      pageChangeDisabled = false;
+      diagnosticsPage = -1;
+      currentPage = 0;
+      break;
+
+    default:
+      return;
   }
+
+  // Print a message to indicate the change
+  Serial.print("Button event ");
+  Serial.print(event);
+  Serial.print(", pageChangeDisabled is now ");
+  Serial.println(pageChangeDisabled ? "ON" : "OFF");
+
+  postTaskEvent(controlTaskId);
+  uiRedraw = true;
+  lcd.clear();
 }
 
 
-//Read the TDS
-sensorData tdsData[sensorArray_Size];
-int currentIndexForTDS = 0;
+/*************************************************
+*       Debug and Com Message Functions Below
+************************************************/
+
 
-void readTDS() {
+void debugInfo() {
+  logEvent(LOG_READINGS, ambientTemp, zones.temperature[0], zones.humidity[0], waterTemp, phValue, tdsValue, zones.heaterOn[0]);
 
-  // If there is no reading Do nothing (If no sensor, or when initializing ignore data)
-  if (tdsValue == 0) { return; }
+  for (int zone = 1; zone < zones.count; zone++) {
+    logEvent(LOG_ZONE_READINGS, zone + 1, zones.temperature[zone], zones.humidity[zone], zones.target[zone], zones.heaterOn[zone]);
+  }
+}
 
-  if (currentIndexForTDS < sensorArray_Size) {
 
-    //Sensor Information
-    tdsData[currentIndexForTDS].name = "TDS";
-    tdsData[currentIndexForTDS].sensorName = "TDS Sensor 1";
-    tdsData[currentIndexForTDS].sensorType = "TDS";
-    tdsData[currentIndexForTDS].sensorLocation = "Greenhouse 1";
-    tdsData[currentIndexForTDS].dataType = "PPM";
+/*************************************************
+*       Sensor Reading Functions Below
+************************************************/
 
-    //Sensor Data
-    tdsData[currentIndexForTDS].data = tdsValue;
-    tdsData[currentIndexForTDS].timestamp = getCurrentTime();
-    currentIndexForTDS++;
+//Hardware reads of the sensing pass (sensing.h)
+float readZoneTemperature(int zone) {
+  return zoneDht[zone].readTemperature();
+}
 
-  } else {
-    resetSensorArray();
-  }
+float readZoneHumidity(int zone) {
+  return zoneDht[zone].readHumidity();
 }
 
-// Reset the Sensor Array values to 0
-void resetSensorArray() {
+int32_t readNtcAdc() {
+  return analogRead(NTCPin);
+}
 
-  currentIndexForDHT = 0;
-  currentIndexForTemp = 0;
-  currentIndexForWaterTemp = 0;
-  currentIndexForPH = 0;
-  currentIndexForTDS = 0;
+float readWaterTemperature() {
+  sensor.requestTemp();
+  return sensor.readTemp() ? sensor.getTemp() : NAN;
+}
 
-  for (int i = 0; i < sensorArray_Size; i++) {
-    tempData[i].data = 0;
-    humidityData[i].data = 0;
-    deviceTempData[i].data = 0;
-    waterTempData[i].data = 0;
-    phData[i].data = 0;
-    tdsData[i].data = 0;
-  }
+int32_t readPhAdc() {
+  return analogRead(analogPin);
 }
 
 
@@ -580,7 +790,6 @@ void initEncoder() {
   // Initialize the rotary encoder pins
   pinMode(ROTARY_PIN_A, INPUT_PULLUP);
   pinMode(ROTARY_PIN_B, INPUT_PULLUP);
-  pinMode(ROTARY_BUTTON, INPUT_PULLUP);
 
   //Attach Interrupt to the Left and Right Turning of the Encoder Nob
   attachInterrupt(digitalPinToInterrupt(ROTARY_PIN_A), handleEncoder, CHANGE);  //left
@@ -598,6 +807,7 @@ void getEncoderPosition() {
       currentPage = (currentPage - 1 + numPages) % numPages;
     }
     lastEncoderPos = encoderPos;
+    diagnosticsPage = -1;  // Turning the knob leaves the diagnostics pages
   }
 }
 
@@ -607,19 +817,22 @@ void handleEncoder() {
   static unsigned int lastEncoded = 0;
   static unsigned int newEncoded = 0;
 
-  int MSB = digitalRead(ROTARY_PIN_A);
-  int LSB = digitalRead(ROTARY_PIN_B);
+  int pins = tracedInt(TRACE_ENCODER, []() -> int32_t { return (digitalRead(ROTARY_PIN_A) << 1) | digitalRead(ROTARY_PIN_B); });
+  int MSB = pins >> 1;
+  int LSB = pins & 1;
 
-  // Handles changing the target temperature on the Heater Screen
-  if (pageChangeDisabled == true) {
+  // Handles changing the setting on the current Edit Page
+  const LcdPage& page = currentLcdPage();
+  if (pageChangeDisabled == true && page.setting != NULL) {
+    float& setting = page.setting[page.zoned ? currentLcdZone() : 0];
 
     newEncoded = (MSB << 1) | LSB;
     int sum = (lastEncoded << 2) | newEncoded;
 
     if (sum == 0b1101 || sum == 0b0100 || sum == 0b0010 || sum == 0b1011) {
-      targetTemperature++;  // Increase the target temperature by one degree
+      setting += page.settingStep;  // Increase the setting by one step
     } else if (sum == 0b1110 || sum == 0b0111 || sum == 0b0001 || sum == 0b1000) {
-      targetTemperature--;  // Decrease the target temperature by one degree
+      setting -= page.settingStep;  // Decrease the setting by one step
     }
 
     lastEncoded = newEncoded;
@@ -638,6 +851,11 @@ void handleEncoder() {
 
     lastEncoded = newEncoded;
   }
+
+  //Redraw the LCD now instead of waiting for the next refresh
+  encoderMoved = true;
+  uiRedraw = true;
+  postTaskEvent(uiTaskId);
 }
 
 
@@ -671,6 +889,7 @@ void connectWiFi() {
     lcd.print("Network");
 
     status = WiFi.begin(ssid, pass);
+    recordWifiStatus(status);
     delay(2000);
   }
 
@@ -704,109 +923,286 @@ void printWifiStatus() {
         - Handles HTTP Requests (GET, POST)
 *****************************************/
 
-void makeGetRequest(const char* serverRoute) {
+// Metrics endpoint of a route
+NetEndpointId endpointOf(const char* route) {
+  if (route == serverRoute) {
+    return NET_SEND_DATA;
+  }
+  if (route == ping) {
+    return NET_PING;
+  }
+  if (route == serverTest) {
+    return NET_TEST;
+  }
+  if (route == serverAlarmRoute) {
+    return NET_ALARM;
+  }
+  return NET_OTHER;
+}
+
+// Wait for the first byte of the response, false after the 5 second timeout
+bool waitForResponse(NetRequest& request) {
+  unsigned long startTime = millis();
+  while (!client.available()) {
+    if (millis() - startTime > 5000) {  // 5 second timeout
+      logEvent(LOG_RESPONSE_TIMEOUT);
+      recordEvent(EVENT_HTTP, HTTP_TIMEOUT);
+      netRequestDone(request, NET_FAIL_TIMEOUT);
+      return false;
+    }
+    idleFor(1);  // Sleep instead of spinning while the server answers
+  }
+
+  netRequestFirstByte(request);
+  return true;
+}
+
+// Failure cause of a response that has a valid status line, anything but a 2xx is an error
+NetFailure responseFailure(const ServerResponse& response) {
+  return response.statusCode >= 200 && response.statusCode < 300 ? NET_OK : NET_FAIL_HTTP_ERROR;
+}
+
+// extraQuery is appended to the query string, "" for none
+void makeGetRequest(const char* serverRoute, const char* extraQuery) {
   client.stop();
+  arenaReset(uploadArena);
 
-  String queryString = "?deviceID=" + device_id;
+  char* url = arenaPrintf(uploadArena, "%s?deviceID=%s%s", serverRoute, device_id.c_str(), extraQuery);
+  if (url == NULL) {
+    Serial.println("No room for the request URL");
+    return;
+  }
 
-  Serial.println("Attempting to Connect to API Server");
+  logEvent(LOG_GET_START);
+  recordEvent(EVENT_HTTP, HTTP_GET_START);
+  ProfileScope profile(PROFILE_HTTP_GET);
+  NetRequest request;
+  netRequestStart(request, endpointOf(serverRoute), strlen(url));
 
   //Send a Get Request to the Server
-  client.get(serverRoute + queryString);
+  client.get(url);
 
   //Check if the Connection was Successfull
   if (!client.connected()) {
-    Serial.println("Failed to Connect to API Server");
+    logEvent(LOG_CONNECT_FAILED);
+    recordEvent(EVENT_HTTP, HTTP_CONNECT_FAILED);
+    netRequestDone(request, NET_FAIL_CONNECT);
     return;
   }
+  netRequestConnected(request);
 
   // Wait for a response with a timeout
-  unsigned long startTime = millis();
-  while (!client.available()) {
-    if (millis() - startTime > 5000) {  // 5 second timeout
-      Serial.println("Server Response Timeout");
-      return;
-    }
+  if (!waitForResponse(request)) {
+    return;
   }
-  int statusCode = client.responseStatusCode();
-  String response = client.responseBody();
+  ServerResponse response;
+  ArenaJsonDocument responseDoc(RESPONSE_DOCUMENT_SIZE);
 
-  if (statusCode > 0) {
-    Serial.print("HTTP Response Status Code: ");
-    Serial.println(statusCode);
-    Serial.print("Response: ");
-    Serial.println(response);
+  if (readServerResponse(client, response, responseDoc)) {
+    logServerResponse(response);
+    noteServerEncodings(response);
+    netRequestDone(request, responseFailure(response), response.contentLength);
   } else {
-    Serial.println("HTTP Request failed");
+    logEvent(LOG_HTTP_FAILED);
+    recordEvent(EVENT_HTTP, HTTP_FAILED);
+    netRequestDone(request, NET_FAIL_BAD_RESPONSE);
   }
 }
 
 
 
-String convertToJSON() {
-  StaticJsonDocument<1000> doc;  // Create a static JSON document.
+// Find the oldest and newest timestamp held in the sample columns (0 if empty)
+void rawSampleRange(unsigned long& oldest, unsigned long& newest) {
+  uint32_t oldestSample, newestSample;
+  sampleTimeRange(sampleColumns, oldestSample, newestSample);
+  oldest = oldestSample;
+  newest = newestSample;
+}
 
-  JsonArray Data = doc.createNestedArray("Data");
+// Rows waiting in the sample columns
+uint32_t rawRowCount() {
+  return sampleRowCount(sampleColumns);
+}
 
-  for (int i = 0; i < sensorArray_Size; i++) {
+// ms the oldest raw sample has waited for its upload (0 if there is none)
+uint32_t oldestUnsentAge() {
+  unsigned long oldest, newest;
+  rawSampleRange(oldest, newest);
+  unsigned long now = getCurrentTime();
+  return oldest != 0 && now > oldest ? (now - oldest) * 1000 : 0;
+}
 
-    //Check if the iteration has no data
-    if (deviceTempData[i].data != 0 || tempData[i].data != 0 || humidityData[i].data != 0 || waterTempData[i].data != 0 || phData[i].data != 0 ||tdsData[i].data != 0) {
+// Serialize the stored sensor data into buffer, returns the length (0 if it did not fit)
+//  - The document lives in the upload arena, reset at the start of the next upload cycle
+//  - The body is built in upload_body.h, the rows that do not fit wait for the next upload
+size_t convertToJSON(char* buffer, size_t bufferSize) {
+  ProfileScope profile(PROFILE_JSON);
+  ArenaJsonDocument doc(JSON_DOCUMENT_SIZE);  // Create a JSON document.
+  if (doc.capacity() == 0) {
+    return 0;
+  }
 
-      //If there not all 0 then create an object to store this iterations data
-      JsonObject sensorDataObject = Data.createNestedObject();
+  addUploadRollups(doc, uploadBatch, sampleColumns, getCurrentTime());
 
-      JsonObject DeviceInfo = sensorDataObject.createNestedObject("Device");
-      DeviceInfo["DeviceID"] = device_id;
+  //Neither comes from the sensors, a replay leaves them out so two builds diff cleanly
+  if (profileReportDue && !traceReplaying) {
+    addProfileToJSON(doc.createNestedObject("Profile"));
+  }
+  if (postMortemDue && !traceReplaying) {
+    addPostMortemToJSON(doc.createNestedObject("PostMortem"));
+  }
 
-      JsonArray SensorReadings = sensorDataObject.createNestedArray("SensorReadings");
+  addUploadRows(doc, uploadBatch, sampleColumns, device_id.c_str());
 
-      addSensorReading(SensorReadings, deviceTempData[i]);
-      addSensorReading(SensorReadings, tempData[i]);
-      addSensorReading(SensorReadings, humidityData[i]);
-      addSensorReading(SensorReadings, waterTempData[i]);
-      addSensorReading(SensorReadings, phData[i]);
-      addSensorReading(SensorReadings, tdsData[i]);
-    }
-  }
   // Convert the JSON document to a string
-  String postData;
-  serializeJson(doc, postData);
-
-  return postData;
+  return serializeUpload(doc, buffer, bufferSize);
 }
 
-void addSensorReading(JsonArray& SensorReadings, sensorData sensor) {
-  //If there is Data
-  if (sensor.data != 0) {
-    JsonObject reading = SensorReadings.createNestedObject();
 
-    reading["Name"] = sensor.name;
-    reading["Value"] = sensor.data;
-    reading["Time"] = sensor.timestamp;
+// Upload, then pick the time to the next upload from the link (upload_policy.h)
+void adaptiveUpload() {
+  //Alarms go first, they must not wait behind the batch
+  sendPendingAlarms();
 
-    if (!sensor.sensorName.isEmpty()) {
-      reading["Sensor"] = sensor.sensorName;
-    }
-    if (!sensor.sensorType.isEmpty()) {
-      reading["Type"] = sensor.sensorType;
-    }
-    if (!sensor.dataType.isEmpty()) {
-      reading["Field"] = sensor.dataType;
-    }
-    if (!sensor.sensorLocation.isEmpty()) {
-      reading["Location"] = sensor.sensorLocation;
+  linkNoteRssi(uploadLink, WiFi.RSSI());
+
+  uint32_t rows = rawRowCount();
+  unsigned long start = millis();
+  bool ok = postSensorData(serverRoute);
+  linkNoteUpload(uploadLink, ok, uploadBytes, rows, millis() - start);
+
+  const RuntimeConfig& config = runtimeConfig();
+  UploadLimits limits = { config.sendDataInterval, config.sampleInterval, config.maxDataAge, SAMPLE_ROWS };
+  uint32_t interval = nextUploadInterval(uploadLink, limits, oldestUnsentAge());
+
+  setTaskInterval(uploadTaskId, interval);
+  logEvent(LOG_UPLOAD_INTERVAL, interval, linkQuality(uploadLink), uploadLink.rssi, uploadLink.successRate);
+}
+
+// Send the alarms that may go now in one compact POST, they stay queued and the lane backs off if it fails
+void sendPendingAlarms() {
+  int ready[ALARM_QUEUE_SIZE];
+  int count = collectReadyAlarms(alarmQueue, millis(), ready, ALARM_QUEUE_SIZE);
+  if (count == 0) {
+    return;
+  }
+
+  //Cut to the alarms that fit, the others go with the next POST
+  char body[ALARM_BODY_SIZE];
+  size_t length = formatAlarmJSON(body, sizeof(body), device_id.c_str(), alarmQueue, ready, count);
+  if (length == 0) {
+    return;
+  }
+  if (postAlarms(body, length)) {
+    completeAlarms(alarmQueue, millis(), ready, count);
+    logEvent(LOG_ALARMS_SENT, count);
+    if (nextAlarmDue(alarmQueue, millis()) == 0) {
+      postTaskEvent(alarmTaskId);  // Cut off from this body
     }
+  } else {
+    alarmPostFailed(alarmQueue, millis());
+  }
+}
+
+// Returns true if the server answered with a 2xx status
+bool postAlarms(const char* body, size_t length) {
+  arenaReset(uploadArena);
+
+  recordEvent(EVENT_HTTP, HTTP_POST_START, length);
+  NetRequest request;
+  netRequestStart(request, NET_ALARM, length);
+
+  client.beginRequest();
+  client.post(serverAlarmRoute);
+
+  if (!client.connected()) {
+    client.stop();
+    logEvent(LOG_CONNECT_FAILED);
+    recordEvent(EVENT_HTTP, HTTP_CONNECT_FAILED);
+    netRequestDone(request, NET_FAIL_CONNECT);
+    return false;
+  }
+  netRequestConnected(request);
+
+  client.sendHeader("Content-Type", "application/json");
+  client.sendHeader("Content-Length", (int)length);
+  client.beginBody();
+  client.write((const uint8_t*)body, length);
+  client.endRequest();
+
+  if (!waitForResponse(request)) {
+    return false;
+  }
+
+  ServerResponse response;
+  ArenaJsonDocument responseDoc(RESPONSE_DOCUMENT_SIZE);
+  if (!readServerResponse(client, response, responseDoc)) {
+    logEvent(LOG_HTTP_FAILED);
+    recordEvent(EVENT_HTTP, HTTP_FAILED);
+    netRequestDone(request, NET_FAIL_BAD_RESPONSE);
+    return false;
+  }
+  logServerResponse(response);
+  noteServerEncodings(response);
+  netRequestDone(request, responseFailure(response), response.contentLength);
+
+  return response.statusCode >= 200 && response.statusCode < 300;
+}
+
+// Compress the uploads once the server lists deflate in "encodings" (Any response, the first ping tells)
+void noteServerEncodings(const ServerResponse& response) {
+  bool deflate = response.acceptsDeflate && !deflateRejected && uploadDeflated != NULL;
+  if (response.hasEncodings && deflate != uploadDeflate) {
+    uploadDeflate = deflate;
+    logEvent(LOG_UPLOAD_ENCODING, uploadDeflate, deflateRejected);
   }
 }
 
+// Deflate the staged body into uploadDeflated, returns its length (0 to send the JSON as it is)
+size_t compressUpload(size_t length) {
+  if (!uploadDeflate) {
+    return 0;
+  }
+
+  ProfileScope profile(PROFILE_DEFLATE);
+  unsigned long start = micros();
+  size_t compressed = deflateCompress(deflateState, (const uint8_t*)uploadStaging, length, uploadDeflated, UPLOAD_DEFLATE_SIZE);
+  logEvent(LOG_UPLOAD_COMPRESSED, length, compressed, micros() - start);
 
-void postSensorData(const char* serverRoute) {
+  return compressed < length ? compressed : 0;
+}
 
-  Serial.println("making POST request");
+// Returns true once the server has stored the upload
+bool postSensorData(const char* serverRoute) {
 
-  String contentType = "application/json";
-  String postData = convertToJSON();
+  arenaReset(uploadArena);
+
+  const char* contentType = "application/json";
+  if (uploadStaging == NULL) {
+    Serial.println("No upload staging buffer");
+    return false;
+  }
+
+  size_t jsonLength = convertToJSON(uploadStaging, UPLOAD_STAGING_SIZE);
+  logEvent(LOG_POST_START, jsonLength, uploadBatch.sequence);
+  if (jsonLength == 0) {
+    uploadBytes = 0;
+    logEvent(LOG_UPLOAD_TOO_BIG);
+    return false;
+  }
+
+  //The body on the wire, deflated once the server accepts it
+  size_t compressedLength = compressUpload(jsonLength);
+  bool compressed = compressedLength > 0;
+  const uint8_t* body = compressed ? uploadDeflated : (const uint8_t*)uploadStaging;
+  size_t postLength = compressed ? compressedLength : jsonLength;
+  uploadBytes = postLength;
+
+  ProfileScope profile(PROFILE_HTTP_POST);
+  recordEvent(EVENT_HTTP, HTTP_POST_START, min(postLength, (size_t)0xFFFF));
+  NetRequest request;
+  netRequestStart(request, endpointOf(serverRoute), postLength, uploadBatch.sequence == uploadBatch.lastPostedSequence);
+  uploadBatch.lastPostedSequence = uploadBatch.sequence;
 
   client.beginRequest();
   client.post(serverRoute);
@@ -814,33 +1210,239 @@ void postSensorData(const char* serverRoute) {
   //Check if the Connection was Successfull
   if (!client.connected()) {
     client.stop();
-    Serial.println("Failed to send Data");
-    return;
+    logEvent(LOG_CONNECT_FAILED);
+    recordEvent(EVENT_HTTP, HTTP_CONNECT_FAILED);
+    netRequestDone(request, NET_FAIL_CONNECT);
+    return false;
   }
+  netRequestConnected(request);
 
   client.sendHeader("Content-Type", contentType);
-  client.sendHeader("Content-Length", postData.length());
+  if (compressed) {
+    client.sendHeader("Content-Encoding", "deflate");
+  }
+  client.sendHeader("Content-Length", (int)postLength);
   client.beginBody();
-  client.print(postData);
+  client.write(body, postLength);
   client.endRequest();
 
+  if (!waitForResponse(request)) {
+    return false;
+  }
+
   // read the status code and body of the response
-  int statusCode = client.responseStatusCode();
-  String response = client.responseBody();
+  ServerResponse response;
+  ArenaJsonDocument responseDoc(RESPONSE_DOCUMENT_SIZE);
+
+  if (!readServerResponse(client, response, responseDoc)) {
+    logEvent(LOG_HTTP_FAILED);
+    recordEvent(EVENT_HTTP, HTTP_FAILED);
+    netRequestDone(request, NET_FAIL_BAD_RESPONSE);
+    return false;
+  }
+  logServerResponse(response);
+  noteServerEncodings(response);
 
-  if (statusCode > 0) {
-    Serial.print("HTTP Response Status Code: ");
-    Serial.println(statusCode);
-    Serial.print("Response: ");
-    Serial.println(response);
+  //Take any config pushed with the response, even when the upload itself is not acknowledged
+  if (!response.config.isNull() && updateConfig(response.config)) {
+    applyRuntimeConfig();
+  }
 
-    resetSensorArray();
+  //A server that cannot inflate after all, the same rows go again as plain JSON
+  if (compressed && response.statusCode == 415) {
+    deflateRejected = true;
+    uploadDeflate = false;
+    logEvent(LOG_UPLOAD_ENCODING, uploadDeflate, deflateRejected);
+    netRequestDone(request, NET_FAIL_HTTP_ERROR, response.contentLength);
+    return false;
+  }
 
-  } else {
-    Serial.println("HTTP Request failed");
+  //Not stored (An error status, or the ack of another upload), the same rows go again
+  if (!uploadStored(uploadBatch, response.statusCode, response.hasAck, response.ack)) {
+    bool otherAck = response.hasAck && response.ack != uploadBatch.sequence;
+    if (otherAck) {
+      logEvent(LOG_NOT_ACKNOWLEDGED, uploadBatch.sequence, response.ack);
+    }
+    netRequestDone(request, otherAck ? NET_FAIL_NOT_ACKED : NET_FAIL_HTTP_ERROR, response.contentLength);
+    return false;
+  }
+  netRequestDone(request, NET_OK, response.contentLength);
+
+  commitUpload(uploadBatch, sampleColumns);
+  profileReportDue = false;
+  postMortemDue = false;
+  return true;
+}
+
+/*****************************************
+*   Benchmarks (Build with GG_BENCHMARK defined, harness in benchmark.h)
+      - Run once in setup() before the scheduler starts
+      - convertToJSON() is timed with 0, 10 and 100 rows in the sample columns,
+        deflateCompress() on its body with 10 and 20 rows
+      - The cases that need no board are in benchmark.h, tools/firmware_bench.cpp
+        runs them on the host
+      - profileScope is an empty ProfileScope, its cost over emptyCall is what
+        the profiler adds to every timed section
+*****************************************/
+#if defined(GG_BENCHMARK)
+
+void benchConvertToJSON() {
+  arenaReset(uploadArena);
+  benchmarkSink = convertToJSON(uploadStaging, UPLOAD_STAGING_SIZE);
+}
+
+// The body convertToJSON() left in the staging buffer
+size_t benchmarkBodyLength = 0;
+
+void benchDeflate() {
+  benchmarkSink = deflateCompress(deflateState, (const uint8_t*)uploadStaging, benchmarkBodyLength, uploadDeflated, UPLOAD_DEFLATE_SIZE);
+}
+
+void benchAddSensorReading() {
+  arenaReset(uploadArena);
+  ArenaJsonDocument doc(1024);
+  JsonArray readings = doc.createNestedArray("SensorReadings");
+  addSensorReading(readings, ROLLUP_GROW_TEMP, sampleColumns.time[ROLLUP_GROW_TEMP][0], sampleColumns.value[ROLLUP_GROW_TEMP][0]);
+  benchmarkSink = readings.size();
+}
+
+// The readings line of debugInfo() formatted and printed as text, as before the binary log
+void benchReadingsText() {
+  char line[128];
+  snprintf(line, sizeof(line), "Ambient %.2f C, Grow %.2f C %.2f %%, Water %.2f C, pH %.2f, TDS %.0f ppm, Heater on %u",
+           ambientTemp, zones.temperature[0], zones.humidity[0], waterTemp, phValue, tdsValue, 1);
+  Serial.println(line);
+}
+
+void benchReadingsBinary() {
+  logEvent(LOG_READINGS, ambientTemp, zones.temperature[0], zones.humidity[0], waterTemp, phValue, tdsValue, true);
+  logTail = logHead;  // Keep the ring from filling, the drain is not part of the cost at the log site
+}
+
+// One sample of a channel past its warm up, the cost added to every reading
+void benchAnomalySample() {
+  benchmarkStep = (benchmarkStep + 1) % 100;
+  benchmarkSink = addAnomalySample(anomalyChannels[ANOMALY_WATER_TEMP], anomalyLimits[ANOMALY_WATER_TEMP], 22.0 + (benchmarkStep % 7) * 0.0625, 1700000000UL + benchmarkStep * 30);
+}
+
+// One control pass over every wired zone, on a copy so the relays keep their state
+ZoneTable benchmarkZones;
+
+void benchControlZones() {
+  benchmarkStep = (benchmarkStep + 1) % 100;
+  benchmarkZones.temperature[benchmarkStep % benchmarkZones.count] = 18.0 + (benchmarkStep % 9) * 0.5;
+  benchmarkSink = controlZones(benchmarkZones, ALARM_TEMPERATURE_MARGIN).changed;
+}
+
+// An empty call, the loop and call cost that every case carries
+void benchEmptyCall() {}
+
+// An empty ProfileScope, what timing a section adds to it
+void benchProfileScope() {
+  ProfileScope profile(PROFILE_LCD);
+}
+
+void runBenchmarks() {
+  Serial.println("Running benchmarks");
+
+  //Cost of a scope over an empty call, the LCD section is left as it was
+  uint32_t callCycles = runBenchmark("emptyCall", 0, benchEmptyCall, 1000);
+  ProfileSection lcdSection = profileSections[PROFILE_LCD];
+  uint32_t scopeCycles = runBenchmark("profileScope", 0, benchProfileScope, 1000);
+  profileSections[PROFILE_LCD] = lcdSection;
+  if (cycleCounterRunning) {
+    Serial.print("  ProfileScope costs ");
+    Serial.print((unsigned long)(scopeCycles > callCycles ? scopeCycles - callCycles : 0));
+    Serial.println(" cycles (Target under 50)");
+  }
+
+  const int fills[] = { 0, 10, 100 };
+  for (int fill : fills) {
+    fillBenchmarkRows(sampleColumns, fill);
+    runBenchmark("convertToJSON", fill, benchConvertToJSON, 20);
   }
+
+  //Compressed size printed next to the time, tools/deflate_bench.cpp has the ratios of realistic bodies
+  const int deflateFills[] = { 10, 20 };
+  for (int fill : deflateFills) {
+    fillBenchmarkRows(sampleColumns, fill);
+    arenaReset(uploadArena);
+    benchmarkBodyLength = convertToJSON(uploadStaging, UPLOAD_STAGING_SIZE);
+    runBenchmark("deflateCompress", fill, benchDeflate, 20);
+    Serial.print("  ");
+    Serial.print(benchmarkBodyLength);
+    Serial.print(" bytes deflated to ");
+    Serial.println((unsigned long)benchmarkSink);
+  }
+
+  fillBenchmarkRows(sampleColumns, 1);
+  runBenchmark("addSensorReading", 1, benchAddSensorReading, 200);
+
+  runPortableBenchmarks(sampleColumns);
+  runBenchmark("readingsText", 0, benchReadingsText, 20);
+  runBenchmark("readingsBinary", 0, benchReadingsBinary, 1000);
+  runBenchmark("anomalySample", 0, benchAnomalySample, 1000);
+
+  benchmarkZones = zones;
+  runBenchmark("controlZones", zones.count, benchControlZones, 1000);
+
+  //Leave the upload state as it was before the benchmarks
+  initAnomalyChannel(anomalyChannels[ANOMALY_WATER_TEMP]);
+  resetSensorArray();
+  arenaReset(uploadArena);
+  uploadBatch.catchingUp = false;
+  uploadBatch.pendingUploadedUntil = uploadBatch.uploadedUntil;
+}
+
+#endif
+
+
+/*****************************************
+*   Trace Replay (Build with GG_TRACE_REPLAY, recording in sensor_trace.h)
+      - Runs the recorded inputs through the read functions, the heater
+        decision and convertToJSON() as fast as the board can
+      - Prints every heater change and every upload payload, two builds can be
+        compared by diffing their "REPLAY" lines
+      - Payloads leave out the profile and the post mortem, they depend on the
+        run and not on the trace
+*****************************************/
+#if defined(GG_TRACE_REPLAY)
+
+void replaySensingPass(uint32_t time) {
+  sampleTime = time;
+  readSensors();
+}
+
+// Same decision as controlTask() for every zone, printed instead of switching the relays
+void replayControl(uint32_t time) {
+  controlZones(zones, ALARM_TEMPERATURE_MARGIN);
+  printReplayHeaters(Serial, zones, time);
+}
+
+void replayPayload(uint32_t time) {
+  arenaReset(uploadArena);
+  size_t length = convertToJSON(uploadStaging, UPLOAD_STAGING_SIZE);
+
+  Serial.print("REPLAY ");
+  Serial.print(time);
+  Serial.print(" PAYLOAD ");
+  Serial.write((const uint8_t*)uploadStaging, length);
+  Serial.println();
+  resetSensorArray();
 }
 
+void replayTrace() {
+  const RuntimeConfig& config = runtimeConfig();
+  uint32_t passesPerUpload = max(1UL, (unsigned long)(config.sendDataInterval / config.sampleInterval));
+  const TraceReplayHooks hooks = { handleEncoder, replaySensingPass, replayPayload, replayControl };
+
+  resetSensorArray();
+  replayTraceRecords(hooks, passesPerUpload);
+}
+
+#endif
+
+
 /*****************************************
 *   Functions to Store the TDS Readings
 *****************************************/
@@ -864,30 +1466,8 @@ float getTDSReading() {
     printTimepoint = millis();
     for (copyIndex = 0; copyIndex < SCOUNT; copyIndex++)
       analogBufferTemp[copyIndex] = analogBuffer[copyIndex];
-    averageVoltage = getMedianNum(analogBufferTemp, SCOUNT) * (float)VREF / 1024.0;                                                                                                   // read the analog value more stable by the median filtering algorithm, and convert to voltage value
-    float compensationCoefficient = 1.0 + 0.02 * (temperature - 25.0);                                                                                                                //temperature compensation formula: fFinalResult(25^C) = fFinalResult(current)/(1.0+0.02*(fTP-25.0));
-    float compensationVolatge = averageVoltage / compensationCoefficient;                                                                                                             //temperature compensation
-    tdsValue = (133.42 * compensationVolatge * compensationVolatge * compensationVolatge - 255.86 * compensationVolatge * compensationVolatge + 857.39 * compensationVolatge) * 0.5;  //convert voltage value to tds value
-  }
-}
-
-int getMedianNum(int bArray[], int iFilterLen) {
-  int bTab[iFilterLen];
-  for (byte i = 0; i < iFilterLen; i++)
-    bTab[i] = bArray[i];
-  int i, j, bTemp;
-  for (j = 0; j < iFilterLen - 1; j++) {
-    for (i = 0; i < iFilterLen - j - 1; i++) {
-      if (bTab[i] > bTab[i + 1]) {
-        bTemp = bTab[i];
-        bTab[i] = bTab[i + 1];
-        bTab[i + 1] = bTemp;
-      }
-    }
+    averageVoltage = getMedianNum(analogBufferTemp, SCOUNT) * (float)VREF / 1024.0;  // read the analog value more stable by the median filtering algorithm, and convert to voltage value
+    tdsValue = tdsFromVoltage(averageVoltage, temperature);
   }
-  if ((iFilterLen & 1) > 0)
-    bTemp = bTab[(iFilterLen - 1) / 2];
-  else
-    bTemp = (bTab[iFilterLen / 2] + bTab[iFilterLen / 2 - 1]) / 2;
-  return bTemp;
-}
\ No newline at end of file
+  return tdsValue;
+}
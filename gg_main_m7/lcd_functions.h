@@ -1,7 +1,5 @@
-//Initialize LCD
-void useLCD() {
-  lcd.init();  // initialize the LCD
-  lcd.backlight();
+//Load the default Custom Characters (The trend pages replace some of them while shown)
+void loadDefaultChars() {
   lcd.createChar(0, Heart);
   lcd.createChar(1, Cup);
   lcd.createChar(2, Shield);
@@ -10,6 +8,13 @@ void useLCD() {
   lcd.createChar(5, arrowright);
 }
 
+//Initialize LCD
+void useLCD() {
+  lcd.init();  // initialize the LCD
+  lcd.backlight();
+  loadDefaultChars();
+}
+
 //Display the Boot Screen
 void bootScreen() {
 
@@ -42,151 +47,113 @@ void bootScreen() {
   lcd.clear();
 }
 
-// Function to display DHT sensor data
-void displayDHTData(float temperature, float humidity, int currentPage, int lastPage) {
-  // Clear the LCD
+/*****************************************
+*   LCD Page Table Types
+      - Each page is described by an LcdPage entry instead of its own display function
+      - renderPage() draws the shared header and the bound values for any page
+*****************************************/
+
+// One value row on a page: label, bound variable and unit (e.g. "Temperature: 21.50 C")
+struct LcdValue {
+  const char* label;
+  const float* value;
+  const char* unit;
+  int decimals;
+};
+
+struct LcdPage {
+  const char* title;              // Fixed title (Max 18 characters)
+  const char* (*titleFunction)(int zone);  // Title that changes at runtime, used instead of title when set
+  LcdValue lines[2];              // Rows 2 and 3, label NULL to leave the row empty
+  int editPage;                   // Index in the edit page table shown on a Button Click, -1 for none
+
+  //Edit pages only, the setting the encoder changes
+  float* setting;
+  float settingDefault;  // Restored on a Long Press
+  float settingStep;     // Change per encoder step
+
+  //Trend pages only, drawn as summaries and a sparkline instead of value rows
+  const SensorTrend* trend;
+
+  //Zone pages, the values (And setting) point at the zone arrays (zones.h) and show the slot of zone.
+  //An edit page is zoned without a zone of its own, it takes the zone of the page it was opened from
+  int zone;
+  bool zoned;
+};
+
+//Page drawn last, a different page clears the screen first
+const LcdPage* lastRenderedPage = NULL;
+
+// Draw the top row: arrows and the centered title
+void drawPageTitle(const char* title, byte leftArrow, byte rightArrow) {
+  int padding = (18 - (int)strlen(title)) / 2;
 
-  if (currentPage != lastPage) {
-    lcd.clear();
-  }
-
-
-  // Display the data on the LCD
   lcd.setCursor(0, 0);
-  lcd.write(byte(4));
-  lcd.setCursor(1, 0);
-  lcd.print("Grow Area Temp. #1");
-  lcd.setCursor(19, 0);
-  lcd.write(byte(5));
-  lcd.setCursor(0, 1);
-  for (int i = 0; i < 20; i++) {
-    lcd.write(byte(3));  // Display the custom character Line 20 times
-  }
-  lcd.setCursor(0, 2);
-  lcd.print("Temperature: " + String(temperature) + " C");
-  lcd.setCursor(0, 3);
-  lcd.print("Humidity: " + String(humidity) + " %");
-}
+  lcd.write(leftArrow);
 
-// Function to display ambient temperature
-void displayAmbientTemp(float ambientTemp, int currentPage, int lastPage) {
-
-  if (currentPage != lastPage) {
-    lcd.clear();
+  //Pad both sides so a shorter title overwrites the previous one
+  int column = 1;
+  for (; column < 1 + padding; column++) {
+    lcd.write(' ');
   }
-
-  // Display ambient temperature data on the LCD
-  lcd.setCursor(0, 0);
-  lcd.write(byte(4));
-  lcd.setCursor(2, 0);
-  lcd.print("Room Temperature");
-  lcd.setCursor(19, 0);
-  lcd.write(byte(5));
-  lcd.setCursor(0, 1);
-  for (int i = 0; i < 20; i++) {
-    lcd.write(byte(3));  // Display the custom character Line 20 times
+  column += lcd.print(title);
+  for (; column < 19; column++) {
+    lcd.write(' ');
   }
-  lcd.setCursor(0, 2);
-  lcd.print("Temperature: " + String(ambientTemp) + " C");
-}
-
-
-
-// Function to display Heater Relay Screen
-void displayHeaterStatus(int RELAY_PIN, float temperature, float targetTemperature, int currentPage, int lastPage) {
-  // Read relay status
-  int relayStatus = digitalRead(RELAY_PIN);
 
-  if (currentPage != lastPage) {
-    lcd.clear();
-  }
+  lcd.write(rightArrow);
+}
 
-  // Display the Title on the LCD
-  lcd.setCursor(0, 0);
-  lcd.write(byte(4));
-  lcd.setCursor(2, 0);
+// Draw the arrows, the centered title and the line under it
+void drawPageHeader(const char* title) {
+  drawPageTitle(title, byte(4), byte(5));
 
-  if (relayStatus == LOW) {
-    lcd.print("Heater is ON");
-  } else {
-    lcd.print("Heater is OFF");
-  }
-  lcd.setCursor(19, 0);
-  lcd.write(byte(5));
   lcd.setCursor(0, 1);
   for (int i = 0; i < 20; i++) {
     lcd.write(byte(3));  // Display the custom character Line 20 times
   }
-
-  lcd.setCursor(0, 2);
-  lcd.print("Temp: " + String(temperature) + " C");
-
-  lcd.setCursor(0, 3);
-  lcd.print("Target: " + String(targetTemperature) + " C");
 }
 
-//Function to display the change Target Temperature Screen
-void displayTempChange(float targetTemperature, int currentPage, int lastPage) {
+// Draw any page from the page table, zone is the slot shown by a zoned page
+void renderPage(const LcdPage& page, int zone) {
 
-  if (currentPage != lastPage) {
+  if (&page != lastRenderedPage) {
     lcd.clear();
-  }
 
-  //Display the Tearget Temperature on the LCD
-  lcd.setCursor(0, 0);
-  lcd.write(byte(4));
-  lcd.setCursor(2, 0);
-  lcd.print("Set Temperature");
-  lcd.setCursor(19, 0);
-  lcd.write(byte(5));
-  lcd.setCursor(0, 1);
-  for (int i = 0; i < 20; i++) {
-    lcd.write(byte(3));  // Display the custom character Line 20 times
+    //Swap the Custom Characters when entering or leaving a trend page
+    if (page.trend != NULL) {
+      loadSparkChars();
+    } else if (lastRenderedPage != NULL && lastRenderedPage->trend != NULL) {
+      loadDefaultChars();
+    }
+    lastRenderedPage = &page;
   }
 
-  lcd.setCursor(0, 2);
-  lcd.print("Temperature: " + String(targetTemperature) + " C");
-}
-
-
-// Function to display water flow data
-void displayWaterFlow(int currentPage, int lastPage) {
+  const char* title = page.titleFunction != NULL ? page.titleFunction(zone) : page.title;
 
-  if (currentPage != lastPage) {
-    lcd.clear();
+  //The arrow glyphs are in use as sparkline bars, use plain arrows
+  if (page.trend != NULL) {
+    drawPageTitle(title, '<', '>');
+    renderTrendRows(*page.trend);
+    return;
   }
 
-  lcd.setCursor(0, 0);
-  lcd.write(byte(4));
-  lcd.setCursor(1, 0);
-  lcd.print("Water Flow Monitor");
-  lcd.setCursor(19, 0);
-  lcd.write(byte(5));
-  lcd.setCursor(0, 1);
-  for (int i = 0; i < 20; i++) {
-    lcd.write(byte(3));  // Display the custom character Line 20 times
-  }
-}
+  drawPageHeader(title);
 
+  for (int row = 0; row < 2; row++) {
+    const LcdValue& line = page.lines[row];
+    if (line.label == NULL) {
+      continue;
+    }
 
-// Function to display water flow data
-void displayWaterTemp(float waterTemp, int currentPage, int lastPage) {
+    lcd.setCursor(0, row + 2);
+    size_t length = lcd.print(line.label);
+    length += lcd.print(line.value[page.zoned ? zone : 0], line.decimals);
+    length += lcd.print(line.unit);
 
-  if (currentPage != lastPage) {
-    lcd.clear();
+    //Clear what is left of a longer previous value
+    for (; length < 20; length++) {
+      lcd.write(' ');
+    }
   }
-
-  lcd.setCursor(0, 0);
-  lcd.write(byte(4));
-  lcd.setCursor(1, 0);
-  lcd.print("Water Temp Monitor");
-  lcd.setCursor(19, 0);
-  lcd.write(byte(5));
-  lcd.setCursor(0, 1);
-  for (int i = 0; i < 20; i++) {
-    lcd.write(byte(3));  // Display the custom character Line 20 times
-  }
-
-  lcd.setCursor(0, 2);
-  lcd.print("Temperature: " + String(waterTemp) + " C");
 }
@@ -0,0 +1,155 @@
+/*****************************************
+*   Memory Regions
+      - Internal SRAM: hot state and buffers touched every cycle (Fast, small)
+      - External SDRAM (8 MB on the GIGA R1): large cold buffers such as the
+        rollup history and the upload staging buffer (Slow, large)
+      - Bump allocators, everything is allocated once at boot and never freed
+      - Measures the bandwidth and latency of each region at boot
+      - Builds for other boards back both regions with plain arrays
+*****************************************/
+
+#if defined(ARDUINO_GIGA)
+#include <SDRAM.h>
+#define SDRAM_POOL_SIZE (4 * 1024 * 1024)  // Leaves the rest of the SDRAM for SDRAM.malloc() users
+#else
+#define SDRAM_POOL_SIZE (512 * 1024)
+uint8_t sdramBacking[SDRAM_POOL_SIZE];
+#endif
+
+#define INTERNAL_POOL_SIZE (48 * 1024)
+
+enum MemoryRegionId {
+  REGION_INTERNAL,
+  REGION_SDRAM,
+  MEMORY_REGIONS
+};
+
+struct MemoryRegion {
+  const char* name;
+  uint8_t* base;
+  size_t size;
+  size_t used;
+
+  //Measured at boot
+  float writeMBps;
+  float readMBps;
+  float latencyNs;  // Dependent random load
+};
+
+uint8_t internalPool[INTERNAL_POOL_SIZE] __attribute__((aligned(32)));
+
+MemoryRegion memoryRegions[MEMORY_REGIONS] = {
+  { "Internal", NULL, 0, 0, 0, 0, 0 },
+  { "SDRAM", NULL, 0, 0, 0, 0, 0 },
+};
+
+
+// Allocate from a region, NULL if it is full. Memory is never freed
+void* regionAlloc(MemoryRegionId id, size_t size, size_t align = 8) {
+  MemoryRegion& region = memoryRegions[id];
+  if (region.base == NULL) {
+    return NULL;
+  }
+
+  size_t offset = (region.used + align - 1) & ~(align - 1);
+  if (offset + size > region.size) {
+    Serial.print("Memory region full: ");
+    Serial.println(region.name);
+    return NULL;
+  }
+
+  region.used = offset + size;
+  return region.base + offset;
+}
+
+// Sequential write / read bandwidth and dependent load latency over the free part of a region
+void measureRegion(MemoryRegion& region) {
+  size_t bytes = region.size - region.used;
+  if (bytes > 256 * 1024) {
+    bytes = 256 * 1024;
+  }
+  if (region.base == NULL || bytes < 4096) {
+    return;
+  }
+
+  volatile uint32_t* words = (volatile uint32_t*)(region.base + region.used);
+  size_t count = bytes / sizeof(uint32_t);
+
+  unsigned long start = micros();
+  for (size_t i = 0; i < count; i++) {
+    words[i] = i;
+  }
+  unsigned long elapsed = micros() - start;
+  region.writeMBps = elapsed > 0 ? (float)bytes / elapsed : 0;
+
+  uint32_t sum = 0;
+  start = micros();
+  for (size_t i = 0; i < count; i++) {
+    sum += words[i];
+  }
+  elapsed = micros() - start;
+  region.readMBps = elapsed > 0 ? (float)bytes / elapsed : 0;
+
+  //Pointer chase over one word per 32 byte line in a pseudo random order, defeats the prefetch
+  size_t lines = bytes / 32;
+  size_t stride = 32 / sizeof(uint32_t);
+  size_t step = 7919 % lines;  // Prime step visits every line when lines is not a multiple of it
+  for (size_t i = 0; i < lines; i++) {
+    words[i * stride] = ((i + step) % lines) * stride;
+  }
+
+  uint32_t index = 0;
+  start = micros();
+  for (size_t i = 0; i < lines; i++) {
+    index = words[index];
+  }
+  elapsed = micros() - start;
+  region.latencyNs = (float)elapsed * 1000.0 / lines;
+
+  //Keep the compiler from dropping the loops
+  if (sum == 0xFFFFFFFF && index == 0xFFFFFFFF) {
+    Serial.println();
+  }
+}
+
+void initMemoryRegions() {
+  memoryRegions[REGION_INTERNAL].base = internalPool;
+  memoryRegions[REGION_INTERNAL].size = INTERNAL_POOL_SIZE;
+
+#if defined(ARDUINO_GIGA)
+  SDRAM.begin();
+  memoryRegions[REGION_SDRAM].base = (uint8_t*)SDRAM.malloc(SDRAM_POOL_SIZE);
+#else
+  memoryRegions[REGION_SDRAM].base = sdramBacking;
+#endif
+
+  if (memoryRegions[REGION_SDRAM].base == NULL) {
+    Serial.println("SDRAM not available");
+  } else {
+    memoryRegions[REGION_SDRAM].size = SDRAM_POOL_SIZE;
+  }
+
+  for (int id = 0; id < MEMORY_REGIONS; id++) {
+    measureRegion(memoryRegions[id]);
+  }
+}
+
+// Allocate a large cold buffer, falls back to the heap if the SDRAM is not available
+void* coldAlloc(size_t size) {
+  void* buffer = regionAlloc(REGION_SDRAM, size);
+  if (buffer == NULL) {
+    buffer = malloc(size);
+  }
+  return buffer;
+}
+
+void printMemoryRegions() {
+  for (int id = 0; id < MEMORY_REGIONS; id++) {
+    MemoryRegion& region = memoryRegions[id];
+    char line[112];
+    snprintf(line, sizeof(line), "%-8s used %7u / %7u bytes  write %6.1f MB/s  read %6.1f MB/s  latency %5.1f ns",
+             region.name, (unsigned int)region.used, (unsigned int)region.size,
+             region.writeMBps, region.readMBps, region.latencyNs);
+    Serial.println(line);
+  }
+}
@@ -0,0 +1,338 @@
+/*****************************************
+*   Network Metrics
+      - Per endpoint: requests, successes, retries, failures by cause, bytes
+        sent and received
+      - Latency histograms in ms for connect (Includes sending the request
+        line and headers, HttpClient does both in one call), time to first
+        byte and total duration, one bucket per power of two ms
+      - Sent with the ping (Heartbeat) with the WiFi RSSI, printed with the
+        task statistics and served as Prometheus text on
+        http://<board>:METRICS_PORT/metrics
+      - Bytes sent are the POST body or the GET URL, bytes received are the
+        Content-Length of the response
+*****************************************/
+
+#define NET_BUCKETS 16  // Bucket n counts [2^n, 2^(n+1)) ms, bucket 0 also counts 0 ms
+#define METRICS_PORT 80
+#define METRICS_TEXT_SIZE 20480  // Formatted in the upload arena
+#define METRICS_REQUEST_TIMEOUT 500  // Time a scraper gets to send its request
+
+enum NetEndpointId {
+  NET_SEND_DATA,
+  NET_PING,
+  NET_TEST,
+  NET_ALARM,
+  NET_OTHER,
+  NET_ENDPOINTS
+};
+
+const char* const netEndpointNames[NET_ENDPOINTS] = { "sendData", "ping", "testconnection", "alarm", "other" };
+const char* const netEndpointKeys[NET_ENDPOINTS] = { "up", "ping", "test", "alarm", "other" };  // Heartbeat prefix
+
+enum NetFailure {
+  NET_OK = -1,
+  NET_FAIL_CONNECT,
+  NET_FAIL_TIMEOUT,       // No response within RESPONSE_TIMEOUT
+  NET_FAIL_BAD_RESPONSE,  // No valid status line
+  NET_FAIL_HTTP_ERROR,    // Status 400 and up
+  NET_FAIL_NOT_ACKED,     // Upload not acknowledged, it is sent again
+  NET_FAILURE_CAUSES
+};
+
+const char* const netFailureNames[NET_FAILURE_CAUSES] = { "connect", "timeout", "bad_response", "http_error", "not_acked" };
+
+struct NetHistogram {
+  uint32_t count;
+  uint64_t totalMs;
+  uint32_t maxMs;
+  uint32_t buckets[NET_BUCKETS];
+};
+
+struct NetEndpointStats {
+  uint32_t requests;
+  uint32_t successes;
+  uint32_t retries;
+  uint32_t failures[NET_FAILURE_CAUSES];
+  uint64_t bytesSent;
+  uint64_t bytesReceived;
+
+  NetHistogram connect;
+  NetHistogram firstByte;
+  NetHistogram total;
+};
+
+NetEndpointStats netStats[NET_ENDPOINTS];
+
+// Times of the request in flight (millis())
+struct NetRequest {
+  NetEndpointId endpoint;
+  unsigned long start;
+  unsigned long connected;
+  unsigned long firstByte;
+};
+
+WiFiServer metricsServer(METRICS_PORT);
+
+
+void netHistogramAdd(NetHistogram& histogram, uint32_t ms) {
+  histogram.count++;
+  histogram.totalMs += ms;
+  if (ms > histogram.maxMs) {
+    histogram.maxMs = ms;
+  }
+
+  int bucket = ms == 0 ? 0 : 31 - __builtin_clz(ms);
+  histogram.buckets[bucket < NET_BUCKETS ? bucket : NET_BUCKETS - 1]++;
+}
+
+uint32_t netHistogramAvg(const NetHistogram& histogram) {
+  return histogram.count > 0 ? histogram.totalMs / histogram.count : 0;
+}
+
+// Start timing a request, retry is true when it sends again what an earlier request failed to deliver
+void netRequestStart(NetRequest& request, NetEndpointId endpoint, size_t bytesSent, bool retry = false) {
+  request.endpoint = endpoint;
+  request.start = millis();
+  request.connected = 0;
+  request.firstByte = 0;
+
+  NetEndpointStats& stats = netStats[endpoint];
+  stats.requests++;
+  stats.bytesSent += bytesSent;
+  if (retry) {
+    stats.retries++;
+  }
+}
+
+void netRequestConnected(NetRequest& request) {
+  request.connected = millis();
+  netHistogramAdd(netStats[request.endpoint].connect, request.connected - request.start);
+}
+
+void netRequestFirstByte(NetRequest& request) {
+  request.firstByte = millis();
+  netHistogramAdd(netStats[request.endpoint].firstByte, request.firstByte - request.start);
+}
+
+// End of the request, failure is NET_OK when it succeeded
+void netRequestDone(NetRequest& request, NetFailure failure, long bytesReceived = 0) {
+  NetEndpointStats& stats = netStats[request.endpoint];
+
+  netHistogramAdd(stats.total, millis() - request.start);
+  if (bytesReceived > 0) {
+    stats.bytesReceived += bytesReceived;
+  }
+
+  if (failure == NET_OK) {
+    stats.successes++;
+  } else {
+    stats.failures[failure]++;
+  }
+}
+
+uint32_t netFailureCount(const NetEndpointStats& stats) {
+  uint32_t count = 0;
+  for (int cause = 0; cause < NET_FAILURE_CAUSES; cause++) {
+    count += stats.failures[cause];
+  }
+  return count;
+}
+
+// Heartbeat query parameters, appended to the ping request after the diagnostics
+int netMetricsQuery(char* buffer, size_t size) {
+  int length = snprintf(buffer, size, "&rssi=%ld", (long)WiFi.RSSI());
+
+  for (int id = 0; id < NET_ENDPOINTS && length >= 0 && (size_t)length < size; id++) {
+    const NetEndpointStats& stats = netStats[id];
+    if (stats.requests == 0) {
+      continue;
+    }
+
+    const char* key = netEndpointKeys[id];
+    length += snprintf(buffer + length, size - length,
+                       "&%sN=%lu&%sOk=%lu&%sRetry=%lu&%sTimeout=%lu&%sFail=%lu&%sTx=%llu&%sRx=%llu&%sConnMs=%lu&%sTtfbMs=%lu&%sMs=%lu&%sMaxMs=%lu",
+                       key, (unsigned long)stats.requests, key, (unsigned long)stats.successes, key, (unsigned long)stats.retries,
+                       key, (unsigned long)stats.failures[NET_FAIL_TIMEOUT], key, (unsigned long)netFailureCount(stats),
+                       key, (unsigned long long)stats.bytesSent, key, (unsigned long long)stats.bytesReceived,
+                       key, (unsigned long)netHistogramAvg(stats.connect), key, (unsigned long)netHistogramAvg(stats.firstByte),
+                       key, (unsigned long)netHistogramAvg(stats.total), key, (unsigned long)stats.total.maxMs);
+  }
+  return length;
+}
+
+void printNetMetrics() {
+  char line[160];
+
+  snprintf(line, sizeof(line), "Endpoint        Reqs     OK  Retry  Fail  Sent(B)  Recv(B)  Conn(ms)  TTFB(ms)  Total(ms)  Max(ms)   RSSI %ld dBm", (long)WiFi.RSSI());
+  Serial.println(line);
+
+  for (int id = 0; id < NET_ENDPOINTS; id++) {
+    const NetEndpointStats& stats = netStats[id];
+    if (stats.requests == 0) {
+      continue;
+    }
+
+    snprintf(line, sizeof(line), "%-14s %5lu %6lu %6lu %5lu %8llu %8llu %9lu %9lu %10lu %8lu",
+             netEndpointNames[id], (unsigned long)stats.requests, (unsigned long)stats.successes,
+             (unsigned long)stats.retries, (unsigned long)netFailureCount(stats),
+             (unsigned long long)stats.bytesSent, (unsigned long long)stats.bytesReceived,
+             (unsigned long)netHistogramAvg(stats.connect), (unsigned long)netHistogramAvg(stats.firstByte),
+             (unsigned long)netHistogramAvg(stats.total), (unsigned long)stats.total.maxMs);
+    Serial.println(line);
+
+    Serial.print("               Failures:");
+    for (int cause = 0; cause < NET_FAILURE_CAUSES; cause++) {
+      Serial.print(" ");
+      Serial.print(netFailureNames[cause]);
+      Serial.print(" ");
+      Serial.print(stats.failures[cause]);
+    }
+    Serial.println();
+  }
+}
+
+
+/*****************************************
+*   Prometheus Text (/metrics)
+*****************************************/
+
+// snprintf at the end of the text, the length stops growing once the buffer is full
+void metricsAppend(char* text, size_t size, size_t& length, const char* format, ...) {
+  if (length >= size) {
+    return;
+  }
+
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(text + length, size - length, format, args);
+  va_end(args);
+
+  if (written > 0) {
+    length = min(length + written, size - 1);
+  }
+}
+
+void appendHistogram(char* text, size_t size, size_t& length, const char* name, const char* endpoint, const NetHistogram& histogram) {
+  uint32_t cumulative = 0;
+  for (int bucket = 0; bucket < NET_BUCKETS - 1; bucket++) {
+    cumulative += histogram.buckets[bucket];
+    metricsAppend(text, size, length, "%s_bucket{endpoint=\"%s\",le=\"%lu\"} %lu\n", name, endpoint, 2UL << bucket, (unsigned long)cumulative);
+  }
+  metricsAppend(text, size, length, "%s_bucket{endpoint=\"%s\",le=\"+Inf\"} %lu\n", name, endpoint, (unsigned long)histogram.count);
+  metricsAppend(text, size, length, "%s_sum{endpoint=\"%s\"} %llu\n", name, endpoint, (unsigned long long)histogram.totalMs);
+  metricsAppend(text, size, length, "%s_count{endpoint=\"%s\"} %lu\n", name, endpoint, (unsigned long)histogram.count);
+}
+
+// All the metrics in the Prometheus text format, returns the length
+size_t formatMetrics(char* text, size_t size) {
+  size_t length = 0;
+
+  metricsAppend(text, size, length, "# TYPE gg_wifi_rssi_dbm gauge\ngg_wifi_rssi_dbm %ld\n", (long)WiFi.RSSI());
+  metricsAppend(text, size, length, "# TYPE gg_uptime_seconds gauge\ngg_uptime_seconds %lu\n", millis() / 1000);
+
+  metricsAppend(text, size, length, "# TYPE gg_http_requests_total counter\n");
+  for (int id = 0; id < NET_ENDPOINTS; id++) {
+    metricsAppend(text, size, length, "gg_http_requests_total{endpoint=\"%s\"} %lu\n", netEndpointNames[id], (unsigned long)netStats[id].requests);
+  }
+  metricsAppend(text, size, length, "# TYPE gg_http_successes_total counter\n");
+  for (int id = 0; id < NET_ENDPOINTS; id++) {
+    metricsAppend(text, size, length, "gg_http_successes_total{endpoint=\"%s\"} %lu\n", netEndpointNames[id], (unsigned long)netStats[id].successes);
+  }
+  metricsAppend(text, size, length, "# TYPE gg_http_retries_total counter\n");
+  for (int id = 0; id < NET_ENDPOINTS; id++) {
+    metricsAppend(text, size, length, "gg_http_retries_total{endpoint=\"%s\"} %lu\n", netEndpointNames[id], (unsigned long)netStats[id].retries);
+  }
+  metricsAppend(text, size, length, "# TYPE gg_http_failures_total counter\n");
+  for (int id = 0; id < NET_ENDPOINTS; id++) {
+    for (int cause = 0; cause < NET_FAILURE_CAUSES; cause++) {
+      metricsAppend(text, size, length, "gg_http_failures_total{endpoint=\"%s\",cause=\"%s\"} %lu\n",
+                    netEndpointNames[id], netFailureNames[cause], (unsigned long)netStats[id].failures[cause]);
+    }
+  }
+  metricsAppend(text, size, length, "# TYPE gg_http_sent_bytes_total counter\n");
+  for (int id = 0; id < NET_ENDPOINTS; id++) {
+    metricsAppend(text, size, length, "gg_http_sent_bytes_total{endpoint=\"%s\"} %llu\n", netEndpointNames[id], (unsigned long long)netStats[id].bytesSent);
+  }
+  metricsAppend(text, size, length, "# TYPE gg_http_received_bytes_total counter\n");
+  for (int id = 0; id < NET_ENDPOINTS; id++) {
+    metricsAppend(text, size, length, "gg_http_received_bytes_total{endpoint=\"%s\"} %llu\n", netEndpointNames[id], (unsigned long long)netStats[id].bytesReceived);
+  }
+
+  const char* histograms[] = { "gg_http_connect_ms", "gg_http_first_byte_ms", "gg_http_duration_ms" };
+  for (int h = 0; h < 3; h++) {
+    metricsAppend(text, size, length, "# TYPE %s histogram\n", histograms[h]);
+    for (int id = 0; id < NET_ENDPOINTS; id++) {
+      const NetEndpointStats& stats = netStats[id];
+      if (stats.requests == 0) {
+        continue;  // Keeps the text short, the counters above still list every endpoint
+      }
+      const NetHistogram& histogram = h == 0 ? stats.connect : h == 1 ? stats.firstByte : stats.total;
+      appendHistogram(text, size, length, histograms[h], netEndpointNames[id], histogram);
+    }
+  }
+  return length;
+}
+
+void initMetricsServer() {
+  metricsServer.begin();
+}
+
+// Answer one scrape if a client is waiting, GET /metrics gets the metrics, anything else a 404
+void serveMetrics() {
+  WiFiClient scraper = metricsServer.available();
+  if (!scraper) {
+    return;
+  }
+
+  //Request line, then the headers up to the blank line
+  char requestLine[64];
+  size_t length = 0;
+  bool lineDone = false;
+  bool blankLine = false;
+  size_t lineLength = 0;
+  unsigned long start = millis();
+
+  while (!blankLine && scraper.connected() && millis() - start < METRICS_REQUEST_TIMEOUT) {
+    int c = scraper.read();
+    if (c < 0) {
+      idleFor(1);
+      continue;
+    }
+    if (c == '\r') {
+      continue;
+    }
+    if (c == '\n') {
+      lineDone = true;
+      blankLine = lineLength == 0;
+      lineLength = 0;
+      continue;
+    }
+    lineLength++;
+    if (!lineDone && length < sizeof(requestLine) - 1) {
+      requestLine[length++] = c;
+    }
+  }
+  requestLine[length] = '\0';
+
+  if (strncmp(requestLine, "GET /metrics", 12) != 0) {
+    scraper.print("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    scraper.stop();
+    return;
+  }
+
+  //Formatted in the upload arena, one write instead of a socket write per line
+  arenaReset(uploadArena);
+  char* text = (char*)arenaAlloc(uploadArena, METRICS_TEXT_SIZE, 1);
+  if (text == NULL) {
+    scraper.print("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    scraper.stop();
+    return;
+  }
+  size_t textLength = formatMetrics(text, METRICS_TEXT_SIZE);
+
+  char header[128];
+  snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %u\r\nConnection: close\r\n\r\n", (unsigned int)textLength);
+  scraper.print(header);
+  scraper.write((const uint8_t*)text, textLength);
+  scraper.stop();
+}
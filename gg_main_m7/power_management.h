@@ -0,0 +1,148 @@
+/*****************************************
+*   Power Management functions
+      - Sleeps the core between scheduled tasks (Sleep or Stop mode)
+      - Wakes on the next deadline, encoder / button interrupts or WiFi driver activity
+      - Turns the LCD Backlight off after a period of inactivity
+      - Tracks the percentage of time asleep and estimates the energy used per day
+      - tools/power_sim.cpp runs these on the host over a simulated day of the
+        task table, with the task run times of a post-mortem dump
+*****************************************/
+
+#include <mbed.h>
+
+#define BACKLIGHT_TIMEOUT 60000  // Turn the backlight off after 1 minute without input
+#define IDLE_WAKE_FLAG 0x1
+
+// Rough board level figures used for the energy estimate, measure your own board and update
+#define SUPPLY_VOLTAGE 5.0
+#define ACTIVE_CURRENT_MA 140.0     // M7 running, WiFi associated
+#define SLEEP_CURRENT_MA 70.0       // Core in WFI, clocks running
+#define DEEP_SLEEP_CURRENT_MA 35.0  // Stop mode, WiFi in power save
+#define BACKLIGHT_CURRENT_MA 20.0
+
+//Thread running loop(), woken by the interrupts
+osThreadId_t idleThreadId = NULL;
+
+//Sleep Statistics
+uint64_t sleepMicros = 0;      // Time asleep in either mode
+uint64_t deepSleepMicros = 0;  // Part of sleepMicros where Stop mode was allowed
+uint64_t backlightOnMillis = 0;
+unsigned long powerStatsStart = 0;  // millis() at boot, micros() would roll over after 71 minutes
+unsigned long backlightOnSince = 0;
+
+//Backlight State
+unsigned long lastUserActivity = 0;
+bool backlightOn = true;
+
+
+void initPowerManagement() {
+  idleThreadId = osThreadGetId();
+  powerStatsStart = millis();
+  backlightOnSince = millis();
+  lastUserActivity = millis();
+}
+
+// Wake the loop() thread early (Safe to call from an interrupt)
+void wakeFromIdle() {
+  if (idleThreadId != NULL) {
+    osThreadFlagsSet(idleThreadId, IDLE_WAKE_FLAG);
+  }
+}
+
+// Sleep for up to ms, returns early when an interrupt calls wakeFromIdle()
+//  - Waiting on a thread flag lets the RTOS idle thread pick the deepest mode the
+//    sleep manager allows (Stop mode when no peripheral holds a deep sleep lock)
+void idleFor(unsigned long ms) {
+  if (ms == 0) {
+    return;
+  }
+
+  bool deepSleepAllowed = sleep_manager_can_deep_sleep();
+  unsigned long start = micros();
+
+  rtos::ThisThread::flags_wait_any_for(IDLE_WAKE_FLAG, std::chrono::milliseconds(ms));
+
+  unsigned long slept = micros() - start;
+  sleepMicros += slept;
+  if (deepSleepAllowed) {
+    deepSleepMicros += slept;
+  }
+}
+
+// Call on every button press or encoder turn
+void noteUserActivity() {
+  lastUserActivity = millis();
+
+  if (!backlightOn) {
+    lcd.backlight();
+    backlightOn = true;
+    backlightOnSince = millis();
+  }
+}
+
+bool isDisplayAsleep() {
+  return !backlightOn;
+}
+
+// Turn the backlight off once the display has been left alone
+void updateBacklight() {
+  if (backlightOn && millis() - lastUserActivity > BACKLIGHT_TIMEOUT) {
+    lcd.noBacklight();
+    backlightOn = false;
+    backlightOnMillis += millis() - backlightOnSince;
+  }
+}
+
+// Time since boot in us
+float powerStatsUptime() {
+  return (millis() - powerStatsStart) * 1000.0;
+}
+
+// Percentage of time spent asleep since boot
+float sleepPercent() {
+  float uptime = powerStatsUptime();
+  if (uptime <= 0) {
+    return 0;
+  }
+
+  return 100.0 * sleepMicros / uptime;
+}
+
+// Estimated energy per day in mWh, based on the measured duty cycle
+float estimatedEnergyPerDay() {
+  float uptime = powerStatsUptime();
+  if (uptime <= 0) {
+    return 0;
+  }
+
+  uint64_t backlightTime = backlightOnMillis;
+  if (backlightOn) {
+    backlightTime += millis() - backlightOnSince;
+  }
+
+  float deepFraction = deepSleepMicros / uptime;
+  float sleepFraction = (sleepMicros - deepSleepMicros) / uptime;
+  float activeFraction = 1.0 - deepFraction - sleepFraction;
+  float backlightFraction = backlightTime * 1000.0 / uptime;
+
+  float averageCurrent = ACTIVE_CURRENT_MA * activeFraction
+                         + SLEEP_CURRENT_MA * sleepFraction
+                         + DEEP_SLEEP_CURRENT_MA * deepFraction
+                         + BACKLIGHT_CURRENT_MA * backlightFraction;
+
+  return averageCurrent * SUPPLY_VOLTAGE * 24.0;
+}
+
+void printPowerStats() {
+  Serial.print("Asleep: ");
+  Serial.print(sleepPercent(), 1);
+  Serial.print("% (Stop mode allowed ");
+  Serial.print((unsigned long)(deepSleepMicros / 1000));
+  Serial.print(" ms of ");
+  Serial.print((unsigned long)(sleepMicros / 1000));
+  Serial.println(" ms)");
+
+  Serial.print("Estimated energy per day: ");
+  Serial.print(estimatedEnergyPerDay(), 0);
+  Serial.println(" mWh");
+}
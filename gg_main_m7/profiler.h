@@ -0,0 +1,198 @@
+/*****************************************
+*   Section Profiler
+      - Times instrumented sections of the tasks (LCD redraw, DHT read, NTP,
+        JSON serialization, HTTP) with the DWT cycle counter of the M7
+      - Per section: count, min / avg / max and a histogram with one bucket
+        per power of two cycles, all in a static table
+      - A ProfileScope at the top of a block times the rest of the block,
+        the update is a handful of instructions. The target is under 50
+        cycles a scope, the profileScope case of a GG_BENCHMARK build
+        measures it on the board
+      - The network sections (NTP, HTTP) wait for seconds, past the wrap of
+        CYCCNT (About 8.9 s at 480 MHz), so they are timed in us with micros()
+      - Without a running cycle counter every section falls back to micros().
+        Off target the counter is a monotonic clock in ns, so the same code
+        builds for host tests (tools/tests/profiler_test.cpp)
+      - Printed with the task statistics and added to the next upload
+*****************************************/
+
+#if !defined(ARDUINO)
+#include <chrono>
+#endif
+
+#define PROFILE_BUCKETS 32  // Bucket n counts sections that took [2^n, 2^(n+1)) ticks
+
+enum ProfileSectionId {
+  PROFILE_LCD,
+  PROFILE_DHT,
+  PROFILE_NTP,
+  PROFILE_JSON,
+  PROFILE_HTTP_POST,
+  PROFILE_HTTP_GET,
+  PROFILE_DEFLATE,
+  PROFILE_SECTIONS
+};
+
+const char* const profileNames[PROFILE_SECTIONS] = { "lcd", "dht", "ntp", "json", "http_post", "http_get", "deflate" };
+
+//Sections timed with micros() instead of the cycle counter
+const bool profileInMicros[PROFILE_SECTIONS] = { false, false, true, false, true, true, false };
+
+struct ProfileSection {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t total;
+  uint32_t histogram[PROFILE_BUCKETS];
+};
+
+ProfileSection profileSections[PROFILE_SECTIONS];
+
+//Set by the stats task, the next upload carries the profile
+bool profileReportDue = false;
+
+//True when readCycleCounter() counts CPU cycles
+bool cycleCounterRunning = false;
+
+
+// Start the DWT cycle counter (Cortex-M3 and up), false if this core has none
+bool startCycleCounter() {
+#if defined(DWT) && defined(CoreDebug)
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+#if defined(__CORTEX_M) && (__CORTEX_M == 7)
+  DWT->LAR = 0xC5ACCE55;  // Unlock the DWT registers on the M7
+#endif
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  uint32_t start = DWT->CYCCNT;
+  __NOP();
+  return DWT->CYCCNT != start;
+#else
+  return false;
+#endif
+}
+
+// Current tick, CPU cycles on target (Wraps after about 9 s at 480 MHz), us if the counter does not run
+inline uint32_t readCycleCounter() {
+#if defined(DWT)
+  return cycleCounterRunning ? DWT->CYCCNT : micros();
+#elif !defined(ARDUINO)
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+  return micros();
+#endif
+}
+
+// Ticks per us of readCycleCounter()
+float profileTicksPerMicro() {
+#if defined(DWT)
+  return cycleCounterRunning ? SystemCoreClock / 1000000.0 : 1.0;
+#elif !defined(ARDUINO)
+  return 1000.0;
+#else
+  return 1.0;
+#endif
+}
+
+// Tick of section id, and its ticks per us
+inline uint32_t profileTick(ProfileSectionId id) {
+  return profileInMicros[id] ? micros() : readCycleCounter();
+}
+
+float sectionTicksPerMicro(int id) {
+  return profileInMicros[id] ? 1.0 : profileTicksPerMicro();
+}
+
+void initProfiler() {
+  cycleCounterRunning = startCycleCounter();
+  memset(profileSections, 0, sizeof(profileSections));
+}
+
+inline void profileAdd(ProfileSectionId id, uint32_t ticks) {
+  ProfileSection& section = profileSections[id];
+
+  if (section.count == 0 || ticks < section.min) {
+    section.min = ticks;
+  }
+  if (ticks > section.max) {
+    section.max = ticks;
+  }
+  section.count++;
+  section.total += ticks;
+  section.histogram[ticks == 0 ? 0 : 31 - __builtin_clz(ticks)]++;
+}
+
+// Times from construction to the end of the enclosing block
+class ProfileScope {
+public:
+  explicit ProfileScope(ProfileSectionId id)
+    : id(id), start(profileTick(id)) {}
+
+  ~ProfileScope() {
+    profileAdd(id, profileTick(id) - start);
+  }
+
+private:
+  ProfileSectionId id;
+  uint32_t start;
+};
+
+void printProfile() {
+  for (int id = 0; id < PROFILE_SECTIONS; id++) {
+    const ProfileSection& section = profileSections[id];
+    if (section.count == 0) {
+      continue;
+    }
+    float ticksPerMicro = sectionTicksPerMicro(id);
+
+    char line[128];
+    snprintf(line, sizeof(line), "%-10s n %6lu  min %9.1f us  avg %9.1f us  max %9.1f us",
+             profileNames[id], (unsigned long)section.count,
+             section.min / ticksPerMicro,
+             section.total / section.count / ticksPerMicro,
+             section.max / ticksPerMicro);
+    Serial.println(line);
+
+    //Non empty buckets as "upper bound in us:count"
+    Serial.print("           ");
+    for (int bucket = 0; bucket < PROFILE_BUCKETS; bucket++) {
+      if (section.histogram[bucket] == 0) {
+        continue;
+      }
+      Serial.print(" <");
+      Serial.print((2.0 * (1UL << bucket)) / ticksPerMicro, 0);
+      Serial.print(":");
+      Serial.print(section.histogram[bucket]);
+    }
+    Serial.println();
+  }
+}
+
+// Add the profile to an upload as { name: { n, min, avg, max (us), ticksPerUs, hist: [...] } }
+void addProfileToJSON(JsonObject profile) {
+  for (int id = 0; id < PROFILE_SECTIONS; id++) {
+    const ProfileSection& section = profileSections[id];
+    if (section.count == 0) {
+      continue;
+    }
+    float ticksPerMicro = sectionTicksPerMicro(id);
+
+    JsonObject entry = profile.createNestedObject(profileNames[id]);
+    entry["n"] = section.count;
+    entry["min"] = section.min / ticksPerMicro;
+    entry["avg"] = section.total / section.count / ticksPerMicro;
+    entry["max"] = section.max / ticksPerMicro;
+    entry["ticksPerUs"] = ticksPerMicro;  // Of the histogram, cycles or us per section
+
+    //Histogram up to the highest used bucket, index n counts [2^n, 2^(n+1)) ticks
+    int last = PROFILE_BUCKETS - 1;
+    while (last > 0 && section.histogram[last] == 0) {
+      last--;
+    }
+    JsonArray histogram = entry.createNestedArray("hist");
+    for (int bucket = 0; bucket <= last; bucket++) {
+      histogram.add(section.histogram[bucket]);
+    }
+  }
+}
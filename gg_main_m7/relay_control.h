@@ -1,8 +1,4 @@
-void setRelay1 (int RELAY_PIN, float temperature1, float targetTemperature) {
-      // Relay 1
-    if (temperature1 <= targetTemperature) {
-        digitalWrite(RELAY_PIN, LOW);
-    } else {
-        digitalWrite(RELAY_PIN, HIGH);
-    }
-}
\ No newline at end of file
+// Switch a relay, the relays are active LOW
+void setRelay (int RELAY_PIN, bool on) {
+    digitalWrite(RELAY_PIN, on ? LOW : HIGH);
+}
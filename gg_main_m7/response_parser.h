@@ -0,0 +1,119 @@
+/*****************************************
+*   Server Response Parser
+      - Reads the status line and headers as they arrive (HttpClient keeps
+        only the Content-Length, nothing is stored)
+      - Streams the body straight into a filtered JSON parser, only the known
+        keys are kept:
+          "ack"     Sequence number of the upload the server stored
+          "config"  Configuration update pushed by the server
+          "encodings"  Content-Encodings the server accepts for the uploads,
+                       ["deflate"] turns the compression on (deflate.h)
+      - Unknown keys and anything after the JSON are discarded as they are read
+      - The parsed keys live in a document owned by the caller (Upload arena)
+*****************************************/
+
+#define RESPONSE_DOCUMENT_SIZE 1024  // Room for the kept keys only, the body itself is never stored
+#define RESPONSE_TIMEOUT 5000
+
+struct ServerResponse {
+  int statusCode;
+  long contentLength;  // -1 when the server did not send one
+
+  bool hasAck;
+  unsigned long ack;
+
+  JsonObjectConst config;  // Null when the response carried no config
+
+  bool hasEncodings;    // The server listed the encodings it accepts
+  bool acceptsDeflate;
+};
+
+
+// Keys kept from the body, every other key is skipped by the parser
+void buildResponseFilter(JsonDocument& filter) {
+  filter["ack"] = true;
+  filter["encodings"] = true;
+  addConfigFilter(filter.createNestedObject("config"));
+}
+
+// Read and drop what is left of the body, bounded by the Content-Length and the timeout
+void discardResponseBody(HttpClient& http) {
+  unsigned long start = millis();
+
+  while (!http.endOfBodyReached() && millis() - start < RESPONSE_TIMEOUT) {
+    if (http.read() < 0 && !http.connected()) {
+      break;
+    }
+  }
+}
+
+// Read the response to the request just sent, returns false if there was no valid status line
+//  - doc holds the kept keys, response.config points into it
+//  - A body that is not JSON is not an error, the response just has no ack or config
+bool readServerResponse(HttpClient& http, ServerResponse& response, JsonDocument& doc) {
+  response.statusCode = http.responseStatusCode();
+  response.contentLength = -1;
+  response.hasAck = false;
+  response.ack = 0;
+  response.config = JsonObjectConst();
+  response.hasEncodings = false;
+  response.acceptsDeflate = false;
+
+  if (response.statusCode <= 0) {
+    return false;
+  }
+
+  http.skipResponseHeaders();
+  response.contentLength = http.contentLength();
+
+  if (response.contentLength == 0) {
+    return true;
+  }
+
+  StaticJsonDocument<384> filter;  // 16 byte slot per key
+  buildResponseFilter(filter);
+
+  if (doc.capacity() == 0) {
+    discardResponseBody(http);
+    return true;
+  }
+
+  http.setTimeout(RESPONSE_TIMEOUT);
+  DeserializationError error = deserializeJson(doc, http, DeserializationOption::Filter(filter));
+  discardResponseBody(http);
+
+  if (error) {
+    Serial.print("Response not parsed: ");
+    Serial.println(error.c_str());
+    return true;
+  }
+
+  JsonVariantConst ack = doc["ack"];
+  if (ack.is<unsigned long>()) {
+    response.hasAck = true;
+    response.ack = ack.as<unsigned long>();
+  }
+  response.config = doc["config"].as<JsonObjectConst>();
+
+  JsonArrayConst encodings = doc["encodings"].as<JsonArrayConst>();
+  if (!encodings.isNull()) {
+    response.hasEncodings = true;
+    for (JsonVariantConst encoding : encodings) {
+      response.acceptsDeflate |= encoding == "deflate";
+    }
+  }
+
+  return true;
+}
+
+void logServerResponse(const ServerResponse& response) {
+  logEvent(LOG_HTTP_STATUS, response.statusCode, response.contentLength);
+  recordEvent(EVENT_HTTP, HTTP_RESPONSE, response.statusCode);
+
+  if (response.hasAck) {
+    logEvent(LOG_HTTP_ACK, response.ack);
+  }
+  if (!response.config.isNull()) {
+    logEvent(LOG_HTTP_CONFIG);
+  }
+}
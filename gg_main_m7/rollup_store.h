@@ -0,0 +1,305 @@
+/*****************************************
+*   Rollup Store
+      - Long local history at reduced resolution for every Sensor channel
+      - Raw samples live in the sample columns (sample_columns.h, short window,
+        wiped when full), one column per channel
+      - Every sample also updates an open 1 minute bucket, closed minutes cascade
+        into an open 1 hour bucket (Incremental, O(1) per sample)
+      - When the device was offline longer than the raw window, uploads send the
+        rollups for the missing period instead of dropping the data
+      - The rings are cold data and live in the SDRAM region (memory_regions.h)
+*****************************************/
+
+#ifndef ROLLUP_MINUTES
+#define ROLLUP_MINUTES 1440  // 24 hours of 1 minute buckets per channel
+#endif
+#ifndef ROLLUP_HOURS
+#define ROLLUP_HOURS 720     // 30 days of 1 hour buckets per channel
+#endif
+
+#define ROLLUP_UPLOAD_MINUTE_SPAN 600   // Max period of minute rollups per upload (10 minutes)
+#define ROLLUP_UPLOAD_HOUR_SPAN 43200   // Max period of hour rollups per upload (12 hours)
+#define ROLLUP_UPLOAD_MAX 96            // Max rollups per upload, the spans shrink with the channel count to stay under it
+
+enum RollupChannelId {
+  ROLLUP_DEVICE_TEMP,
+  ROLLUP_GROW_TEMP,
+  ROLLUP_HUMIDITY,
+  ROLLUP_WATER_TEMP,
+  ROLLUP_PH,
+  ROLLUP_TDS,
+  ROLLUP_ZONE_CHANNELS,  // Grow Temp and Humidity of zones 2 and up, in pairs (rollupZoneChannel())
+  ROLLUP_CHANNELS = ROLLUP_ZONE_CHANNELS + 2 * (GG_ZONES - 1)
+};
+
+struct RollupBucket {
+  unsigned long start;  // Unix time of the start of the period
+  float min;
+  float max;
+  float sum;
+  unsigned int count;
+};
+
+struct RollupChannel {
+  //Sensor Information sent with the rollups
+  const char* name;
+  const char* sensorName;
+  const char* sensorType;
+  const char* sensorLocation;  // NULL for the location of zone in the runtime config
+  int zone;
+  const char* dataType;
+
+  RollupBucket openMinute;
+  RollupBucket openHour;
+
+  //Rings of closed buckets, head is the next slot to write
+  RollupBucket* minutes;  // ROLLUP_MINUTES buckets
+  int minuteHead;
+  int minuteCount;
+  RollupBucket* hours;    // ROLLUP_HOURS buckets
+  int hourHead;
+  int hourCount;
+};
+
+RollupChannel rollupStore[ROLLUP_CHANNELS];
+
+//The channels the functions below work on, tools/load_gen.cpp points it at the store of each virtual device
+RollupChannel* rollupChannels = rollupStore;
+
+
+// Channel of a zone's Grow Temp or Humidity, zone 1 keeps the single zone ids
+RollupChannelId rollupZoneChannel(int zone, bool humidity) {
+  if (zone == 0) {
+    return humidity ? ROLLUP_HUMIDITY : ROLLUP_GROW_TEMP;
+  }
+  return (RollupChannelId)(ROLLUP_ZONE_CHANNELS + 2 * (zone - 1) + (humidity ? 1 : 0));
+}
+
+
+void initRollupChannel(RollupChannelId id, const char* name, const char* sensorName, const char* sensorType, const char* sensorLocation, const char* dataType, int zone = 0) {
+  RollupChannel& channel = rollupChannels[id];
+
+  channel.name = name;
+  channel.sensorName = sensorName;
+  channel.sensorType = sensorType;
+  channel.sensorLocation = sensorLocation;
+  channel.dataType = dataType;
+  channel.zone = zone;
+
+  channel.minutes = (RollupBucket*)coldAlloc(ROLLUP_MINUTES * sizeof(RollupBucket));
+  channel.hours = (RollupBucket*)coldAlloc(ROLLUP_HOURS * sizeof(RollupBucket));
+
+  channel.openMinute.count = 0;
+  channel.openHour.count = 0;
+  channel.minuteHead = 0;
+  channel.minuteCount = 0;
+  channel.hourHead = 0;
+  channel.hourCount = 0;
+}
+
+void startBucket(RollupBucket& bucket, unsigned long start) {
+  bucket.start = start;
+  bucket.min = 0;
+  bucket.max = 0;
+  bucket.sum = 0;
+  bucket.count = 0;
+}
+
+// Merge a sample or a finer bucket into a bucket
+void mergeIntoBucket(RollupBucket& bucket, float min, float max, float sum, unsigned int count) {
+  if (bucket.count == 0 || min < bucket.min) {
+    bucket.min = min;
+  }
+  if (bucket.count == 0 || max > bucket.max) {
+    bucket.max = max;
+  }
+  bucket.sum += sum;
+  bucket.count += count;
+}
+
+void pushHour(RollupChannel& channel) {
+  channel.hours[channel.hourHead] = channel.openHour;
+  channel.hourHead = (channel.hourHead + 1) % ROLLUP_HOURS;
+  if (channel.hourCount < ROLLUP_HOURS) {
+    channel.hourCount++;
+  }
+}
+
+// Close the open minute: store it and cascade it into the open hour
+void closeMinute(RollupChannel& channel) {
+  RollupBucket& minute = channel.openMinute;
+
+  channel.minutes[channel.minuteHead] = minute;
+  channel.minuteHead = (channel.minuteHead + 1) % ROLLUP_MINUTES;
+  if (channel.minuteCount < ROLLUP_MINUTES) {
+    channel.minuteCount++;
+  }
+
+  unsigned long hourStart = minute.start - minute.start % 3600;
+  if (channel.openHour.count > 0 && channel.openHour.start != hourStart) {
+    pushHour(channel);
+    channel.openHour.count = 0;
+  }
+  if (channel.openHour.count == 0) {
+    startBucket(channel.openHour, hourStart);
+  }
+  mergeIntoBucket(channel.openHour, minute.min, minute.max, minute.sum, minute.count);
+
+  minute.count = 0;
+}
+
+// Add one sample, timestamp is Unix time
+//  - Samples without a time are not kept, a value of 0 means no reading (Same as the JSON upload)
+void addRollupSample(RollupChannelId id, unsigned long timestamp, float value) {
+  RollupChannel& channel = rollupChannels[id];
+  if (timestamp == 0 || value == 0 || channel.minutes == NULL || channel.hours == NULL) {
+    return;
+  }
+
+  unsigned long minuteStart = timestamp - timestamp % 60;
+
+  if (channel.openMinute.count > 0 && channel.openMinute.start != minuteStart) {
+    closeMinute(channel);
+  }
+  if (channel.openMinute.count == 0) {
+    startBucket(channel.openMinute, minuteStart);
+  }
+  mergeIntoBucket(channel.openMinute, value, value, value, 1);
+}
+
+// Oldest closed minute kept by any channel, 0 if none were kept yet
+unsigned long oldestRollupMinute() {
+  unsigned long oldest = 0;
+
+  for (int id = 0; id < ROLLUP_CHANNELS; id++) {
+    RollupChannel& channel = rollupChannels[id];
+    if (channel.minuteCount == 0) {
+      continue;
+    }
+
+    int tail = (channel.minuteHead - channel.minuteCount + ROLLUP_MINUTES) % ROLLUP_MINUTES;
+    if (oldest == 0 || channel.minutes[tail].start < oldest) {
+      oldest = channel.minutes[tail].start;
+    }
+  }
+  return oldest;
+}
+
+// Oldest closed hour kept by any channel, 0 if none were kept yet
+unsigned long oldestRollupHour() {
+  unsigned long oldest = 0;
+
+  for (int id = 0; id < ROLLUP_CHANNELS; id++) {
+    RollupChannel& channel = rollupChannels[id];
+    if (channel.hourCount == 0) {
+      continue;
+    }
+
+    int tail = (channel.hourHead - channel.hourCount + ROLLUP_HOURS) % ROLLUP_HOURS;
+    if (oldest == 0 || channel.hours[tail].start < oldest) {
+      oldest = channel.hours[tail].start;
+    }
+  }
+  return oldest;
+}
+
+// Start of the newest hour still open on any channel, 0 if none
+unsigned long latestOpenHour() {
+  unsigned long latest = 0;
+
+  for (int id = 0; id < ROLLUP_CHANNELS; id++) {
+    if (rollupChannels[id].openHour.count > 0 && rollupChannels[id].openHour.start > latest) {
+      latest = rollupChannels[id].openHour.start;
+    }
+  }
+  return latest;
+}
+
+// Location sent with the channel's rollups and raw samples
+const char* rollupChannelLocation(const RollupChannel& channel) {
+  return channel.sensorLocation != NULL ? channel.sensorLocation : runtimeConfig().zoneLocations[channel.zone];
+}
+
+// Add one bucket, false if the document is full (The caller then fails the whole upload)
+bool addRollupToJSON(JsonArray& Rollups, const RollupChannel& channel, const RollupBucket& bucket, unsigned long period) {
+  JsonObject rollup = Rollups.createNestedObject();
+  if (rollup.isNull()) {
+    return false;
+  }
+
+  rollup["Name"] = channel.name;
+  rollup["Sensor"] = channel.sensorName;
+  rollup["Type"] = channel.sensorType;
+  rollup["Field"] = channel.dataType;
+  rollup["Location"] = rollupChannelLocation(channel);
+  rollup["Start"] = bucket.start;
+  rollup["Period"] = period;
+  rollup["Min"] = bucket.min;
+  rollup["Max"] = bucket.max;
+  rollup["Mean"] = bucket.sum / bucket.count;
+  return rollup["Count"].set(bucket.count);  // Members are allocated in order, the last one fails first
+}
+
+// Add every closed bucket of one ring that lies fully inside [from, to), false if the document is full
+bool addBucketsToJSON(JsonArray& Rollups, const RollupChannel& channel, const RollupBucket* buckets, int head, int count, int size, unsigned long period, unsigned long from, unsigned long to) {
+  for (int i = 0; i < count; i++) {
+    const RollupBucket& bucket = buckets[(head - count + i + size) % size];
+    if (bucket.start >= from && bucket.start + period <= to && !addRollupToJSON(Rollups, channel, bucket, period)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Longest span of buckets of period that keeps an upload within ROLLUP_UPLOAD_MAX rollups, at most limit
+unsigned long rollupUploadSpan(unsigned long period, unsigned long limit) {
+  unsigned long buckets = ROLLUP_UPLOAD_MAX / ROLLUP_CHANNELS;
+  return min(limit, max(buckets, 1UL) * period);
+}
+
+// Add the rollups for the period [from, to) that the raw samples no longer cover
+//  - Hour buckets are used where the minute buckets have already been overwritten
+//  - At most one span per upload, returns the end of the period covered so the
+//    next upload can continue from there (from when the document was full)
+unsigned long addRollupsToJSON(JsonArray& Rollups, unsigned long from, unsigned long to) {
+  if (from == 0 || to <= from) {
+    return max(from, to);
+  }
+
+  //Nothing older than the oldest hour bucket is left to send
+  unsigned long oldestHour = oldestRollupHour();
+  if (oldestHour > from) {
+    from = oldestHour;
+  }
+
+  //Minutes older than this were overwritten, only the hour buckets cover them
+  unsigned long minuteStart = oldestRollupMinute();
+  if (minuteStart == 0) {
+    minuteStart = to;
+  }
+
+  //Send the whole hour the minutes start in as an hour bucket if it is closed
+  unsigned long hourBoundary = minuteStart + (3600 - minuteStart % 3600) % 3600;
+  unsigned long hourEnd = minuteStart;
+  if (hourBoundary <= latestOpenHour()) {
+    hourEnd = hourBoundary;
+  }
+
+  unsigned long end;
+  bool fit = true;
+  if (from < hourEnd) {
+    end = min(min(to, hourEnd), from + rollupUploadSpan(3600, ROLLUP_UPLOAD_HOUR_SPAN));
+    for (int id = 0; id < ROLLUP_CHANNELS && fit; id++) {
+      RollupChannel& channel = rollupChannels[id];
+      fit = addBucketsToJSON(Rollups, channel, channel.hours, channel.hourHead, channel.hourCount, ROLLUP_HOURS, 3600, from, end);
+    }
+  } else {
+    end = min(to, from + rollupUploadSpan(60, ROLLUP_UPLOAD_MINUTE_SPAN));
+    for (int id = 0; id < ROLLUP_CHANNELS && fit; id++) {
+      RollupChannel& channel = rollupChannels[id];
+      fit = addBucketsToJSON(Rollups, channel, channel.minutes, channel.minuteHead, channel.minuteCount, ROLLUP_MINUTES, 60, from, end);
+    }
+  }
+
+  return fit ? end : from;
+}
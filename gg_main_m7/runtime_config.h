@@ -0,0 +1,262 @@
+/*****************************************
+*   Runtime Configuration
+      - Settings the server can change without a reflash (Sent in the "config"
+        object of the /sensors/sendData response)
+      - Two copies, updates are built in the inactive copy and made live by
+        flipping the index, readers always see a whole config
+      - Persisted in the flash KVStore on the GIGA, loaded at boot
+      - Versioned, fields are only ever added at the end of the struct so an
+        older stored config is migrated by keeping its prefix
+      - targetTemperature and location are those of zone 1, kept equal to
+        zoneTargets[0] and zoneLocations[0] (zones.h)
+*****************************************/
+
+#if defined(ARDUINO_GIGA)
+#include <kvstore_global_api.h>
+#define CONFIG_KEY "/kv/gg_config"
+#endif
+
+#define CONFIG_VERSION 3
+
+//Compile time defaults, used until the server sends a config
+#define DEFAULT_DEVICE_ID "GG-001"
+#define DEFAULT_SAMPLE_INTERVAL 30000
+#define DEFAULT_SEND_DATA_INTERVAL 30000
+#define DEFAULT_PING_INTERVAL 60000
+#define DEFAULT_TARGET_TEMPERATURE 20
+#define DEFAULT_LOCATION "Greenhouse 1"
+#define DEFAULT_ZONE_LOCATION "Greenhouse %d"  // Zones 2 and up
+#define DEFAULT_MAX_DATA_AGE 600000
+
+struct RuntimeConfig {
+  //Header, keep first
+  uint32_t version;   // Layout version (CONFIG_VERSION)
+  uint32_t size;      // sizeof(RuntimeConfig) when it was stored
+  uint32_t revision;  // Server revision, updates with a lower or equal revision are ignored
+
+  //Version 1
+  char deviceId[16];
+  uint32_t sampleInterval;    // ms between sensor readings
+  uint32_t sendDataInterval;  // ms between uploads
+  uint32_t pingInterval;      // ms between pings
+  float targetTemperature;    // Heater target
+  char location[24];          // Location sent with the Grow Area sensors (Zone 1) and the tank sensors
+
+  //Version 2
+  uint32_t maxDataAge;  // ms a reading may wait for its upload when the link is bad (upload_policy.h)
+
+  //Version 3
+  float zoneTargets[ZONE_MAX];                   // Heater target per zone
+  char zoneLocations[ZONE_MAX][ZONE_NAME_SIZE];  // Location sent with each zone's Grow Area sensors
+};
+
+RuntimeConfig runtimeConfigs[2];
+volatile int activeConfig = 0;
+
+//Zones whose target temperature the last applied update carried (Bit per zone), the
+//other zones keep a target set on the encoder
+uint8_t pushedZoneTargets = 0;
+
+
+// The live config, do not keep the reference across an update
+const RuntimeConfig& runtimeConfig() {
+  return runtimeConfigs[activeConfig];
+}
+
+// Zone 1 from the version 1 fields, the other zones numbered after it
+void defaultZones(RuntimeConfig& config) {
+  for (int zone = 0; zone < ZONE_MAX; zone++) {
+    config.zoneTargets[zone] = config.targetTemperature;
+    snprintf(config.zoneLocations[zone], ZONE_NAME_SIZE, DEFAULT_ZONE_LOCATION, zone + 1);
+  }
+  strlcpy(config.zoneLocations[0], config.location, ZONE_NAME_SIZE);
+}
+
+void defaultConfig(RuntimeConfig& config) {
+  memset(&config, 0, sizeof(config));
+  config.version = CONFIG_VERSION;
+  config.size = sizeof(RuntimeConfig);
+  config.revision = 0;
+
+  strlcpy(config.deviceId, DEFAULT_DEVICE_ID, sizeof(config.deviceId));
+  config.sampleInterval = DEFAULT_SAMPLE_INTERVAL;
+  config.sendDataInterval = DEFAULT_SEND_DATA_INTERVAL;
+  config.pingInterval = DEFAULT_PING_INTERVAL;
+  config.targetTemperature = DEFAULT_TARGET_TEMPERATURE;
+  strlcpy(config.location, DEFAULT_LOCATION, sizeof(config.location));
+  config.maxDataAge = DEFAULT_MAX_DATA_AGE;
+  defaultZones(config);
+}
+
+bool validZones(const RuntimeConfig& config) {
+  for (int zone = 0; zone < ZONE_MAX; zone++) {
+    if (config.zoneLocations[zone][0] == '\0' || config.zoneTargets[zone] < 0 || config.zoneTargets[zone] > 40) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Reject values that would stall the device or flood the server
+bool validConfig(const RuntimeConfig& config) {
+  return config.deviceId[0] != '\0'
+         && config.location[0] != '\0'
+         && config.sampleInterval >= 1000 && config.sampleInterval <= 3600000
+         && config.sendDataInterval >= 5000 && config.sendDataInterval <= 3600000
+         && config.pingInterval >= 5000 && config.pingInterval <= 3600000
+         && config.targetTemperature >= 0 && config.targetTemperature <= 40
+         && config.maxDataAge >= 60000 && config.maxDataAge <= 86400000
+         && validZones(config);
+}
+
+// Bring a stored config of any older layout up to the current one
+//  - Fields missing from the stored copy keep their defaults
+//  - Returns false for a config written by newer firmware or a corrupt one
+bool migrateConfig(const uint8_t* stored, size_t storedSize, RuntimeConfig& config) {
+  defaultConfig(config);
+
+  if (storedSize < 3 * sizeof(uint32_t)) {
+    return false;
+  }
+
+  uint32_t version, size;
+  memcpy(&version, stored, sizeof(version));
+  memcpy(&size, stored + sizeof(uint32_t), sizeof(size));
+  if (version == 0 || version > CONFIG_VERSION || size != storedSize) {
+    return false;
+  }
+
+  memcpy(&config, stored, min(storedSize, sizeof(RuntimeConfig)));
+  config.version = CONFIG_VERSION;
+  config.size = sizeof(RuntimeConfig);
+
+  //Strings from a corrupt copy must still be terminated
+  config.deviceId[sizeof(config.deviceId) - 1] = '\0';
+  config.location[sizeof(config.location) - 1] = '\0';
+  for (int zone = 0; zone < ZONE_MAX; zone++) {
+    config.zoneLocations[zone][ZONE_NAME_SIZE - 1] = '\0';
+  }
+
+  //Before version 3 the single zone was set by targetTemperature and location
+  if (version < 3) {
+    defaultZones(config);
+  }
+
+  if (!validConfig(config)) {
+    defaultConfig(config);
+    return false;
+  }
+  return true;
+}
+
+void saveConfig(const RuntimeConfig& config) {
+#if defined(ARDUINO_GIGA)
+  int result = kv_set(CONFIG_KEY, &config, sizeof(config), 0);
+  if (result != MBED_SUCCESS) {
+    Serial.print("Config not saved: ");
+    Serial.println(result);
+  }
+#else
+  (void)config;  // Nowhere to keep it off the board
+#endif
+}
+
+// Load the stored config (Or the defaults) into the live copy, call once at boot
+void initRuntimeConfig() {
+  RuntimeConfig& config = runtimeConfigs[activeConfig];
+  defaultConfig(config);
+
+#if defined(ARDUINO_GIGA)
+  uint8_t stored[2 * sizeof(RuntimeConfig)];  // Room for a larger layout, rejected by migrateConfig()
+  size_t storedSize = 0;
+  if (kv_get(CONFIG_KEY, stored, sizeof(stored), &storedSize) == MBED_SUCCESS) {
+    if (!migrateConfig(stored, storedSize, config)) {
+      Serial.println("Stored config ignored, using the defaults");
+    }
+  }
+#endif
+
+  Serial.print("Config revision ");
+  Serial.println(config.revision);
+}
+
+// Add the known config keys to the response filter, anything else the server sends is dropped
+void addConfigFilter(JsonObject filter) {
+  filter["revision"] = true;
+  filter["deviceId"] = true;
+  filter["sampleInterval"] = true;
+  filter["sendDataInterval"] = true;
+  filter["pingInterval"] = true;
+  filter["targetTemperature"] = true;
+  filter["location"] = true;
+  filter["maxDataAge"] = true;
+  filter["zones"][0]["targetTemperature"] = true;  // The first element filters every zone
+  filter["zones"][0]["location"] = true;
+}
+
+// Build the new config from the live one plus the keys in the update, then swap it in
+//  - "targetTemperature" and "location" set zone 1, "zones" sets each zone by position
+//  - Returns true if the live config changed, the caller then applies it to the tasks
+//  - pushedZoneTargets tells the caller which zone targets the update carried
+bool updateConfig(JsonObjectConst update) {
+  const RuntimeConfig& current = runtimeConfig();
+
+  uint32_t revision = update["revision"] | 0UL;
+  if (revision <= current.revision) {
+    return false;
+  }
+
+  int next = 1 - activeConfig;
+  RuntimeConfig& config = runtimeConfigs[next];
+  config = current;
+  config.revision = revision;
+
+  const char* deviceId = update["deviceId"];
+  if (deviceId != NULL) {
+    strlcpy(config.deviceId, deviceId, sizeof(config.deviceId));
+  }
+  const char* location = update["location"];
+  if (location != NULL) {
+    strlcpy(config.location, location, sizeof(config.location));
+  }
+  config.sampleInterval = update["sampleInterval"] | config.sampleInterval;
+  config.sendDataInterval = update["sendDataInterval"] | config.sendDataInterval;
+  config.pingInterval = update["pingInterval"] | config.pingInterval;
+  config.targetTemperature = update["targetTemperature"] | config.targetTemperature;
+  config.maxDataAge = update["maxDataAge"] | config.maxDataAge;
+
+  uint8_t pushedTargets = update["targetTemperature"].isNull() ? 0 : 1;
+
+  config.zoneTargets[0] = config.targetTemperature;
+  strlcpy(config.zoneLocations[0], config.location, ZONE_NAME_SIZE);
+  JsonArrayConst zoneUpdates = update["zones"];
+  for (int zone = 0; zone < ZONE_MAX && zone < (int)zoneUpdates.size(); zone++) {
+    JsonObjectConst zoneUpdate = zoneUpdates[zone];
+    if (!zoneUpdate["targetTemperature"].isNull()) {
+      pushedTargets |= 1 << zone;
+    }
+    config.zoneTargets[zone] = zoneUpdate["targetTemperature"] | config.zoneTargets[zone];
+    const char* zoneLocation = zoneUpdate["location"];
+    if (zoneLocation != NULL) {
+      strlcpy(config.zoneLocations[zone], zoneLocation, ZONE_NAME_SIZE);
+    }
+  }
+  config.targetTemperature = config.zoneTargets[0];
+  strlcpy(config.location, config.zoneLocations[0], sizeof(config.location));
+
+  if (!validConfig(config)) {
+    Serial.print("Config revision ");
+    Serial.print(revision);
+    Serial.println(" rejected");
+    return false;
+  }
+
+  activeConfig = next;
+  pushedZoneTargets = pushedTargets;
+  saveConfig(config);
+
+  Serial.print("Config revision ");
+  Serial.print(revision);
+  Serial.println(" applied");
+  return true;
+}
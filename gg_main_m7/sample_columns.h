@@ -0,0 +1,115 @@
+/*****************************************
+*   Sample Columns
+      - Raw samples waiting for their upload, one column per Sensor channel:
+        a timestamp array and a value array per channel, in the order of
+        RollupChannelId (rollup_store.h), which also holds the names, type
+        and location of each channel
+      - Row n is the n-th sample of every channel since the last upload
+        (One sensing pass). A bit per row tells whether any channel has a
+        reading there, so the upload skips empty rows without touching them
+      - A value of 0 is a failed reading: it keeps its row but is not sent
+      - Short window, wiped after a successful upload (Only the rows it carried)
+        or when a column is full
+      - Needs GG_ZONES from zones.h. tools/sample_columns_bench.cpp times it
+        against the old array of sensorData structs
+*****************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+#define SAMPLE_ROWS 100
+#define SAMPLE_CHANNELS (6 + 2 * (GG_ZONES - 1))  // ROLLUP_CHANNELS
+#define SAMPLE_ROW_WORDS ((SAMPLE_ROWS + 31) / 32)
+
+struct SampleColumns {
+  uint32_t time[SAMPLE_CHANNELS][SAMPLE_ROWS];  // Unix time
+  float value[SAMPLE_CHANNELS][SAMPLE_ROWS];
+  uint16_t count[SAMPLE_CHANNELS];              // Rows written per channel
+  uint32_t present[SAMPLE_ROW_WORDS];           // Bit per row, set when a channel has a reading (Not 0) in it
+};
+
+
+void clearSampleColumns(SampleColumns& columns) {
+  memset(columns.count, 0, sizeof(columns.count));
+  memset(columns.present, 0, sizeof(columns.present));
+}
+
+// Drop the rows before row (Sent by an upload that did not carry them all), later rows move to the front
+void dropSampleRows(SampleColumns& columns, int row) {
+  memset(columns.present, 0, sizeof(columns.present));
+
+  for (int channel = 0; channel < SAMPLE_CHANNELS; channel++) {
+    int count = columns.count[channel];
+    int keep = count > row ? count - row : 0;
+    memmove(columns.time[channel], columns.time[channel] + count - keep, keep * sizeof(uint32_t));
+    memmove(columns.value[channel], columns.value[channel] + count - keep, keep * sizeof(float));
+    columns.count[channel] = keep;
+
+    for (int kept = 0; kept < keep; kept++) {
+      if (columns.value[channel][kept] != 0) {
+        columns.present[kept / 32] |= 1UL << (kept % 32);
+      }
+    }
+  }
+}
+
+// Append a sample to the channel's column, false if the column is full
+bool addSample(SampleColumns& columns, int channel, uint32_t time, float value) {
+  int row = columns.count[channel];
+  if (row >= SAMPLE_ROWS) {
+    return false;
+  }
+
+  columns.time[channel][row] = time;
+  columns.value[channel][row] = value;
+  columns.count[channel] = row + 1;
+  if (value != 0) {
+    columns.present[row / 32] |= 1UL << (row % 32);
+  }
+  return true;
+}
+
+// The reading of channel in row, 0 if it has none
+inline float sampleValue(const SampleColumns& columns, int channel, int row) {
+  return row < columns.count[channel] ? columns.value[channel][row] : 0;
+}
+
+// First row at or after row with a reading in it, -1 if there is none
+int nextSampleRow(const SampleColumns& columns, int row) {
+  for (int word = row / 32; word < SAMPLE_ROW_WORDS; word++) {
+    uint32_t bits = columns.present[word];
+    if (word == row / 32) {
+      bits &= ~0UL << (row % 32);
+    }
+    if (bits != 0) {
+      return word * 32 + __builtin_ctz(bits);
+    }
+  }
+  return -1;
+}
+
+// Rows written, the longest column
+int sampleRowCount(const SampleColumns& columns) {
+  int rows = 0;
+  for (int channel = 0; channel < SAMPLE_CHANNELS; channel++) {
+    rows = columns.count[channel] > rows ? columns.count[channel] : rows;
+  }
+  return rows;
+}
+
+// Oldest and newest timestamp of the samples held (0 if empty)
+//  - No branch per sample, 0 (Clock not set) wraps to the largest time and never wins the minimum
+void sampleTimeRange(const SampleColumns& columns, uint32_t& oldest, uint32_t& newest) {
+  uint32_t low = 0xFFFFFFFF;
+  uint32_t high = 0;
+  for (int channel = 0; channel < SAMPLE_CHANNELS; channel++) {
+    const uint32_t* times = columns.time[channel];
+    for (int row = 0; row < columns.count[channel]; row++) {
+      uint32_t time = times[row];
+      low = time - 1 < low ? time - 1 : low;
+      high = time > high ? time : high;
+    }
+  }
+  oldest = low == 0xFFFFFFFF ? 0 : low + 1;
+  newest = high;
+}
@@ -0,0 +1,238 @@
+/*****************************************
+*   Cooperative Task Scheduler
+      - Periodic Tasks ordered by deadline in a min-heap
+      - Event Queue so Interrupts can run a Task before its deadline
+      - Sleeps (power_management.h) until the next deadline or interrupt
+      - Per Task run time and lateness statistics
+      - Task start / stop go to the event trace (event_trace.h), except for
+        the Tasks marked untraced
+*****************************************/
+
+#define MAX_TASKS 16
+#define TASK_EVENT_QUEUE_SIZE 16  // Must be a power of 2
+
+typedef void (*TaskFunction)();
+
+struct Task {
+  const char* name;
+  TaskFunction run;
+  unsigned long interval;  // Period in ms
+  unsigned long nextRun;   // Next deadline in ms (millis() time base)
+  bool traced;             // Start / stop go to the event trace
+
+  //Statistics
+  unsigned long runs;
+  uint64_t totalRunMicros;
+  unsigned long maxRunMicros;
+  uint64_t totalLateMillis;
+  unsigned long maxLateMillis;
+};
+
+Task tasks[MAX_TASKS];
+int taskCount = 0;
+
+//Min-heap of task ids ordered by nextRun
+int taskHeap[MAX_TASKS];
+int taskHeapSize = 0;
+
+//Events posted from interrupts and tasks, each event is the id of the task to run
+volatile uint8_t taskEvents[TASK_EVENT_QUEUE_SIZE];
+volatile unsigned int taskEventHead = 0;
+volatile unsigned int taskEventTail = 0;
+
+void recordTaskEvent(int id, bool start);  // event_trace.h
+
+
+// Deadline comparison that survives the millis() rollover
+bool taskBefore(int a, int b) {
+  return (long)(tasks[a].nextRun - tasks[b].nextRun) < 0;
+}
+
+void swapHeap(int i, int j) {
+  int temp = taskHeap[i];
+  taskHeap[i] = taskHeap[j];
+  taskHeap[j] = temp;
+}
+
+void pushTaskHeap(int id) {
+  int i = taskHeapSize++;
+  taskHeap[i] = id;
+
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (!taskBefore(taskHeap[i], taskHeap[parent])) {
+      break;
+    }
+    swapHeap(i, parent);
+    i = parent;
+  }
+}
+
+int popTaskHeap() {
+  int top = taskHeap[0];
+  taskHeap[0] = taskHeap[--taskHeapSize];
+
+  int i = 0;
+  while (true) {
+    int left = 2 * i + 1;
+    int right = left + 1;
+    int smallest = i;
+
+    if (left < taskHeapSize && taskBefore(taskHeap[left], taskHeap[smallest])) {
+      smallest = left;
+    }
+    if (right < taskHeapSize && taskBefore(taskHeap[right], taskHeap[smallest])) {
+      smallest = right;
+    }
+    if (smallest == i) {
+      break;
+    }
+    swapHeap(i, smallest);
+    i = smallest;
+  }
+
+  return top;
+}
+
+// Register a periodic task, first run is after firstDelay ms. Returns the task id (or -1 if full)
+int addTask(const char* name, TaskFunction run, unsigned long interval, unsigned long firstDelay) {
+  if (taskCount >= MAX_TASKS) {
+    return -1;
+  }
+
+  int id = taskCount++;
+  tasks[id].name = name;
+  tasks[id].run = run;
+  tasks[id].interval = interval;
+  tasks[id].nextRun = millis() + firstDelay;
+  tasks[id].traced = true;
+  tasks[id].runs = 0;
+  tasks[id].totalRunMicros = 0;
+  tasks[id].maxRunMicros = 0;
+  tasks[id].totalLateMillis = 0;
+  tasks[id].maxLateMillis = 0;
+
+  pushTaskHeap(id);
+  return id;
+}
+
+// Ask the scheduler to run a task as soon as possible
+//  - Called from interrupts and from tasks, so the slot is reserved and published
+//    inside a critical section (An interrupt between the two would reuse the slot)
+void postTaskEvent(int id) {
+  if (id < 0) {
+    return;
+  }
+
+  core_util_critical_section_enter();
+  unsigned int next = (taskEventHead + 1) & (TASK_EVENT_QUEUE_SIZE - 1);
+  if (next == taskEventTail) {
+    core_util_critical_section_exit();
+    return;
+  }
+
+  taskEvents[taskEventHead] = id;
+  taskEventHead = next;
+  core_util_critical_section_exit();
+
+  wakeFromIdle();
+}
+
+// Change a task's period, takes effect from its next run
+void setTaskInterval(int id, unsigned long interval) {
+  if (id >= 0 && id < taskCount) {
+    tasks[id].interval = interval;
+  }
+}
+
+// Keep a task out of the event trace (High rate tasks would push everything else out of the ring)
+void setTaskTraced(int id, bool traced) {
+  if (id >= 0 && id < taskCount) {
+    tasks[id].traced = traced;
+  }
+}
+
+void runTask(int id, unsigned long lateMillis) {
+  if (tasks[id].traced) {
+    recordTaskEvent(id, true);
+  }
+  unsigned long start = micros();
+  tasks[id].run();
+  unsigned long runMicros = micros() - start;
+  if (tasks[id].traced) {
+    recordTaskEvent(id, false);
+  }
+
+  tasks[id].runs++;
+  tasks[id].totalRunMicros += runMicros;
+  tasks[id].totalLateMillis += lateMillis;
+
+  if (runMicros > tasks[id].maxRunMicros) {
+    tasks[id].maxRunMicros = runMicros;
+  }
+  if (lateMillis > tasks[id].maxLateMillis) {
+    tasks[id].maxLateMillis = lateMillis;
+  }
+}
+
+// Milliseconds until the earliest deadline (0 if a task is already due)
+unsigned long timeUntilNextTask() {
+  if (taskHeapSize == 0) {
+    return 1000;
+  }
+
+  long remaining = (long)(tasks[taskHeap[0]].nextRun - millis());
+  return remaining > 0 ? remaining : 0;
+}
+
+// Sleep until the next deadline, an interrupt posting an event wakes us early
+void schedulerIdle() {
+  idleFor(timeUntilNextTask());
+}
+
+// Run any posted events, then every task that is due, then sleep until the next deadline
+void runScheduler() {
+
+  // Events first, they come from user input and should feel immediate
+  while (taskEventTail != taskEventHead) {
+    int id = taskEvents[taskEventTail];
+    taskEventTail = (taskEventTail + 1) & (TASK_EVENT_QUEUE_SIZE - 1);
+    runTask(id, 0);
+  }
+
+  // Run every due task in deadline order
+  while (taskHeapSize > 0 && timeUntilNextTask() == 0) {
+    int id = popTaskHeap();
+    unsigned long now = millis();
+    unsigned long late = now - tasks[id].nextRun;
+
+    runTask(id, late);
+
+    // Keep the original cadence, but skip missed periods instead of running them back to back
+    tasks[id].nextRun += tasks[id].interval;
+    if ((long)(tasks[id].nextRun - millis()) < 0) {
+      tasks[id].nextRun = millis() + tasks[id].interval;
+    }
+    pushTaskHeap(id);
+  }
+
+  // Nothing left to do, sleep until the next deadline or an interrupt posts an event
+  while (taskEventTail == taskEventHead && timeUntilNextTask() > 0) {
+    schedulerIdle();
+  }
+}
+
+// Print the per task statistics to the Serial Monitor
+void printTaskStats() {
+  Serial.println("Task            Runs   Avg(us)   Max(us)  AvgLate(ms)  MaxLate(ms)");
+
+  for (int i = 0; i < taskCount; i++) {
+    unsigned long runs = tasks[i].runs > 0 ? tasks[i].runs : 1;
+    char line[96];
+    snprintf(line, sizeof(line), "%-12s %7lu %9lu %9lu %12lu %12lu",
+             tasks[i].name, tasks[i].runs,
+             (unsigned long)(tasks[i].totalRunMicros / runs), tasks[i].maxRunMicros,
+             (unsigned long)(tasks[i].totalLateMillis / runs), tasks[i].maxLateMillis);
+    Serial.println(line);
+  }
+}
@@ -0,0 +1,197 @@
+/*****************************************
+*   Sensing
+      - The readings of a sensing pass: the DHT of every zone, the NTC
+        (Device temperature), the DS18B20 (Water temperature), pH and TDS
+      - Each input goes through the trace (sensor_trace.h), then a reading
+        feeds the trends, the anomaly detector, the rollups and the sample
+        columns the next upload is built from (upload_body.h)
+      - The hardware reads, the sensor faults and the anomaly handling are
+        the sketch's, declared below. tools/trace_replay.cpp runs these same
+        functions on the host with its own
+*****************************************/
+
+//Hardware reads, gg_main_m7.ino
+float readZoneTemperature(int zone);  // NAN when the DHT did not answer
+float readZoneHumidity(int zone);
+int32_t readNtcAdc();
+float readWaterTemperature();  // NAN when the DS18B20 did not answer
+int32_t readPhAdc();
+
+void sensorFault(SensorFaultId id);                    // gg_main_m7.ino
+void checkAnomaly(AnomalyChannelId id, float value);  // gg_main_m7.ino
+
+//Unix time of the current sensing pass, every reading of the pass is stamped with it
+unsigned long sampleTime = 0;
+
+//Temperature Variables (The Grow Area readings are per zone)
+float ambientTemp;
+float waterTemp;
+float phValue;
+float tdsValue = 0;  // Kept up to date by getTDSReading() of the sketch
+
+//Readings, heater relays and target temperatures of the zones (zones.h)
+ZoneTable zones;
+
+//Raw samples waiting for the next upload, one column per rollup channel (sample_columns.h)
+SampleColumns sampleColumns;
+static_assert(SAMPLE_CHANNELS == ROLLUP_CHANNELS, "One sample column per rollup channel");
+
+
+// Drop every raw sample (A column is full, or a benchmark or replay starts over)
+void resetSensorArray() {
+  clearSampleColumns(sampleColumns);
+}
+
+// Sensor fault id of the DHT of zone
+SensorFaultId zoneDhtFault(int zone) {
+  return zone == 0 ? FAULT_DHT : (SensorFaultId)(FAULT_ZONE_DHT + zone - 1);
+}
+
+//Read the Temperature and Humidity of every zone
+int readingZone = 0;  // Zone being read, the trace lambdas cannot capture
+
+void readDHT() {
+  ProfileScope profile(PROFILE_DHT);
+  bool anyRead = false;
+
+  for (readingZone = 0; readingZone < zones.count; readingZone++) {
+    int zone = readingZone;
+
+    float dhtTemperature = tracedFloat(traceZoneSource(zone, false), [] { return readZoneTemperature(readingZone); });
+    if (isnan(dhtTemperature)) {
+      sensorFault(zoneDhtFault(zone));
+      zones.temperature[zone] = 0;
+      zones.humidity[zone] = 0;
+      zones.valid[zone] = false;
+      continue;
+    }
+
+    zones.temperature[zone] = dhtTemperature;
+    zones.valid[zone] = true;
+    zones.humidity[zone] = tracedFloat(traceZoneSource(zone, true), [] { return readZoneHumidity(readingZone); });
+    anyRead = true;
+
+    addRollupSample(rollupZoneChannel(zone, false), sampleTime, zones.temperature[zone]);
+    addRollupSample(rollupZoneChannel(zone, true), sampleTime, zones.humidity[zone]);
+  }
+
+  if (!anyRead) {
+    return;
+  }
+
+  //The trends and the anomaly detector follow Zone 1
+  if (zones.valid[0]) {
+    addTrendSample(growTempTrend, zones.temperature[0]);
+    addTrendSample(humidityTrend, zones.humidity[0]);
+    checkAnomaly(ANOMALY_GROW_TEMP, zones.temperature[0]);
+    checkAnomaly(ANOMALY_HUMIDITY, zones.humidity[0]);
+  }
+
+  //Every zone gets the row, 0 for a failed reading (Not sent)
+  for (int zone = 0; zone < zones.count; zone++) {
+    if (!addSample(sampleColumns, rollupZoneChannel(zone, false), sampleTime, zones.temperature[zone])
+        || !addSample(sampleColumns, rollupZoneChannel(zone, true), sampleTime, zones.humidity[zone])) {
+      resetSensorArray();
+      return;
+    }
+  }
+}
+
+//Read the Device Temperature
+
+void readAmbientTemp() {
+
+  int ntcReading = tracedInt(TRACE_NTC_ADC, readNtcAdc);
+  if (!ntcReading) {
+    sensorFault(FAULT_NTC);
+    ambientTemp = 0;
+    return;
+  }
+
+//Read the Analog Signal and convert it to Readable Temperate
+  ambientTemp = ntcTemperature(ntcReading);
+
+  addTrendSample(ambientTempTrend, ambientTemp);
+  checkAnomaly(ANOMALY_AMBIENT_TEMP, ambientTemp);
+  addRollupSample(ROLLUP_DEVICE_TEMP, sampleTime, ambientTemp);
+
+  if (!addSample(sampleColumns, ROLLUP_DEVICE_TEMP, sampleTime, ambientTemp)) {
+    resetSensorArray();
+  }
+}
+
+//Read the water Temperature
+
+void readWaterTemps() {
+  //Read the Sensor
+  float data = tracedFloat(TRACE_WATER_TEMP, readWaterTemperature);
+
+  if (isnan(data)) {
+    sensorFault(FAULT_WATER_TEMP);
+    waterTemp = 0;
+    return;
+  }
+  waterTemp = data;
+
+  addTrendSample(waterTempTrend, waterTemp);
+  checkAnomaly(ANOMALY_WATER_TEMP, waterTemp);
+  addRollupSample(ROLLUP_WATER_TEMP, sampleTime, waterTemp);
+
+  if (!addSample(sampleColumns, ROLLUP_WATER_TEMP, sampleTime, waterTemp)) {
+    resetSensorArray();
+  }
+}
+
+//Read the PH Sensor
+
+void readPH() {
+
+  //Default to PH 0 If sensor is not connected - Values of 0 are excluded from JSON Document
+  int phReading = tracedInt(TRACE_PH_ADC, readPhAdc);
+  if (!phReading) {
+    recordEvent(EVENT_SENSOR_FAULT, FAULT_PH);  // No alarm, the pH probe is often left unplugged
+    phValue = 0;
+    return;
+  }
+
+  //Read The Sensor
+  phValue = phFromAnalog(phReading);  // Convert the analog value to pH
+
+  //Temporry disable for PH Sensor Recordings
+  phValue = 0;
+
+  addRollupSample(ROLLUP_PH, sampleTime, phValue);
+
+  if (!addSample(sampleColumns, ROLLUP_PH, sampleTime, phValue)) {
+    resetSensorArray();
+  }
+}
+
+
+//Read the TDS
+
+void readTDS() {
+
+  // Sampled by tdsTask, the value this pass uses is the one traced (Always the last input of a pass)
+  tdsValue = tracedFloat(TRACE_TDS, [] { return tdsValue; });
+
+  // If there is no reading Do nothing (If no sensor, or when initializing ignore data)
+  if (tdsValue == 0) { return; }
+
+  addTrendSample(tdsTrend, tdsValue);
+  checkAnomaly(ANOMALY_TDS, tdsValue);
+  addRollupSample(ROLLUP_TDS, sampleTime, tdsValue);
+
+  if (!addSample(sampleColumns, ROLLUP_TDS, sampleTime, tdsValue)) {
+    resetSensorArray();
+  }
+}
+
+// Every reading of a sensing pass, in the order the trace records them
+void readSensors() {
+  readDHT();
+  readAmbientTemp();
+  readWaterTemps();
+  readPH();
+  readTDS();
+}
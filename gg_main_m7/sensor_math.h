@@ -0,0 +1,75 @@
+/*****************************************
+*   Sensor Math
+      - Conversions from raw readings to values, shared by the read functions
+      - The read functions in gg_main_m7.ino do the hardware access and call these
+*****************************************/
+
+#include <math.h>
+
+// NTC Thermistor (Ambient / Device Temperature)
+#define SERIESRESISTOR 10000
+#define NOMINAL_RESISTANCE 10000
+#define NOMINAL_TEMPERATURE 25
+#define BCOEFFICIENT 3950
+
+#define ADC_MAX 1023.0
+
+// Heater
+#define HEATER_HYSTERESIS 0.5  // C either side of the target, the relay holds its state in between
+
+
+// Temperature in C of the NTC divider from its ADC reading (Beta equation), reading must not be 0
+float ntcTemperature(float adcValue) {
+  float resistance = SERIESRESISTOR / ((ADC_MAX / adcValue) - 1.0);
+
+  float temperature = resistance / NOMINAL_RESISTANCE;  // (R/Ro)
+  temperature = log(temperature);                       // ln(R/Ro)
+  temperature /= BCOEFFICIENT;                          // 1/B * ln(R/Ro)
+  temperature += 1.0 / (NOMINAL_TEMPERATURE + 273.15);  // + (1/To)
+  temperature = 1.0 / temperature;                      // Invert
+  return temperature - 273.15;                          // convert to C
+}
+
+// pH from the ADC reading of the BNC probe module
+float phFromAnalog(int reading) {
+  return 3.5 * (reading * 5.0 / 1024);
+}
+
+// TDS in ppm from the probe voltage, compensated to 25 C
+float tdsFromVoltage(float voltage, float temperature) {
+  float compensationCoefficient = 1.0 + 0.02 * (temperature - 25.0);  //temperature compensation formula: fFinalResult(25^C) = fFinalResult(current)/(1.0+0.02*(fTP-25.0));
+  float v = voltage / compensationCoefficient;                        //temperature compensation
+  return (133.42 * v * v * v - 255.86 * v * v + 857.39 * v) * 0.5;    //convert voltage value to tds value
+}
+
+// Median of the first iFilterLen values, bArray is left untouched
+int getMedianNum(int bArray[], int iFilterLen) {
+  int bTab[iFilterLen];
+  for (int i = 0; i < iFilterLen; i++)
+    bTab[i] = bArray[i];
+  int i, j, bTemp;
+  for (j = 0; j < iFilterLen - 1; j++) {
+    for (i = 0; i < iFilterLen - j - 1; i++) {
+      if (bTab[i] > bTab[i + 1]) {
+        bTemp = bTab[i];
+        bTab[i] = bTab[i + 1];
+        bTab[i + 1] = bTemp;
+      }
+    }
+  }
+  if ((iFilterLen & 1) > 0)
+    bTemp = bTab[(iFilterLen - 1) / 2];
+  else
+    bTemp = (bTab[iFilterLen / 2] + bTab[iFilterLen / 2 - 1]) / 2;
+  return bTemp;
+}
+
+// True if the heater should run, heaterOn is its state now
+//  - On at or below target - HEATER_HYSTERESIS, off at or above target + HEATER_HYSTERESIS
+//  - A failed reading (NAN) keeps the state it has, 0 is a real reading
+bool heaterWanted(float temperature, float targetTemperature, bool heaterOn) {
+  if (isnan(temperature)) {
+    return heaterOn;
+  }
+  return heaterOn ? temperature < targetTemperature + HEATER_HYSTERESIS : temperature <= targetTemperature - HEATER_HYSTERESIS;
+}
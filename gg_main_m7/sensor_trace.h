@@ -0,0 +1,268 @@
+/*****************************************
+*   Sensor Trace Record / Replay
+      - Record (Build with GG_TRACE_RECORD): every raw input the firmware reads
+        (Sample clock, DHT values, ADC codes, DS18B20 temperature, TDS, encoder
+        pins) is appended to a ring of 9 byte records in the SDRAM region, and
+        streamed to the Serial Monitor as "TRACE <hex>" lines
+      - Replay (Build with GG_TRACE_REPLAY): the same lines are sent back over
+        Serial, ending with "TRACE END", and the read functions take their
+        inputs from the trace instead of the hardware (Loop in gg_main_m7.ino)
+      - Reads go through tracedFloat() / tracedInt(), which cost one flag check
+        when neither mode is built
+      - The replay loop takes its steps as hooks, so the same loop runs on the
+        board and on the host (tools/trace_replay.cpp). Both print the heater
+        and anomaly changes and the upload payloads as the same "REPLAY" lines
+*****************************************/
+
+#define TRACE_CAPACITY 16384      // Records in the ring (147 KB)
+#define TRACE_RECORDS_PER_LINE 8
+#define TRACE_LOAD_TIMEOUT 30000  // Replay gives up after this long without a line
+#define TRACE_NAN INT32_MIN       // Value of a failed float reading
+
+enum TraceSource : uint8_t {
+  TRACE_CLOCK,         // Unix time of the sensing pass, starts a pass
+  TRACE_DHT_TEMP,      // C x 100, zone 1
+  TRACE_DHT_HUMIDITY,  // % x 100, zone 1
+  TRACE_NTC_ADC,       // ADC code
+  TRACE_WATER_TEMP,    // C x 100, TRACE_NAN when the DS18B20 did not answer
+  TRACE_PH_ADC,        // ADC code
+  TRACE_TDS,           // ppm x 100
+  TRACE_ENCODER,       // (A << 1) | B pin levels, one record per edge
+  TRACE_ZONE_DHT_TEMP,                                       // Zones 2 and up, TRACE_ZONE_DHT_TEMP + zone - 1
+  TRACE_ZONE_DHT_HUMIDITY = TRACE_ZONE_DHT_TEMP + ZONE_MAX - 1,
+  TRACE_SOURCES = TRACE_ZONE_DHT_HUMIDITY + ZONE_MAX - 1
+};
+
+// Source of a zone's DHT reading, zone 1 keeps the single zone ids
+TraceSource traceZoneSource(int zone, bool humidity) {
+  if (zone == 0) {
+    return humidity ? TRACE_DHT_HUMIDITY : TRACE_DHT_TEMP;
+  }
+  return (TraceSource)((humidity ? TRACE_ZONE_DHT_HUMIDITY : TRACE_ZONE_DHT_TEMP) + zone - 1);
+}
+
+struct TraceRecord {
+  uint32_t time;  // millis() when it was read
+  int32_t value;
+  uint8_t source;
+} __attribute__((packed));
+
+TraceRecord* traceRecords = NULL;
+volatile uint32_t traceHead = 0;  // Records written since boot (Or loaded for a replay)
+uint32_t traceDumped = 0;         // Records already streamed to Serial
+
+bool traceRecording = false;
+bool traceReplaying = false;
+int32_t replayInputs[TRACE_SOURCES];  // Values the read functions get during a replay
+
+
+void initTrace(bool record, bool replay) {
+  traceRecords = (TraceRecord*)coldAlloc(TRACE_CAPACITY * sizeof(TraceRecord));
+  if (traceRecords == NULL) {
+    Serial.println("No memory for the sensor trace");
+    return;
+  }
+
+  traceRecording = record;
+  traceReplaying = replay;
+}
+
+// Append one record (Safe to call from an interrupt)
+void traceRecord(TraceSource source, int32_t value) {
+  core_util_critical_section_enter();
+  TraceRecord& record = traceRecords[traceHead % TRACE_CAPACITY];
+  record.time = millis();
+  record.value = value;
+  record.source = source;
+  traceHead++;
+  core_util_critical_section_exit();
+}
+
+int32_t traceEncodeFloat(float value) {
+  return isnan(value) ? TRACE_NAN : (int32_t)lroundf(value * 100);
+}
+
+float traceDecodeFloat(int32_t value) {
+  return value == TRACE_NAN ? NAN : value / 100.0;
+}
+
+// Read a float input through the trace: recorded when recording, taken from the trace when replaying
+float tracedFloat(TraceSource source, float (*read)()) {
+  if (traceReplaying) {
+    return traceDecodeFloat(replayInputs[source]);
+  }
+
+  float value = read();
+  if (traceRecording) {
+    traceRecord(source, traceEncodeFloat(value));
+  }
+  return value;
+}
+
+int32_t tracedInt(TraceSource source, int32_t (*read)()) {
+  if (traceReplaying) {
+    return replayInputs[source];
+  }
+
+  int32_t value = read();
+  if (traceRecording) {
+    traceRecord(source, value);
+  }
+  return value;
+}
+
+// Stream the records written since the last call as hex lines
+void dumpTrace(Print& out) {
+  uint32_t head = traceHead;
+
+  if (head - traceDumped > TRACE_CAPACITY) {
+    out.print("TRACE LOST ");
+    out.println(head - traceDumped - TRACE_CAPACITY);
+    traceDumped = head - TRACE_CAPACITY;
+  }
+
+  while (traceDumped < head) {
+    out.print("TRACE ");
+    for (int i = 0; i < TRACE_RECORDS_PER_LINE && traceDumped < head; i++, traceDumped++) {
+      const TraceRecord& record = traceRecords[traceDumped % TRACE_CAPACITY];
+      char hex[20];
+      snprintf(hex, sizeof(hex), "%08lX%08lX%02X", (unsigned long)record.time, (unsigned long)(uint32_t)record.value, record.source);
+      out.print(hex);
+    }
+    out.println();
+  }
+}
+
+// Parse one "TRACE <hex>" line into the ring, returns false for any other line
+bool parseTraceLine(const char* line) {
+  if (strncmp(line, "TRACE ", 6) != 0) {
+    return false;
+  }
+
+  for (const char* hex = line + 6; strlen(hex) >= 18 && traceHead < TRACE_CAPACITY; hex += 18) {
+    char field[9];
+    TraceRecord& record = traceRecords[traceHead];
+
+    memcpy(field, hex, 8);
+    field[8] = '\0';
+    record.time = strtoul(field, NULL, 16);
+    memcpy(field, hex + 8, 8);
+    record.value = (int32_t)strtoul(field, NULL, 16);
+    memcpy(field, hex + 16, 2);
+    field[2] = '\0';
+    record.source = strtoul(field, NULL, 16);
+
+    if (record.source < TRACE_SOURCES) {
+      traceHead++;
+    }
+  }
+  return true;
+}
+
+// Read a recorded trace back from Serial until "TRACE END", returns the number of records loaded
+uint32_t loadTraceFromSerial() {
+  if (traceRecords == NULL) {
+    return 0;
+  }
+
+  Serial.println("Send the trace lines, then TRACE END");
+  traceHead = 0;
+
+  char line[6 + TRACE_RECORDS_PER_LINE * 18 + 2];
+  size_t length = 0;
+  unsigned long lastLine = millis();
+
+  while (millis() - lastLine < TRACE_LOAD_TIMEOUT) {
+    int c = Serial.read();
+    if (c < 0) {
+      continue;
+    }
+
+    if (c != '\n') {
+      if (c != '\r' && length < sizeof(line) - 1) {
+        line[length++] = c;
+      }
+      continue;
+    }
+
+    line[length] = '\0';
+    length = 0;
+    lastLine = millis();
+
+    if (strcmp(line, "TRACE END") == 0) {
+      break;
+    }
+    parseTraceLine(line);
+  }
+
+  Serial.print("Trace records loaded: ");
+  Serial.println(traceHead);
+  return traceHead;
+}
+
+// Steps of a replay, the sketch and tools/trace_replay.cpp each set their own
+struct TraceReplayHooks {
+  void (*encoderEdge)();                 // After a TRACE_ENCODER record, NULL to skip
+  void (*sensingPass)(uint32_t sampleTime);  // The inputs of a pass are in replayInputs (TRACE_TDS ends a pass)
+  void (*upload)(uint32_t time);         // Every passesPerUpload passes and after the last, NULL to skip
+  void (*control)(uint32_t time);        // After every record (The heater decision)
+};
+
+// Feed the loaded records through the hooks in the order they were read
+void replayTraceRecords(const TraceReplayHooks& hooks, uint32_t passesPerUpload) {
+  uint32_t passes = 0;
+  uint32_t time = 0;
+
+  for (uint32_t i = 0; i < traceHead; i++) {
+    const TraceRecord& record = traceRecords[i];
+    time = record.time;
+    replayInputs[record.source] = record.value;
+
+    if (record.source == TRACE_ENCODER && hooks.encoderEdge != NULL) {
+      hooks.encoderEdge();
+    }
+
+    if (record.source == TRACE_TDS) {
+      hooks.sensingPass((uint32_t)replayInputs[TRACE_CLOCK]);
+      if (++passes % passesPerUpload == 0 && hooks.upload != NULL) {
+        hooks.upload(time);
+      }
+    }
+
+    hooks.control(time);
+  }
+
+  if (passes % passesPerUpload != 0 && hooks.upload != NULL) {
+    hooks.upload(time);
+  }
+}
+
+bool replayHeaterOn[ZONE_MAX] = { false };
+bool replayHeaterKnown[ZONE_MAX] = { false };
+
+// Print the zones whose heater changed since the last call
+//  - Zone 1 keeps the line of the single zone firmware so older replays still diff
+void printReplayHeaters(Print& out, const ZoneTable& zones, uint32_t time) {
+  for (int zone = 0; zone < zones.count; zone++) {
+    bool heaterOn = zones.heaterOn[zone];
+    if (replayHeaterKnown[zone] && heaterOn == replayHeaterOn[zone]) {
+      continue;
+    }
+
+    replayHeaterOn[zone] = heaterOn;
+    replayHeaterKnown[zone] = true;
+    char line[80];
+    if (zone == 0) {
+      snprintf(line, sizeof(line), "REPLAY %lu HEATER %s %.2f %.2f", (unsigned long)time, heaterOn ? "ON" : "OFF", zones.temperature[zone], zones.target[zone]);
+    } else {
+      snprintf(line, sizeof(line), "REPLAY %lu ZONE %d HEATER %s %.2f %.2f", (unsigned long)time, zone + 1, heaterOn ? "ON" : "OFF", zones.temperature[zone], zones.target[zone]);
+    }
+    out.println(line);
+  }
+}
+
+void printReplayAnomaly(Print& out, uint32_t sampleTime, const char* channel, bool started, float value) {
+  char line[64];
+  snprintf(line, sizeof(line), "REPLAY %lu ANOMALY %s %s %.2f", (unsigned long)sampleTime, channel, started ? "ON" : "OFF", value);
+  out.println(line);
+}
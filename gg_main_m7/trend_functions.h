@@ -0,0 +1,215 @@
+/*****************************************
+*   Trend functions
+      - Rolling 1 hour and 24 hour Min / Max / Avg per Sensor
+      - Each window is a ring of time buckets, adding a sample is O(1)
+      - Sparkline drawn with 8 bar height levels using the CGRAM characters
+*****************************************/
+
+#define TREND_HOUR_BUCKETS 20        // One bucket per sparkline column
+#define TREND_HOUR_BUCKET_SECONDS 180  // 20 x 3 minutes = 1 hour
+#define TREND_DAY_BUCKETS 24
+#define TREND_DAY_BUCKET_SECONDS 3600  // 24 x 1 hour = 24 hours
+
+#define SPARKLINE_LEVELS 8
+#define TREND_VALUE_WIDTH 4  // Characters per value on a summary row, 3 values fill the 20 columns
+
+struct TrendBucket {
+  unsigned long index;  // Bucket number since boot (time / bucket length)
+  float min;
+  float max;
+  float sum;
+  unsigned int count;
+};
+
+struct SensorTrend {
+  TrendBucket hour[TREND_HOUR_BUCKETS];
+  TrendBucket day[TREND_DAY_BUCKETS];
+};
+
+//Aggregate of one window
+struct TrendSummary {
+  float min;
+  float max;
+  float avg;
+  unsigned int count;
+};
+
+//Rolling Trends for each Sensor
+SensorTrend growTempTrend;
+SensorTrend humidityTrend;
+SensorTrend ambientTempTrend;
+SensorTrend waterTempTrend;
+SensorTrend tdsTrend;
+
+// CGRAM slots holding the bar glyphs for heights 1 to 7, height 8 is the ROM full block
+//  - Slot 3 (LineTop) is left alone, the arrows are swapped for '<' '>' on the trend page
+const byte sparkSlots[SPARKLINE_LEVELS - 1] = { 0, 1, 2, 4, 5, 6, 7 };
+#define SPARK_FULL_BLOCK 0xFF
+
+
+// Time base for the buckets, seconds since boot so the trend works before the NTP sync
+unsigned long trendNow() {
+  return millis() / 1000;
+}
+
+// Add a sample to a ring of buckets, the bucket is reset when it is reused for a new period
+void addToBuckets(TrendBucket* buckets, int bucketCount, unsigned long bucketSeconds, unsigned long now, float value) {
+  unsigned long index = now / bucketSeconds;
+  TrendBucket& bucket = buckets[index % bucketCount];
+
+  if (bucket.index != index || bucket.count == 0) {
+    bucket.index = index;
+    bucket.min = value;
+    bucket.max = value;
+    bucket.sum = 0;
+    bucket.count = 0;
+  }
+
+  if (value < bucket.min) {
+    bucket.min = value;
+  }
+  if (value > bucket.max) {
+    bucket.max = value;
+  }
+  bucket.sum += value;
+  bucket.count++;
+}
+
+// True if the bucket holds data from inside the window ending now
+bool bucketInWindow(const TrendBucket& bucket, int bucketCount, unsigned long bucketSeconds, unsigned long now) {
+  return bucket.count > 0 && (now / bucketSeconds) - bucket.index < (unsigned long)bucketCount;
+}
+
+// Combine the buckets of one window (Fixed number of buckets, so constant time)
+TrendSummary summarizeBuckets(const TrendBucket* buckets, int bucketCount, unsigned long bucketSeconds, unsigned long now) {
+  TrendSummary summary = { 0, 0, 0, 0 };
+  float sum = 0;
+
+  for (int i = 0; i < bucketCount; i++) {
+    if (!bucketInWindow(buckets[i], bucketCount, bucketSeconds, now)) {
+      continue;
+    }
+
+    if (summary.count == 0 || buckets[i].min < summary.min) {
+      summary.min = buckets[i].min;
+    }
+    if (summary.count == 0 || buckets[i].max > summary.max) {
+      summary.max = buckets[i].max;
+    }
+    sum += buckets[i].sum;
+    summary.count += buckets[i].count;
+  }
+
+  if (summary.count > 0) {
+    summary.avg = sum / summary.count;
+  }
+  return summary;
+}
+
+void addTrendSample(SensorTrend& trend, float value) {
+  unsigned long now = trendNow();
+  addToBuckets(trend.hour, TREND_HOUR_BUCKETS, TREND_HOUR_BUCKET_SECONDS, now, value);
+  addToBuckets(trend.day, TREND_DAY_BUCKETS, TREND_DAY_BUCKET_SECONDS, now, value);
+}
+
+TrendSummary hourSummary(const SensorTrend& trend) {
+  return summarizeBuckets(trend.hour, TREND_HOUR_BUCKETS, TREND_HOUR_BUCKET_SECONDS, trendNow());
+}
+
+TrendSummary daySummary(const SensorTrend& trend) {
+  return summarizeBuckets(trend.day, TREND_DAY_BUCKETS, TREND_DAY_BUCKET_SECONDS, trendNow());
+}
+
+// Fill levels with one bar level (0 - 7) per hour bucket, oldest first, -1 for no data
+void sparklineLevels(const SensorTrend& trend, int levels[TREND_HOUR_BUCKETS]) {
+  unsigned long now = trendNow();
+  unsigned long newest = now / TREND_HOUR_BUCKET_SECONDS;
+  TrendSummary summary = hourSummary(trend);
+
+  for (int column = 0; column < TREND_HOUR_BUCKETS; column++) {
+    unsigned long index = newest - (TREND_HOUR_BUCKETS - 1 - column);
+    const TrendBucket& bucket = trend.hour[index % TREND_HOUR_BUCKETS];
+
+    if (bucket.index != index || !bucketInWindow(bucket, TREND_HOUR_BUCKETS, TREND_HOUR_BUCKET_SECONDS, now)) {
+      levels[column] = -1;
+      continue;
+    }
+
+    //Flat line in the middle when every reading is the same
+    float range = summary.max - summary.min;
+    if (range <= 0) {
+      levels[column] = SPARKLINE_LEVELS / 2 - 1;
+      continue;
+    }
+
+    float avg = bucket.sum / bucket.count;
+    levels[column] = (int)((avg - summary.min) / range * (SPARKLINE_LEVELS - 1) + 0.5);
+  }
+}
+
+// Character to print for a bar level
+byte sparkCharacter(int level) {
+  if (level < 0) {
+    return ' ';
+  }
+  if (level >= SPARKLINE_LEVELS - 1) {
+    return SPARK_FULL_BLOCK;
+  }
+  return sparkSlots[level];
+}
+
+// Load the bar glyphs, bar n is n + 1 pixels high from the bottom
+void loadSparkChars() {
+  for (int level = 0; level < SPARKLINE_LEVELS - 1; level++) {
+    byte glyph[8];
+    for (int row = 0; row < 8; row++) {
+      glyph[row] = (row >= 7 - level) ? 0b11111 : 0b00000;
+    }
+    lcd.createChar(sparkSlots[level], glyph);
+  }
+}
+
+// Format a summary value in TREND_VALUE_WIDTH characters: one decimal when it fits ("18.2"), none otherwise ("100")
+void formatTrendValue(char* text, size_t size, float value) {
+  snprintf(text, size, "%.1f", value);
+  if (strlen(text) > TREND_VALUE_WIDTH) {
+    snprintf(text, size, "%.0f", value);
+  }
+}
+
+// Print one window summary as "1h L18.2 A21.0 H24.5", padded to the full row
+void printTrendSummary(const char* label, TrendSummary summary) {
+  char line[21];
+
+  if (summary.count == 0) {
+    snprintf(line, sizeof(line), "%-3sNo Data", label);
+  } else {
+    char low[12], average[12], high[12];
+    formatTrendValue(low, sizeof(low), summary.min);
+    formatTrendValue(average, sizeof(average), summary.avg);
+    formatTrendValue(high, sizeof(high), summary.max);
+    snprintf(line, sizeof(line), "%-3sL%s A%s H%s", label, low, average, high);
+  }
+
+  size_t length = lcd.print(line);
+  for (; length < 20; length++) {
+    lcd.write(' ');
+  }
+}
+
+// Draw the rows under the title: 1 hour summary, 1 hour sparkline and 24 hour summary
+//  - Expects loadSparkChars() to have been called when the page was entered
+void renderTrendRows(const SensorTrend& trend) {
+  lcd.setCursor(0, 1);
+  printTrendSummary("1h", hourSummary(trend));
+
+  int levels[TREND_HOUR_BUCKETS];
+  sparklineLevels(trend, levels);
+  lcd.setCursor(0, 2);
+  for (int i = 0; i < TREND_HOUR_BUCKETS; i++) {
+    lcd.write(sparkCharacter(levels[i]));
+  }
+
+  lcd.setCursor(0, 3);
+  printTrendSummary("1d", daySummary(trend));
+}
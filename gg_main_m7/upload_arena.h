@@ -0,0 +1,123 @@
+/*****************************************
+*   Upload Arena
+      - Bump pointer allocator for the temporary objects of one upload cycle
+        (JSON documents, request URL)
+      - Reset at the start of every cycle, nothing is freed one by one, so the
+        global heap never sees these allocations and cannot fragment from them
+      - Arena statistics for the Serial Monitor (Heap statistics in diagnostics.h)
+*****************************************/
+
+#include <stdarg.h>
+
+#define UPLOAD_ARENA_SIZE (40 * 1024)
+
+struct Arena {
+  uint8_t* base;
+  size_t size;
+  size_t used;
+
+  //Statistics
+  size_t highWater;
+  unsigned long resets;
+  unsigned long failures;  // Allocations that did not fit
+};
+
+Arena uploadArena = { NULL, 0, 0, 0, 0, 0 };
+
+
+void initArena(Arena& arena, void* buffer, size_t size) {
+  arena.base = (uint8_t*)buffer;
+  arena.size = buffer != NULL ? size : 0;
+  arena.used = 0;
+}
+
+// Allocate from the arena, NULL if it is full
+void* arenaAlloc(Arena& arena, size_t size, size_t align = 8) {
+  size_t offset = (arena.used + align - 1) & ~(align - 1);
+  if (arena.base == NULL || offset + size > arena.size) {
+    arena.failures++;
+    return NULL;
+  }
+
+  arena.used = offset + size;
+  if (arena.used > arena.highWater) {
+    arena.highWater = arena.used;
+  }
+  return arena.base + offset;
+}
+
+// Release everything allocated since the last reset
+void arenaReset(Arena& arena) {
+  arena.used = 0;
+  arena.resets++;
+}
+
+// snprintf into the arena, returns NULL if it does not fit
+char* arenaPrintf(Arena& arena, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+
+  if (length < 0) {
+    return NULL;
+  }
+
+  char* text = (char*)arenaAlloc(arena, length + 1, 1);
+  if (text == NULL) {
+    return NULL;
+  }
+
+  va_start(args, format);
+  vsnprintf(text, length + 1, format, args);
+  va_end(args);
+  return text;
+}
+
+// Allocator for ArduinoJson documents that lives in the upload arena
+//  - Each block keeps its size in front of it so reallocate() can copy it
+struct UploadArenaAllocator {
+  void* allocate(size_t size) {
+    size_t* block = (size_t*)arenaAlloc(uploadArena, size + sizeof(size_t));
+    if (block == NULL) {
+      return NULL;
+    }
+    *block = size;
+    return block + 1;
+  }
+
+  void deallocate(void*) {
+    // Freed all at once by arenaReset()
+  }
+
+  void* reallocate(void* pointer, size_t size) {
+    if (pointer == NULL) {
+      return allocate(size);
+    }
+
+    size_t oldSize = ((size_t*)pointer)[-1];
+    if (size <= oldSize) {
+      return pointer;
+    }
+
+    void* moved = allocate(size);
+    if (moved != NULL) {
+      memcpy(moved, pointer, oldSize);
+    }
+    return moved;
+  }
+};
+
+typedef BasicJsonDocument<UploadArenaAllocator> ArenaJsonDocument;
+
+void printArenaStats() {
+  Serial.print("Upload arena: ");
+  Serial.print(uploadArena.highWater);
+  Serial.print(" / ");
+  Serial.print(uploadArena.size);
+  Serial.print(" bytes high water, ");
+  Serial.print(uploadArena.resets);
+  Serial.print(" cycles, ");
+  Serial.print(uploadArena.failures);
+  Serial.println(" failed allocations");
+}
@@ -0,0 +1,160 @@
+/*****************************************
+*   Upload Body
+      - The JSON of an upload to /sensors/sendData: its Sequence, the rollups
+        of a period the raw samples no longer cover (rollup_store.h), then a
+        Data row per sample row with the readings of that pass
+      - Built in steps so the sketch adds its Profile and PostMortem between
+        the rollups and the rows
+      - The upload in flight is an UploadBatch. What it carried is committed
+        only once the server has stored it: a 2xx status with the ack of its
+        Sequence, or no ack at all (uploadStored(), then commitUpload())
+      - tools/trace_replay.cpp and tools/load_gen.cpp build their bodies here
+        too, on the fake document of tools/tests/fake_json.h
+*****************************************/
+
+#define JSON_DOCUMENT_SIZE 32768
+
+//Document memory of one upload row with a reading on every channel, strings are stored by pointer so only the slots count
+#define JSON_ROW_SIZE (JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(1) + JSON_ARRAY_SIZE(SAMPLE_CHANNELS) + SAMPLE_CHANNELS * JSON_OBJECT_SIZE(7))
+
+//Upload State for the Rollups
+struct UploadBatch {
+  unsigned long sequence;              // Sent with every upload, the server acks it back
+  unsigned long lastPostedSequence;    // Sequence of the last upload sent, the same again is a retry
+  unsigned long uploadedUntil;         // Unix time up to which the server has all the data
+  unsigned long pendingUploadedUntil;  // New value of uploadedUntil once the current upload succeeds
+  unsigned long rollupEnd;             // End of the period the rollups of the current upload cover
+  bool catchingUp;                     // Current upload only carries rollups, keep the raw samples
+  int rowEnd;                          // Sample rows before this one are in the current upload, dropped once it succeeds
+};
+
+void initUploadBatch(UploadBatch& batch) {
+  batch.sequence = 1;
+  batch.lastPostedSequence = 0;
+  batch.uploadedUntil = 0;
+  batch.pendingUploadedUntil = 0;
+  batch.rollupEnd = 0;
+  batch.catchingUp = false;
+  batch.rowEnd = 0;
+}
+
+// Names of the channels the uploads carry, one rollup channel per sample column (NULL location follows the runtime config)
+void initUploadChannels(int zoneCount) {
+  initRollupChannel(ROLLUP_DEVICE_TEMP, "Device Temperature", "Sensor 1", "Internal", "Default", "Temperature");
+  for (int zone = 0; zone < zoneCount; zone++) {
+    initRollupChannel(rollupZoneChannel(zone, false), "Temperature Sensor", "Sensor 1", "DHT", NULL, "Temperature", zone);
+    initRollupChannel(rollupZoneChannel(zone, true), "Humidity Sensor", "Sensor 1", "DHT", NULL, "Humidity", zone);
+  }
+  initRollupChannel(ROLLUP_WATER_TEMP, "Water Temperature", "Sensor 1", "ds18b20", NULL, "Temperature");
+  initRollupChannel(ROLLUP_PH, "PH", "PH Sensor 1", "BNC PH Probe", NULL, "PH");
+  initRollupChannel(ROLLUP_TDS, "TDS", "TDS Sensor 1", "TDS", NULL, "PPM");
+}
+
+// One reading of a channel, the names come from its rollup channel
+//  - The strings are stored by pointer (const char*), the channels and the config outlive the document
+void addSensorReading(JsonArray& SensorReadings, RollupChannelId id, uint32_t time, float value) {
+  const RollupChannel& channel = rollupChannels[id];
+  JsonObject reading = SensorReadings.createNestedObject();
+
+  reading["Name"] = channel.name;
+  reading["Value"] = value;
+  reading["Time"] = time;
+  reading["Sensor"] = channel.sensorName;
+  reading["Type"] = channel.sensorType;
+  reading["Field"] = channel.dataType;
+  reading["Location"] = rollupChannelLocation(channel);
+}
+
+// Sequence, then the rollups for any period the raw samples no longer cover (Device was offline)
+//  - now ends the period when there are no raw samples
+void addUploadRollups(JsonDocument& doc, UploadBatch& batch, const SampleColumns& columns, unsigned long now) {
+  uint32_t oldestRaw, newestRaw;
+  sampleTimeRange(columns, oldestRaw, newestRaw);
+  unsigned long gapEnd = oldestRaw != 0 ? oldestRaw : now;
+
+  doc["Sequence"] = batch.sequence;
+
+  JsonArray Rollups = doc.createNestedArray("Rollups");
+  batch.rollupEnd = addRollupsToJSON(Rollups, batch.uploadedUntil, gapEnd);
+
+  //Still catching up, send only the rollups and keep the raw samples for a later upload
+  batch.catchingUp = batch.rollupEnd < gapEnd;
+  batch.pendingUploadedUntil = batch.catchingUp ? batch.rollupEnd : max((unsigned long)newestRaw, batch.rollupEnd);
+
+  if (Rollups.size() == 0) {
+    doc.remove("Rollups");
+  }
+}
+
+// The Data rows, after addUploadRollups()
+//  - Rows that would not fit in the document wait for the next upload, rowEnd and
+//    pendingUploadedUntil only cover the rows sent
+void addUploadRows(JsonDocument& doc, UploadBatch& batch, const SampleColumns& columns, const char* deviceId) {
+  JsonArray Data = doc.createNestedArray("Data");
+  batch.rowEnd = 0;
+  unsigned long newestSent = 0;
+
+  //Rows with at least one reading, from the presence bits
+  int row;
+  for (row = nextSampleRow(columns, 0); row >= 0 && !batch.catchingUp; row = nextSampleRow(columns, row + 1)) {
+
+    //Stop before a row that may not fit, the rest go with the next upload
+    if (doc.capacity() - doc.memoryUsage() < JSON_ROW_SIZE) {
+      break;
+    }
+
+    JsonObject sensorDataObject = Data.createNestedObject();
+
+    JsonObject DeviceInfo = sensorDataObject.createNestedObject("Device");
+    DeviceInfo["DeviceID"] = deviceId;
+
+    JsonArray SensorReadings = sensorDataObject.createNestedArray("SensorReadings");
+
+    for (int channel = 0; channel < SAMPLE_CHANNELS; channel++) {
+      float value = sampleValue(columns, channel, row);
+      if (value != 0) {
+        addSensorReading(SensorReadings, (RollupChannelId)channel, columns.time[channel][row], value);
+        newestSent = max(newestSent, (unsigned long)columns.time[channel][row]);
+      }
+    }
+    batch.rowEnd = row + 1;
+  }
+
+  //Every row sent (Trailing rows without a reading go too), or some left for the next
+  //upload and the server has the data up to the newest row sent
+  if (row < 0) {
+    batch.rowEnd = SAMPLE_ROWS;
+  } else if (!batch.catchingUp) {
+    batch.pendingUploadedUntil = max(newestSent, batch.rollupEnd);
+  }
+}
+
+// Serialize the document into buffer, returns the length (0 if it did not fit)
+//  - Whatever did not fit was dropped from the document, a partial upload would lose it
+size_t serializeUpload(const JsonDocument& doc, char* buffer, size_t bufferSize) {
+  if (doc.overflowed()) {
+    return 0;
+  }
+
+  //serializeJson() cuts the text to fit and returns what it wrote, measure first
+  if (measureJson(doc) >= bufferSize) {
+    return 0;
+  }
+  return serializeJson(doc, buffer, bufferSize);
+}
+
+// True when the answer means the server stored the upload
+//  - An error status (4xx / 5xx) never does, with or without an ack
+//  - An ack for another upload means the server did not store this one, it goes again
+bool uploadStored(const UploadBatch& batch, int statusCode, bool hasAck, unsigned long ack) {
+  return statusCode >= 200 && statusCode < 300 && (!hasAck || ack == batch.sequence);
+}
+
+// The server stored the upload, the next one carries what came after it
+void commitUpload(UploadBatch& batch, SampleColumns& columns) {
+  batch.sequence++;
+  batch.uploadedUntil = batch.pendingUploadedUntil;
+  if (!batch.catchingUp) {
+    dropSampleRows(columns, batch.rowEnd);
+  }
+}
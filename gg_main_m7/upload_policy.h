@@ -0,0 +1,116 @@
+/*****************************************
+*   Adaptive Upload Policy
+      - Picks the time to the next upload from the link: smoothed RSSI,
+        success rate of recent uploads and measured throughput
+      - Good link: small batches at up to twice the configured rate
+        (sendDataInterval / 2). Bad link: larger batches up to the time the
+        sample columns can hold, plus a backoff while uploads keep failing
+      - The oldest unsent sample is never made to wait past maxDataAge, and a
+        batch is kept small enough to go out within UPLOAD_SEND_BUDGET at the
+        measured throughput
+      - Tuned with tools/upload_policy_sim.cpp against link models
+*****************************************/
+
+#include <math.h>
+#include <stdint.h>
+
+#define LINK_RSSI_GOOD -60.0    // dBm at and above which the signal counts as perfect
+#define LINK_RSSI_BAD -85.0     // dBm at and below which it counts as unusable
+#define LINK_SMOOTHING 0.25     // Weight of the newest upload in the averages
+#define UPLOAD_SEND_BUDGET 3000  // ms one upload may take at the measured throughput
+#define UPLOAD_MAX_BACKOFF 4     // Failed uploads in a row that still double the interval
+
+struct LinkEstimate {
+  float rssi;         // dBm
+  float successRate;  // 0 - 1
+  float throughput;   // Bytes per ms of the successful uploads, 0 until the first
+  float rowBytes;     // Upload bytes per row of sensor data, on the wire (Deflated once the server accepts it)
+  uint32_t failStreak;
+  bool measured;      // False until the first RSSI
+};
+
+struct UploadLimits {
+  uint32_t baseInterval;    // sendDataInterval of the config, ms
+  uint32_t sampleInterval;  // ms between rows
+  uint32_t maxDataAge;      // ms the oldest unsent row may wait
+  uint32_t maxRows;         // Rows the sample columns hold
+};
+
+
+void initLinkEstimate(LinkEstimate& link) {
+  link.rssi = LINK_RSSI_GOOD;
+  link.successRate = 1;
+  link.throughput = 0;
+  link.rowBytes = 0;
+  link.failStreak = 0;
+  link.measured = false;
+}
+
+inline float linkSmooth(float average, float sample) {
+  return average + LINK_SMOOTHING * (sample - average);
+}
+
+void linkNoteRssi(LinkEstimate& link, float rssi) {
+  link.rssi = link.measured ? linkSmooth(link.rssi, rssi) : rssi;
+  link.measured = true;
+}
+
+// Outcome of one upload of rows rows and bytes bytes that took ms
+void linkNoteUpload(LinkEstimate& link, bool ok, uint32_t bytes, uint32_t rows, uint32_t ms) {
+  link.successRate = linkSmooth(link.successRate, ok ? 1 : 0);
+  link.failStreak = ok ? 0 : link.failStreak + 1;
+
+  if (rows > 0 && bytes > 0) {
+    float perRow = (float)bytes / rows;
+    link.rowBytes = link.rowBytes > 0 ? linkSmooth(link.rowBytes, perRow) : perRow;
+  }
+  if (ok && bytes > 0) {
+    float rate = (float)bytes / (ms > 0 ? ms : 1);
+    link.throughput = link.throughput > 0 ? linkSmooth(link.throughput, rate) : rate;
+  }
+}
+
+// 0 (Unusable) to 1 (Perfect)
+float linkQuality(const LinkEstimate& link) {
+  float signal = (link.rssi - LINK_RSSI_BAD) / (LINK_RSSI_GOOD - LINK_RSSI_BAD);
+  signal = signal < 0 ? 0 : signal > 1 ? 1 : signal;
+  return signal * link.successRate;
+}
+
+// ms to the next upload, oldestAge is how long the oldest unsent row has waited (0 if none)
+uint32_t nextUploadInterval(const LinkEstimate& link, const UploadLimits& limits, uint32_t oldestAge) {
+  uint32_t shortest = limits.baseInterval / 2 > limits.sampleInterval ? limits.baseInterval / 2 : limits.sampleInterval;
+  uint32_t longest = limits.maxRows * limits.sampleInterval;
+  if (longest > limits.maxDataAge) {
+    longest = limits.maxDataAge;
+  }
+
+  //The largest batch that still goes out within the send budget
+  if (link.throughput > 0 && link.rowBytes > 0) {
+    uint32_t budgetRows = (uint32_t)(UPLOAD_SEND_BUDGET * link.throughput / link.rowBytes);
+    uint64_t budgetInterval = (uint64_t)budgetRows * limits.sampleInterval;
+    if (budgetInterval < longest) {
+      longest = (uint32_t)budgetInterval;
+    }
+  }
+  if (longest < shortest) {
+    longest = shortest;
+  }
+
+  //Geometric between the two, a perfect link uploads at the shortest interval
+  float quality = linkQuality(link);
+  float interval = shortest * powf((float)longest / shortest, 1 - quality);
+
+  //Back off while uploads keep failing
+  uint32_t backoff = link.failStreak < UPLOAD_MAX_BACKOFF ? link.failStreak : UPLOAD_MAX_BACKOFF;
+  interval *= (float)(1UL << backoff);
+  if (interval > longest) {
+    interval = longest;
+  }
+
+  //Never let the oldest row wait past maxDataAge
+  if (oldestAge + interval > limits.maxDataAge) {
+    interval = oldestAge < limits.maxDataAge ? limits.maxDataAge - oldestAge : 0;
+  }
+  return interval > shortest ? (uint32_t)interval : shortest;
+}
@@ -0,0 +1,96 @@
+/*****************************************
+*   Zones
+      - One zone per greenhouse (Or area) the board looks after: its DHT,
+        heater relay, target temperature, name and LCD pages
+      - Held as a table of arrays, one slot per zone, so the sensing and
+        control passes walk each field front to back for every zone at once
+      - GG_ZONES sets how many zones are wired (Default 1, up to ZONE_MAX),
+        the pins are in the zone pin tables of gg_main_m7.ino and the target
+        temperatures and names in the runtime config
+      - Zone 1 keeps the ids of the single zone firmware (Trace sources,
+        rollup channels, alarm subject 0), the other zones are added after
+      - Needs heaterWanted() from sensor_math.h. tools/zone_sim.cpp runs 8
+        simulated zones
+*****************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+#define ZONE_MAX 8  // Zone bits fit a uint8_t mask
+#define ZONE_NAME_SIZE 24
+
+#ifndef GG_ZONES
+#define GG_ZONES 1
+#endif
+
+#if GG_ZONES < 1 || GG_ZONES > ZONE_MAX
+#error "GG_ZONES must be 1 to ZONE_MAX"
+#endif
+
+struct ZoneTable {
+  int count;
+
+  //Readings, 0 after a failed reading (valid tells it from a reading of 0 C)
+  float temperature[ZONE_MAX];  // C
+  float humidity[ZONE_MAX];     // %
+  bool valid[ZONE_MAX];         // false until the first reading and after a failed one
+
+  //Control
+  float target[ZONE_MAX];       // C
+  bool heaterOn[ZONE_MAX];
+  uint8_t relayPin[ZONE_MAX];
+
+  char name[ZONE_MAX][ZONE_NAME_SIZE];
+};
+
+//Result of one control pass, one bit per zone
+struct ZoneDecisions {
+  uint8_t changed;  // Heater switched
+  uint8_t over;     // Past target + margin
+  uint8_t under;    // Below target - margin
+  uint8_t failed;   // No valid reading, heater left as it was
+};
+
+
+void initZones(ZoneTable& zones, int count, const uint8_t* relayPins) {
+  memset(&zones, 0, sizeof(zones));
+  zones.count = count < ZONE_MAX ? count : ZONE_MAX;
+  for (int zone = 0; zone < zones.count; zone++) {
+    zones.relayPin[zone] = relayPins[zone];
+  }
+}
+
+void setZoneName(ZoneTable& zones, int zone, const char* name) {
+  strncpy(zones.name[zone], name, ZONE_NAME_SIZE - 1);
+  zones.name[zone][ZONE_NAME_SIZE - 1] = '\0';
+}
+
+// Heater decision and temperature alarms for every zone in one pass
+//  - The heater switches with the hysteresis of heaterWanted()
+//  - A zone without a valid reading keeps its heater as it was and sets the failed bit instead of a temperature alarm
+ZoneDecisions controlZones(ZoneTable& zones, float alarmMargin) {
+  ZoneDecisions decisions = { 0, 0, 0, 0 };
+
+  for (int zone = 0; zone < zones.count; zone++) {
+    float temperature = zones.temperature[zone];
+    float target = zones.target[zone];
+    uint8_t bit = 1 << zone;
+
+    if (!zones.valid[zone]) {
+      decisions.failed |= bit;
+      continue;
+    }
+    bool on = heaterWanted(temperature, target, zones.heaterOn[zone]);
+    if (on != zones.heaterOn[zone]) {
+      decisions.changed |= bit;
+    }
+    zones.heaterOn[zone] = on;
+
+    if (temperature > target + alarmMargin) {
+      decisions.over |= bit;
+    } else if (temperature < target - alarmMargin) {
+      decisions.under |= bit;
+    }
+  }
+  return decisions;
+}
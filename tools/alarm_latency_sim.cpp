@@ -0,0 +1,266 @@
+/*****************************************
+*   Alarm Latency Simulation
+      - Runs gg_main_m7/alarm_queue.h in a model of the cooperative scheduler
+        for a simulated day, every bulk upload carries a 1000 row backlog
+      - Alarm to wire: from the raise to the first byte of the request that
+        carries it. With the alarm queue that is the compact POST, sent at
+        the next task boundary (A running upload is never interrupted).
+        Without it, the alarm would ride in the next bulk upload, behind the
+        backlog
+      - Random alarms plus a storm (Over temperature raised every second for
+        10 min) to show the coalescing and the rate limit. The latencies are
+        those of the fresh alarms, a raise that coalesces or waits for its
+        rate limit is counted but not timed
+      - A full queue of the longest records (6 and 8 alarms) must fit the
+        alarm body, a smaller body must post the most urgent alarms that fit
+        and keep the rest
+      - A 10 min outage of the alarm endpoint: the lane must back off instead
+        of posting on every alarm task run, and deliver everything once the
+        link is back. Exits with 1 if a check fails
+
+      g++ -O2 -o alarm_latency_sim tools/alarm_latency_sim.cpp && ./alarm_latency_sim
+*****************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include "../gg_main_m7/alarm_queue.h"
+
+#define SIM_DURATION (24UL * 3600 * 1000)
+#define SIM_STEP 10                // ms
+#define SIM_UPLOAD_INTERVAL 30000
+#define SIM_BACKLOG_ROWS 1000
+#define SIM_ROW_BYTES 900
+#define SIM_ALARM_INTERVAL 1000    // Periodic run of the alarm task
+#define SIM_ALARM_EVERY 300000     // Mean ms between random alarms
+#define SIM_STORM_START (12UL * 3600 * 1000)
+#define SIM_STORM_LENGTH 600000
+#define SIM_DEVICE_ID "GG-GREENHOUSE01"  // Longest deviceId
+#define SIM_OUTAGE_START 60000
+#define SIM_OUTAGE_LENGTH 600000
+
+struct LinkModel {
+  const char* name;
+  uint32_t connectMs;
+  float bytesPerMs;
+};
+
+const LinkModel linkModels[] = {
+  { "good", 80, 60 },
+  { "fair", 250, 12 },
+  { "weak", 700, 3 },
+};
+
+uint32_t simRandom = 1;
+
+float randomUnit() {
+  simRandom = simRandom * 1103515245 + 12345;
+  return ((simRandom >> 8) & 0xFFFF) / 65536.0f;
+}
+
+uint32_t percentile(std::vector<uint32_t> values, int percent) {
+  if (values.empty()) {
+    return 0;
+  }
+  size_t index = (values.size() - 1) * percent / 100;
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+void simulate(const LinkModel& model) {
+  AlarmQueue queue;
+  initAlarmQueue(queue);
+  simRandom = 4242;
+
+  uint32_t batchMs = model.connectMs + (uint32_t)(SIM_BACKLOG_ROWS * SIM_ROW_BYTES / model.bytesPerMs);
+  uint32_t busyUntil = 0;
+  uint32_t nextUpload = SIM_UPLOAD_INTERVAL;
+  uint32_t nextAlarmRun = SIM_ALARM_INTERVAL;
+  bool alarmEvent = false;
+
+  std::vector<uint32_t> queued;  // Alarm to wire with the alarm queue, ms
+  std::vector<uint32_t> batched;  // Alarm to wire riding in the next bulk upload, ms
+  std::vector<uint32_t> batchedRaises;  // Raise times waiting for the next bulk upload
+  uint32_t alarmPosts = 0;
+  uint32_t uploads = 0;
+
+  for (uint32_t now = 0; now < SIM_DURATION; now += SIM_STEP) {
+    //Raise
+    bool storm = now >= SIM_STORM_START && now < SIM_STORM_START + SIM_STORM_LENGTH;
+    bool randomAlarm = randomUnit() < (float)SIM_STEP / SIM_ALARM_EVERY;
+    bool stormAlarm = storm && now % 1000 == 0;
+    if (randomAlarm || stormAlarm) {
+      AlarmType type = stormAlarm ? ALARM_OVER_TEMPERATURE : (AlarmType)(randomUnit() * ALARM_TYPES);
+      uint8_t subject = stormAlarm ? 0 : (uint8_t)(randomUnit() * ALARM_SUBJECTS);
+      Alarm probe = {};
+      probe.type = type;
+      probe.subject = subject;
+      bool limited = alarmWait(queue, probe, now) > 0;
+
+      if (raiseAlarm(queue, type, subject, 30, now, now / 1000) == ALARM_QUEUED && !limited) {
+        batchedRaises.push_back(now);
+      }
+      alarmEvent = alarmEvent || nextAlarmDue(queue, now) == 0;
+    }
+
+    if (now < busyUntil) {
+      continue;
+    }
+
+    //Events first, then the due tasks (scheduler.h)
+    if (alarmEvent || now >= nextAlarmRun) {
+      alarmEvent = false;
+      if (now >= nextAlarmRun) {
+        nextAlarmRun += SIM_ALARM_INTERVAL;
+      }
+
+      int ready[ALARM_QUEUE_SIZE];
+      int count = collectReadyAlarms(queue, now, ready, ALARM_QUEUE_SIZE);
+      if (count > 0) {
+        char body[ALARM_BODY_SIZE];
+        size_t bytes = formatAlarmJSON(body, sizeof(body), "GG-001", queue, ready, count);
+        if (bytes == 0) {
+          continue;
+        }
+        uint32_t wire = now + model.connectMs;
+        for (int i = 0; i < count; i++) {
+          const Alarm& alarm = queue.pending[ready[i]];
+          bool limited = queue.sentOnce[alarm.type][alarm.subject]
+                         && alarm.raisedAt - queue.lastSent[alarm.type][alarm.subject] < alarmRateLimits[alarm.type];
+          if (!limited) {
+            queued.push_back(wire - alarm.raisedAt);
+          }
+        }
+        busyUntil = wire + (uint32_t)(bytes / model.bytesPerMs);
+        completeAlarms(queue, busyUntil, ready, count);
+        alarmPosts++;
+        continue;
+      }
+    }
+
+    if (now >= nextUpload) {
+      //The alarms would be written after the backlog rows
+      uint32_t wire = now + batchMs;
+      for (uint32_t raisedAt : batchedRaises) {
+        batched.push_back(wire - raisedAt);
+      }
+      batchedRaises.clear();
+      busyUntil = wire;
+      nextUpload += SIM_UPLOAD_INTERVAL;
+      if (nextUpload < busyUntil) {
+        nextUpload = busyUntil;
+      }
+      uploads++;
+    }
+  }
+
+  printf("%-5s %7.1f %7u %7u %8u %8u %8.2f %8.2f %8.2f %8.1f %8.1f %8.1f\n",
+         model.name, batchMs / 1000.0, uploads, queue.raised, alarmPosts, queue.coalesced,
+         percentile(queued, 50) / 1000.0, percentile(queued, 95) / 1000.0, percentile(queued, 100) / 1000.0,
+         percentile(batched, 50) / 1000.0, percentile(batched, 95) / 1000.0, percentile(batched, 100) / 1000.0);
+}
+
+// Queue alarms of distinct type and subject with the longest values, count and time
+void fillWorstCase(AlarmQueue& queue, int alarms) {
+  initAlarmQueue(queue);
+  for (int i = 0; i < alarms; i++) {
+    AlarmType type = (AlarmType)(i % ALARM_TYPES);
+    uint8_t subject = ALARM_SUBJECTS - 1 - i / ALARM_TYPES;
+    raiseAlarm(queue, type, subject, i % 2 ? -1e9 : 1e9, 0, 0xFFFFFFFF);
+    queue.pending[queue.count - 1].count = 0xFFFF;
+  }
+}
+
+int checkBodySize() {
+  int failures = 0;
+  AlarmQueue queue;
+  int ready[ALARM_QUEUE_SIZE];
+  char body[ALARM_BODY_SIZE];
+
+  for (int alarms : { 6, 8 }) {
+    fillWorstCase(queue, alarms);
+    int count = collectReadyAlarms(queue, 0, ready, ALARM_QUEUE_SIZE);
+    size_t length = formatAlarmJSON(body, sizeof(body), SIM_DEVICE_ID, queue, ready, count);
+    printf("%d alarms of the longest kind: %zu of %d body bytes, %d sent\n", alarms, length, ALARM_BODY_SIZE, count);
+    if (length == 0 || count != alarms) {
+      printf("FAILED: the alarm body does not hold %d alarms\n", alarms);
+      failures++;
+    }
+  }
+
+  //The 512 byte body this lane had: the most urgent alarms go, the others stay queued for the next POST
+  fillWorstCase(queue, ALARM_QUEUE_SIZE);
+  char small[512];
+  int count = collectReadyAlarms(queue, 0, ready, ALARM_QUEUE_SIZE);
+  size_t length = formatAlarmJSON(small, sizeof(small), SIM_DEVICE_ID, queue, ready, count);
+  bool closed = length > 2 && strcmp(small + length - 2, "]}") == 0;
+  bool urgentFirst = count > 0 && queue.pending[ready[0]].type == ALARM_OVER_TEMPERATURE;
+  completeAlarms(queue, 1000, ready, count);
+  int left = queue.count;
+  int more = collectReadyAlarms(queue, 1000, ready, ALARM_QUEUE_SIZE);
+  size_t rest = formatAlarmJSON(small, sizeof(small), SIM_DEVICE_ID, queue, ready, more);
+  printf("512 byte body: %d alarms in the first POST, %d in the next\n\n", ALARM_QUEUE_SIZE - left, more);
+  if (!closed || !urgentFirst || left == 0 || left == ALARM_QUEUE_SIZE || rest == 0 || more != left) {
+    printf("FAILED: a body too small for the queue must post the alarms that fit\n");
+    failures++;
+  }
+  return failures;
+}
+
+// The alarm endpoint is down for SIM_OUTAGE_LENGTH, an alarm is raised every 10 s through it
+int simulateOutage() {
+  AlarmQueue queue;
+  initAlarmQueue(queue);
+  uint32_t outageEnd = SIM_OUTAGE_START + SIM_OUTAGE_LENGTH;
+  uint32_t postsInOutage = 0;
+  uint32_t lastDelivery = 0;
+
+  for (uint32_t now = 0; now < outageEnd + 600000; now += SIM_ALARM_INTERVAL) {
+    if (now >= SIM_OUTAGE_START && now < outageEnd && now % 10000 == 0) {
+      raiseAlarm(queue, (AlarmType)(now / 10000 % ALARM_TYPES), now / 40000 % 4, 30, now, now / 1000);
+    }
+
+    int ready[ALARM_QUEUE_SIZE];
+    int count = collectReadyAlarms(queue, now, ready, ALARM_QUEUE_SIZE);
+    char body[ALARM_BODY_SIZE];
+    if (count == 0 || formatAlarmJSON(body, sizeof(body), "GG-001", queue, ready, count) == 0) {
+      continue;
+    }
+    if (now < outageEnd) {
+      postsInOutage++;
+      alarmPostFailed(queue, now);
+    } else {
+      completeAlarms(queue, now, ready, count);
+      lastDelivery = queue.count == 0 && lastDelivery == 0 ? now : lastDelivery;
+    }
+  }
+
+  uint32_t maxWait = ALARM_RETRY_BASE << ALARM_MAX_BACKOFF;
+  printf("%u s outage: %u alarm POSTs tried (%u without the backoff), queue empty %.0f s after it\n",
+         SIM_OUTAGE_LENGTH / 1000, postsInOutage, SIM_OUTAGE_LENGTH / SIM_ALARM_INTERVAL,
+         lastDelivery > outageEnd ? (lastDelivery - outageEnd) / 1000.0 : 0.0);
+  if (postsInOutage > 12 || lastDelivery == 0 || lastDelivery - outageEnd > maxWait || queue.count != 0) {
+    printf("FAILED: the alarm lane does not back off and recover\n");
+    return 1;
+  }
+  return 0;
+}
+
+int main() {
+  printf("Simulated %lu h, bulk upload every %u s with %u rows pending, alarm lane latency vs riding in the batch\n\n",
+         SIM_DURATION / 3600000, SIM_UPLOAD_INTERVAL / 1000, SIM_BACKLOG_ROWS);
+  printf("%-5s %7s %7s %7s %8s %8s %8s %8s %8s %8s %8s %8s\n",
+         "Link", "Batch(s)", "Uploads", "Raised", "AlarmPOST", "Coalesce",
+         "Q P50(s)", "Q P95(s)", "Q Max(s)", "B P50(s)", "B P95(s)", "B Max(s)");
+
+  for (const LinkModel& model : linkModels) {
+    simulate(model);
+  }
+  printf("\n");
+
+  int failures = checkBodySize() + simulateOutage();
+  printf(failures == 0 ? "PASS\n" : "FAIL\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,393 @@
+/*****************************************
+*   Anomaly Detector Evaluation
+      - Runs gg_main_m7/anomaly_detector.h over a sensor trace (The "TRACE
+        <hex>" lines of a GG_TRACE_RECORD build, sensor_trace.h) with the
+        faults labelled by "# FAULT <start> <end> <channel> <name>" lines
+        (Unix times, AnomalyChannelId). The board ignores the labels, the
+        same file replays on a GG_TRACE_REPLAY build
+      - Without a file it builds a labelled week of synthetic readings: daily
+        cycles, heater cycling, sensor noise and resolution, and two of each
+        fault (Heater failure, water probe out of the tank, grow area
+        overheating, humidifier failure, TDS probe out of the solution)
+      - Reports the detection delay of every labelled fault and the anomalies
+        started outside them (False alarms), exits with 1 if a fault was missed
+      - Times addAnomalySample() per sample on the host, the board figure
+        comes from the anomalySample case of a GG_BENCHMARK build
+
+      g++ -O2 -o anomaly_eval tools/anomaly_eval.cpp
+      ./anomaly_eval                   Synthetic week
+      ./anomaly_eval --write week.txt  Save the synthetic week as a labelled trace
+      ./anomaly_eval capture.txt       Recorded trace with its labels
+*****************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "../gg_main_m7/sensor_math.h"
+#include "../gg_main_m7/anomaly_detector.h"
+
+//Same ids and encoding as sensor_trace.h
+enum TraceSource : uint8_t {
+  TRACE_CLOCK,
+  TRACE_DHT_TEMP,
+  TRACE_DHT_HUMIDITY,
+  TRACE_NTC_ADC,
+  TRACE_WATER_TEMP,
+  TRACE_PH_ADC,
+  TRACE_TDS,
+  TRACE_ENCODER,
+  TRACE_SOURCES
+};
+#define TRACE_NAN INT32_MIN
+#define TRACE_RECORDS_PER_LINE 8
+
+#define SIM_START 1700000000UL
+#define SIM_DAYS 7
+#define SIM_SAMPLE_INTERVAL 30  // s
+#define FALSE_ALARM_GRACE 10800  // s after a fault in which the return to normal is not a false alarm
+#define BENCH_SAMPLES 2000000
+
+struct TraceRecord {
+  uint32_t time;
+  int32_t value;
+  uint8_t source;
+};
+
+struct Fault {
+  uint32_t start;
+  uint32_t end;
+  int channel;
+  char name[32];
+};
+
+struct Trace {
+  std::vector<TraceRecord> records;
+  std::vector<Fault> faults;
+};
+
+uint32_t simRandom = 1;
+
+float randomUnit() {
+  simRandom = simRandom * 1103515245 + 12345;
+  return ((simRandom >> 8) & 0xFFFF) / 65536.0f;
+}
+
+// Roughly normal, sum of uniforms
+float randomNoise(float deviation) {
+  float sum = 0;
+  for (int i = 0; i < 6; i++) {
+    sum += randomUnit();
+  }
+  return (sum - 3) * deviation * 1.41f;
+}
+
+int32_t encodeFloat(float value) {
+  return isnan(value) ? TRACE_NAN : (int32_t)lroundf(value * 100);
+}
+
+// ADC code of the NTC divider at temperature, inverse of ntcTemperature()
+int32_t ntcReading(float temperature) {
+  float resistance = NOMINAL_RESISTANCE * expf(BCOEFFICIENT * (1 / (temperature + 273.15f) - 1 / (NOMINAL_TEMPERATURE + 273.15f)));
+  return (int32_t)lroundf(ADC_MAX / (SERIESRESISTOR / resistance + 1));
+}
+
+// 0 before start, rising to 1 with time constant tau (s)
+float approach(uint32_t time, uint32_t start, float tau) {
+  return time < start ? 0 : 1 - expf(-(float)(time - start) / tau);
+}
+
+/*****************************************
+*   Synthetic Week
+*****************************************/
+
+// Offset of a fault that moves the reading toward target with time constant tau, and back with recoverTau
+float faultOffset(const Fault& fault, uint32_t time, float normal, float target, float tau, float recoverTau) {
+  if (time < fault.start) {
+    return 0;
+  }
+  float reached = (target - normal) * approach(time < fault.end ? time : fault.end, fault.start, tau);
+  return time < fault.end ? reached : reached * (1 - approach(time, fault.end, recoverTau));
+}
+
+void addFault(Trace& trace, float day, float hours, int channel, const char* name) {
+  Fault fault;
+  fault.start = SIM_START + (uint32_t)(day * 86400);
+  fault.end = fault.start + (uint32_t)(hours * 3600);
+  fault.channel = channel;
+  snprintf(fault.name, sizeof(fault.name), "%s", name);
+  trace.faults.push_back(fault);
+}
+
+Trace syntheticWeek() {
+  Trace trace;
+  simRandom = 2024;
+
+  for (int week = 0; week < 2; week++) {
+    float day = week * 3.5f;
+    addFault(trace, day + 0.40f, 8, ANOMALY_WATER_TEMP, "heater_failure");
+    addFault(trace, day + 1.10f, 1, ANOMALY_WATER_TEMP, "probe_out_of_tank");
+    addFault(trace, day + 1.60f, 3, ANOMALY_GROW_TEMP, "grow_overheat");
+    addFault(trace, day + 2.30f, 4, ANOMALY_HUMIDITY, "humidifier_failure");
+    addFault(trace, day + 2.90f, 2, ANOMALY_TDS, "tds_probe_out");
+  }
+
+  uint32_t millis = 5000;
+  for (uint32_t time = SIM_START; time < SIM_START + SIM_DAYS * 86400UL; time += SIM_SAMPLE_INTERVAL, millis += SIM_SAMPLE_INTERVAL * 1000) {
+    float dayPhase = 2 * M_PI * ((time - SIM_START) % 86400) / 86400.0f;
+    float heaterCycle = ((time - SIM_START) % 1200) / 1200.0f;  // 20 min on / off
+
+    float room = 20 + 3 * sinf(dayPhase);
+    float grow = 24 + 0.8f * (heaterCycle < 0.5f ? heaterCycle : 1 - heaterCycle) + 0.7f * sinf(dayPhase);
+    float humidity = 62 - 8 * sinf(dayPhase);
+    float water = 25 + 0.3f * sinf(dayPhase - 1);  // Heated tank
+    float tds = 820 - 6 * (time - SIM_START) / 86400.0f;
+
+    for (const Fault& fault : trace.faults) {
+      if (strcmp(fault.name, "heater_failure") == 0) {
+        water += faultOffset(fault, time, water, room, 7200, 3600);
+      } else if (strcmp(fault.name, "probe_out_of_tank") == 0) {
+        water += faultOffset(fault, time, water, room, 120, 60);
+      } else if (strcmp(fault.name, "grow_overheat") == 0) {
+        grow += faultOffset(fault, time, grow, grow + 6, 5400, 1800);
+      } else if (strcmp(fault.name, "humidifier_failure") == 0) {
+        humidity += faultOffset(fault, time, humidity, humidity - 22, 1800, 1800);
+      } else if (strcmp(fault.name, "tds_probe_out") == 0) {
+        tds += faultOffset(fault, time, tds, 30, 60, 60);
+      }
+    }
+
+    //Sensor noise and resolution
+    grow = roundf((grow + randomNoise(0.1f)) * 10) / 10;        // DHT22, 0.1 C
+    humidity = roundf((humidity + randomNoise(0.6f)) * 10) / 10;
+    water = roundf((water + randomNoise(0.04f)) * 16) / 16;     // DS18B20, 0.0625 C
+    tds += randomNoise(4);
+
+    const TraceRecord pass[] = {
+      { millis, (int32_t)time, TRACE_CLOCK },
+      { millis + 20, encodeFloat(grow), TRACE_DHT_TEMP },
+      { millis + 40, encodeFloat(humidity), TRACE_DHT_HUMIDITY },
+      { millis + 41, ntcReading(room + randomNoise(0.05f)), TRACE_NTC_ADC },
+      { millis + 800, encodeFloat(water), TRACE_WATER_TEMP },
+      { millis + 801, 0, TRACE_PH_ADC },
+      { millis + 802, encodeFloat(tds), TRACE_TDS },
+    };
+    trace.records.insert(trace.records.end(), pass, pass + sizeof(pass) / sizeof(pass[0]));
+  }
+  return trace;
+}
+
+/*****************************************
+*   Trace Files
+*****************************************/
+
+bool writeTrace(const Trace& trace, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    return false;
+  }
+
+  for (const Fault& fault : trace.faults) {
+    fprintf(file, "# FAULT %u %u %d %s\n", fault.start, fault.end, fault.channel, fault.name);
+  }
+  for (size_t i = 0; i < trace.records.size(); i += TRACE_RECORDS_PER_LINE) {
+    fprintf(file, "TRACE ");
+    for (size_t j = i; j < i + TRACE_RECORDS_PER_LINE && j < trace.records.size(); j++) {
+      const TraceRecord& record = trace.records[j];
+      fprintf(file, "%08X%08X%02X", record.time, (uint32_t)record.value, record.source);
+    }
+    fprintf(file, "\n");
+  }
+  fprintf(file, "TRACE END\n");
+  fclose(file);
+  return true;
+}
+
+bool readTrace(Trace& trace, const char* path) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    return false;
+  }
+
+  char line[512];
+  while (fgets(line, sizeof(line), file)) {
+    Fault fault;
+    if (sscanf(line, "# FAULT %u %u %d %31s", &fault.start, &fault.end, &fault.channel, fault.name) == 4) {
+      trace.faults.push_back(fault);
+      continue;
+    }
+    if (strncmp(line, "TRACE ", 6) != 0) {
+      continue;
+    }
+
+    //Same layout as parseTraceLine() in sensor_trace.h
+    for (const char* hex = line + 6; strspn(hex, "0123456789ABCDEFabcdef") >= 18; hex += 18) {
+      char field[9] = { 0 };
+      TraceRecord record;
+      memcpy(field, hex, 8);
+      record.time = strtoul(field, NULL, 16);
+      memcpy(field, hex + 8, 8);
+      record.value = (int32_t)strtoul(field, NULL, 16);
+      field[2] = '\0';
+      memcpy(field, hex + 16, 2);
+      record.source = strtoul(field, NULL, 16);
+      if (record.source < TRACE_SOURCES) {
+        trace.records.push_back(record);
+      }
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+/*****************************************
+*   Evaluation
+*****************************************/
+
+struct Detection {
+  uint32_t time;
+  int channel;
+  uint8_t flags;
+};
+
+// Feed every sensing pass to the detector the way the read functions do, 0 readings are faults and skipped
+std::vector<Detection> detect(const Trace& trace, uint32_t& firstTime, uint32_t& lastTime) {
+  AnomalyChannel channels[ANOMALY_CHANNELS];
+  for (AnomalyChannel& channel : channels) {
+    initAnomalyChannel(channel);
+  }
+
+  std::vector<Detection> detections;
+  int32_t inputs[TRACE_SOURCES] = { 0 };
+  firstTime = 0;
+  lastTime = 0;
+
+  for (const TraceRecord& record : trace.records) {
+    inputs[record.source] = record.value;
+    if (record.source != TRACE_TDS) {
+      continue;
+    }
+
+    uint32_t time = (uint32_t)inputs[TRACE_CLOCK];
+    firstTime = firstTime == 0 ? time : firstTime;
+    lastTime = time;
+
+    float values[ANOMALY_CHANNELS];
+    bool valid[ANOMALY_CHANNELS];
+    values[ANOMALY_GROW_TEMP] = inputs[TRACE_DHT_TEMP] / 100.0f;
+    values[ANOMALY_HUMIDITY] = inputs[TRACE_DHT_HUMIDITY] / 100.0f;
+    values[ANOMALY_AMBIENT_TEMP] = inputs[TRACE_NTC_ADC] ? ntcTemperature(inputs[TRACE_NTC_ADC]) : 0;
+    values[ANOMALY_WATER_TEMP] = inputs[TRACE_WATER_TEMP] / 100.0f;
+    values[ANOMALY_TDS] = inputs[TRACE_TDS] / 100.0f;
+    valid[ANOMALY_GROW_TEMP] = valid[ANOMALY_HUMIDITY] = inputs[TRACE_DHT_TEMP] != TRACE_NAN;
+    valid[ANOMALY_AMBIENT_TEMP] = inputs[TRACE_NTC_ADC] != 0;
+    valid[ANOMALY_WATER_TEMP] = inputs[TRACE_WATER_TEMP] != TRACE_NAN;
+    valid[ANOMALY_TDS] = inputs[TRACE_TDS] != 0;
+
+    for (int id = 0; id < ANOMALY_CHANNELS; id++) {
+      if (valid[id] && addAnomalySample(channels[id], anomalyLimits[id], values[id], time) == ANOMALY_STARTED) {
+        detections.push_back({ time, id, channels[id].activeFlags });
+      }
+    }
+  }
+  return detections;
+}
+
+const char* flagNames(uint8_t flags) {
+  return flags == (ANOMALY_LEVEL | ANOMALY_RATE) ? "level+rate" : flags == ANOMALY_RATE ? "rate" : "level";
+}
+
+// Returns the number of missed faults
+int evaluate(const Trace& trace) {
+  uint32_t firstTime, lastTime;
+  std::vector<Detection> detections = detect(trace, firstTime, lastTime);
+  std::vector<bool> explained(detections.size(), false);
+  int missed = 0;
+
+  printf("%-20s %-11s %10s %10s %12s %-10s\n", "Fault", "Channel", "Start", "Length(h)", "Detected(min)", "By");
+  for (const Fault& fault : trace.faults) {
+    const Detection* first = NULL;
+    for (size_t i = 0; i < detections.size(); i++) {
+      const Detection& detection = detections[i];
+      if (detection.channel == fault.channel && detection.time >= fault.start && detection.time < fault.end + FALSE_ALARM_GRACE) {
+        explained[i] = true;
+        if (first == NULL && detection.time < fault.end) {
+          first = &detection;
+        }
+      }
+    }
+
+    char delay[16] = "missed";
+    if (first != NULL) {
+      snprintf(delay, sizeof(delay), "%.1f", (first->time - fault.start) / 60.0);
+    } else {
+      missed++;
+    }
+    printf("%-20s %-11s %10u %10.1f %12s %-10s\n", fault.name, anomalyChannelNames[fault.channel],
+           fault.start - firstTime, (fault.end - fault.start) / 3600.0, delay, first != NULL ? flagNames(first->flags) : "");
+  }
+
+  float days = (lastTime - firstTime) / 86400.0f;
+  printf("\n%-11s %12s %12s\n", "Channel", "FalseAlarms", "PerDay");
+  for (int id = 0; id < ANOMALY_CHANNELS; id++) {
+    int count = 0;
+    for (size_t i = 0; i < detections.size(); i++) {
+      if (!explained[i] && detections[i].channel == id) {
+        count++;
+        printf("  false alarm %s at +%.2f h (%s)\n", anomalyChannelNames[id], (detections[i].time - firstTime) / 3600.0, flagNames(detections[i].flags));
+      }
+    }
+    printf("%-11s %12d %12.2f\n", anomalyChannelNames[id], count, days > 0 ? count / days : 0);
+  }
+  printf("\n%.1f days, %zu faults, %d missed\n", days, trace.faults.size(), missed);
+  return missed;
+}
+
+void benchmark() {
+  AnomalyChannel channel;
+  initAnomalyChannel(channel);
+  simRandom = 7;
+  std::vector<float> values(4096);
+  for (float& value : values) {
+    value = 22 + randomNoise(0.1f);
+  }
+
+  volatile int sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < BENCH_SAMPLES; i++) {
+    sink += addAnomalySample(channel, anomalyLimits[ANOMALY_WATER_TEMP], values[i & 4095], SIM_START + i * SIM_SAMPLE_INTERVAL);
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  printf("addAnomalySample: %.1f ns per sample on the host, %zu bytes of state per channel\n", ns / BENCH_SAMPLES, sizeof(AnomalyChannel));
+}
+
+int main(int argc, char** argv) {
+  Trace trace;
+
+  if (argc == 3 && strcmp(argv[1], "--write") == 0) {
+    trace = syntheticWeek();
+    if (!writeTrace(trace, argv[2])) {
+      perror(argv[2]);
+      return 2;
+    }
+    printf("%zu records, %zu faults written to %s\n", trace.records.size(), trace.faults.size(), argv[2]);
+    return 0;
+  }
+
+  if (argc == 2) {
+    if (!readTrace(trace, argv[1])) {
+      perror(argv[1]);
+      return 2;
+    }
+  } else {
+    trace = syntheticWeek();
+  }
+
+  int missed = evaluate(trace);
+  printf("\n");
+  benchmark();
+  return missed > 0 ? 1 : 0;
+}
@@ -0,0 +1,195 @@
+/*****************************************
+*   Deflate Benchmark
+      - Compresses upload bodies shaped like those of convertToJSON() with
+        gg_main_m7/deflate.h and reports the ratio and the cost per upload
+      - Payloads: the rows of one upload interval (10 rows), a backlog as
+        large as fits the 64 KB staging buffer (50 rows, 20 with 8 zones), with
+        1 and 8 zones, and a catch-up upload of an hour of minute rollups.
+        Values as the sensors give them: whole degrees and % from the DHT11,
+        1/16 C from the DS18B20, floats from the NTC and the TDS
+      - Every stream is inflated again (tools/tests/inflate_fixed.h) and its
+        Adler-32 checked, the run exits with 1 if
+        one does not match. --write <dir> saves each body and its stream to
+        check them with another inflater:
+          python3 -c "import sys,zlib; print(zlib.decompress(open(sys.argv[1],'rb').read()) == open(sys.argv[2],'rb').read())" d/rows50.zz d/rows50.json
+      - Host time, the board figure comes from the deflateCompress case of a
+        GG_BENCHMARK build
+
+      g++ -O2 -o deflate_bench tools/deflate_bench.cpp && ./deflate_bench
+*****************************************/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+
+#include "../gg_main_m7/deflate.h"
+#include "tests/inflate_fixed.h"
+
+#define BENCH_BODY_SIZE 65536  // UPLOAD_STAGING_SIZE of gg_main_m7.ino
+
+uint32_t benchRandom = 1;
+
+float randomUnit() {
+  benchRandom = benchRandom * 1103515245 + 12345;
+  return ((benchRandom >> 8) & 0xFFFF) / 65536.0f;
+}
+
+struct Channel {
+  const char* name;
+  const char* sensorName;
+  const char* sensorType;
+  const char* dataType;
+  const char* location;
+  float value;
+  float step;     // Largest change between two rows
+  float quantum;  // Sensor resolution, 0 for a float with all its digits
+};
+
+void appendf(std::string& text, const char* format, ...) __attribute__((format(printf, 2, 3)));
+void appendf(std::string& text, const char* format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  text += buffer;
+}
+
+int buildChannels(Channel* channels, int zones) {
+  static char locations[8][24];
+  int count = 0;
+  channels[count++] = { "Device Temperature", "Sensor 1", "Internal", "Temperature", "Default", 31.2f, 0.2f, 0 };
+  channels[count++] = { "Temperature Sensor", "Sensor 1", "DHT", "Temperature", "Greenhouse 1", 22, 1, 1 };
+  channels[count++] = { "Humidity Sensor", "Sensor 1", "DHT", "Humidity", "Greenhouse 1", 61, 2, 1 };
+  channels[count++] = { "Water Temperature", "Sensor 1", "ds18b20", "Temperature", "Greenhouse 1", 24.5f, 0.0625f, 0.0625f };
+  channels[count++] = { "TDS", "TDS Sensor 1", "TDS", "PPM", "Greenhouse 1", 612, 4, 0 };
+  for (int zone = 1; zone < zones; zone++) {
+    snprintf(locations[zone], sizeof(locations[zone]), "Greenhouse %d", zone + 1);
+    channels[count++] = { "Temperature Sensor", "Sensor 1", "DHT", "Temperature", locations[zone], 20.0f + zone, 1, 1 };
+    channels[count++] = { "Humidity Sensor", "Sensor 1", "DHT", "Humidity", locations[zone], 55.0f + zone, 2, 1 };
+  }
+  return count;
+}
+
+float nextValue(Channel& channel) {
+  channel.value += (randomUnit() * 2 - 1) * channel.step;
+  if (channel.quantum > 0) {
+    return roundf(channel.value / channel.quantum) * channel.quantum;
+  }
+  return channel.value;
+}
+
+// The "Data" rows of convertToJSON(), floats printed with up to 9 digits as the JSON library does
+std::string rowsPayload(int rows, int zones) {
+  Channel channels[20];
+  int count = buildChannels(channels, zones);
+  benchRandom = 7;
+
+  std::string body = "{\"Sequence\":1042,\"Data\":[";
+  for (int row = 0; row < rows; row++) {
+    appendf(body, "%s{\"Device\":{\"DeviceID\":\"GG-001\"},\"SensorReadings\":[", row > 0 ? "," : "");
+    for (int i = 0; i < count; i++) {
+      Channel& channel = channels[i];
+      appendf(body, "%s{\"Name\":\"%s\",\"Value\":%.9g,\"Time\":%u,\"Sensor\":\"%s\",\"Type\":\"%s\",\"Field\":\"%s\",\"Location\":\"%s\"}",
+              i > 0 ? "," : "", channel.name, nextValue(channel), 1760000000u + row * 30,
+              channel.sensorName, channel.sensorType, channel.dataType, channel.location);
+    }
+    body += "]}";
+  }
+  body += "]}";
+  return body;
+}
+
+// A catch-up upload: minute rollups of every channel (addRollupToJSON())
+std::string rollupsPayload(int minutes) {
+  Channel channels[20];
+  int count = buildChannels(channels, 1);
+  benchRandom = 11;
+
+  std::string body = "{\"Sequence\":1043,\"Rollups\":[";
+  for (int i = 0; i < count; i++) {
+    Channel& channel = channels[i];
+    for (int minute = 0; minute < minutes; minute++) {
+      float a = nextValue(channel), b = nextValue(channel);
+      appendf(body, "%s{\"Name\":\"%s\",\"Sensor\":\"%s\",\"Type\":\"%s\",\"Field\":\"%s\",\"Location\":\"%s\",\"Start\":%u,\"Period\":60,\"Min\":%.9g,\"Max\":%.9g,\"Mean\":%.9g,\"Count\":2}",
+              i > 0 || minute > 0 ? "," : "", channel.name, channel.sensorName, channel.sensorType, channel.dataType,
+              channel.location, 1760000000u + minute * 60, fminf(a, b), fmaxf(a, b), (a + b) / 2);
+    }
+  }
+  body += "],\"Data\":[]}";
+  return body;
+}
+
+
+/*****************************************
+*   Benchmark
+*****************************************/
+
+void writeFile(const char* directory, const char* name, const char* extension, const void* data, size_t length) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s.%s", directory, name, extension);
+  FILE* file = fopen(path, "wb");
+  if (file != NULL) {
+    fwrite(data, 1, length, file);
+    fclose(file);
+  }
+}
+
+int main(int argc, char** argv) {
+  const char* writeDirectory = argc > 2 && strcmp(argv[1], "--write") == 0 ? argv[2] : NULL;
+
+  struct Payload {
+    const char* name;
+    std::string body;
+  } payloads[] = {
+    { "rows10", rowsPayload(10, 1) },
+    { "rows50", rowsPayload(50, 1) },
+    { "rows10_8zones", rowsPayload(10, 8) },
+    { "rows20_8zones", rowsPayload(20, 8) },
+    { "rollups", rollupsPayload(60) },
+  };
+
+  static DeflateState state;
+  static uint8_t stream[BENCH_BODY_SIZE];
+  int failures = 0;
+
+  printf("Upload bodies compressed with deflate.h (Fixed Huffman, %d hashes x %d positions), host time\n", 1 << DEFLATE_HASH_BITS, DEFLATE_WAYS);
+  printf("State %zu bytes plus the output buffer\n\n", sizeof(DeflateState));
+  printf("%-15s %9s %9s %7s %10s %9s  %s\n", "Payload", "Body(B)", "Wire(B)", "Ratio", "us/upload", "MB/s", "Round trip");
+
+  for (Payload& payload : payloads) {
+    const uint8_t* body = (const uint8_t*)payload.body.data();
+    size_t length = payload.body.size();
+    if (length > DEFLATE_MAX_INPUT) {
+      printf("%-15s %9zu  larger than an upload body, skipped\n", payload.name, length);
+      continue;
+    }
+
+    size_t compressed = deflateCompress(state, body, length, stream, sizeof(stream));
+    std::string inflated;
+    bool same = compressed > 0 && inflateFixed(stream, compressed, inflated) && inflated == payload.body;
+    failures += !same;
+
+    int calls = 20000000 / length + 1;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; i++) {
+      deflateCompress(state, body, length, stream, sizeof(stream));
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / calls;
+
+    printf("%-15s %9zu %9zu %6.1fx %10.1f %9.1f  %s\n", payload.name, length, compressed, (double)length / compressed,
+           us, length / us, same ? "ok" : "FAIL");
+
+    if (writeDirectory != NULL) {
+      writeFile(writeDirectory, payload.name, "json", body, length);
+      writeFile(writeDirectory, payload.name, "zz", stream, compressed);
+    }
+  }
+
+  printf("\n%s\n", failures == 0 ? "Every stream inflates back to its body" : "Round trip FAILED");
+  return failures == 0 ? 0 : 1;
+}
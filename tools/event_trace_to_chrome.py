@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""Convert a gg_main_m7 post-mortem event trace (event_trace.h) to Chrome trace JSON.
+
+The input is either a serial capture holding the "EVENTS" lines printed at
+boot, or the "PostMortem" object of an upload. The event kinds and their
+ids are read from event_trace.h, so the tool always matches the firmware.
+Open the output in chrome://tracing or https://ui.perfetto.dev.
+
+    python3 tools/event_trace_to_chrome.py capture.txt -o trace.json
+    python3 tools/event_trace_to_chrome.py --json upload.json -o trace.json
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+EVENT_HEX_SIZE = 16
+WRAP = 1 << 32  # micros() wraps after about 71 minutes
+
+PID = 1
+TID_TASKS = 1
+TID_HTTP = 2
+TID_EVENTS = 3
+
+
+def load_header(header_path):
+    """Return the event kind names and the HttpEventState / SensorFaultId names, in id order."""
+    with open(header_path) as header:
+        source = header.read()
+
+    table = source[source.index("#define EVENT_KINDS(X)"):]
+    table = table[:table.index("\n\n")]
+    kinds = re.findall(r"X\((\w+)\)", table)
+
+    def enum_names(name):
+        body = re.search(r"enum %s\s*:\s*\w+\s*\{([^}]*)\}" % name, source).group(1)
+        return [entry.strip() for entry in body.split(",") if entry.strip()]
+
+    return kinds, enum_names("HttpEventState"), enum_names("SensorFaultId")
+
+
+def parse_events(hex_text):
+    events = []
+    for i in range(0, len(hex_text) - EVENT_HEX_SIZE + 1, EVENT_HEX_SIZE):
+        field = hex_text[i:i + EVENT_HEX_SIZE]
+        events.append((int(field[0:8], 16), int(field[8:10], 16), int(field[10:12], 16), int(field[12:16], 16)))
+    return events
+
+
+def read_capture(path):
+    """Return (boot, reset flags, task names, events) of the dump in a serial capture."""
+    boot, reset, tasks, hex_text = 0, 0, [], ""
+    with open(path, "rb") as capture:
+        for raw in capture.read().split(b"\n"):
+            line = raw.decode("latin-1").strip()
+            # Binary log frames can share the line, start at the marker
+            start = line.find("EVENTS ")
+            if start < 0:
+                continue
+            line = line[start + len("EVENTS "):]
+
+            if line.startswith("BOOT "):
+                fields = line.split()
+                boot, reset, tasks, hex_text = int(fields[1]), int(fields[3], 16), [], ""
+            elif line.startswith("TASKS "):
+                tasks = line[len("TASKS "):].split(",")
+            elif line == "END":
+                continue
+            else:
+                hex_text += line
+    return boot, reset, tasks, parse_events(hex_text)
+
+
+def read_upload(path):
+    with open(path) as upload:
+        document = json.load(upload)
+    post_mortem = document.get("PostMortem", document)
+    return post_mortem["boot"], post_mortem["reset"], post_mortem["tasks"], parse_events(post_mortem["events"])
+
+
+def to_chrome(boot, reset, tasks, events, kinds, http_states, faults):
+    def name_of(names, index, prefix):
+        return names[index] if index < len(names) else "%s %d" % (prefix, index)
+
+    trace = [
+        {"ph": "M", "pid": PID, "name": "process_name", "args": {"name": "gg_main_m7 boot %d" % boot}},
+        {"ph": "M", "pid": PID, "tid": TID_TASKS, "name": "thread_name", "args": {"name": "Tasks"}},
+        {"ph": "M", "pid": PID, "tid": TID_HTTP, "name": "thread_name", "args": {"name": "HTTP"}},
+        {"ph": "M", "pid": PID, "tid": TID_EVENTS, "name": "thread_name", "args": {"name": "Events"}},
+    ]
+
+    offset = 0
+    last_time = None
+    open_task = None
+    open_request = False
+
+    for time, kind, event_id, value in events:
+        if last_time is not None and time < last_time:
+            offset += WRAP
+        last_time = time
+        ts = time + offset
+        kind_name = name_of(kinds, kind, "EVENT")
+
+        if kind_name == "EVENT_TASK_START":
+            open_task = name_of(tasks, event_id, "task")
+            trace.append({"ph": "B", "pid": PID, "tid": TID_TASKS, "ts": ts, "name": open_task, "args": {"folded runs": value}})
+        elif kind_name == "EVENT_TASK_STOP":
+            open_task = None
+            trace.append({"ph": "E", "pid": PID, "tid": TID_TASKS, "ts": ts})
+        elif kind_name == "EVENT_HTTP":
+            state = name_of(http_states, event_id, "HTTP")
+            if state in ("HTTP_GET_START", "HTTP_POST_START"):
+                args = {"bytes": value} if state == "HTTP_POST_START" else {}
+                trace.append({"ph": "B", "pid": PID, "tid": TID_HTTP, "ts": ts, "name": state[5:-6], "args": args})
+                open_request = True
+            elif open_request:
+                trace.append({"ph": "E", "pid": PID, "tid": TID_HTTP, "ts": ts, "args": {"result": state, "status": value}})
+                open_request = False
+            else:
+                trace.append({"ph": "i", "s": "t", "pid": PID, "tid": TID_HTTP, "ts": ts, "name": state, "args": {"status": value}})
+        elif kind_name == "EVENT_RELAY":
+            trace.append({"ph": "C", "pid": PID, "ts": ts, "name": "relay %d" % event_id, "args": {"on": value}})
+        elif kind_name == "EVENT_WIFI":
+            trace.append({"ph": "C", "pid": PID, "ts": ts, "name": "wifi status", "args": {"status": value}})
+        elif kind_name == "EVENT_SENSOR_FAULT":
+            zone_fault = faults.index("FAULT_ZONE_DHT")
+            fault = name_of(faults, event_id, "FAULT") if event_id < zone_fault else "FAULT_DHT zone %d" % (event_id - zone_fault + 2)
+            trace.append({"ph": "i", "s": "t", "pid": PID, "tid": TID_EVENTS, "ts": ts, "name": fault})
+        elif kind_name == "EVENT_BOOT":
+            trace.append({"ph": "i", "s": "g", "pid": PID, "tid": TID_EVENTS, "ts": ts, "name": "boot", "args": {"reset": "0x%X" % (value << 16)}})
+        else:
+            trace.append({"ph": "i", "s": "t", "pid": PID, "tid": TID_EVENTS, "ts": ts, "name": kind_name, "args": {"id": event_id, "value": value}})
+
+    summary = "%d events, reset flags 0x%08X" % (len(events), reset)
+    if open_task is not None:
+        summary += ", last task never finished: %s" % open_task
+    return {"traceEvents": trace, "displayTimeUnit": "ms", "otherData": {"boot": boot, "reset": "0x%08X" % reset}}, summary
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture", nargs="?", help="Serial capture with the EVENTS lines")
+    parser.add_argument("--json", help="Upload body (or its PostMortem object) instead of a capture")
+    parser.add_argument("-o", "--output", help="Chrome trace JSON, stdout when omitted")
+    parser.add_argument("--header", default=os.path.join(here, "..", "gg_main_m7", "event_trace.h"))
+    args = parser.parse_args()
+
+    if not args.capture and not args.json:
+        parser.error("give a capture or --json")
+
+    kinds, http_states, faults = load_header(args.header)
+    boot, reset, tasks, events = read_upload(args.json) if args.json else read_capture(args.capture)
+    if not events:
+        sys.exit("No events found")
+
+    trace, summary = to_chrome(boot, reset, tasks, events, kinds, http_states, faults)
+    if args.output:
+        with open(args.output, "w") as out:
+            json.dump(trace, out)
+    else:
+        json.dump(trace, sys.stdout)
+        sys.stdout.write("\n")
+    sys.stderr.write(summary + "\n")
+
+
+if __name__ == "__main__":
+    main()
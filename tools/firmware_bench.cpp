@@ -0,0 +1,137 @@
+/*****************************************
+*   Firmware Benchmark (Host)
+      - The benchmark cases of gg_main_m7/benchmark.h that need no board,
+        built for the host: getMedianNum(), the TDS and NTC conversions,
+        convertTimeStamp() and the sample columns (addSample() and
+        sampleTimeRange() with 0, 10 and 100 rows held)
+      - The same runBenchmark() prints the same BENCH JSON lines as a
+        GG_BENCHMARK build on the board, so one script collects both. On
+        the host "cycles" is 0 and "ns" is the monotonic clock
+      - Checks that every case printed its line with a time, and the
+        results of the functions timed: the median, the timestamp text, a
+        full column refusing the sample and the fill staying as it was.
+        Exits with 1 if a check fails
+
+      g++ -O2 -I tools/host -o firmware_bench tools/firmware_bench.cpp && ./firmware_bench
+*****************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "tests/fake_json.h"
+
+#include "../gg_main_m7/sensor_math.h"
+#include "../gg_main_m7/zones.h"
+#include "../gg_main_m7/sample_columns.h"
+#include "../gg_main_m7/getTime.h"
+#include "../gg_main_m7/profiler.h"
+#include "../gg_main_m7/benchmark.h"
+
+SampleColumns columns;
+
+// One BENCH line, as a script reading the Serial Monitor parses it
+struct BenchLine {
+  char name[32];
+  int rows;
+  int iterations;
+  unsigned long cycles;
+  double ns;
+};
+
+std::vector<BenchLine> parseBenchLines(const std::string& output) {
+  std::vector<BenchLine> lines;
+  for (size_t start = 0; start < output.size();) {
+    size_t end = output.find('\n', start);
+    std::string line = output.substr(start, end - start);
+    start = end == std::string::npos ? output.size() : end + 1;
+
+    BenchLine bench;
+    if (sscanf(line.c_str(), "BENCH {\"build\":\"%*[^\"]\",\"name\":\"%31[^\"]\",\"rows\":%d,\"iterations\":%d,\"cycles\":%lu,\"ns\":%lf}",
+               bench.name, &bench.rows, &bench.iterations, &bench.cycles, &bench.ns) == 5) {
+      lines.push_back(bench);
+    }
+  }
+  return lines;
+}
+
+int main() {
+  bool ok = true;
+
+  //The board keeps UTC
+  setenv("TZ", "UTC", 1);
+  tzset();
+
+  initProfiler();
+
+  //Every line goes to stdout and is kept for the checks
+  std::string output;
+  Serial.capture = &output;
+  runPortableBenchmarks(columns);
+  Serial.capture = NULL;
+
+  //Each case once, the sample cases once per fill
+  struct Expected {
+    const char* name;
+    int rows;
+  };
+  const Expected expected[] = {
+    { "getMedianNum", BENCHMARK_MEDIAN_SAMPLES }, { "tdsFromVoltage", 0 }, { "ntcTemperature", 0 }, { "convertTimeStamp", 0 },
+    { "addSample", 0 }, { "sampleTimeRange", 0 }, { "addSample", 10 }, { "sampleTimeRange", 10 },
+    { "addSample", SAMPLE_ROWS }, { "sampleTimeRange", SAMPLE_ROWS },
+  };
+  const int expectedCount = sizeof(expected) / sizeof(expected[0]);
+
+  std::vector<BenchLine> lines = parseBenchLines(output);
+  if ((int)lines.size() != expectedCount) {
+    printf("FAIL: %d BENCH lines, expected %d\n", (int)lines.size(), expectedCount);
+    ok = false;
+  }
+  for (int i = 0; i < expectedCount && i < (int)lines.size(); i++) {
+    const BenchLine& line = lines[i];
+    if (strcmp(line.name, expected[i].name) != 0 || line.rows != expected[i].rows) {
+      printf("FAIL: line %d is %s rows %d, expected %s rows %d\n", i + 1, line.name, line.rows, expected[i].name, expected[i].rows);
+      ok = false;
+    }
+    if (!(line.ns > 0) || line.iterations <= 0 || line.cycles != 0) {
+      printf("FAIL: %s rows %d has %d iterations, %lu cycles, %.1f ns\n", line.name, line.rows, line.iterations, line.cycles, line.ns);
+      ok = false;
+    }
+  }
+
+  //The functions timed give the right results
+  std::vector<int> sorted(benchmarkAdc, benchmarkAdc + BENCHMARK_MEDIAN_SAMPLES);
+  std::sort(sorted.begin(), sorted.end());
+  int median = (sorted[BENCHMARK_MEDIAN_SAMPLES / 2] + sorted[BENCHMARK_MEDIAN_SAMPLES / 2 - 1]) / 2;
+  if (getMedianNum(benchmarkAdc, BENCHMARK_MEDIAN_SAMPLES) != median) {
+    printf("FAIL: getMedianNum %d, expected %d\n", getMedianNum(benchmarkAdc, BENCHMARK_MEDIAN_SAMPLES), median);
+    ok = false;
+  }
+
+  String stamp = convertTimeStamp(1700000000UL);
+  if (strcmp(stamp.c_str(), "2023-11-14 22:13:20") != 0) {
+    printf("FAIL: convertTimeStamp gave %s\n", stamp.c_str());
+    ok = false;
+  }
+
+  //A pass adds a row up to the last one, a full column refuses it, the fill is the same after
+  const int fills[] = { 0, 10, SAMPLE_ROWS - 1, SAMPLE_ROWS };
+  for (int fill : fills) {
+    fillBenchmarkRows(columns, fill);
+    benchmarkColumns = &columns;
+    benchmarkFill = fill;
+    benchAddSample();
+    bool added = benchmarkSink != 0;
+    if (added != (fill < SAMPLE_ROWS) || sampleRowCount(columns) != fill) {
+      printf("FAIL: addSample on %d rows: added %d, %d rows after\n", fill, added, sampleRowCount(columns));
+      ok = false;
+    }
+  }
+
+  printf("%d cases timed, %s\n", (int)lines.size(), ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
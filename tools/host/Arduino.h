@@ -0,0 +1,378 @@
+/*****************************************
+*   Host Arduino Shim
+      - The part of the Arduino core the firmware headers use, for the host
+        tests in tools/tests (CMake target in tools/CMakeLists.txt)
+      - Virtual clock: millis() and micros() only move when a test calls
+        hostAdvance() (Or delay()), so the tests are deterministic
+      - Pins are an array of levels, hostSetPin() changes one and runs the
+        interrupt attached to it, as the edge would on the board
+      - Serial writes to stdout. A test can give it a baud rate: its TX
+        buffer then empties at that rate on the virtual clock and a write to
+        a full buffer waits for room, as it blocks on the board
+*****************************************/
+
+#ifndef GG_HOST_ARDUINO_H
+#define GG_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <type_traits>
+
+typedef uint8_t byte;
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define HOST_PINS 128
+
+//Binary constants of the LCD glyphs (Arduino binary.h)
+#define B00000 0
+#define B00100 4
+#define B01010 10
+#define B01110 14
+#define B11111 31
+
+//Virtual time
+inline uint64_t& hostMicros() {
+  static uint64_t micros = 0;
+  return micros;
+}
+
+//One shot timers (mbed::Timeout in mbed.h), run by hostAdvance() when their deadline is reached
+struct HostTimer {
+  uint64_t deadline;
+  void (*callback)();
+};
+
+#define HOST_TIMERS 16
+
+inline HostTimer** hostTimers() {
+  static HostTimer* timers[HOST_TIMERS];
+  return timers;
+}
+
+inline void hostAdvanceMicros(unsigned long us) {
+  uint64_t end = hostMicros() + us;
+
+  //Step to each deadline in order, a callback may arm a timer again
+  while (true) {
+    HostTimer* due = NULL;
+    for (int i = 0; i < HOST_TIMERS; i++) {
+      HostTimer* timer = hostTimers()[i];
+      if (timer != NULL && timer->callback != NULL && timer->deadline <= end && (due == NULL || timer->deadline < due->deadline)) {
+        due = timer;
+      }
+    }
+    if (due == NULL) {
+      break;
+    }
+
+    if (due->deadline > hostMicros()) {
+      hostMicros() = due->deadline;
+    }
+    void (*callback)() = due->callback;
+    due->callback = NULL;
+    callback();
+  }
+
+  hostMicros() = end;
+}
+
+inline void hostAdvance(unsigned long ms) {
+  hostAdvanceMicros(ms * 1000);
+}
+
+inline unsigned long millis() {
+  return (unsigned long)(hostMicros() / 1000);
+}
+
+inline unsigned long micros() {
+  return (unsigned long)hostMicros();
+}
+
+inline void delay(unsigned long ms) {
+  hostAdvance(ms);
+}
+
+inline void delayMicroseconds(unsigned int us) {
+  hostAdvanceMicros(us);
+}
+
+//Pins and interrupts
+struct HostPin {
+  int level;
+  int mode;
+  void (*isr)();
+  int isrMode;
+  int analog;
+};
+
+inline HostPin* hostPins() {
+  static HostPin pins[HOST_PINS];
+  return pins;
+}
+
+inline void pinMode(int pin, int mode) {
+  hostPins()[pin].mode = mode;
+  if (mode == INPUT_PULLUP && hostPins()[pin].isr == NULL) {
+    hostPins()[pin].level = HIGH;
+  }
+}
+
+inline int digitalRead(int pin) {
+  return hostPins()[pin].level;
+}
+
+inline void digitalWrite(int pin, int level) {
+  hostPins()[pin].level = level;
+}
+
+inline int analogRead(int pin) {
+  return hostPins()[pin].analog;
+}
+
+inline int digitalPinToInterrupt(int pin) {
+  return pin;
+}
+
+inline void attachInterrupt(int interrupt, void (*isr)(), int mode) {
+  hostPins()[interrupt].isr = isr;
+  hostPins()[interrupt].isrMode = mode;
+}
+
+inline void detachInterrupt(int interrupt) {
+  hostPins()[interrupt].isr = NULL;
+}
+
+// Drive an input pin, the attached interrupt runs if the edge matches its mode
+inline void hostSetPin(int pin, int level) {
+  HostPin& state = hostPins()[pin];
+  int previous = state.level;
+  state.level = level;
+
+  if (state.isr == NULL || previous == level) {
+    return;
+  }
+  if (state.isrMode == CHANGE || (state.isrMode == RISING && level == HIGH) || (state.isrMode == FALLING && level == LOW)) {
+    state.isr();
+  }
+}
+
+template <typename T, typename U>
+inline typename std::common_type<T, U>::type min(T a, U b) {
+  return a < b ? a : b;
+}
+
+template <typename T, typename U>
+inline typename std::common_type<T, U>::type max(T a, U b) {
+  return a > b ? a : b;
+}
+
+#define constrain(value, low, high) ((value) < (low) ? (low) : ((value) > (high) ? (high) : (value)))
+
+#if !defined(__APPLE__) && !defined(__FreeBSD__)
+inline size_t strlcpy(char* destination, const char* source, size_t size) {
+  size_t length = strlen(source);
+  if (size > 0) {
+    size_t copy = length < size - 1 ? length : size - 1;
+    memcpy(destination, source, copy);
+    destination[copy] = '\0';
+  }
+  return length;
+}
+#endif
+
+//String, the part the firmware headers use
+class String {
+public:
+  String() {}
+  String(const char* text) : text_(text) {}
+
+  unsigned int length() const {
+    return (unsigned int)text_.size();
+  }
+
+  const char* c_str() const {
+    return text_.c_str();
+  }
+
+private:
+  std::string text_;
+};
+
+#define DEC 10
+#define HEX 16
+
+//Print, the base of Serial and the LCD
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+
+  size_t write(const char* text) {
+    size_t length = 0;
+    while (text[length] != '\0') {
+      write((uint8_t)text[length++]);
+    }
+    return length;
+  }
+
+  size_t write(char c) {
+    return write((uint8_t)c);
+  }
+
+  size_t write(const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      write(data[i]);
+    }
+    return size;
+  }
+
+  size_t print(const char* text) {
+    return write(text);
+  }
+
+  size_t print(char c) {
+    return write((uint8_t)c);
+  }
+
+  size_t print(long value) {
+    char text[24];
+    snprintf(text, sizeof(text), "%ld", value);
+    return write(text);
+  }
+
+  size_t print(unsigned long value) {
+    char text[24];
+    snprintf(text, sizeof(text), "%lu", value);
+    return write(text);
+  }
+
+  size_t print(int value) {
+    return print((long)value);
+  }
+
+  size_t print(unsigned int value) {
+    return print((unsigned long)value);
+  }
+
+  size_t print(unsigned long value, int base) {
+    char text[24];
+    snprintf(text, sizeof(text), base == HEX ? "%lX" : "%lu", value);
+    return write(text);
+  }
+
+  size_t print(unsigned int value, int base) {
+    return print((unsigned long)value, base);
+  }
+
+  size_t print(double value, int decimals = 2) {
+    char text[48];
+    snprintf(text, sizeof(text), "%.*f", decimals, value);
+    return write(text);
+  }
+
+  size_t println() {
+    return write("\r\n");
+  }
+
+  template <typename T>
+  size_t println(T value) {
+    size_t length = print(value);
+    return length + println();
+  }
+
+  size_t println(double value, int decimals) {
+    size_t length = print(value, decimals);
+    return length + println();
+  }
+
+  size_t println(unsigned long value, int base) {
+    size_t length = print(value, base);
+    return length + println();
+  }
+
+  size_t println(unsigned int value, int base) {
+    return println((unsigned long)value, base);
+  }
+};
+
+class HostSerial : public Print {
+public:
+  using Print::write;
+
+  bool muted = false;  // Set by tests that run the firmware many thousand times
+
+  //Port model, off while baud is 0 (Writes never wait)
+  unsigned long baud = 0;
+  int txBufferSize = 64;
+  double txEmptyAt = 0;              // us of the virtual clock the TX buffer is empty at
+  std::string* capture = NULL;       // Gets every byte written when set
+
+  void begin(unsigned long) {}
+
+  // us the port takes to send a byte (Start, 8 data and stop bit)
+  double byteMicros() const {
+    return 10e6 / baud;
+  }
+
+  // Bytes waiting in the TX buffer now
+  int txQueued() const {
+    double left = txEmptyAt - (double)hostMicros();
+    return left > 0 ? (int)ceil(left / byteMicros() - 1e-9) : 0;
+  }
+
+  size_t write(uint8_t c) override {
+    if (baud > 0) {
+      if (txQueued() >= txBufferSize) {
+        double room = txEmptyAt - (txBufferSize - 1) * byteMicros();
+        hostAdvanceMicros((unsigned long)ceil(room - (double)hostMicros()));
+      }
+      txEmptyAt = fmax(txEmptyAt, (double)hostMicros()) + byteMicros();
+    }
+    if (capture != NULL) {
+      *capture += (char)c;
+    }
+    if (!muted && c != '\r') {
+      fputc(c, stdout);
+    }
+    return 1;
+  }
+
+  // Bytes the port takes without waiting
+  int availableForWrite() {
+    return baud > 0 ? txBufferSize - txQueued() : txBufferSize;
+  }
+
+  // Nothing is ever typed on the host
+  int available() {
+    return 0;
+  }
+
+  int read() {
+    return -1;
+  }
+
+  operator bool() const {
+    return true;
+  }
+};
+
+inline HostSerial& hostSerial() {
+  static HostSerial serial;
+  return serial;
+}
+
+#define Serial hostSerial()
+
+#endif
@@ -0,0 +1,83 @@
+/*****************************************
+*   Host LiquidCrystal_I2C Shim
+      - A frame buffer of the character display and its 8 CGRAM glyphs, the
+        tests read back what the firmware drew (hostRow())
+      - Writes past the end of a row are counted as overflows, on the HD44780
+        they would land on another row
+*****************************************/
+
+#ifndef GG_HOST_LIQUIDCRYSTAL_I2C_H
+#define GG_HOST_LIQUIDCRYSTAL_I2C_H
+
+#include <string>
+
+#include "Arduino.h"
+
+#define HOST_LCD_MAX_COLUMNS 40
+#define HOST_LCD_MAX_ROWS 4
+
+class LiquidCrystal_I2C : public Print {
+public:
+  using Print::write;
+
+  uint8_t columns;
+  uint8_t rows;
+  char frame[HOST_LCD_MAX_ROWS][HOST_LCD_MAX_COLUMNS];
+  uint8_t glyphs[8][8];
+  int column = 0;
+  int row = 0;
+  bool backlightOn = false;
+  unsigned long overflows = 0;  // Characters written past the end of a row
+  unsigned long clears = 0;
+
+  LiquidCrystal_I2C(uint8_t, uint8_t columns, uint8_t rows)
+    : columns(columns), rows(rows) {
+    memset(glyphs, 0, sizeof(glyphs));
+    clear();
+  }
+
+  void init() {
+    clear();
+  }
+
+  void clear() {
+    memset(frame, ' ', sizeof(frame));
+    column = 0;
+    row = 0;
+    clears++;
+  }
+
+  void setCursor(int newColumn, int newRow) {
+    column = newColumn;
+    row = newRow;
+  }
+
+  void backlight() {
+    backlightOn = true;
+  }
+
+  void noBacklight() {
+    backlightOn = false;
+  }
+
+  void createChar(uint8_t slot, uint8_t glyph[8]) {
+    memcpy(glyphs[slot & 7], glyph, 8);
+  }
+
+  size_t write(uint8_t c) override {
+    if (row < 0 || row >= rows || column < 0 || column >= columns) {
+      overflows++;
+    } else {
+      frame[row][column] = (char)c;
+    }
+    column++;
+    return 1;
+  }
+
+  // One row as drawn, CGRAM characters are the bytes 0 - 7
+  std::string hostRow(int index) const {
+    return std::string(frame[index], columns);
+  }
+};
+
+#endif
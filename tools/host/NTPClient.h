@@ -0,0 +1,28 @@
+/*****************************************
+*   Host NTPClient Shim
+      - No network: the client has the time a test sets (epoch), moving
+        with the virtual clock. update() is false until it is set
+*****************************************/
+
+#ifndef GG_HOST_NTP_CLIENT_H
+#define GG_HOST_NTP_CLIENT_H
+
+#include "Arduino.h"
+#include "WiFi.h"
+
+class NTPClient {
+public:
+  unsigned long epoch = 0;  // Unix time at millis() 0, set by a test
+
+  NTPClient(WiFiUDP&, const char*) {}
+
+  bool update() {
+    return epoch != 0;
+  }
+
+  unsigned long getEpochTime() {
+    return epoch + millis() / 1000;
+  }
+};
+
+#endif
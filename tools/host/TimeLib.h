@@ -0,0 +1,12 @@
+/*****************************************
+*   Host TimeLib Shim
+      - getTime.h only needs time_t and localtime() from it, the C library
+        has both
+*****************************************/
+
+#ifndef GG_HOST_TIME_LIB_H
+#define GG_HOST_TIME_LIB_H
+
+#include <time.h>
+
+#endif
@@ -0,0 +1,117 @@
+/*****************************************
+*   Host WiFi Shim
+      - The part of the WiFi library network_metrics.h and getTime.h use:
+        the RSSI, a server socket and its clients, a UDP socket for the NTP
+        client (tools/host/NTPClient.h) that never sends
+      - No network: a test queues a client on the server with the bytes it
+        sends (hostConnect()), the firmware reads them and what it writes
+        back is kept in the client for the test to check
+      - WiFi.RSSI() is the level a test sets, -60 dBm otherwise
+*****************************************/
+
+#ifndef GG_HOST_WIFI_H
+#define GG_HOST_WIFI_H
+
+#include <deque>
+#include <memory>
+#include <string>
+
+#include "Arduino.h"
+
+//Both ends of a connection, shared by the copies of its WiFiClient
+struct HostSocket {
+  std::string input;   // Bytes the peer sent
+  size_t readAt = 0;
+  std::string output;  // Bytes the firmware wrote
+  bool open = true;
+};
+
+class WiFiClient : public Print {
+public:
+  using Print::write;
+
+  std::shared_ptr<HostSocket> socket;
+
+  size_t write(uint8_t c) override {
+    if (socket == NULL || !socket->open) {
+      return 0;
+    }
+    socket->output += (char)c;
+    return 1;
+  }
+
+  int available() {
+    return socket != NULL ? (int)(socket->input.size() - socket->readAt) : 0;
+  }
+
+  int read() {
+    if (available() == 0) {
+      return -1;
+    }
+    return (uint8_t)socket->input[socket->readAt++];
+  }
+
+  // Open until stop(), the peer never closes first
+  bool connected() {
+    return socket != NULL && socket->open;
+  }
+
+  void stop() {
+    if (socket != NULL) {
+      socket->open = false;
+    }
+  }
+
+  operator bool() const {
+    return socket != NULL;
+  }
+};
+
+class WiFiServer {
+public:
+  int port;
+  std::deque<WiFiClient> pending;  // Clients waiting for available()
+
+  explicit WiFiServer(int serverPort) : port(serverPort) {}
+
+  void begin() {}
+
+  // Next client waiting, an empty one (false) when there is none
+  WiFiClient available() {
+    if (pending.empty()) {
+      return WiFiClient();
+    }
+    WiFiClient client = pending.front();
+    pending.pop_front();
+    return client;
+  }
+
+  // A client connects and sends request, the test keeps it to read the answer
+  WiFiClient hostConnect(const std::string& request) {
+    WiFiClient client;
+    client.socket = std::make_shared<HostSocket>();
+    client.socket->input = request;
+    pending.push_back(client);
+    return client;
+  }
+};
+
+class WiFiUDP {};
+
+class HostWiFi {
+public:
+  long rssi = -60;
+
+  long RSSI() {
+    return rssi;
+  }
+};
+
+inline HostWiFi& hostWiFi() {
+  static HostWiFi wifi;
+  return wifi;
+}
+
+#define WiFi hostWiFi()
+
+#endif
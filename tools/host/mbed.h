@@ -0,0 +1,184 @@
+/*****************************************
+*   Host mbed Shim
+      - Critical sections as a nesting counter, a test can check that every
+        enter has its exit and what ran inside one
+      - mbed::Timeout on the virtual clock, the callback runs inside the
+        hostAdvance() call that reaches its deadline
+      - Heap statistics (mbed_stats_heap_get) from the counters a test keeps
+        with hostCountAllocation() and hostCountFree(), zero otherwise.
+        alloc_cnt is the blocks allocated now, as the mbed malloc wrappers
+        keep it
+      - No RTOS threads: osThreadEnumerate() finds none. The thread of
+        loop() has flags, a wait for them moves the virtual clock and ends
+        early when a Timeout callback sets one (wakeFromIdle())
+      - The sleep manager allows Stop mode unless a test clears
+        hostDeepSleepAllowed()
+*****************************************/
+
+#ifndef GG_HOST_MBED_H
+#define GG_HOST_MBED_H
+
+#include <chrono>
+
+#include "Arduino.h"
+
+inline int& hostCriticalDepth() {
+  static int depth = 0;
+  return depth;
+}
+
+inline unsigned long& hostCriticalSections() {
+  static unsigned long sections = 0;
+  return sections;
+}
+
+inline void core_util_critical_section_enter() {
+  hostCriticalDepth()++;
+  hostCriticalSections()++;
+}
+
+inline void core_util_critical_section_exit() {
+  hostCriticalDepth()--;
+}
+
+namespace mbed {
+
+class Timeout {
+public:
+  HostTimer timer = { 0, NULL };
+
+  ~Timeout() {
+    detach();
+    for (int i = 0; i < HOST_TIMERS; i++) {
+      if (hostTimers()[i] == &timer) {
+        hostTimers()[i] = NULL;
+      }
+    }
+  }
+
+  // Arm (Or re-arm) the timer, callback runs once after delay
+  void attach(void (*callback)(), std::chrono::microseconds delay) {
+    int free = -1;
+    bool registered = false;
+    for (int i = 0; i < HOST_TIMERS; i++) {
+      registered |= hostTimers()[i] == &timer;
+      if (hostTimers()[i] == NULL && free < 0) {
+        free = i;
+      }
+    }
+    if (!registered && free >= 0) {
+      hostTimers()[free] = &timer;
+    }
+
+    timer.deadline = hostMicros() + delay.count();
+    timer.callback = callback;
+  }
+
+  void detach() {
+    timer.callback = NULL;
+  }
+};
+
+}
+
+struct mbed_stats_heap_t {
+  uint32_t current_size;
+  uint32_t max_size;
+  uint32_t total_size;
+  uint32_t reserved_size;
+  uint32_t alloc_cnt;
+  uint32_t alloc_fail_cnt;
+  uint32_t overhead_size;
+};
+
+inline mbed_stats_heap_t& hostHeapStats() {
+  static mbed_stats_heap_t stats;
+  return stats;
+}
+
+inline void hostCountAllocation(bool succeeded) {
+  if (succeeded) {
+    hostHeapStats().alloc_cnt++;
+  } else {
+    hostHeapStats().alloc_fail_cnt++;
+  }
+}
+
+inline void hostCountFree() {
+  hostHeapStats().alloc_cnt--;
+}
+
+inline void mbed_stats_heap_get(mbed_stats_heap_t* stats) {
+  *stats = hostHeapStats();
+}
+
+typedef void* osThreadId_t;
+
+inline uint32_t osThreadEnumerate(osThreadId_t*, uint32_t) {
+  return 0;
+}
+
+inline const char* osThreadGetName(osThreadId_t) {
+  return NULL;
+}
+
+inline uint32_t osThreadGetStackSize(osThreadId_t) {
+  return 0;
+}
+
+inline uint32_t osThreadGetStackSpace(osThreadId_t) {
+  return 0;
+}
+
+//Flags of the one thread there is (loop())
+inline uint32_t& hostThreadFlags() {
+  static uint32_t flags = 0;
+  return flags;
+}
+
+inline osThreadId_t osThreadGetId() {
+  return &hostThreadFlags();
+}
+
+inline uint32_t osThreadFlagsSet(osThreadId_t, uint32_t flags) {
+  hostThreadFlags() |= flags;
+  return hostThreadFlags();
+}
+
+namespace rtos {
+namespace ThisThread {
+
+// Wait on the virtual clock for any of flags, up to timeout. Returns the flags that ended it (0 on timeout) and clears them
+inline uint32_t flags_wait_any_for(uint32_t flags, std::chrono::milliseconds timeout) {
+  uint64_t end = hostMicros() + (uint64_t)timeout.count() * 1000;
+
+  //Step from timer to timer, a callback may set a flag
+  while ((hostThreadFlags() & flags) == 0 && hostMicros() < end) {
+    uint64_t next = end;
+    for (int i = 0; i < HOST_TIMERS; i++) {
+      HostTimer* timer = hostTimers()[i];
+      if (timer != NULL && timer->callback != NULL && timer->deadline < next) {
+        next = timer->deadline > hostMicros() ? timer->deadline : hostMicros();
+      }
+    }
+    hostAdvanceMicros((unsigned long)(next - hostMicros()));
+  }
+
+  uint32_t set = hostThreadFlags() & flags;
+  hostThreadFlags() &= ~flags;
+  return set;
+}
+
+}
+}
+
+inline bool& hostDeepSleepAllowed() {
+  static bool allowed = true;
+  return allowed;
+}
+
+inline bool sleep_manager_can_deep_sleep() {
+  return hostDeepSleepAllowed();
+}
+
+#endif
@@ -0,0 +1,868 @@
+/*****************************************
+*   Upload Load Generator
+      - N virtual Garden Guardian devices in one process against the upload
+        server: each samples into its own sample columns and rollup store,
+        picks the time to its next upload with the firmware's policy
+        (upload_policy.h), POSTs the body to /sensors/sendData and pings
+        /sensors/ping as makeGetRequest() does
+      - The body is built by gg_main_m7/upload_body.h, the code of
+        convertToJSON(), on the fake JSON document (tools/tests/fake_json.h):
+        the Sequence, the rollups of a period the raw rows no longer cover,
+        the rows that fit the document (The rest wait for the next upload).
+        It is deflated with gg_main_m7/deflate.h once a response lists
+        deflate in "encodings", plain JSON again after a 415
+      - An upload counts when uploadStored() says so (A 2xx with the ack of
+        its Sequence, or no ack), then commitUpload() drops its rows and the
+        Sequence moves on. A failure keeps the rows for the next upload and
+        backs off, as on the board
+      - -o minutes starts the fleet back from an outage that long: every
+        device holds what it sampled meanwhile (Rows wiped when a column
+        filled, its rollups have them) and catches up from its start
+      - One epoll loop per thread, non-blocking sockets, a connection per
+        request (Connection: close). 10k devices per thread at the default
+        intervals. The firmware reaches the rollup store through one pointer
+        (rollupChannels), sampling and body building hold a mutex
+      - Reports requests, failures, request rate, bytes posted against the
+        JSON they carry, the uploads with rollups and those capped by the
+        document, latency percentiles and the CPU the generator used
+      - Without arguments it runs against a stand-in server on a loopback
+        thread that inflates the bodies and answers every 8th upload with a
+        500 and no ack, after an outage: only those uploads may fail, every
+        device must catch up with rollups, the backlog must reach the row cap
+        and no row may be lost. Exits with 1 if a check fails. Linux only
+
+      g++ -O2 -pthread -I tools/host -o load_gen tools/load_gen.cpp
+      ./load_gen                                  Self check
+      ./load_gen HOST PORT [-d devices] [-t threads] [-s seconds] [-o outage minutes]
+                 [-r sampleInterval s] [-i sendDataInterval s] [-p pingInterval s]
+      python3 tools/stand_in_server.py --port 3420 & ./load_gen 127.0.0.1 3420 -d 10000
+*****************************************/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Arduino.h>
+#include "tests/fake_json.h"
+
+//A store per virtual device, shorter rings than the 24 h of minutes and 30 days of hours of the board
+#define ROLLUP_MINUTES 30
+#define ROLLUP_HOURS 12
+
+#include "../gg_main_m7/sensor_math.h"
+#include "../gg_main_m7/zones.h"
+#include "../gg_main_m7/runtime_config.h"
+#include "../gg_main_m7/memory_regions.h"
+#include "../gg_main_m7/rollup_store.h"
+#include "../gg_main_m7/sample_columns.h"
+#include "../gg_main_m7/upload_body.h"
+#include "../gg_main_m7/upload_policy.h"
+#include "../gg_main_m7/deflate.h"
+#include "tests/inflate_fixed.h"
+
+#define LOAD_SEND_ROUTE "/sensors/sendData"  // serverRoute of gg_main_m7.ino
+#define LOAD_PING_ROUTE "/sensors/ping"
+#define LOAD_TIMEOUT 5000                   // RESPONSE_TIMEOUT of response_parser.h
+#define LOAD_RSSI -55                       // Every device on a good link
+#define LOAD_MAX_DATA_AGE 600000            // DEFAULT_MAX_DATA_AGE of runtime_config.h
+#define LOAD_BODY_SIZE 65536                // UPLOAD_STAGING_SIZE of gg_main_m7.ino
+#define LOAD_DEFLATE_SIZE 16384             // UPLOAD_DEFLATE_SIZE
+#define LOAD_EPOLL_EVENTS 256
+#define LOAD_DRAIN 10000                    // ms the requests in flight get once the run is over
+
+#define SELF_CHECK_DEVICES 2000
+#define SELF_CHECK_THREADS 2
+#define SELF_CHECK_SECONDS 6
+#define SELF_CHECK_OUTAGE 4       // Minutes, a pass a second: 240 passes wipe 200 rows and leave 40
+#define SELF_CHECK_ERROR_EVERY 8  // Uploads the stand-in server answers with a 500
+
+struct LoadOptions {
+  sockaddr_in server;
+  const char* host;
+  int devices = 10000;
+  int threads = 1;
+  int seconds = 60;
+  int outage = 0;                     // Minutes the fleet was offline before the run
+  uint32_t sampleInterval = 30000;    // DEFAULT_SAMPLE_INTERVAL of runtime_config.h
+  uint32_t sendDataInterval = 30000;  // DEFAULT_SEND_DATA_INTERVAL
+  uint32_t pingInterval = 60000;      // DEFAULT_PING_INTERVAL
+};
+
+uint64_t nowMs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+uint64_t nowUs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void appendf(std::string& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+void appendf(std::string& out, const char* format, ...) {
+  char text[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  out.append(text, std::min(length, (int)sizeof(text) - 1));
+}
+
+
+/*****************************************
+*   Virtual devices
+*****************************************/
+
+enum DeviceState : uint8_t {
+  DEVICE_IDLE,
+  DEVICE_CONNECTING,
+  DEVICE_SENDING,
+  DEVICE_READING
+};
+
+enum RequestKind : uint8_t {
+  REQUEST_UPLOAD,
+  REQUEST_PING
+};
+
+struct Device {
+  char id[16];
+  SampleColumns columns;
+  RollupChannel rollups[ROLLUP_CHANNELS];  // Its rollup store, rollupChannels points here while it samples or builds a body
+  UploadBatch batch;     // Sequence and what the upload in flight carries
+  LinkEstimate link;
+  bool deflate;          // The server listed deflate in "encodings"
+  bool deflateRejected;  // A compressed body got a 415, plain JSON from then on
+  bool compressed;       // The upload in flight is deflated
+  bool rollupsSent;      // The upload in flight carries rollups
+  uint64_t nextSample;   // ms, generator clock
+  uint64_t nextUpload;
+  uint64_t nextPing;
+  uint64_t wake;         // The timer entry that is current, the others are stale
+  uint64_t started;      // us, the request in flight
+  uint32_t postedRows;
+  uint32_t jsonLength;   // Body of the upload in flight before deflate
+  uint32_t bodyLength;   // and as sent
+  uint32_t rowsSampled;
+  uint32_t rowsAcked;
+  uint32_t rowsWiped;    // Wiped when a column filled up, as on the board (The rollups keep them)
+  uint32_t uploadsFailed;
+  int fd;
+  DeviceState state;
+  RequestKind kind;
+  std::string out;       // Request bytes, out.size() - written still to send
+  size_t written;
+  std::string in;        // Response so far
+};
+
+struct LoadStats {
+  uint64_t uploads = 0;
+  uint64_t pings = 0;
+  uint64_t failures = 0;
+  uint64_t timeouts = 0;
+  uint64_t notAcked = 0;
+  uint64_t bytesPosted = 0;     // Request bytes on the wire, headers included
+  uint64_t jsonBytes = 0;       // Upload bodies before deflate
+  uint64_t bodyBytes = 0;       // Upload bodies as sent
+  uint64_t rollupUploads = 0;   // Uploads that carried rollups
+  uint64_t cappedUploads = 0;   // Uploads that left rows for the next one
+  std::vector<uint32_t> latencies;  // us per request, successful or not
+};
+
+struct Worker {
+  const LoadOptions* options;
+  std::vector<Device> devices;
+  int firstDevice;
+  int epoll;
+  uint64_t runStart;
+  uint32_t unixStart;
+  int inFlight;
+  LoadStats stats;
+  std::priority_queue<std::pair<uint64_t, uint32_t>, std::vector<std::pair<uint64_t, uint32_t>>,
+                      std::greater<std::pair<uint64_t, uint32_t>>> timers;
+  std::vector<char> staging;      // JSON of the body being built
+  std::vector<uint8_t> deflated;  // Its deflate stream
+  DeflateState deflateState;
+};
+
+//The firmware's rollup functions work on rollupChannels, one pointer for every thread
+std::mutex rollupMutex;
+
+void schedule(Worker& worker, uint32_t index, uint64_t when) {
+  worker.devices[index].wake = when;
+  worker.timers.push({ when, index });
+}
+
+// Typical reading of a channel, pH is 0 as readPH() sends none for now
+float channelBase(int channel) {
+  switch (channel) {
+    case ROLLUP_DEVICE_TEMP: return 38;
+    case ROLLUP_WATER_TEMP: return 18;
+    case ROLLUP_PH: return 0;
+    case ROLLUP_TDS: return 640;
+  }
+  bool humidity = channel == ROLLUP_HUMIDITY || (channel >= ROLLUP_ZONE_CHANNELS && (channel - ROLLUP_ZONE_CHANNELS) % 2 == 1);
+  return humidity ? 60 : 21;
+}
+
+// One sensing pass stamped time, every channel into the rollups and the sample columns as readSensors()
+//  - Full columns are wiped first as resetSensorArray() does. Called with rollupMutex held
+void samplePass(Device& device, uint32_t time) {
+  if (sampleRowCount(device.columns) >= SAMPLE_ROWS) {
+    device.rowsWiped += sampleRowCount(device.columns);
+    clearSampleColumns(device.columns);
+  }
+
+  rollupChannels = device.rollups;
+  for (int channel = 0; channel < SAMPLE_CHANNELS; channel++) {
+    float base = channelBase(channel);
+    float value = base != 0 ? base + (float)((device.rowsSampled * 7 + channel * 3 + device.id[10]) % 20) * 0.05f : 0;
+    addRollupSample((RollupChannelId)channel, time, value);
+    addSample(device.columns, channel, time, value);
+  }
+  device.rowsSampled++;
+}
+
+// The sensing passes due by now, one row per pass
+void samplePasses(Worker& worker, Device& device, uint64_t now) {
+  std::lock_guard<std::mutex> lock(rollupMutex);
+  while (device.nextSample <= now) {
+    samplePass(device, worker.unixStart + (uint32_t)((device.nextSample - worker.runStart) / 1000));
+    device.nextSample += worker.options->sampleInterval;
+  }
+}
+
+// The body of the next upload into worker.staging as convertToJSON() builds it, its length (0 if it did not fit)
+size_t buildUploadBody(Worker& worker, Device& device, uint64_t now) {
+  std::lock_guard<std::mutex> lock(rollupMutex);
+  rollupChannels = device.rollups;
+
+  FakeJsonDocument doc(JSON_DOCUMENT_SIZE / FAKE_JSON_SLOT_SIZE);
+  addUploadRollups(doc, device.batch, device.columns, worker.unixStart + (now - worker.runStart) / 1000);
+  addUploadRows(doc, device.batch, device.columns, device.id);
+  device.rollupsSent = doc.root->member("Rollups") != NULL;
+
+  //Rows before rowEnd went, none while catching up
+  device.postedRows = device.batch.catchingUp ? 0 : std::min(device.batch.rowEnd, sampleRowCount(device.columns));
+  return serializeUpload(doc, worker.staging.data(), LOAD_BODY_SIZE);
+}
+
+// ms the oldest unsent row has waited, 0 if none
+uint32_t oldestUnsentAge(Worker& worker, Device& device, uint64_t now) {
+  uint32_t oldest, newest;
+  sampleTimeRange(device.columns, oldest, newest);
+  if (oldest == 0) {
+    return 0;
+  }
+  int64_t sampled = (int64_t)worker.runStart + ((int64_t)oldest - worker.unixStart) * 1000;  // Before the run after an outage
+  return (int64_t)now > sampled ? (uint32_t)std::min<int64_t>(now - sampled, UINT32_MAX) : 0;
+}
+
+// false if the request could not even be started
+bool startRequest(Worker& worker, uint32_t index, uint64_t now) {
+  Device& device = worker.devices[index];
+  const LoadOptions& options = *worker.options;
+
+  device.in.clear();
+  device.written = 0;
+  device.started = nowUs();
+  device.state = DEVICE_CONNECTING;
+  worker.inFlight++;
+
+  if (now >= device.nextPing) {
+    device.kind = REQUEST_PING;
+    device.out.clear();
+    appendf(device.out, "GET %s?deviceID=%s&uptime=%llu HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+            LOAD_PING_ROUTE, device.id, (unsigned long long)(now - worker.runStart) / 1000, options.host);
+  } else {
+    device.kind = REQUEST_UPLOAD;
+    device.jsonLength = device.bodyLength = 0;
+    samplePasses(worker, device, now);
+    size_t length = buildUploadBody(worker, device, now);
+    if (length == 0) {
+      return false;  // Cannot happen with the row cap, a failed upload as LOG_UPLOAD_TOO_BIG on the board
+    }
+
+    //Deflated once the server accepts it, as compressUpload()
+    size_t compressed = 0;
+    if (device.deflate) {
+      compressed = deflateCompress(worker.deflateState, (const uint8_t*)worker.staging.data(), length, worker.deflated.data(), LOAD_DEFLATE_SIZE);
+    }
+    device.compressed = compressed > 0 && compressed < length;
+    device.jsonLength = length;
+
+    const char* body = device.compressed ? (const char*)worker.deflated.data() : worker.staging.data();
+    size_t bodyLength = device.compressed ? compressed : length;
+    device.bodyLength = bodyLength;
+    device.out.clear();
+    appendf(device.out, "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Type: application/json\r\n%sContent-Length: %zu\r\nConnection: close\r\n\r\n",
+            LOAD_SEND_ROUTE, options.host, device.compressed ? "Content-Encoding: deflate\r\n" : "", bodyLength);
+    device.out.append(body, bodyLength);
+  }
+
+  device.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (device.fd < 0 || (connect(device.fd, (const sockaddr*)&options.server, sizeof(options.server)) < 0 && errno != EINPROGRESS)) {
+    return false;
+  }
+  epoll_event event = {};
+  event.events = EPOLLOUT;
+  event.data.u32 = index;
+  epoll_ctl(worker.epoll, EPOLL_CTL_ADD, device.fd, &event);
+  schedule(worker, index, now + LOAD_TIMEOUT);
+  return true;
+}
+
+// Status code of the response, 0 without a status line
+int responseStatus(const std::string& response) {
+  return response.compare(0, 9, "HTTP/1.1 ") == 0 ? atoi(response.c_str() + 9) : 0;
+}
+
+// The Sequence the answer acks, -1 if it has none
+long responseAck(const std::string& response, size_t bodyStart) {
+  size_t ack = response.find("\"ack\":", bodyStart);
+  return ack == std::string::npos ? -1 : strtol(response.c_str() + ack + 6, NULL, 10);
+}
+
+// Deflate from the "encodings" of any response, as noteServerEncodings()
+void noteEncodings(Device& device, const std::string& response, size_t bodyStart) {
+  size_t list = response.find("\"encodings\":", bodyStart);
+  if (list == std::string::npos) {
+    return;
+  }
+  size_t end = response.find(']', list);  // Any spacing, as JSON allows
+  device.deflate = response.find("\"deflate\"", list) < end && !device.deflateRejected;
+}
+
+// The response is whole: headers and Content-Length bytes of body
+bool responseComplete(const std::string& response, size_t& bodyStart) {
+  size_t end = response.find("\r\n\r\n");
+  if (end == std::string::npos) {
+    return false;
+  }
+  bodyStart = end + 4;
+  const char* length = strcasestr(response.c_str(), "\r\nContent-Length:");
+  return length != NULL && length < response.c_str() + end && response.size() - bodyStart >= strtoul(length + 17, NULL, 10);
+}
+
+void finishRequest(Worker& worker, uint32_t index, bool timedOut) {
+  Device& device = worker.devices[index];
+  const LoadOptions& options = *worker.options;
+  uint64_t now = nowMs();
+  uint32_t us = (uint32_t)(nowUs() - device.started);
+  if (device.fd >= 0) {
+    close(device.fd);  // Leaves the epoll set with it
+    device.fd = -1;
+  }
+  device.state = DEVICE_IDLE;
+  worker.inFlight--;
+  worker.stats.latencies.push_back(us);
+  worker.stats.bytesPosted += device.written;
+
+  size_t bodyStart = 0;
+  bool complete = !timedOut && responseComplete(device.in, bodyStart);
+  int status = complete ? responseStatus(device.in) : 0;
+  worker.stats.timeouts += timedOut;
+  if (complete) {
+    noteEncodings(device, device.in, bodyStart);
+  }
+
+  if (device.kind == REQUEST_PING) {
+    worker.stats.pings++;
+    worker.stats.failures += status != 200;
+    device.nextPing = now + options.pingInterval;
+  } else {
+    long ack = complete ? responseAck(device.in, bodyStart) : -1;
+    bool stored = uploadStored(device.batch, status, ack >= 0, ack >= 0 ? ack : 0);
+    worker.stats.uploads++;
+    worker.stats.failures += !stored;
+    device.uploadsFailed += !stored;
+    worker.stats.notAcked += status >= 200 && status < 300 && !stored;
+    worker.stats.jsonBytes += device.jsonLength;
+    worker.stats.bodyBytes += device.bodyLength;
+    worker.stats.rollupUploads += device.rollupsSent;
+    worker.stats.cappedUploads += !device.batch.catchingUp && device.batch.rowEnd < SAMPLE_ROWS;
+
+    //A server that cannot inflate after all, the same rows go again as plain JSON
+    if (device.compressed && status == 415) {
+      device.deflateRejected = true;
+      device.deflate = false;
+    }
+    if (stored) {
+      device.rowsAcked += device.postedRows;
+      commitUpload(device.batch, device.columns);
+    }
+    linkNoteRssi(device.link, LOAD_RSSI);
+    linkNoteUpload(device.link, stored, device.written, device.postedRows, us / 1000);
+
+    UploadLimits limits = { options.sendDataInterval, options.sampleInterval, LOAD_MAX_DATA_AGE, SAMPLE_ROWS };
+    device.nextUpload = now + nextUploadInterval(device.link, limits, oldestUnsentAge(worker, device, now));
+  }
+  schedule(worker, index, std::min(device.nextUpload, device.nextPing));
+}
+
+void handleEvent(Worker& worker, uint32_t index, uint32_t events) {
+  Device& device = worker.devices[index];
+  if (device.state == DEVICE_CONNECTING) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    getsockopt(device.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+    if (error != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+      finishRequest(worker, index, false);
+      return;
+    }
+    device.state = DEVICE_SENDING;
+  }
+
+  if (device.state == DEVICE_SENDING) {
+    while (device.written < device.out.size()) {
+      ssize_t sent = send(device.fd, device.out.data() + device.written, device.out.size() - device.written, MSG_NOSIGNAL);
+      if (sent < 0) {
+        if (errno != EAGAIN) {
+          finishRequest(worker, index, false);
+        }
+        return;
+      }
+      device.written += sent;
+    }
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.u32 = index;
+    epoll_ctl(worker.epoll, EPOLL_CTL_MOD, device.fd, &event);
+    device.state = DEVICE_READING;
+    return;
+  }
+
+  char buffer[4096];
+  while (true) {
+    ssize_t received = recv(device.fd, buffer, sizeof(buffer), 0);
+    if (received > 0) {
+      device.in.append(buffer, received);
+      continue;
+    }
+    size_t bodyStart;
+    if (received == 0 || errno != EAGAIN || responseComplete(device.in, bodyStart)) {
+      finishRequest(worker, index, false);
+    }
+    return;
+  }
+}
+
+void runWorker(Worker& worker, uint64_t runEnd) {
+  epoll_event events[LOAD_EPOLL_EVENTS];
+  bool draining = false;
+
+  while (true) {
+    uint64_t now = nowMs();
+    if (!draining && now >= runEnd) {
+      draining = true;
+      runEnd = now + LOAD_DRAIN;
+    }
+
+    //Due timers: start a request, or time out the one in flight
+    while (!worker.timers.empty() && worker.timers.top().first <= now) {
+      uint32_t index = worker.timers.top().second;
+      uint64_t when = worker.timers.top().first;
+      worker.timers.pop();
+      Device& device = worker.devices[index];
+      if (when != device.wake) {
+        continue;
+      }
+      if (device.state != DEVICE_IDLE) {
+        finishRequest(worker, index, true);
+      } else if (!draining && !startRequest(worker, index, now)) {
+        finishRequest(worker, index, false);  // As a refused connection
+      }
+    }
+    if (draining && (worker.inFlight == 0 || now >= runEnd)) {
+      break;
+    }
+
+    int timeout = worker.timers.empty() ? 100 : (int)std::min<uint64_t>(100, worker.timers.top().first > now ? worker.timers.top().first - now : 0);
+    int count = epoll_wait(worker.epoll, events, LOAD_EPOLL_EVENTS, timeout);
+    for (int i = 0; i < count; i++) {
+      handleEvent(worker, events[i].data.u32, events[i].events);
+    }
+  }
+}
+
+
+void initWorker(Worker& worker, const LoadOptions& options, int firstDevice, int count, uint64_t runStart) {
+  worker.options = &options;
+  worker.firstDevice = firstDevice;
+  worker.epoll = epoll_create1(EPOLL_CLOEXEC);
+  worker.runStart = runStart;
+  worker.unixStart = (uint32_t)time(NULL);
+  worker.inFlight = 0;
+  worker.devices.resize(count);
+  worker.staging.resize(LOAD_BODY_SIZE);
+  worker.deflated.resize(LOAD_DEFLATE_SIZE);
+
+  //Boots spread over one interval, as a fleet that was not powered up at once
+  uint32_t spread = 12345 + firstDevice;
+  for (int i = 0; i < count; i++) {
+    Device& device = worker.devices[i];
+    snprintf(device.id, sizeof(device.id), "GG-LOAD-%05d", firstDevice + i);
+    clearSampleColumns(device.columns);
+    rollupChannels = device.rollups;
+    initUploadChannels(GG_ZONES);  // coldAlloc() takes the rings from the heap, the SDRAM region is not set up here
+    initUploadBatch(device.batch);
+    initLinkEstimate(device.link);
+    device.deflate = device.deflateRejected = false;
+    device.rowsSampled = device.rowsAcked = device.rowsWiped = device.uploadsFailed = 0;
+
+    //Back from an outage: it kept sensing, the server has everything before it
+    if (options.outage > 0) {
+      uint32_t step = std::max(options.sampleInterval / 1000, 1U);
+      uint32_t from = worker.unixStart - options.outage * 60;
+      for (uint32_t time = from; time < worker.unixStart; time += step) {
+        samplePass(device, time);
+      }
+      device.batch.uploadedUntil = from;
+    }
+
+    spread = spread * 1103515245 + 12345;
+    uint64_t boot = runStart + (spread >> 8) % options.sendDataInterval;
+    device.nextSample = boot;
+    device.nextUpload = boot + options.sendDataInterval;
+    device.nextPing = boot + options.pingInterval;
+    device.fd = -1;
+    device.state = DEVICE_IDLE;
+    schedule(worker, i, device.nextUpload);
+  }
+}
+
+uint32_t percentile(const std::vector<uint32_t>& sorted, double share) {
+  return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, (size_t)(share * sorted.size()))];
+}
+
+double cpuSeconds() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Run the fleet for options.seconds, the totals of every worker in total
+void runLoad(const LoadOptions& options, std::vector<Worker>& workers, LoadStats& total) {
+  //A file descriptor per request in flight
+  rlimit files;
+  if (getrlimit(RLIMIT_NOFILE, &files) == 0) {
+    files.rlim_cur = files.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files);
+  }
+
+  //Every device set up before a thread starts, initWorker() moves rollupChannels without the mutex
+  uint64_t runStart = nowMs();
+  workers.resize(options.threads);
+  int perWorker = (options.devices + options.threads - 1) / options.threads;
+  for (int i = 0; i < options.threads; i++) {
+    int first = i * perWorker;
+    initWorker(workers[i], options, first, std::max(0, std::min(perWorker, options.devices - first)), runStart);
+  }
+
+  double cpuStart = cpuSeconds();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < options.threads; i++) {
+    threads.emplace_back(runWorker, std::ref(workers[i]), runStart + options.seconds * 1000ULL);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  double elapsed = (nowMs() - runStart) / 1000.0;
+  double cpu = cpuSeconds() - cpuStart;
+
+  for (Worker& worker : workers) {
+    close(worker.epoll);
+    total.uploads += worker.stats.uploads;
+    total.pings += worker.stats.pings;
+    total.failures += worker.stats.failures;
+    total.timeouts += worker.stats.timeouts;
+    total.notAcked += worker.stats.notAcked;
+    total.bytesPosted += worker.stats.bytesPosted;
+    total.jsonBytes += worker.stats.jsonBytes;
+    total.bodyBytes += worker.stats.bodyBytes;
+    total.rollupUploads += worker.stats.rollupUploads;
+    total.cappedUploads += worker.stats.cappedUploads;
+    total.latencies.insert(total.latencies.end(), worker.stats.latencies.begin(), worker.stats.latencies.end());
+  }
+  std::sort(total.latencies.begin(), total.latencies.end());
+
+  uint64_t requests = total.uploads + total.pings;
+  printf("LOAD devices=%d threads=%d seconds=%.1f uploads=%llu pings=%llu failures=%llu (timeouts %llu, not acked %llu)\n",
+         options.devices, options.threads, elapsed, (unsigned long long)total.uploads, (unsigned long long)total.pings,
+         (unsigned long long)total.failures, (unsigned long long)total.timeouts, (unsigned long long)total.notAcked);
+  printf("LOAD rate=%.1f req/s posted=%.1f KB/s (%.0f B per request) cpu=%.2f cores\n",
+         requests / elapsed, total.bytesPosted / elapsed / 1024, requests > 0 ? (double)total.bytesPosted / requests : 0.0, cpu / elapsed);
+  printf("LOAD bodies json=%.1f KB/s sent=%.1f KB/s (%.1fx) with rollups=%llu capped=%llu\n", total.jsonBytes / elapsed / 1024,
+         total.bodyBytes / elapsed / 1024, total.bodyBytes > 0 ? (double)total.jsonBytes / total.bodyBytes : 0.0,
+         (unsigned long long)total.rollupUploads, (unsigned long long)total.cappedUploads);
+  printf("LOAD latency ms p50=%.1f p90=%.1f p99=%.1f max=%.1f\n", percentile(total.latencies, 0.5) / 1000.0,
+         percentile(total.latencies, 0.9) / 1000.0, percentile(total.latencies, 0.99) / 1000.0,
+         total.latencies.empty() ? 0.0 : total.latencies.back() / 1000.0);
+}
+
+
+/*****************************************
+*   Stand-in server for the self check
+*****************************************/
+
+struct StandInServer {
+  int listener;
+  int epoll;
+  std::atomic<bool> stop{ false };
+  std::atomic<uint64_t> answered{ 0 };
+  uint64_t uploads = 0;
+  uint64_t errors = 0;      // Uploads answered with a 500
+  uint64_t compressed = 0;  // Deflated bodies
+  uint64_t badBodies = 0;   // Bodies that did not inflate, answered with a 415
+  std::vector<std::string> pending;  // Request so far, per file descriptor
+};
+
+// Answer a whole request as tools/stand_in_server.py: the ack of its Sequence, deflate listed in "encodings"
+//  - A deflated body is inflated first. Every SELF_CHECK_ERROR_EVERY uploads one gets a 500 without an ack
+bool answerRequest(StandInServer& server, int fd, const std::string& request) {
+  size_t end = request.find("\r\n\r\n");
+  if (end == std::string::npos) {
+    return false;
+  }
+  const char* headersEnd = request.c_str() + end;
+  const char* length = strcasestr(request.c_str(), "\r\nContent-Length:");
+  size_t bodyLength = length != NULL && length < headersEnd ? strtoul(length + 17, NULL, 10) : 0;
+  if (request.size() - end - 4 < bodyLength) {
+    return false;
+  }
+
+  int status = 200;
+  std::string body = "{\"status\":\"ok\",\"encodings\":[\"deflate\"]}";
+  if (request.compare(0, 5, "POST ") == 0) {
+    std::string json = request.substr(end + 4, bodyLength);
+    const char* encoding = strcasestr(request.c_str(), "\r\nContent-Encoding: deflate");
+    bool inflated = true;
+    if (encoding != NULL && encoding < headersEnd) {
+      server.compressed++;
+      std::string plain;
+      inflated = inflateFixed((const uint8_t*)json.data(), json.size(), plain);
+      json = plain;
+    }
+
+    server.uploads++;
+    size_t sequence = json.find("\"Sequence\":");
+    if (!inflated) {
+      server.badBodies++;
+      status = 415;
+      body = "{\"error\":\"bad deflate stream\",\"encodings\":[\"deflate\"]}";
+    } else if (server.uploads % SELF_CHECK_ERROR_EVERY == 0) {
+      server.errors++;
+      status = 500;
+      body = "{\"error\":\"injected\",\"encodings\":[\"deflate\"]}";
+    } else if (sequence != std::string::npos) {
+      body = "{\"ack\":" + std::to_string(strtoul(json.c_str() + sequence + 11, NULL, 10)) + ",\"encodings\":[\"deflate\"]}";
+    }
+  }
+
+  std::string response;
+  appendf(response, "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", status,
+          status == 200 ? "OK" : status == 415 ? "Unsupported Media Type" : "Internal Server Error", body.size());
+  response += body;
+  send(fd, response.data(), response.size(), MSG_NOSIGNAL);  // Small enough for the socket buffer
+  return true;
+}
+void runStandInServer(StandInServer& server) {
+  epoll_event events[LOAD_EPOLL_EVENTS];
+  while (!server.stop) {
+    int count = epoll_wait(server.epoll, events, LOAD_EPOLL_EVENTS, 50);
+    for (int i = 0; i < count; i++) {
+      int fd = events[i].data.fd;
+      if (fd == server.listener) {
+        int client;
+        while ((client = accept4(server.listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+          if ((size_t)client >= server.pending.size()) {
+            server.pending.resize(client + 1);
+          }
+          server.pending[client].clear();
+          epoll_event event = {};
+          event.events = EPOLLIN;
+          event.data.fd = client;
+          epoll_ctl(server.epoll, EPOLL_CTL_ADD, client, &event);
+        }
+        continue;
+      }
+
+      char buffer[16384];
+      ssize_t received;
+      while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        server.pending[fd].append(buffer, received);
+      }
+      bool answered = answerRequest(server, fd, server.pending[fd]);
+      if (answered || received == 0 || errno != EAGAIN) {
+        server.answered += answered;
+        close(fd);
+      }
+    }
+  }
+}
+
+int selfCheck() {
+  StandInServer server;
+  server.listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (bind(server.listener, (sockaddr*)&address, sizeof(address)) < 0 || listen(server.listener, 4096) < 0 ||
+      getsockname(server.listener, (sockaddr*)&address, &length) < 0) {
+    printf("FAILED: no loopback listener (%s)\n", strerror(errno));
+    return 1;
+  }
+  server.epoll = epoll_create1(EPOLL_CLOEXEC);
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = server.listener;
+  epoll_ctl(server.epoll, EPOLL_CTL_ADD, server.listener, &event);
+  std::thread serverThread(runStandInServer, std::ref(server));
+
+  //Short intervals, every device uploads and pings several times after catching up on the outage
+  LoadOptions options;
+  options.server = address;
+  options.host = "127.0.0.1";
+  options.devices = SELF_CHECK_DEVICES;
+  options.threads = SELF_CHECK_THREADS;
+  options.seconds = SELF_CHECK_SECONDS;
+  options.sampleInterval = 500;
+  options.sendDataInterval = 1000;
+  options.pingInterval = 3000;
+  options.outage = SELF_CHECK_OUTAGE;
+
+  std::vector<Worker> workers;
+  LoadStats total;
+  runLoad(options, workers, total);
+  server.stop = true;
+  serverThread.join();
+  close(server.epoll);
+  close(server.listener);
+
+  //No row lost: each one acked, still held for the next upload or wiped with its rollups kept
+  int failures = 0;
+  uint64_t rowsSampled = 0, rowsAcked = 0, rowsWiped = 0, rowsLost = 0;
+  int caughtUp = 0, behind = 0;
+  for (const Worker& worker : workers) {
+    for (const Device& device : worker.devices) {
+      rowsSampled += device.rowsSampled;
+      rowsAcked += device.rowsAcked;
+      rowsWiped += device.rowsWiped;
+      rowsLost += device.rowsSampled - device.rowsAcked - device.rowsWiped - sampleRowCount(device.columns);
+      //The server has the last pass of the outage, unless an upload failed and the policy still backs off
+      bool past = device.batch.uploadedUntil + 1 >= worker.unixStart;
+      caughtUp += past;
+      behind += !past && device.uploadsFailed == 0;
+    }
+  }
+  printf("%llu rows sampled, %llu acked, %llu wiped (In the rollups), %llu lost, %llu requests answered\n",
+         (unsigned long long)rowsSampled, (unsigned long long)rowsAcked, (unsigned long long)rowsWiped,
+         (unsigned long long)rowsLost, (unsigned long long)server.answered.load());
+  printf("%d of %d devices past the outage (%d behind without a failure), %llu of %llu uploads deflated, %llu answered with a 500\n",
+         caughtUp, SELF_CHECK_DEVICES, behind,
+         (unsigned long long)server.compressed, (unsigned long long)server.uploads, (unsigned long long)server.errors);
+
+  //At least an upload per device per sendDataInterval after the boot spread, the injected errors back off
+  uint64_t expectedUploads = (uint64_t)SELF_CHECK_DEVICES * (SELF_CHECK_SECONDS * 1000 / options.sendDataInterval - 3);
+  if (total.failures != server.errors || server.errors == 0 || total.notAcked != 0 || total.uploads < expectedUploads || total.pings == 0) {
+    printf("FAILED: %llu uploads (%llu expected), %llu failures\n", (unsigned long long)total.uploads,
+           (unsigned long long)expectedUploads, (unsigned long long)total.failures);
+    failures++;
+  }
+  if (rowsLost != 0 || rowsAcked == 0) {
+    printf("FAILED: rows lost\n");
+    failures++;
+  }
+  if (server.answered != total.uploads + total.pings) {
+    printf("FAILED: the server answered %llu requests\n", (unsigned long long)server.answered.load());
+    failures++;
+  }
+  if (total.rollupUploads < SELF_CHECK_DEVICES || caughtUp == 0 || behind != 0 || total.cappedUploads == 0) {
+    printf("FAILED: the outage was not caught up with rollups, or no upload reached the row cap\n");
+    failures++;
+  }
+  if (server.compressed == 0 || server.badBodies != 0 || total.bodyBytes >= total.jsonBytes) {
+    printf("FAILED: the bodies were not deflated, or did not inflate\n");
+    failures++;
+  }
+
+  printf(failures == 0 ? "PASS\n" : "FAIL\n");
+  return failures == 0 ? 0 : 1;
+}
+
+
+int main(int argc, char** argv) {
+  Serial.muted = true;  // The firmware headers print their own progress
+  initRuntimeConfig();
+  if (argc < 3) {
+    return selfCheck();
+  }
+
+  LoadOptions options;
+  options.host = argv[1];
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* found;
+  if (getaddrinfo(argv[1], argv[2], &hints, &found) != 0) {
+    printf("Cannot resolve %s:%s\n", argv[1], argv[2]);
+    return 1;
+  }
+  options.server = *(sockaddr_in*)found->ai_addr;
+  freeaddrinfo(found);
+
+  for (int i = 3; i + 1 < argc; i += 2) {
+    int value = atoi(argv[i + 1]);
+    if (strcmp(argv[i], "-d") == 0) {
+      options.devices = value;
+    } else if (strcmp(argv[i], "-t") == 0) {
+      options.threads = value;
+    } else if (strcmp(argv[i], "-s") == 0) {
+      options.seconds = value;
+    } else if (strcmp(argv[i], "-o") == 0) {
+      options.outage = value;
+    } else if (strcmp(argv[i], "-r") == 0) {
+      options.sampleInterval = value * 1000;
+    } else if (strcmp(argv[i], "-i") == 0) {
+      options.sendDataInterval = value * 1000;
+    } else if (strcmp(argv[i], "-p") == 0) {
+      options.pingInterval = value * 1000;
+    } else {
+      printf("Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (options.devices < 1 || options.threads < 1 || options.seconds < 1 || options.outage < 0 || options.sampleInterval == 0 ||
+      options.sendDataInterval == 0 || options.pingInterval == 0) {
+    printf("Devices, threads, seconds and intervals must be at least 1\n");
+    return 1;
+  }
+
+  std::vector<Worker> workers;
+  LoadStats total;
+  runLoad(options, workers, total);
+  return 0;
+}
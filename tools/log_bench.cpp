@@ -0,0 +1,222 @@
+/*****************************************
+*   Binary Log Benchmark
+      - The loop() time the Serial output of one sensing and upload cycle
+        costs, with the text prints the binary log replaced (Serial at 9600
+        and at 115200 baud) and with gg_main_m7/binary_log.h (115200 baud)
+      - The port is the Serial model of the host shim: a 64 byte TX buffer
+        that empties at the baud on the virtual clock, a write to a full
+        buffer waits. That wait is loop() time on the board, the CPU cost of
+        the log sites themselves is timed with steady_clock on the host
+      - The binary log runs as on the board: the log sites write frames into
+        the ring and the log task drains what the port takes every 50 ms
+      - Checks that drainLog() never waits for the port (It writes nothing
+        while the port is full), that every frame reaches the port whole and
+        in order, no frame is dropped and the log saves loop() time. Exits
+        with 1 if a check fails
+
+      g++ -O2 -I tools/host -o log_bench tools/log_bench.cpp && ./log_bench
+*****************************************/
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include "../gg_main_m7/binary_log.h"
+
+#define BENCH_CYCLES 20          // Sensing and upload cycles, one every 30 s
+#define BENCH_CYCLE_MS 30000
+#define BENCH_DRAIN_MS 50        // logDrainInterval of gg_main_m7.ino
+#define BENCH_CPU_RUNS 100000
+
+//Readings of the cycle, as debugInfo() has them
+float ambientTemp = 23.81, growTemp = 21, humidity = 64, waterTemp = 18.44, phValue = 0, tdsValue = 642;
+unsigned long sequence = 1;
+
+// The prints of one cycle before the binary log: sensingTask(), debugInfo(), postSensorData() and the ping
+void textCycle() {
+  Serial.println("Reading Temerature");
+  Serial.print("Ambient Temperature: ");
+  Serial.println(ambientTemp);
+  Serial.print("DHT Temp Sensor 1: ");
+  Serial.println(growTemp);
+  Serial.print("DHT Humidity Sensor 1: ");
+  Serial.println(humidity);
+  Serial.print("Water Temperature Sensor 1: ");
+  Serial.println(waterTemp);
+  Serial.print("pH: ");
+  Serial.println(phValue, 2);
+  Serial.print("TDS Value:");
+  Serial.print(tdsValue, 0);
+  Serial.println("ppm");
+  Serial.println("Heater is ON");
+
+  Serial.println("making POST request");
+  Serial.print("HTTP Response Status Code: ");
+  Serial.println(200);
+  Serial.print("Ack: ");
+  Serial.println(sequence);
+
+  Serial.println("Attempting to Connect to API Server");
+  Serial.print("HTTP Response Status Code: ");
+  Serial.println(200);
+  sequence++;
+}
+
+// The same cycle with the binary log, as gg_main_m7.ino logs it now
+void binaryCycle() {
+  logEvent(LOG_SENSING);
+  logEvent(LOG_READINGS, ambientTemp, growTemp, humidity, waterTemp, phValue, tdsValue, true);
+
+  logEvent(LOG_POST_START, 1480U, sequence);
+  logEvent(LOG_HTTP_STATUS, 200, -1);
+  logEvent(LOG_HTTP_ACK, sequence);
+
+  logEvent(LOG_GET_START);
+  logEvent(LOG_HTTP_STATUS, 200, -1);
+  sequence++;
+}
+
+const LogFormatId cycleFormats[] = { LOG_SENSING, LOG_READINGS, LOG_POST_START, LOG_HTTP_STATUS, LOG_HTTP_ACK, LOG_GET_START, LOG_HTTP_STATUS };
+const int cycleFrames = sizeof(cycleFormats) / sizeof(cycleFormats[0]);
+
+struct Run {
+  const char* name;
+  unsigned long baud;
+  uint64_t blockedUs;  // Virtual time loop() waited on the port
+  size_t bytes;
+};
+
+// Run the cycles on the virtual clock, only the time inside the log sites and the drains counts
+Run runCycles(const char* name, unsigned long baud, bool binary, std::string& port) {
+  Run run = { name, baud, 0, 0 };
+  Serial.baud = baud;
+  Serial.txEmptyAt = (double)hostMicros();
+  Serial.capture = &port;
+  sequence = 1;
+
+  for (int cycle = 0; cycle < BENCH_CYCLES; cycle++) {
+    uint64_t start = hostMicros();
+    if (binary) {
+      binaryCycle();
+    } else {
+      textCycle();
+    }
+    run.blockedUs += hostMicros() - start;
+
+    //The rest of the cycle, the log task runs every 50 ms
+    for (int ms = 0; ms < BENCH_CYCLE_MS; ms += BENCH_DRAIN_MS) {
+      hostAdvance(BENCH_DRAIN_MS);
+      if (binary) {
+        start = hostMicros();
+        drainLog();
+        run.blockedUs += hostMicros() - start;
+      }
+    }
+  }
+
+  Serial.capture = NULL;
+  Serial.baud = 0;
+  run.bytes = port.size();
+  return run;
+}
+
+// Frames in the bytes the port got, false if one is broken or out of place
+bool checkFrames(const std::string& port, int& frames) {
+  frames = 0;
+  size_t at = 0;
+  while (at < port.size()) {
+    if ((uint8_t)port[at] != LOG_FRAME_SYNC || at + 7 > port.size()) {
+      return false;
+    }
+    uint8_t id = port[at + 1];
+    uint8_t count = port[at + 2];
+    if (id != cycleFormats[frames % cycleFrames] || count > LOG_MAX_ARGS) {
+      return false;
+    }
+    at += 7 + 4 * count;
+    frames++;
+  }
+  return at == port.size();
+}
+
+// Host ns per call of fn with the port off
+double cpuNs(void (*fn)()) {
+  Serial.muted = true;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_CPU_RUNS; i++) {
+    fn();
+    logTail = logHead;  // Keep the ring from filling, the drain is timed on the virtual clock
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_CPU_RUNS;
+}
+
+int main() {
+  int failures = 0;
+  Serial.muted = true;
+
+  //Port full: drainLog() must leave the frames for the next run instead of waiting
+  Serial.baud = 115200;
+  std::string port;
+  Serial.capture = &port;
+  for (int i = 0; i < Serial.txBufferSize; i++) {
+    Serial.write('.');
+  }
+  binaryCycle();
+  uint64_t before = hostMicros();
+  size_t written = port.size();
+  drainLog();
+  bool waited = hostMicros() != before || port.size() != written;
+  hostAdvance(BENCH_DRAIN_MS);
+  drainLog();
+  bool drained = port.size() > written && hostMicros() == before + BENCH_DRAIN_MS * 1000;
+  logTail = logHead;
+  Serial.capture = NULL;
+  Serial.baud = 0;
+  printf("Full port: drainLog() %s, %zu bytes once it had room\n", waited ? "WAITED" : "returned at once", port.size() - written);
+  if (waited || !drained) {
+    printf("FAILED: drainLog() on a full port\n");
+    failures++;
+  }
+
+  std::string text9600, text115200, binary;
+  std::vector<Run> runs;
+  runs.push_back(runCycles("text", 9600, false, text9600));
+  runs.push_back(runCycles("text", 115200, false, text115200));
+  runs.push_back(runCycles("binary", 115200, true, binary));
+
+  double textNs = cpuNs(textCycle);
+  double binaryNs = cpuNs(binaryCycle);
+
+  printf("\n%d cycles (Sensing, upload and ping), Serial TX buffer %d bytes\n\n", BENCH_CYCLES, Serial.txBufferSize);
+  printf("%-8s %7s %14s %18s %16s\n", "Log", "Baud", "Bytes/cycle", "loop() wait/cycle", "Host CPU/cycle");
+  for (const Run& run : runs) {
+    bool isBinary = run.name[0] == 'b';
+    printf("%-8s %7lu %14.0f %15.2f ms %13.0f ns\n", run.name, run.baud, (double)run.bytes / BENCH_CYCLES,
+           run.blockedUs / 1000.0 / BENCH_CYCLES, isBinary ? binaryNs : textNs);
+  }
+  printf("\nloop() time saved per cycle: %.2f ms against text at 9600 baud, %.2f ms against text at 115200 baud\n",
+         (runs[0].blockedUs - runs[2].blockedUs) / 1000.0 / BENCH_CYCLES, (runs[1].blockedUs - runs[2].blockedUs) / 1000.0 / BENCH_CYCLES);
+
+  int frames = 0;
+  if (!checkFrames(binary, frames) || frames != BENCH_CYCLES * cycleFrames) {
+    printf("FAILED: %d frames decoded, %d logged\n", frames, BENCH_CYCLES * cycleFrames);
+    failures++;
+  }
+  if (logDropped > 0 || logHead != logTail) {
+    printf("FAILED: %u frames dropped, %u bytes left in the ring\n", (unsigned)logDropped, (unsigned)(logHead - logTail));
+    failures++;
+  }
+  if (runs[2].blockedUs != 0) {
+    printf("FAILED: the binary log waited %.2f ms for the port\n", runs[2].blockedUs / 1000.0);
+    failures++;
+  }
+  if (runs[2].blockedUs >= runs[1].blockedUs || binaryNs >= textNs) {
+    printf("FAILED: the binary log saves no loop() time\n");
+    failures++;
+  }
+
+  printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+  return failures == 0 ? 0 : 1;
+}
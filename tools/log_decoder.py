@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Decode the binary log of gg_main_m7 (binary_log.h) back into text.
+
+The format table is read from binary_log.h, so the decoder always matches
+the firmware it is run against. Plain text printed on the same port is
+passed through unchanged.
+
+    python3 tools/log_decoder.py capture.bin
+    python3 tools/log_decoder.py --port /dev/ttyACM0   (Needs pyserial)
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+FRAME_SYNC = 0xA5
+HEADER_SIZE = 7
+CONVERSION = re.compile(r"%(?:%|[-+ #0]*\d*(?:\.\d+)?([dufx]))")
+
+
+def load_formats(header_path):
+    """Return the format strings of LOG_FORMATS, in id order."""
+    with open(header_path) as header:
+        source = header.read()
+    table = source[source.index("#define LOG_FORMATS(X)"):]
+    table = table[:table.index("\n\n")]
+    return [format for _, format in re.findall(r'X\((\w+),\s*"((?:[^"\\]|\\.)*)"\)', table)]
+
+
+def format_frame(formats, format_id, timestamp, words):
+    if format_id >= len(formats):
+        return "[%10.3f] <unknown log format %d>" % (timestamp / 1000.0, format_id)
+
+    format = formats[format_id]
+    args = []
+    for match, word in zip((m for m in CONVERSION.finditer(format) if m.group(1)), words):
+        kind = match.group(1)
+        raw = struct.pack("<I", word)
+        if kind == "f":
+            args.append(struct.unpack("<f", raw)[0])
+        elif kind == "d":
+            args.append(struct.unpack("<i", raw)[0])
+        else:
+            args.append(word)
+
+    try:
+        text = format % tuple(args)
+    except (TypeError, ValueError):
+        text = "%s %r" % (format, args)
+    return "[%10.3f] %s" % (timestamp / 1000.0, text)
+
+
+def decode(stream, formats, out, follow=False):
+    """Decode frames from a binary stream, text bytes are copied through."""
+    buffer = bytearray()
+    while True:
+        chunk = stream.read(1024)
+        if not chunk:
+            if follow:
+                continue
+            break
+        buffer.extend(chunk)
+
+        position = 0
+        while position < len(buffer):
+            byte = buffer[position]
+            if byte != FRAME_SYNC:
+                out.write(chr(byte))
+                position += 1
+                continue
+
+            if len(buffer) - position < HEADER_SIZE:
+                break
+            format_id, count = buffer[position + 1], buffer[position + 2]
+            size = HEADER_SIZE + 4 * count
+            if len(buffer) - position < size:
+                break
+
+            timestamp = struct.unpack_from("<I", buffer, position + 3)[0]
+            words = struct.unpack_from("<%dI" % count, buffer, position + HEADER_SIZE)
+            out.write(format_frame(formats, format_id, timestamp, words) + "\n")
+            position += size
+
+        del buffer[:position]
+        out.flush()
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture", nargs="?", help="Captured serial output, stdin when omitted")
+    parser.add_argument("--port", help="Read from a serial port instead")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--header", default=os.path.join(here, "..", "gg_main_m7", "binary_log.h"))
+    args = parser.parse_args()
+
+    formats = load_formats(args.header)
+
+    if args.port:
+        import serial
+        decode(serial.Serial(args.port, args.baud, timeout=1), formats, sys.stdout, follow=True)
+    elif args.capture:
+        with open(args.capture, "rb") as stream:
+            decode(stream, formats, sys.stdout)
+    else:
+        decode(sys.stdin.buffer, formats, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,428 @@
+/*****************************************
+*   Power Simulation
+      - A simulated day of the task table of gg_main_m7.ino (The intervals
+        of setup() and the runtime config defaults) run by the firmware's
+        own scheduler.h and power_management.h on the virtual clock: a task
+        run is active time, idleFor() is the sleep it counts, and
+        estimatedEnergyPerDay() turns both into mWh/day with its current
+        figures
+      - The run time of each task comes from a post-mortem dump (The
+        "EVENTS" lines printed at boot, event_trace.h), or from the rough
+        figures below for the tasks the dump has none of. Untraced tasks
+        (tds, log) always use the figures
+      - Once with Stop mode allowed and once with a peripheral holding the
+        deep sleep lock (USB Serial attached), with button presses at an even
+        rate keeping the backlight on for BACKLIGHT_TIMEOUT after each
+      - Checks that the estimate is the current figures weighted by the
+        simulated times, the tasks' run time is the active time, and that a
+        dump of the last task records of the day (formatEventHex() of
+        event_trace.h) gives back the run times it was made with. Exits
+        with 1 if a check fails
+
+      g++ -O2 -I tools/host -o power_sim tools/power_sim.cpp && ./power_sim [capture.txt] [-p presses/day]
+*****************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include <mbed.h>
+#include <LiquidCrystal_I2C.h>
+#include "tests/fake_json.h"
+
+LiquidCrystal_I2C lcd(0x27, 20, 4);
+
+#include "../gg_main_m7/sensor_math.h"
+#include "../gg_main_m7/zones.h"
+#include "../gg_main_m7/runtime_config.h"
+#include "../gg_main_m7/memory_regions.h"
+#include "../gg_main_m7/power_management.h"
+#include "../gg_main_m7/scheduler.h"
+#include "../gg_main_m7/event_trace.h"
+
+#define SIM_DAY_MS (24UL * 3600 * 1000)
+#define SIM_PRESSES_PER_DAY 24
+#define SIM_TOLERANCE 0.001  // Relative, the estimate works in float
+
+//Intervals of gg_main_m7.ino that are not in the runtime config
+#define SIM_CONTROL_INTERVAL 1000
+#define SIM_UI_INTERVAL 100
+#define SIM_UI_SLEEP_INTERVAL 1000
+#define SIM_TDS_INTERVAL 20
+#define SIM_TIME_SYNC_INTERVAL 10000
+#define SIM_STATS_INTERVAL 300000
+#define SIM_LOG_INTERVAL 50
+#define SIM_DIAG_INTERVAL 10000
+#define SIM_METRICS_INTERVAL 250
+#define SIM_ALARM_INTERVAL 1000
+
+// A task of setup(), with the run time a run costs
+struct SimTask {
+  const char* name;
+  unsigned long interval;     // 0: the runtime config sets it (sampleInterval, sendDataInterval, pingInterval)
+  bool firstAfterInterval;    // First run after one interval instead of at once
+  bool traced;
+  unsigned long runMicros;    // Rough figure, replaced by the dump when it has the task
+  const char* source;         // Where runMicros came from
+};
+
+//Rough figures: the DHT and DS18B20 reads dominate the sensing pass, the uploads and pings wait on WiFi
+SimTask simTasks[] = {
+  { "timesync", SIM_TIME_SYNC_INTERVAL, false, true, 60, "figure" },
+  { "sensing", 0, false, true, 28000, "figure" },
+  { "control", SIM_CONTROL_INTERVAL, false, true, 150, "figure" },
+  { "ui", SIM_UI_INTERVAL, false, true, 400, "figure" },
+  { "tds", SIM_TDS_INTERVAL, false, false, 25, "figure" },
+  { "upload", 0, true, true, 350000, "figure" },
+  { "ping", 0, true, true, 120000, "figure" },
+  { "alarm", SIM_ALARM_INTERVAL, true, true, 20, "figure" },
+  { "stats", SIM_STATS_INTERVAL, true, true, 6000, "figure" },
+  { "diag", SIM_DIAG_INTERVAL, false, true, 400, "figure" },
+  { "log", SIM_LOG_INTERVAL, false, false, 40, "figure" },
+  { "metrics", SIM_METRICS_INTERVAL, false, true, 30, "figure" },
+};
+const int simTaskCount = sizeof(simTasks) / sizeof(simTasks[0]);
+
+int uiTaskId = -1;
+
+//Button presses, a Timeout standing in for the encoder interrupt
+mbed::Timeout pressTimer;
+unsigned long pressInterval = 0;
+bool pressPending = false;
+
+void pressInterrupt() {
+  pressPending = true;
+  postTaskEvent(uiTaskId);
+  pressTimer.attach(pressInterrupt, std::chrono::milliseconds(pressInterval));
+}
+
+// A task run: its run time on the virtual clock, the ui task also runs the backlight as uiTask() does
+void runSimTask(int id) {
+  if (id == uiTaskId) {
+    if (pressPending) {
+      pressPending = false;
+      noteUserActivity();
+    }
+    updateBacklight();
+    setTaskInterval(uiTaskId, isDisplayAsleep() ? SIM_UI_SLEEP_INTERVAL : SIM_UI_INTERVAL);
+  }
+  hostAdvanceMicros(simTasks[id].runMicros);
+}
+
+//One function per task, the scheduler calls them without an argument
+const TaskFunction simTaskFunctions[] = {
+  [] { runSimTask(0); }, [] { runSimTask(1); }, [] { runSimTask(2); }, [] { runSimTask(3); },
+  [] { runSimTask(4); }, [] { runSimTask(5); }, [] { runSimTask(6); }, [] { runSimTask(7); },
+  [] { runSimTask(8); }, [] { runSimTask(9); }, [] { runSimTask(10); }, [] { runSimTask(11); },
+};
+static_assert(sizeof(simTaskFunctions) / sizeof(simTaskFunctions[0]) == sizeof(simTasks) / sizeof(simTasks[0]), "One function per task");
+
+
+/*****************************************
+*   Post-mortem Dump
+*****************************************/
+
+// Run times of a dump: per task name the sum of the timed runs and their count
+struct DumpTask {
+  std::string name;
+  uint64_t timedMicros = 0;
+  unsigned long timedRuns = 0;
+};
+
+// Parse the EVENTS lines of a capture, false if it has none
+//  - A start followed by its stop is a timed run. The runs a start folded are gone from the ring, untimed
+bool readDump(const std::string& capture, std::vector<DumpTask>& dumpTasks) {
+  std::vector<TraceEvent> events;
+  dumpTasks.clear();
+
+  for (size_t start = 0; start < capture.size();) {
+    size_t end = capture.find('\n', start);
+    std::string line = capture.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    start = end == std::string::npos ? capture.size() : end + 1;
+
+    size_t at = line.find("EVENTS ");
+    if (at == std::string::npos) {
+      continue;
+    }
+    std::string rest = line.substr(at + 7);
+    while (!rest.empty() && (rest.back() == '\r' || rest.back() == ' ')) {
+      rest.pop_back();
+    }
+
+    if (rest.compare(0, 6, "TASKS ") == 0) {
+      std::string names = rest.substr(6);
+      for (size_t from = 0; from <= names.size();) {
+        size_t comma = names.find(',', from);
+        DumpTask task;
+        task.name = names.substr(from, comma == std::string::npos ? std::string::npos : comma - from);
+        dumpTasks.push_back(task);
+        from = comma == std::string::npos ? names.size() + 1 : comma + 1;
+      }
+      continue;
+    }
+    if (rest.compare(0, 5, "BOOT ") == 0 || rest == "END") {
+      continue;
+    }
+
+    for (size_t i = 0; i + 16 <= rest.size(); i += 16) {
+      std::string field = rest.substr(i, 16);
+      TraceEvent event;
+      event.time = (uint32_t)strtoul(field.substr(0, 8).c_str(), NULL, 16);
+      event.kind = (uint8_t)strtoul(field.substr(8, 2).c_str(), NULL, 16);
+      event.id = (uint8_t)strtoul(field.substr(10, 2).c_str(), NULL, 16);
+      event.value = (uint16_t)strtoul(field.substr(12, 4).c_str(), NULL, 16);
+      events.push_back(event);
+    }
+  }
+
+  //Tasks run one at a time, a stop closes the start before it
+  for (size_t i = 0; i < events.size(); i++) {
+    const TraceEvent& event = events[i];
+    if (event.kind != EVENT_TASK_START || event.id >= dumpTasks.size()) {
+      continue;
+    }
+    DumpTask& task = dumpTasks[event.id];
+    for (size_t j = i + 1; j < events.size(); j++) {
+      if (events[j].kind == EVENT_TASK_STOP && events[j].id == event.id) {
+        task.timedMicros += (uint32_t)(events[j].time - event.time);  // micros() wraps
+        task.timedRuns++;
+        break;
+      }
+      if (events[j].kind == EVENT_TASK_START) {
+        break;  // Stop lost to the reset
+      }
+    }
+  }
+  return !dumpTasks.empty();
+}
+
+// The figures of the tasks the dump timed, returns how many
+int applyDump(const std::vector<DumpTask>& dumpTasks) {
+  int applied = 0;
+  for (const DumpTask& dumped : dumpTasks) {
+    for (SimTask& task : simTasks) {
+      if (dumped.name == task.name && dumped.timedRuns > 0) {
+        task.runMicros = (unsigned long)(dumped.timedMicros / dumped.timedRuns);
+        task.source = "dump";
+        applied++;
+      }
+    }
+  }
+  return applied;
+}
+
+// The last events of the ring as the EVENTS lines of a post-mortem
+std::string formatDump() {
+  std::string capture = "EVENTS TASKS ";
+  for (int i = 0; i < taskCount; i++) {
+    capture += (i > 0 ? "," : "");
+    capture += tasks[i].name;
+  }
+  capture += "\n";
+
+  uint32_t count = min(eventTrace->head, (uint32_t)EVENT_TRACE_CAPACITY);
+  uint32_t first = eventTrace->head - count;
+  for (uint32_t i = 0; i < count; i += EVENT_TRACE_PER_LINE) {
+    capture += "EVENTS ";
+    for (uint32_t j = i; j < count && j < i + EVENT_TRACE_PER_LINE; j++) {
+      char hex[17];
+      formatEventHex(eventTrace->events[(first + j) % EVENT_TRACE_CAPACITY], hex);
+      capture += hex;
+    }
+    capture += "\n";
+  }
+  return capture + "EVENTS END\n";
+}
+
+
+/*****************************************
+*   Simulated Day
+*****************************************/
+
+struct DayResult {
+  float energy;            // mWh/day, estimatedEnergyPerDay()
+  double expected;         // The same from the simulated times
+  double sleepFraction;    // Asleep, either mode
+  double activeMicros;     // Uptime not asleep
+  double taskMicros;       // Run time the scheduler counted
+  double backlightFraction;
+};
+
+// Reset the firmware state and run a day, deepSleep is what the sleep manager allows
+DayResult simulateDay(bool deepSleep, unsigned long pressesPerDay) {
+  hostMicros() = 0;
+  hostThreadFlags() = 0;
+  hostDeepSleepAllowed() = deepSleep;
+  sleepMicros = 0;
+  deepSleepMicros = 0;
+  backlightOnMillis = 0;
+  backlightOn = true;
+  taskCount = 0;
+  taskHeapSize = 0;
+  taskEventHead = taskEventTail = 0;
+
+  initPowerManagement();
+  for (int id = 0; id < simTaskCount; id++) {
+    const SimTask& task = simTasks[id];
+    unsigned long interval = task.interval;
+    if (interval == 0) {
+      interval = strcmp(task.name, "sensing") == 0 ? runtimeConfig().sampleInterval
+                 : strcmp(task.name, "upload") == 0 ? runtimeConfig().sendDataInterval
+                                                    : runtimeConfig().pingInterval;
+    }
+    int taskId = addTask(task.name, simTaskFunctions[id], interval, task.firstAfterInterval ? interval : 0);
+    setTaskTraced(taskId, task.traced);
+    if (strcmp(task.name, "ui") == 0) {
+      uiTaskId = taskId;
+    }
+  }
+
+  pressInterval = pressesPerDay > 0 ? SIM_DAY_MS / pressesPerDay : 0;
+  pressPending = false;
+  pressTimer.detach();
+  if (pressInterval > 0) {
+    pressTimer.attach(pressInterrupt, std::chrono::milliseconds(pressInterval / 2));
+  }
+
+  while (millis() < SIM_DAY_MS) {
+    runScheduler();
+  }
+  pressTimer.detach();
+
+  DayResult result;
+  result.energy = estimatedEnergyPerDay();
+
+  double uptime = millis() * 1000.0;
+  double backlightTime = backlightOnMillis + (backlightOn ? millis() - backlightOnSince : 0);
+  double deepFraction = deepSleepMicros / uptime;
+  double lightFraction = (sleepMicros - deepSleepMicros) / uptime;
+  result.sleepFraction = sleepMicros / uptime;
+  result.backlightFraction = backlightTime * 1000.0 / uptime;
+  result.activeMicros = uptime - sleepMicros;
+  result.expected = (ACTIVE_CURRENT_MA * (1 - deepFraction - lightFraction) + SLEEP_CURRENT_MA * lightFraction
+                     + DEEP_SLEEP_CURRENT_MA * deepFraction + BACKLIGHT_CURRENT_MA * result.backlightFraction)
+                    * SUPPLY_VOLTAGE * 24.0;
+  result.taskMicros = 0;
+  for (int id = 0; id < taskCount; id++) {
+    result.taskMicros += tasks[id].totalRunMicros;
+  }
+  return result;
+}
+
+void printDay(const char* label, const DayResult& result, bool deepSleep) {
+  printf("\n%s: %.0f mWh/day (%.1f mA average at %.1f V), asleep %.2f%%, backlight on %.2f%%\n",
+         label, result.energy, result.energy / (SUPPLY_VOLTAGE * 24.0), SUPPLY_VOLTAGE,
+         100 * result.sleepFraction, 100 * result.backlightFraction);
+  printf("%-10s %6s %9s %10s %9s %11s\n", "Task", "Source", "Runs", "Avg(us)", "Active%", "mWh/day");
+
+  //What each task adds over sleeping through its run time
+  double sleepCurrent = deepSleep ? DEEP_SLEEP_CURRENT_MA : SLEEP_CURRENT_MA;
+  for (int id = 0; id < taskCount; id++) {
+    const Task& task = tasks[id];
+    double fraction = task.totalRunMicros / (SIM_DAY_MS * 1000.0);
+    printf("%-10s %6s %9lu %10lu %8.3f%% %11.1f\n", task.name, simTasks[id].source, task.runs,
+           task.runs > 0 ? (unsigned long)(task.totalRunMicros / task.runs) : 0, 100 * fraction,
+           (ACTIVE_CURRENT_MA - sleepCurrent) * fraction * SUPPLY_VOLTAGE * 24.0);
+  }
+}
+
+bool near(double value, double expected) {
+  return fabs(value - expected) <= SIM_TOLERANCE * fabs(expected) + 1e-9;
+}
+
+int main(int argc, char** argv) {
+  const char* capturePath = NULL;
+  unsigned long pressesPerDay = SIM_PRESSES_PER_DAY;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      pressesPerDay = strtoul(argv[++i], NULL, 10);
+    } else {
+      capturePath = argv[i];
+    }
+  }
+
+  Serial.muted = true;
+  initRuntimeConfig();
+  initEventTrace();
+  static_assert(sizeof(simTasks) / sizeof(simTasks[0]) <= MAX_TASKS, "One scheduler slot per task");
+
+  bool ok = true;
+
+  if (capturePath != NULL) {
+    FILE* file = fopen(capturePath, "rb");
+    if (file == NULL) {
+      perror(capturePath);
+      return 1;
+    }
+    std::string capture;
+    char buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      capture.append(buffer, length);
+    }
+    fclose(file);
+
+    std::vector<DumpTask> dumpTasks;
+    if (!readDump(capture, dumpTasks)) {
+      printf("%s: no EVENTS TASKS line, not a post-mortem dump\n", capturePath);
+      return 1;
+    }
+    printf("%s: run times of %d tasks from the dump\n", capturePath, applyDump(dumpTasks));
+  }
+
+  printf("Simulated day: upload every %lu s, ping every %lu s, sensing every %lu s, %lu button presses\n",
+         (unsigned long)runtimeConfig().sendDataInterval / 1000, (unsigned long)runtimeConfig().pingInterval / 1000,
+         (unsigned long)runtimeConfig().sampleInterval / 1000, pressesPerDay);
+  printf("Currents (power_management.h): active %.0f mA, sleep %.0f mA, Stop mode %.0f mA, backlight %.0f mA\n",
+         ACTIVE_CURRENT_MA, SLEEP_CURRENT_MA, DEEP_SLEEP_CURRENT_MA, BACKLIGHT_CURRENT_MA);
+
+  const bool modes[] = { true, false };
+  DayResult results[2];
+  for (int mode = 0; mode < 2; mode++) {
+    DayResult& result = results[mode];
+    result = simulateDay(modes[mode], pressesPerDay);
+    printDay(modes[mode] ? "Stop mode allowed" : "Sleep mode only (Deep sleep locked)", result, modes[mode]);
+
+    if (!near(result.energy, result.expected)) {
+      printf("FAIL: estimatedEnergyPerDay() %.1f mWh, the figures give %.1f\n", result.energy, result.expected);
+      ok = false;
+    }
+    if (!near(result.activeMicros, result.taskMicros)) {
+      printf("FAIL: %.0f us active, the tasks ran %.0f us\n", result.activeMicros, result.taskMicros);
+      ok = false;
+    }
+  }
+  if (!(results[0].energy < results[1].energy)) {
+    printf("FAIL: Stop mode does not save energy\n");
+    ok = false;
+  }
+
+  //The last task records of the day as a dump, read back they give the run times of the traced tasks
+  std::vector<DumpTask> dumpTasks;
+  if (!readDump(formatDump(), dumpTasks) || (int)dumpTasks.size() != taskCount) {
+    printf("FAIL: the dump of the day has %d tasks, %d ran\n", (int)dumpTasks.size(), taskCount);
+    ok = false;
+  }
+  int timed = 0;
+  for (int id = 0; id < (int)dumpTasks.size() && id < simTaskCount; id++) {
+    const DumpTask& dumped = dumpTasks[id];
+    if (dumped.timedRuns == 0) {
+      continue;
+    }
+    timed++;
+    unsigned long mean = (unsigned long)(dumped.timedMicros / dumped.timedRuns);
+    if (!simTasks[id].traced || mean != simTasks[id].runMicros) {
+      printf("FAIL: %s reads back at %lu us a run, it ran %lu us\n", dumped.name.c_str(), mean, simTasks[id].runMicros);
+      ok = false;
+    }
+  }
+  if (timed == 0) {
+    printf("FAIL: no task timed in the dump of the day\n");
+    ok = false;
+  }
+
+  printf("\n%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
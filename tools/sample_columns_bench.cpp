@@ -0,0 +1,368 @@
+/*****************************************
+*   Sample Columns Benchmark
+      - Times the upload serialization loop of convertToJSON() over the raw
+        samples in two layouts:
+          rows    The previous layout: one array of sensorData structs per
+                  channel (Five Strings, timestamp and value per sample),
+                  every slot of every array read to find the rows with data
+          columns gg_main_m7/sample_columns.h: a timestamp and a value array
+                  per channel, the names once per channel, a presence bit per row
+      - Both write the same JSON with the same small writer (No ArduinoJson on
+        the host), the outputs are compared and the run exits with 1 if they
+        differ. "scan" is the part before any JSON: the time range of the
+        samples and the search for the rows with data
+      - 1 zone (6 channels) and 8 zones (20 channels), 10 and 100 of the 100
+        rows filled. The Strings are modelled as on the board (Pointer,
+        capacity, length, text on the heap), the sizes are printed for the
+        32 bit board
+      - The board figures come from the convertToJSON cases of a GG_BENCHMARK build
+
+      g++ -O2 -o sample_columns_bench tools/sample_columns_bench.cpp && ./sample_columns_bench
+*****************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#define GG_ZONES 8
+#include "../gg_main_m7/sensor_math.h"
+#include "../gg_main_m7/zones.h"
+#include "../gg_main_m7/sample_columns.h"
+
+#define BENCH_DEVICE_ID "GG-001"
+#define BENCH_BUFFER_SIZE 1048576
+#define BENCH_BOARD_POINTER 4  // Bytes of a pointer on the board
+
+//Arduino String: buffer pointer, capacity and length, the text on the heap
+struct HostString {
+  char* buffer;
+  unsigned capacity;
+  unsigned len;
+
+  void operator=(const char* text) {
+    free(buffer);
+    len = strlen(text);
+    capacity = len;
+    buffer = (char*)malloc(len + 1);
+    memcpy(buffer, text, len + 1);
+  }
+  const char* c_str() const { return buffer != NULL ? buffer : ""; }
+  bool isEmpty() const { return len == 0; }
+};
+
+//The previous layout, as in gg_main_m7.ino before the sample columns
+struct sensorData {
+  HostString name;
+  HostString sensorName;
+  unsigned long timestamp;
+  HostString sensorType;
+  HostString sensorLocation;
+  HostString dataType;
+  float data;
+};
+
+const size_t boardSensorDataSize = 5 * (BENCH_BOARD_POINTER + 8) + 4 + 4;
+
+struct ChannelInfo {
+  const char* name;
+  const char* sensorName;
+  const char* sensorType;
+  const char* dataType;
+  const char* location;
+};
+
+//In RollupChannelId order, the zones after Zone 1 in pairs
+ChannelInfo channelInfo[SAMPLE_CHANNELS];
+const char* const zoneNames[ZONE_MAX] = { "Greenhouse 1", "Greenhouse 2", "Greenhouse 3", "Greenhouse 4",
+                                          "Greenhouse 5", "Greenhouse 6", "Greenhouse 7", "Greenhouse 8" };
+
+void initChannelInfo() {
+  channelInfo[0] = { "Device Temperature", "Sensor 1", "Internal", "Temperature", "Default" };
+  channelInfo[1] = { "Temperature Sensor", "Sensor 1", "DHT", "Temperature", zoneNames[0] };
+  channelInfo[2] = { "Humidity Sensor", "Sensor 1", "DHT", "Humidity", zoneNames[0] };
+  channelInfo[3] = { "Water Temperature", "Sensor 1", "ds18b20", "Temperature", zoneNames[0] };
+  channelInfo[4] = { "PH", "PH Sensor 1", "BNC PH Probe", "PH", zoneNames[0] };
+  channelInfo[5] = { "TDS", "TDS Sensor 1", "TDS", "PPM", zoneNames[0] };
+  for (int zone = 1; zone < GG_ZONES; zone++) {
+    channelInfo[6 + 2 * (zone - 1)] = { "Temperature Sensor", "Sensor 1", "DHT", "Temperature", zoneNames[zone] };
+    channelInfo[7 + 2 * (zone - 1)] = { "Humidity Sensor", "Sensor 1", "DHT", "Humidity", zoneNames[zone] };
+  }
+}
+
+
+/*****************************************
+*   JSON writer, the same for both layouts
+*****************************************/
+
+struct Writer {
+  char* buffer;
+  size_t length;
+};
+
+inline void writeText(Writer& out, const char* text) {
+  size_t length = strlen(text);
+  memcpy(out.buffer + out.length, text, length);
+  out.length += length;
+}
+
+inline void writeString(Writer& out, const char* key, const char* value) {
+  writeText(out, key);
+  out.buffer[out.length++] = '"';
+  writeText(out, value);
+  out.buffer[out.length++] = '"';
+}
+
+inline void writeUnsigned(Writer& out, uint32_t value) {
+  char digits[10];
+  int count = 0;
+  do {
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  while (count > 0) {
+    out.buffer[out.length++] = digits[--count];
+  }
+}
+
+// Two decimals, as the JSON of the board
+inline void writeValue(Writer& out, float value) {
+  if (value < 0) {
+    out.buffer[out.length++] = '-';
+    value = -value;
+  }
+  uint32_t hundredths = (uint32_t)(value * 100 + 0.5f);
+  writeUnsigned(out, hundredths / 100);
+  out.buffer[out.length++] = '.';
+  out.buffer[out.length++] = '0' + hundredths / 10 % 10;
+  out.buffer[out.length++] = '0' + hundredths % 10;
+}
+
+void writeReading(Writer& out, bool first, const char* name, float value, uint32_t time,
+                  const char* sensorName, const char* sensorType, const char* dataType, const char* location) {
+  writeText(out, first ? "{" : ",{");
+  writeString(out, "\"Name\":", name);
+  writeText(out, ",\"Value\":");
+  writeValue(out, value);
+  writeText(out, ",\"Time\":");
+  writeUnsigned(out, time);
+  if (sensorName[0] != '\0') {
+    writeString(out, ",\"Sensor\":", sensorName);
+  }
+  if (sensorType[0] != '\0') {
+    writeString(out, ",\"Type\":", sensorType);
+  }
+  if (dataType[0] != '\0') {
+    writeString(out, ",\"Field\":", dataType);
+  }
+  if (location[0] != '\0') {
+    writeString(out, ",\"Location\":", location);
+  }
+  writeText(out, "}");
+}
+
+void writeRowStart(Writer& out, bool first) {
+  writeText(out, first ? "{\"Device\":{" : ",{\"Device\":{");
+  writeString(out, "\"DeviceID\":", BENCH_DEVICE_ID);
+  writeText(out, "},\"SensorReadings\":[");
+}
+
+
+/*****************************************
+*   Rows layout
+*****************************************/
+
+sensorData rowArrays[SAMPLE_CHANNELS][SAMPLE_ROWS];
+int rowCounts[SAMPLE_CHANNELS];
+
+void fillRows(int channels, int rows) {
+  for (int channel = 0; channel < SAMPLE_CHANNELS; channel++) {
+    rowCounts[channel] = channel < channels ? rows : 0;
+    for (int row = 0; row < SAMPLE_ROWS; row++) {
+      sensorData& sample = rowArrays[channel][row];
+      bool filled = channel < channels && row < rows;
+      const ChannelInfo& info = channelInfo[channel];
+      sample.name = info.name;
+      sample.sensorName = info.sensorName;
+      sample.sensorType = info.sensorType;
+      sample.sensorLocation = info.location;
+      sample.dataType = info.dataType;
+      sample.data = filled ? 20.0f + (channel * 7 + row) % 50 * 0.1f : 0;
+      sample.timestamp = filled ? 1700000000UL + row * 30 : 0;
+    }
+  }
+}
+
+// rawSampleRange() and the row check of convertToJSON() before the sample columns
+int scanRows(int channels, uint32_t& oldest, uint32_t& newest) {
+  oldest = 0;
+  newest = 0;
+  for (int channel = 0; channel < channels; channel++) {
+    for (int row = 0; row < rowCounts[channel]; row++) {
+      uint32_t time = rowArrays[channel][row].timestamp;
+      if (time == 0) {
+        continue;
+      }
+      oldest = oldest == 0 || time < oldest ? time : oldest;
+      newest = time > newest ? time : newest;
+    }
+  }
+
+  int present = 0;
+  for (int row = 0; row < SAMPLE_ROWS; row++) {
+    bool hasData = false;
+    for (int channel = 0; channel < channels && !hasData; channel++) {
+      hasData = rowArrays[channel][row].data != 0;
+    }
+    present += hasData;
+  }
+  return present;
+}
+
+size_t serializeRows(int channels, char* buffer) {
+  Writer out = { buffer, 0 };
+  uint32_t oldest, newest;
+  scanRows(channels, oldest, newest);
+
+  writeText(out, "{\"Data\":[");
+  bool firstRow = true;
+  for (int row = 0; row < SAMPLE_ROWS; row++) {
+    bool hasData = false;
+    for (int channel = 0; channel < channels && !hasData; channel++) {
+      hasData = rowArrays[channel][row].data != 0;
+    }
+    if (!hasData) {
+      continue;
+    }
+
+    writeRowStart(out, firstRow);
+    firstRow = false;
+    bool first = true;
+    for (int channel = 0; channel < channels; channel++) {
+      const sensorData& sensor = rowArrays[channel][row];
+      if (sensor.data != 0) {
+        writeReading(out, first, sensor.name.c_str(), sensor.data, sensor.timestamp, sensor.sensorName.c_str(),
+                     sensor.sensorType.c_str(), sensor.dataType.c_str(), sensor.sensorLocation.c_str());
+        first = false;
+      }
+    }
+    writeText(out, "]}");
+  }
+  writeText(out, "]}");
+  return out.length;
+}
+
+
+/*****************************************
+*   Columns layout
+*****************************************/
+
+SampleColumns columns;
+
+void fillColumns(int channels, int rows) {
+  clearSampleColumns(columns);
+  for (int channel = 0; channel < channels; channel++) {
+    for (int row = 0; row < rows; row++) {
+      addSample(columns, channel, 1700000000UL + row * 30, 20.0f + (channel * 7 + row) % 50 * 0.1f);
+    }
+  }
+}
+
+int scanColumns(uint32_t& oldest, uint32_t& newest) {
+  sampleTimeRange(columns, oldest, newest);
+
+  int present = 0;
+  for (int row = nextSampleRow(columns, 0); row >= 0; row = nextSampleRow(columns, row + 1)) {
+    present++;
+  }
+  return present;
+}
+
+size_t serializeColumns(int channels, char* buffer) {
+  Writer out = { buffer, 0 };
+  uint32_t oldest, newest;
+  sampleTimeRange(columns, oldest, newest);
+
+  writeText(out, "{\"Data\":[");
+  bool firstRow = true;
+  for (int row = nextSampleRow(columns, 0); row >= 0; row = nextSampleRow(columns, row + 1)) {
+    writeRowStart(out, firstRow);
+    firstRow = false;
+    bool first = true;
+    for (int channel = 0; channel < channels; channel++) {
+      float value = sampleValue(columns, channel, row);
+      if (value != 0) {
+        const ChannelInfo& info = channelInfo[channel];
+        writeReading(out, first, info.name, value, columns.time[channel][row], info.sensorName,
+                     info.sensorType, info.dataType, info.location);
+        first = false;
+      }
+    }
+    writeText(out, "]}");
+  }
+  writeText(out, "]}");
+  return out.length;
+}
+
+
+/*****************************************
+*   Benchmark
+*****************************************/
+
+volatile uint32_t benchSink;
+
+template<typename Function>
+double nsPerCall(Function function, int calls) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < calls; i++) {
+    function();
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+}
+
+int main() {
+  initChannelInfo();
+  static char rowsJson[BENCH_BUFFER_SIZE];
+  static char columnsJson[BENCH_BUFFER_SIZE];
+  int failures = 0;
+
+  printf("Upload serialization loop, %d rows per channel held, ns per upload on the host\n", SAMPLE_ROWS);
+  printf("Raw samples held on the board: rows %zu bytes per channel plus the String text, columns %zu bytes per channel\n\n",
+         boardSensorDataSize * SAMPLE_ROWS, (sizeof(uint32_t) + sizeof(float)) * SAMPLE_ROWS);
+  printf("%-5s %5s %8s %11s %11s %7s %12s %12s %7s\n",
+         "Zones", "Rows", "JSON(B)", "Scan rows", "Scan cols", "Speedup", "Serial. rows", "Serial. cols", "Speedup");
+
+  const int zoneCounts[] = { 1, 8 };
+  const int fills[] = { 10, 100 };
+  for (int zones : zoneCounts) {
+    int channels = 6 + 2 * (zones - 1);
+
+    for (int fill : fills) {
+      fillRows(channels, fill);
+      fillColumns(channels, fill);
+
+      size_t rowsLength = serializeRows(channels, rowsJson);
+      size_t columnsLength = serializeColumns(channels, columnsJson);
+      bool same = rowsLength == columnsLength && memcmp(rowsJson, columnsJson, rowsLength) == 0;
+      if (!same) {
+        printf("%-5d %5d  FAIL: the two layouts write different JSON\n", zones, fill);
+        failures++;
+        continue;
+      }
+
+      uint32_t oldest, newest;
+      int calls = 200000 / fill;
+      double scanRowsNs = nsPerCall([&] { benchSink = scanRows(channels, oldest, newest) + oldest; }, calls * 10);
+      double scanColumnsNs = nsPerCall([&] { benchSink = scanColumns(oldest, newest) + oldest; }, calls * 10);
+      double serialRowsNs = nsPerCall([&] { benchSink = serializeRows(channels, rowsJson); }, calls);
+      double serialColumnsNs = nsPerCall([&] { benchSink = serializeColumns(channels, columnsJson); }, calls);
+
+      printf("%-5d %5d %8zu %11.0f %11.0f %6.1fx %12.0f %12.0f %6.1fx\n",
+             zones, fill, columnsLength, scanRowsNs, scanColumnsNs, scanRowsNs / scanColumnsNs,
+             serialRowsNs, serialColumnsNs, serialRowsNs / serialColumnsNs);
+    }
+  }
+
+  printf("\n%s\n", failures == 0 ? "Both layouts write the same JSON" : "Layouts DIFFER");
+  return failures == 0 ? 0 : 1;
+}
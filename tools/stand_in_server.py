@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""Stand-in for the sensor API server, to check the network metrics of gg_main_m7.
+
+Answers /sensors/sendData (with the ack of the upload), /sensors/ping,
+/sensors/testconnection and /sensors/alarm, and can inject latency, errors, dropped connections
+and wrong acks. It counts what it received per endpoint; with --scrape it
+reads the board's /metrics and prints both side by side, the request and
+byte counters must match. Point SECRET_API_SERVER / SECRET_PORT at this host.
+
+Every answer lists "encodings": ["deflate"], the board then deflates its
+uploads (Content-Encoding: deflate); the report shows the bytes on the wire
+and the inflated JSON. With --no-deflate the list is empty and a compressed
+body is answered with a 415, as a server that cannot inflate would.
+
+    python3 tools/stand_in_server.py --port 3420 --delay 200 --error-rate 0.1
+    python3 tools/stand_in_server.py --scrape http://192.168.1.50/metrics
+"""
+
+import argparse
+import json
+import random
+import re
+import socketserver
+import threading
+import time
+import urllib.request
+import zlib
+from http.server import BaseHTTPRequestHandler, HTTPServer
+
+ENDPOINTS = {
+    "/sensors/sendData": "sendData",
+    "/sensors/ping": "ping",
+    "/sensors/testconnection": "testconnection",
+    "/sensors/alarm": "alarm",
+}
+
+counts = {}
+counts_lock = threading.Lock()
+
+
+def count(endpoint, key, amount=1):
+    with counts_lock:
+        entry = counts.setdefault(endpoint, {"requests": 0, "errors": 0, "dropped": 0, "wrong_acks": 0, "sent_bytes": 0, "received_bytes": 0,
+                                              "compressed": 0, "json_bytes": 0})
+        entry[key] += amount
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    options = None
+
+    def endpoint(self):
+        return ENDPOINTS.get(self.path.split("?")[0], "other")
+
+    def answer(self, endpoint, body, status=200):
+        options = self.options
+        time.sleep(options.delay / 1000.0)
+
+        if random.random() < options.drop_rate:
+            count(endpoint, "dropped")
+            self.close_connection = True
+            self.connection.close()
+            return
+
+        if status == 200 and random.random() < options.error_rate:
+            status = 500
+            count(endpoint, "errors")
+            body = {"error": "injected"}
+        body["encodings"] = [] if options.no_deflate else ["deflate"]
+
+        data = json.dumps(body).encode()
+        count(endpoint, "received_bytes", len(data))
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(data)))
+        self.send_header("Connection", "close")
+        self.end_headers()
+        self.wfile.write(data)
+
+    def do_GET(self):
+        endpoint = self.endpoint()
+        count(endpoint, "requests")
+        count(endpoint, "sent_bytes", len(self.path))  # The board counts the URL of a GET
+        self.answer(endpoint, {"status": "ok"})
+
+    def do_POST(self):
+        endpoint = self.endpoint()
+        length = int(self.headers.get("Content-Length", 0))
+        body = self.rfile.read(length)
+        count(endpoint, "requests")
+        count(endpoint, "sent_bytes", length)
+
+        if self.headers.get("Content-Encoding", "").lower() == "deflate":
+            count(endpoint, "compressed")
+            try:
+                if self.options.no_deflate:
+                    raise zlib.error("deflate not accepted")
+                body = zlib.decompress(body)
+            except zlib.error as error:
+                self.answer(endpoint, {"error": str(error)}, 415)
+                return
+        count(endpoint, "json_bytes", len(body))
+
+        try:
+            sequence = json.loads(body).get("Sequence", 0)
+        except ValueError:
+            sequence = 0
+        if random.random() < self.options.wrong_ack_rate:
+            count(endpoint, "wrong_acks")
+            sequence += 1000
+        self.answer(endpoint, {"ack": sequence})
+
+    def log_message(self, format, *args):
+        if self.options.verbose:
+            BaseHTTPRequestHandler.log_message(self, format, *args)
+
+
+class Server(socketserver.ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+
+
+def scrape(url):
+    """Return {endpoint: {metric: value}} of the counters on the board's /metrics."""
+    text = urllib.request.urlopen(url, timeout=5).read().decode()
+    board = {}
+    for name, labels, value in re.findall(r'^(gg_http_\w+_total)\{([^}]*)\} (\S+)$', text, re.M):
+        endpoint = re.search(r'endpoint="([^"]+)"', labels).group(1)
+        cause = re.search(r'cause="([^"]+)"', labels)
+        key = name[len("gg_http_"):-len("_total")] + ("_" + cause.group(1) if cause else "")
+        board.setdefault(endpoint, {})[key] = float(value)
+    return board
+
+
+def report(scrape_url):
+    with counts_lock:
+        snapshot = json.loads(json.dumps(counts))
+
+    print("%-15s %9s %9s %9s %9s %9s %11s %10s %9s" % ("Endpoint", "Requests", "Errors", "Dropped", "WrongAck", "Sent(B)",
+                                                    "Answered(B)", "Deflated", "JSON(B)"))
+    for endpoint, entry in sorted(snapshot.items()):
+        print("%-15s %9d %9d %9d %9d %9d %11d %10d %9d" % (endpoint, entry["requests"], entry["errors"], entry["dropped"],
+                                                          entry["wrong_acks"], entry["sent_bytes"], entry["received_bytes"],
+                                                          entry["compressed"], entry["json_bytes"]))
+
+    if not scrape_url:
+        return
+    try:
+        board = scrape(scrape_url)
+    except OSError as error:
+        print("Scrape failed: %s" % error)
+        return
+
+    # Requests that never reached the server (connect failures) are only on the board
+    print("%-15s %9s %9s %9s %9s %9s %9s" % ("Board", "Requests", "HttpErr", "Timeout", "NotAcked", "Sent(B)", "Recv(B)"))
+    for endpoint, entry in sorted(board.items()):
+        if entry.get("requests", 0) == 0:
+            continue
+        print("%-15s %9d %9d %9d %9d %9d %9d" % (endpoint, entry.get("requests", 0), entry.get("failures_http_error", 0),
+                                                 entry.get("failures_timeout", 0), entry.get("failures_not_acked", 0),
+                                                 entry.get("sent_bytes", 0), entry.get("received_bytes", 0)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=3420)
+    parser.add_argument("--delay", type=int, default=0, help="ms before every answer")
+    parser.add_argument("--error-rate", type=float, default=0.0, help="Share of requests answered with a 500")
+    parser.add_argument("--drop-rate", type=float, default=0.0, help="Share of requests closed without an answer")
+    parser.add_argument("--wrong-ack-rate", type=float, default=0.0, help="Share of uploads acked with another sequence")
+    parser.add_argument("--no-deflate", action="store_true", help="Do not accept compressed uploads (415)")
+    parser.add_argument("--scrape", help="Board /metrics URL to compare against")
+    parser.add_argument("--report-interval", type=int, default=60, help="s between reports")
+    parser.add_argument("--verbose", action="store_true")
+    options = parser.parse_args()
+
+    Handler.options = options
+    server = Server(("", options.port), Handler)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    print("Stand-in server on port %d" % options.port)
+
+    try:
+        while True:
+            time.sleep(options.report_interval)
+            report(options.scrape)
+    except KeyboardInterrupt:
+        report(options.scrape)
+
+
+if __name__ == "__main__":
+    main()
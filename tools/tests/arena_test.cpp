@@ -0,0 +1,131 @@
+/*****************************************
+*   Upload Arena Cycle Test
+      - gg_main_m7/upload_arena.h through 100k upload cycles shaped like
+        sendSensorData(): reset, the request URL, the upload document filled
+        to a varying size, the response document
+      - The arena high water is the same after the last cycle as after the
+        first, the used size never passes the arena and nothing is left
+        allocated on the heap once a cycle ends
+      - Documents that do not fit fail with capacity 0 (Counted), the next
+        cycle allocates normally again
+      - reallocate() keeps the block contents when it has to move
+*****************************************/
+
+#include <new>
+#include <stdlib.h>
+
+#include <Arduino.h>
+#include "check.h"
+#include "fake_json.h"
+
+#include "../../gg_main_m7/upload_arena.h"
+
+#define TEST_CYCLES 100000
+#define JSON_DOCUMENT_SIZE 32768     // As in gg_main_m7.ino
+#define RESPONSE_DOCUMENT_SIZE 1024  // As in response_parser.h
+
+//Live heap bytes, every new / delete of the test goes through here
+size_t heapLive = 0;
+size_t heapPeak = 0;
+
+void* operator new(size_t size) {
+  size_t* block = (size_t*)malloc(size + sizeof(size_t) * 2);
+  if (block == NULL) {
+    throw std::bad_alloc();
+  }
+  block[0] = size;
+  heapLive += size;
+  heapPeak = max(heapPeak, heapLive);
+  return block + 2;
+}
+
+void operator delete(void* pointer) noexcept {
+  if (pointer != NULL) {
+    size_t* block = (size_t*)pointer - 2;
+    heapLive -= block[0];
+    free(block);
+  }
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+  operator delete(pointer);
+}
+
+uint8_t arenaBuffer[UPLOAD_ARENA_SIZE];
+
+// One upload cycle, rows readings in the upload document, false if a document did not fit
+bool uploadCycle(int rows, size_t uploadSize) {
+  arenaReset(uploadArena);
+
+  char* url = arenaPrintf(uploadArena, "%s?deviceID=%s%s", "/sensors/sendData", "GG-001", rows % 2 ? "&retry=1" : "");
+  if (url == NULL) {
+    return false;
+  }
+
+  ArenaJsonDocument doc(uploadSize);
+  if (doc.capacity() == 0) {
+    return false;
+  }
+  JsonArray Data = fakeJsonObject(doc).createNestedArray("Data");
+  for (int row = 0; row < rows && doc.capacity() - doc.memoryUsage() >= 8 * FAKE_JSON_SLOT_SIZE; row++) {
+    JsonObject reading = Data.createNestedObject();
+    reading["Name"] = "Temperature Sensor";
+    reading["Value"] = 20 + row * 0.1;
+    reading["Time"] = 1700000000UL + row * 30;
+    reading["Location"] = (const char*)url;
+  }
+
+  ArenaJsonDocument responseDoc(RESPONSE_DOCUMENT_SIZE);
+  return responseDoc.capacity() > 0 && !doc.overflowed();
+}
+
+int main() {
+  hostSerial().muted = true;
+  initArena(uploadArena, arenaBuffer, sizeof(arenaBuffer));
+  size_t heapBefore = heapLive;
+
+  //First cycle sets the high water: a full document and the longer URL
+  CHECK(uploadCycle(1001, JSON_DOCUMENT_SIZE));
+  size_t highWater = uploadArena.highWater;
+  CHECK(highWater > JSON_DOCUMENT_SIZE + RESPONSE_DOCUMENT_SIZE && highWater <= UPLOAD_ARENA_SIZE);
+
+  unsigned long failed = 0;
+  bool failedAsExpected = true;
+  bool heapReturned = true;
+  bool usedInArena = true;
+  uint32_t random = 11;
+  for (int cycle = 1; cycle < TEST_CYCLES; cycle++) {
+    random = random * 1103515245 + 12345;
+    int rows = (random >> 16) % 400;
+
+    //Every 97th cycle asks for more than the arena holds
+    bool tooLarge = cycle % 97 == 0;
+    bool done = uploadCycle(rows, tooLarge ? UPLOAD_ARENA_SIZE : JSON_DOCUMENT_SIZE);
+    failedAsExpected &= done != tooLarge;
+    failed += tooLarge;
+
+    usedInArena &= uploadArena.used <= uploadArena.size;
+    heapReturned &= heapLive == heapBefore;
+  }
+
+  printf("%d cycles: arena high water %u of %u bytes, heap peak %u bytes\n",
+         TEST_CYCLES, (unsigned)uploadArena.highWater, (unsigned)uploadArena.size, (unsigned)heapPeak);
+  CHECK(uploadArena.highWater == highWater);
+  CHECK(uploadArena.resets == TEST_CYCLES);
+  CHECK(failedAsExpected);
+  CHECK(uploadArena.failures == failed);
+  CHECK(usedInArena);
+  CHECK(heapReturned);
+
+  //A grown block keeps its contents, a smaller one stays in place
+  arenaReset(uploadArena);
+  UploadArenaAllocator allocator;
+  char* text = (char*)allocator.allocate(16);
+  strlcpy(text, "kept when moved", 16);
+  CHECK(allocator.reallocate(text, 8) == text);
+  char* grown = (char*)allocator.reallocate(text, 4096);
+  CHECK(grown != NULL && grown != text && strcmp(grown, "kept when moved") == 0);
+  CHECK(allocator.reallocate(grown, UPLOAD_ARENA_SIZE) == NULL);
+
+  return checkResult("arena_test");
+}
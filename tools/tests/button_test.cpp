@@ -0,0 +1,141 @@
+/*****************************************
+*   Button Bounce Test
+      - Drives the button pin of gg_main_m7/button_functions.h with bouncing
+        edges on the virtual clock and runs updateButton() the way the ui
+        task does (Every 100 ms and when the interrupt wakes it)
+      - Bounce on press and release still gives one Click, a hold gives one
+        Long Press, two quick clicks give a Double Click
+      - A press released inside the debounce time is a glitch: no event at
+        all, and no Long Press later (The release must not be lost)
+*****************************************/
+
+#include <vector>
+
+#include <mbed.h>
+#include "check.h"
+#include "../../gg_main_m7/button_functions.h"
+
+#define BUTTON_PIN 51
+#define UI_INTERVAL 100
+
+bool uiWoken = false;
+unsigned long nextUiRun = 0;
+std::vector<ButtonEvent> events;
+
+void wakeUi() {
+  uiWoken = true;
+}
+
+// Run the ui task when it is due or was woken, then let ms pass
+void runFor(unsigned long ms) {
+  for (unsigned long i = 0; i < ms; i++) {
+    if (uiWoken || millis() >= nextUiRun) {
+      if (!uiWoken) {
+        nextUiRun += UI_INTERVAL;
+      }
+      uiWoken = false;
+      updateButton();
+      ButtonEvent event;
+      while ((event = getButtonEvent()) != BUTTON_NONE) {
+        events.push_back(event);
+      }
+    }
+    hostAdvance(1);
+  }
+}
+
+// Move the pin to level, bouncing back and forth on the way (ms apart)
+void bounceTo(int level, const std::vector<int>& bounceGaps) {
+  for (int gap : bounceGaps) {
+    hostSetPin(BUTTON_PIN, level);
+    runFor(gap);
+    hostSetPin(BUTTON_PIN, !level);
+    runFor(1);
+  }
+  hostSetPin(BUTTON_PIN, level);
+}
+
+void press(const std::vector<int>& bounce = { 1, 2, 1, 3 }) {
+  bounceTo(LOW, bounce);
+}
+
+void release(const std::vector<int>& bounce = { 2, 1, 4 }) {
+  bounceTo(HIGH, bounce);
+}
+
+bool onlyEvent(ButtonEvent expected) {
+  return events.size() == 1 && events[0] == expected;
+}
+
+int main() {
+  hostSetPin(BUTTON_PIN, HIGH);
+  initButton(BUTTON_PIN, wakeUi);
+  runFor(1000);
+  CHECK(events.empty());
+
+  //Bouncy click
+  press();
+  runFor(120);
+  release();
+  runFor(1000);
+  CHECK(onlyEvent(BUTTON_CLICK));
+
+  //Hold with bounce on both ends
+  events.clear();
+  press();
+  runFor(1500);
+  CHECK(onlyEvent(BUTTON_LONG_PRESS));
+  release();
+  runFor(1000);
+  CHECK(onlyEvent(BUTTON_LONG_PRESS));
+
+  //Two bouncy clicks 150 ms apart
+  events.clear();
+  press();
+  runFor(80);
+  release();
+  runFor(150);
+  press();
+  runFor(80);
+  release();
+  runFor(1000);
+  CHECK(onlyEvent(BUTTON_DOUBLE_CLICK));
+
+  //Glitches shorter than the debounce time, press and release inside 20 ms
+  events.clear();
+  for (int i = 0; i < 5; i++) {
+    press({ 1 });
+    runFor(BUTTON_DEBOUNCE_MS - 12);
+    release({ 1 });
+    runFor(400);
+  }
+  runFor(2000);
+  CHECK(events.empty());
+  CHECK(!buttonStableState);
+
+  //Release bounce spread over longer than the debounce time still ends released
+  events.clear();
+  press();
+  runFor(200);
+  release({ 5, 10, 20, 25 });
+  runFor(2000);
+  CHECK(onlyEvent(BUTTON_CLICK));
+  CHECK(!buttonStableState);
+
+  //Released right at the end of the press bounce, no phantom Long Press
+  events.clear();
+  press({ 1, 1 });
+  release({ 1 });
+  runFor(2000);
+  CHECK(events.empty());
+
+  //Still works afterwards
+  events.clear();
+  press();
+  runFor(100);
+  release();
+  runFor(1000);
+  CHECK(onlyEvent(BUTTON_CLICK));
+
+  return checkResult("button_test");
+}
@@ -0,0 +1,32 @@
+/*****************************************
+*   Host Test Checks
+      - CHECK() prints the failed condition with its line and counts it,
+        the test carries on so one run shows every failure
+      - checkResult() is the exit code of the test: 1 if any check failed
+*****************************************/
+
+#ifndef GG_HOST_CHECK_H
+#define GG_HOST_CHECK_H
+
+#include <stdio.h>
+
+int checkFailures = 0;
+int checkCount = 0;
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+bool check(bool passed, const char* condition, const char* file, int line) {
+  checkCount++;
+  if (!passed) {
+    printf("FAILED %s:%d %s\n", file, line, condition);
+    checkFailures++;
+  }
+  return passed;
+}
+
+int checkResult(const char* name) {
+  printf("%s: %d of %d checks passed\n", name, checkCount - checkFailures, checkCount);
+  return checkFailures > 0 ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,157 @@
+/*****************************************
+*   Runtime Config Test
+      - gg_main_m7/runtime_config.h: stored configs of every CONFIG_VERSION
+        migrated to the current layout, and updates pushed by the server
+        (Built with the fake JSON document)
+      - Version 1 and 2 copies keep their fields, the new ones get their
+        defaults and the zones follow zone 1. Newer, truncated or corrupt
+        copies are rejected with the defaults in place
+      - An update is applied whole or not at all: an invalid value anywhere
+        leaves the live config and its index untouched, a valid one swaps
+        every field in at once
+      - pushedZoneTargets only holds the zones whose target the update carried
+*****************************************/
+
+#include <stddef.h>
+#include <vector>
+
+#include <Arduino.h>
+#include "check.h"
+#include "fake_json.h"
+
+#include "../../gg_main_m7/sensor_math.h"
+#include "../../gg_main_m7/zones.h"
+#include "../../gg_main_m7/runtime_config.h"
+
+//Stored sizes of the older layouts, each version only added fields at the end
+#define CONFIG_V1_SIZE offsetof(RuntimeConfig, maxDataAge)
+#define CONFIG_V2_SIZE offsetof(RuntimeConfig, zoneTargets)
+
+// A config as stored by the firmware of version, cut to that version's size
+std::vector<uint8_t> storedConfig(uint32_t version, size_t size, const RuntimeConfig& fields) {
+  RuntimeConfig config = fields;
+  config.version = version;
+  config.size = size;
+  const uint8_t* bytes = (const uint8_t*)&config;
+  return std::vector<uint8_t>(bytes, bytes + size);
+}
+
+bool migrate(const std::vector<uint8_t>& stored, RuntimeConfig& config) {
+  return migrateConfig(stored.data(), stored.size(), config);
+}
+
+bool isDefault(const RuntimeConfig& config) {
+  RuntimeConfig defaults;
+  defaultConfig(defaults);
+  return memcmp(&config, &defaults, sizeof(config)) == 0;
+}
+
+int main() {
+  hostSerial().muted = true;
+  initRuntimeConfig();
+
+  RuntimeConfig fields;
+  defaultConfig(fields);
+  fields.revision = 12;
+  strlcpy(fields.deviceId, "GG-042", sizeof(fields.deviceId));
+  fields.sampleInterval = 15000;
+  fields.targetTemperature = 23;
+  strlcpy(fields.location, "Tunnel", sizeof(fields.location));
+  fields.maxDataAge = 120000;
+  fields.zoneTargets[1] = 17;
+  strlcpy(fields.zoneLocations[1], "Seedlings", ZONE_NAME_SIZE);
+
+  //Version 1: the zones come from targetTemperature and location, maxDataAge is the default
+  RuntimeConfig config;
+  CHECK(migrate(storedConfig(1, CONFIG_V1_SIZE, fields), config));
+  CHECK(config.version == CONFIG_VERSION && config.size == sizeof(RuntimeConfig));
+  CHECK(config.revision == 12 && strcmp(config.deviceId, "GG-042") == 0 && config.sampleInterval == 15000);
+  CHECK(config.maxDataAge == DEFAULT_MAX_DATA_AGE);
+  CHECK(config.zoneTargets[0] == 23 && config.zoneTargets[1] == 23 && config.zoneTargets[ZONE_MAX - 1] == 23);
+  CHECK(strcmp(config.zoneLocations[0], "Tunnel") == 0 && strcmp(config.zoneLocations[1], "Greenhouse 2") == 0);
+
+  //Version 2: maxDataAge kept, the zones still follow zone 1
+  CHECK(migrate(storedConfig(2, CONFIG_V2_SIZE, fields), config));
+  CHECK(config.maxDataAge == 120000);
+  CHECK(config.zoneTargets[1] == 23 && strcmp(config.zoneLocations[1], "Greenhouse 2") == 0);
+
+  //Current version: every field kept
+  CHECK(migrate(storedConfig(CONFIG_VERSION, sizeof(RuntimeConfig), fields), config));
+  CHECK(memcmp(&config, &fields, sizeof(config)) == 0);
+
+  //Rejected: newer firmware, version 0, a size that does not match, too short for the header
+  CHECK(!migrate(storedConfig(CONFIG_VERSION + 1, sizeof(RuntimeConfig), fields), config) && isDefault(config));
+  CHECK(!migrate(storedConfig(0, CONFIG_V1_SIZE, fields), config) && isDefault(config));
+  std::vector<uint8_t> cut = storedConfig(2, CONFIG_V2_SIZE, fields);
+  cut.resize(CONFIG_V1_SIZE);
+  CHECK(!migrate(cut, config) && isDefault(config));
+  cut.resize(8);
+  CHECK(!migrate(cut, config) && isDefault(config));
+
+  //Corrupt: unterminated strings are cut, an out of range value brings back the defaults
+  RuntimeConfig corrupt = fields;
+  memset(corrupt.deviceId, 'X', sizeof(corrupt.deviceId));
+  memset(corrupt.zoneLocations[3], 'Y', ZONE_NAME_SIZE);
+  CHECK(migrate(storedConfig(CONFIG_VERSION, sizeof(RuntimeConfig), corrupt), config));
+  CHECK(strlen(config.deviceId) == sizeof(config.deviceId) - 1 && strlen(config.zoneLocations[3]) == ZONE_NAME_SIZE - 1);
+  corrupt = fields;
+  corrupt.zoneTargets[5] = 95;
+  CHECK(!migrate(storedConfig(CONFIG_VERSION, sizeof(RuntimeConfig), corrupt), config) && isDefault(config));
+
+  //A valid update swaps every field in at once, the zone 2 target is the only one pushed
+  int active = activeConfig;
+  FakeJsonDocument update(64);
+  JsonObject root = fakeJsonObject(update);
+  root["revision"] = 3;
+  root["sampleInterval"] = 10000;
+  root["location"] = "North";
+  JsonArray zoneUpdates = root.createNestedArray("zones");
+  zoneUpdates.createNestedObject();
+  zoneUpdates.createNestedObject()["targetTemperature"] = 18.5;
+  CHECK(updateConfig(fakeJsonRoot(update)));
+  CHECK(activeConfig != active);
+  CHECK(runtimeConfig().revision == 3 && runtimeConfig().sampleInterval == 10000);
+  CHECK(strcmp(runtimeConfig().location, "North") == 0 && strcmp(runtimeConfig().zoneLocations[0], "North") == 0);
+  CHECK(runtimeConfig().zoneTargets[0] == DEFAULT_TARGET_TEMPERATURE && runtimeConfig().zoneTargets[1] == 18.5f);
+  CHECK(pushedZoneTargets == 0b10);
+
+  //The same revision again is ignored
+  CHECK(!updateConfig(fakeJsonRoot(update)));
+
+  //Invalid value in one zone: nothing changes, not even the valid keys next to it
+  RuntimeConfig before = runtimeConfig();
+  active = activeConfig;
+  FakeJsonDocument invalid(64);
+  JsonObject bad = fakeJsonObject(invalid);
+  bad["revision"] = 4;
+  bad["pingInterval"] = 20000;
+  bad["targetTemperature"] = 21;
+  JsonArray badZones = bad.createNestedArray("zones");
+  badZones.createNestedObject();
+  badZones.createNestedObject();
+  badZones.createNestedObject()["targetTemperature"] = 55;
+  CHECK(!updateConfig(fakeJsonRoot(invalid)));
+  CHECK(activeConfig == active);
+  CHECK(memcmp(&runtimeConfig(), &before, sizeof(before)) == 0);
+  CHECK(pushedZoneTargets == 0b10);
+
+  //Zone 1 through the top level key, the other zones keep their encoder targets
+  FakeJsonDocument zoneOne(64);
+  JsonObject one = fakeJsonObject(zoneOne);
+  one["revision"] = 5;
+  one["targetTemperature"] = 22;
+  CHECK(updateConfig(fakeJsonRoot(zoneOne)));
+  CHECK(runtimeConfig().zoneTargets[0] == 22 && runtimeConfig().targetTemperature == 22);
+  CHECK(pushedZoneTargets == 0b1);
+
+  //An update without targets pushes none
+  FakeJsonDocument intervals(64);
+  JsonObject timing = fakeJsonObject(intervals);
+  timing["revision"] = 6;
+  timing["pingInterval"] = 30000;
+  CHECK(updateConfig(fakeJsonRoot(intervals)));
+  CHECK(pushedZoneTargets == 0);
+  CHECK(runtimeConfig().zoneTargets[0] == 22 && runtimeConfig().zoneTargets[1] == 18.5f);
+
+  return checkResult("config_test");
+}
@@ -0,0 +1,189 @@
+/*****************************************
+*   Heap Diagnostics Uptime Test
+      - gg_main_m7/diagnostics.h through a simulated week of uptime: the
+        scheduler runs the sensing, upload (Upload arena and JSON document),
+        ping and diag tasks on the virtual clock at the default intervals
+      - The test counts every new / delete as the mbed heap stats would, so
+        allocCount is the blocks allocated now
+      - After a day of warm up the heap in use and the allocated blocks are
+        the same at the end of every day. A read of the figures leaves them
+        as they were (The free block probe frees every try and is not
+        counted)
+      - A task leaking a block an hour shows up in both figures
+*****************************************/
+
+#include <new>
+#include <stdlib.h>
+
+#include <mbed.h>
+#include "check.h"
+#include "fake_json.h"
+
+#define MBED_HEAP_STATS_ENABLED 1
+
+void idleFor(unsigned long ms) {
+  hostAdvance(ms);
+}
+
+void wakeFromIdle() {}
+
+void recordTaskEvent(int, bool) {}
+
+#include "../../gg_main_m7/sensor_math.h"
+#include "../../gg_main_m7/zones.h"
+#include "../../gg_main_m7/scheduler.h"
+#include "../../gg_main_m7/sample_columns.h"
+#include "../../gg_main_m7/upload_arena.h"
+//mallinfo() is deprecated in glibc, the board's newlib only has that one
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#include "../../gg_main_m7/diagnostics.h"
+#pragma GCC diagnostic pop
+
+#define TEST_DAY (24UL * 3600 * 1000)
+#define TEST_DAYS 7
+#define JSON_DOCUMENT_SIZE 32768     // As in gg_main_m7.ino
+#define RESPONSE_DOCUMENT_SIZE 1024  // As in response_parser.h
+
+//Every new / delete of the test counted as the mbed malloc wrappers count
+void* operator new(size_t size) {
+  void* block = malloc(size);
+  hostCountAllocation(block != NULL);
+  if (block == NULL) {
+    throw std::bad_alloc();
+  }
+  return block;
+}
+
+void operator delete(void* pointer) noexcept {
+  if (pointer != NULL) {
+    hostCountFree();
+    free(pointer);
+  }
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+  operator delete(pointer);
+}
+
+uint8_t arenaBuffer[UPLOAD_ARENA_SIZE];
+SampleColumns columns;
+uint32_t sampleTime = 1700000000UL;
+char heartbeat[1024];
+
+void sensingTask() {
+  sampleTime += 30;
+  for (int channel = 0; channel < SAMPLE_CHANNELS; channel++) {
+    addSample(columns, channel, sampleTime, 20 + (sampleTime / 30 + channel) % 40 * 0.1f);
+  }
+}
+
+// As sendSensorData(): the URL and both documents in the arena, rows dropped once sent
+void uploadTask() {
+  arenaReset(uploadArena);
+  char* url = arenaPrintf(uploadArena, "%s?deviceID=%s", "/sensors/sendData", "GG-001");
+
+  ArenaJsonDocument doc(JSON_DOCUMENT_SIZE);
+  JsonObject root = fakeJsonObject(doc);
+  root["Sequence"] = sampleTime;
+  JsonArray Data = root.createNestedArray("Data");
+  for (int row = nextSampleRow(columns, 0); row >= 0; row = nextSampleRow(columns, row + 1)) {
+    for (int channel = 0; channel < SAMPLE_CHANNELS; channel++) {
+      JsonObject reading = Data.createNestedObject();
+      reading["Name"] = "Temperature Sensor";
+      reading["Value"] = sampleValue(columns, channel, row);
+      reading["Time"] = columns.time[channel][row];
+      reading["Location"] = (const char*)url;
+    }
+  }
+
+  ArenaJsonDocument responseDoc(RESPONSE_DOCUMENT_SIZE);
+  if (!doc.overflowed() && responseDoc.capacity() > 0) {
+    dropSampleRows(columns, sampleRowCount(columns));
+  }
+}
+
+void pingTask() {
+  diagnosticsQuery(heartbeat, sizeof(heartbeat));
+}
+
+void diagnosticsTask() {
+  updateDiagnostics();
+}
+
+//A block an hour never freed
+struct LeakedBlock {
+  LeakedBlock* next;
+  char payload[56];
+};
+LeakedBlock* leaked = NULL;
+int leakedBlocks = 0;
+
+void leakyTask() {
+  LeakedBlock* block = new LeakedBlock();
+  block->next = leaked;
+  leaked = block;
+  leakedBlocks++;
+}
+
+void runFor(unsigned long ms) {
+  unsigned long end = millis() + ms;
+  while ((long)(end - millis()) > 0) {
+    runScheduler();
+  }
+}
+
+int main() {
+  hostSerial().muted = true;
+  initArena(uploadArena, arenaBuffer, sizeof(arenaBuffer));
+  clearSampleColumns(columns);
+  paintStack();
+
+  addTask("sensing", sensingTask, 30000, 0);
+  addTask("upload", uploadTask, 30000, 15000);
+  addTask("ping", pingTask, 60000, 60000);
+  addTask("diag", diagnosticsTask, 10000, 0);
+
+  //Warm up
+  runFor(TEST_DAY);
+  updateDiagnostics();
+  HeapStats warm = heapStats;
+  CHECK(warm.allocCount >= 0 && warm.used > 0);
+  CHECK(warm.largestFree > 0 && warm.largestFree <= HEAP_PROBE_LIMIT);
+  CHECK(strstr(heartbeat, "&allocs=") != NULL);
+
+  //The rest of the week, every day ends where the first one did
+  bool flat = true;
+  for (int day = 1; day < TEST_DAYS; day++) {
+    runFor(TEST_DAY);
+    updateDiagnostics();
+    if (heapStats.used != warm.used || heapStats.allocCount != warm.allocCount) {
+      printf("Day %d: %u bytes used in %ld blocks, %u in %ld after day 1\n", day + 1, (unsigned)heapStats.used,
+             heapStats.allocCount, (unsigned)warm.used, warm.allocCount);
+      flat = false;
+    }
+  }
+  CHECK(flat);
+  CHECK(uploadArena.resets >= TEST_DAYS * TEST_DAY / 30000 - 1);
+
+  //Reading the figures leaves them as they were, the probe included
+  long before = hostHeapStats().alloc_cnt;
+  readHeapStats(heapStats);
+  CHECK(heapStats.allocCount == before);
+  HeapStats first = heapStats;
+  readHeapStats(heapStats);
+  CHECK(heapStats.allocCount == first.allocCount && heapStats.used == first.used);
+  CHECK(hostHeapStats().alloc_cnt == (uint32_t)before);
+
+  //A leak of a block an hour, two days later
+  addTask("leaky", leakyTask, 3600000, 3600000);
+  runFor(2 * TEST_DAY + 1000);
+  updateDiagnostics();
+  printf("After %d days: %u bytes used in %ld blocks, %d blocks leaked on the last 2\n", TEST_DAYS + 2,
+         (unsigned)heapStats.used, heapStats.allocCount, leakedBlocks);
+  CHECK(leakedBlocks == 48);
+  CHECK(heapStats.allocCount == warm.allocCount + leakedBlocks);
+  CHECK(heapStats.used >= warm.used + leakedBlocks * sizeof(LeakedBlock));
+
+  return checkResult("diagnostics_test");
+}
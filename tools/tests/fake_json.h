@@ -0,0 +1,492 @@
+/*****************************************
+*   Fake JSON Document
+      - The part of the ArduinoJson 6 API that rollup_store.h,
+        runtime_config.h and upload_body.h use, so their tests and the host
+        tools build without the library (Tests of the parser itself use the
+        real library, see CMakeLists.txt)
+      - A document has a capacity in slots like the ArduinoJson pool (One
+        per value, member and element). Once it is full every allocation
+        fails, createNested*() return null and overflowed() is true
+      - Strings are copied, numbers are kept as double. serializeJson()
+        writes whole numbers without a fraction and the others with 9
+        significant digits (ArduinoJson may differ in the last digit)
+      - BasicJsonDocument takes its pool from an allocator, for the tests of
+        the upload arena
+*****************************************/
+
+#ifndef GG_FAKE_JSON_H
+#define GG_FAKE_JSON_H
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+//Pool bytes per slot, as ArduinoJson on a 32 bit board
+#define FAKE_JSON_SLOT_SIZE 16
+#define JSON_ARRAY_SIZE(n) ((n) * FAKE_JSON_SLOT_SIZE)
+#define JSON_OBJECT_SIZE(n) ((n) * FAKE_JSON_SLOT_SIZE)
+
+struct FakeJsonDocument;
+class JsonVariant;
+class JsonObject;
+class JsonArray;
+
+struct FakeJsonNode {
+  enum Type { NODE_NULL, NODE_OBJECT, NODE_ARRAY, NODE_STRING, NODE_NUMBER, NODE_BOOL };
+
+  Type type = NODE_NULL;
+  double number = 0;
+  std::string text;
+  std::vector<std::pair<std::string, FakeJsonNode*>> members;
+  std::vector<FakeJsonNode*> elements;
+
+  FakeJsonNode* member(const char* key) const {
+    for (const auto& entry : members) {
+      if (entry.first == key) {
+        return entry.second;
+      }
+    }
+    return NULL;
+  }
+};
+
+struct FakeJsonDocument {
+  size_t slots;
+  size_t used = 0;
+  bool full = false;
+  std::vector<FakeJsonNode*> nodes;
+  FakeJsonNode* root;
+
+  explicit FakeJsonDocument(size_t slots)
+    : slots(slots) {
+    root = new FakeJsonNode();
+    root->type = FakeJsonNode::NODE_OBJECT;
+  }
+
+  ~FakeJsonDocument() {
+    for (FakeJsonNode* node : nodes) {
+      delete node;
+    }
+    delete root;
+  }
+
+  FakeJsonNode* allocate() {
+    if (used >= slots) {
+      full = true;
+      return NULL;
+    }
+    used++;
+    nodes.push_back(new FakeJsonNode());
+    return nodes.back();
+  }
+
+  bool overflowed() const {
+    return full;
+  }
+
+  size_t capacity() const {
+    return slots * FAKE_JSON_SLOT_SIZE;
+  }
+
+  size_t memoryUsage() const {
+    return used * FAKE_JSON_SLOT_SIZE;
+  }
+
+  //Members of the root object, as on a JsonDocument
+  JsonVariant operator[](const char* member);
+  JsonObject createNestedObject(const char* member);
+  JsonArray createNestedArray(const char* member);
+
+  // The member is gone, its slots stay used (As in the ArduinoJson pool)
+  void remove(const char* member) {
+    for (auto entry = root->members.begin(); entry != root->members.end(); ++entry) {
+      if (entry->first == member) {
+        root->members.erase(entry);
+        return;
+      }
+    }
+  }
+};
+
+typedef FakeJsonDocument JsonDocument;
+
+// A value of the document, or a member / element that is created when it is assigned
+class JsonVariant {
+public:
+  FakeJsonDocument* doc = NULL;
+  FakeJsonNode* node = NULL;
+  FakeJsonNode* parent = NULL;  // Set while the member or element does not exist yet
+  std::string key;
+  size_t index = 0;
+
+  JsonVariant() {}
+  JsonVariant(FakeJsonDocument* doc, FakeJsonNode* node)
+    : doc(doc), node(node) {}
+
+  // Create the node on the first write, false if the document is full
+  bool resolve() {
+    if (node != NULL) {
+      return true;
+    }
+    if (doc == NULL || parent == NULL) {
+      return false;
+    }
+
+    FakeJsonNode* created = doc->allocate();
+    if (created == NULL) {
+      return false;
+    }
+    if (key.empty()) {
+      parent->type = FakeJsonNode::NODE_ARRAY;
+      while (parent->elements.size() < index) {
+        FakeJsonNode* filler = doc->allocate();
+        if (filler == NULL) {
+          return false;
+        }
+        parent->elements.push_back(filler);
+      }
+      parent->elements.push_back(created);
+    } else {
+      parent->type = FakeJsonNode::NODE_OBJECT;
+      parent->members.push_back({ key, created });
+    }
+    node = created;
+    return true;
+  }
+
+  bool set(const char* value) {
+    if (value == NULL || !resolve()) {
+      return false;
+    }
+    node->type = FakeJsonNode::NODE_STRING;
+    node->text = value;
+    return true;
+  }
+
+  bool set(bool value) {
+    if (!resolve()) {
+      return false;
+    }
+    node->type = FakeJsonNode::NODE_BOOL;
+    node->number = value;
+    return true;
+  }
+
+  template <typename T>
+  bool set(T value) {
+    if (!resolve()) {
+      return false;
+    }
+    node->type = FakeJsonNode::NODE_NUMBER;
+    node->number = (double)value;
+    return true;
+  }
+
+  template <typename T>
+  JsonVariant& operator=(T value) {
+    set(value);
+    return *this;
+  }
+
+  JsonVariant operator[](const char* member) {
+    JsonVariant child;
+    child.doc = doc;
+    if (resolve()) {
+      child.parent = node;
+      child.key = member;
+      child.node = node->member(member);
+    }
+    return child;
+  }
+
+  JsonVariant operator[](int element) {
+    JsonVariant child;
+    child.doc = doc;
+    if (resolve()) {
+      child.parent = node;
+      child.index = element;
+      if (node->type == FakeJsonNode::NODE_ARRAY && (size_t)element < node->elements.size()) {
+        child.node = node->elements[element];
+      }
+    }
+    return child;
+  }
+
+  bool isNull() const {
+    return node == NULL || node->type == FakeJsonNode::NODE_NULL;
+  }
+};
+
+class JsonObject {
+public:
+  FakeJsonDocument* doc = NULL;
+  FakeJsonNode* node = NULL;
+
+  JsonObject() {}
+  JsonObject(FakeJsonDocument* doc, FakeJsonNode* node)
+    : doc(doc), node(node) {
+    if (node != NULL) {
+      node->type = FakeJsonNode::NODE_OBJECT;
+    }
+  }
+
+  JsonObject(JsonVariant variant)
+    : JsonObject(variant.resolve() ? variant.doc : NULL, variant.node) {}
+
+  JsonVariant operator[](const char* member) const {
+    JsonVariant child;
+    child.doc = doc;
+    child.parent = node;
+    child.key = member;
+    child.node = node != NULL ? node->member(member) : NULL;
+    return child;
+  }
+
+  JsonObject createNestedObject(const char* member) const;
+  JsonArray createNestedArray(const char* member) const;
+
+  size_t size() const {
+    return node != NULL ? node->members.size() : 0;
+  }
+
+  bool isNull() const {
+    return node == NULL;
+  }
+};
+
+class JsonArray {
+public:
+  FakeJsonDocument* doc = NULL;
+  FakeJsonNode* node = NULL;
+
+  JsonArray() {}
+  JsonArray(FakeJsonDocument* doc, FakeJsonNode* node)
+    : doc(doc), node(node) {
+    if (node != NULL) {
+      node->type = FakeJsonNode::NODE_ARRAY;
+    }
+  }
+
+  JsonObject createNestedObject() const {
+    FakeJsonNode* created = node != NULL ? doc->allocate() : NULL;
+    if (created == NULL) {
+      return JsonObject();
+    }
+    node->elements.push_back(created);
+    return JsonObject(doc, created);
+  }
+
+  template <typename T>
+  bool add(T value) {
+    if (node == NULL) {
+      return false;
+    }
+    JsonVariant element;
+    element.doc = doc;
+    element.parent = node;
+    element.index = node->elements.size();
+    return element.set(value);
+  }
+
+  JsonVariant operator[](int element) const {
+    if (node == NULL || (size_t)element >= node->elements.size()) {
+      return JsonVariant();
+    }
+    return JsonVariant(doc, node->elements[element]);
+  }
+
+  size_t size() const {
+    return node != NULL ? node->elements.size() : 0;
+  }
+
+  bool isNull() const {
+    return node == NULL;
+  }
+};
+
+inline JsonObject JsonObject::createNestedObject(const char* member) const {
+  JsonVariant child = (*this)[member];
+  if (!child.resolve()) {
+    return JsonObject();
+  }
+  return JsonObject(doc, child.node);
+}
+
+inline JsonArray JsonObject::createNestedArray(const char* member) const {
+  JsonVariant child = (*this)[member];
+  if (!child.resolve()) {
+    return JsonArray();
+  }
+  return JsonArray(doc, child.node);
+}
+
+// Read only views, a missing value reads as null and "value | default" gives the default
+class JsonVariantConst {
+public:
+  const FakeJsonNode* node = NULL;
+
+  JsonVariantConst() {}
+  JsonVariantConst(const FakeJsonNode* node)
+    : node(node) {}
+
+  JsonVariantConst operator[](const char* member) const {
+    if (node == NULL || node->type != FakeJsonNode::NODE_OBJECT) {
+      return JsonVariantConst();
+    }
+    return JsonVariantConst(node->member(member));
+  }
+
+  JsonVariantConst operator[](int element) const {
+    if (node == NULL || node->type != FakeJsonNode::NODE_ARRAY || (size_t)element >= node->elements.size()) {
+      return JsonVariantConst();
+    }
+    return JsonVariantConst(node->elements[element]);
+  }
+
+  operator const char*() const {
+    return node != NULL && node->type == FakeJsonNode::NODE_STRING ? node->text.c_str() : NULL;
+  }
+
+  // Number of elements of an array
+  size_t size() const {
+    return node != NULL && node->type == FakeJsonNode::NODE_ARRAY ? node->elements.size() : 0;
+  }
+
+  bool isNull() const {
+    return node == NULL || node->type == FakeJsonNode::NODE_NULL;
+  }
+
+  template <typename T>
+  T operator|(T fallback) const {
+    if (node == NULL || node->type != FakeJsonNode::NODE_NUMBER) {
+      return fallback;
+    }
+    return (T)node->number;
+  }
+};
+
+typedef JsonVariantConst JsonObjectConst;
+typedef JsonVariantConst JsonArrayConst;
+
+inline JsonVariant FakeJsonDocument::operator[](const char* member) {
+  return JsonObject(this, root)[member];
+}
+
+inline JsonObject FakeJsonDocument::createNestedObject(const char* member) {
+  return JsonObject(this, root).createNestedObject(member);
+}
+
+inline JsonArray FakeJsonDocument::createNestedArray(const char* member) {
+  return JsonObject(this, root).createNestedArray(member);
+}
+
+// Document with its pool from an allocator, as ArduinoJson's BasicJsonDocument
+//  - The pool is allocated once at its full capacity (capacity() 0 if that failed),
+//    the slots are counted against it as in FakeJsonDocument
+template <typename TAllocator>
+class BasicJsonDocument : public FakeJsonDocument {
+public:
+  TAllocator allocator;
+  void* pool;
+  size_t poolSize;
+
+  explicit BasicJsonDocument(size_t capacity)
+    : FakeJsonDocument(0) {
+    pool = allocator.allocate(capacity);
+    poolSize = pool != NULL ? capacity : 0;
+    slots = poolSize / FAKE_JSON_SLOT_SIZE;
+  }
+
+  ~BasicJsonDocument() {
+    allocator.deallocate(pool);
+  }
+};
+
+// Read only view of a document, as the firmware gets a pushed config
+inline JsonObjectConst fakeJsonRoot(const FakeJsonDocument& doc) {
+  return JsonObjectConst(doc.root);
+}
+
+inline JsonObject fakeJsonObject(FakeJsonDocument& doc) {
+  return JsonObject(&doc, doc.root);
+}
+
+inline void fakeJsonWrite(const FakeJsonNode* node, std::string& out) {
+  char number[32];
+  switch (node->type) {
+    case FakeJsonNode::NODE_NULL:
+      out += "null";
+      break;
+    case FakeJsonNode::NODE_BOOL:
+      out += node->number != 0 ? "true" : "false";
+      break;
+    case FakeJsonNode::NODE_NUMBER:
+      if (node->number == floor(node->number) && fabs(node->number) < 1e15) {
+        snprintf(number, sizeof(number), "%.0f", node->number);
+      } else {
+        snprintf(number, sizeof(number), "%.9g", node->number);
+      }
+      out += number;
+      break;
+    case FakeJsonNode::NODE_STRING:
+      out += '"';
+      for (char c : node->text) {
+        if (c == '"' || c == '\\') {
+          out += '\\';
+          out += c;
+        } else if ((unsigned char)c < 0x20) {
+          snprintf(number, sizeof(number), "\\u%04x", c);
+          out += number;
+        } else {
+          out += c;
+        }
+      }
+      out += '"';
+      break;
+    case FakeJsonNode::NODE_OBJECT:
+      out += '{';
+      for (size_t i = 0; i < node->members.size(); i++) {
+        out += i > 0 ? ",\"" : "\"";
+        out += node->members[i].first;
+        out += "\":";
+        fakeJsonWrite(node->members[i].second, out);
+      }
+      out += '}';
+      break;
+    case FakeJsonNode::NODE_ARRAY:
+      out += '[';
+      for (size_t i = 0; i < node->elements.size(); i++) {
+        if (i > 0) {
+          out += ',';
+        }
+        fakeJsonWrite(node->elements[i], out);
+      }
+      out += ']';
+      break;
+  }
+}
+
+// Minified JSON of the document into buffer, cut to its size and terminated as
+// ArduinoJson does, returns the bytes written
+inline size_t serializeJson(const FakeJsonDocument& doc, char* buffer, size_t bufferSize) {
+  std::string json;
+  fakeJsonWrite(doc.root, json);
+  if (bufferSize == 0) {
+    return 0;
+  }
+  size_t length = json.size() < bufferSize - 1 ? json.size() : bufferSize - 1;
+  memcpy(buffer, json.data(), length);
+  buffer[length] = '\0';
+  return length;
+}
+
+inline size_t measureJson(const FakeJsonDocument& doc) {
+  std::string json;
+  fakeJsonWrite(doc.root, json);
+  return json.size();
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*****************************************
+*   Inflate, Fixed Huffman Blocks Only
+      - Inflates the zlib streams of gg_main_m7/deflate.h (It writes no
+        other block type) and checks their Adler-32, for the host tools
+        that read back what the firmware compressed: tools/deflate_bench.cpp
+        and the stand-in server of tools/load_gen.cpp
+      - Needs deflate.h included first (adler32())
+*****************************************/
+
+#ifndef GG_HOST_INFLATE_FIXED_H
+#define GG_HOST_INFLATE_FIXED_H
+
+#include <stdint.h>
+#include <string>
+
+struct BitReader {
+  const uint8_t* data;
+  size_t length;
+  size_t position;  // Bit
+};
+
+int readBits(BitReader& in, int count) {
+  int value = 0;
+  for (int i = 0; i < count; i++, in.position++) {
+    if (in.position / 8 >= in.length) {
+      return -1;
+    }
+    value |= ((in.data[in.position / 8] >> (in.position % 8)) & 1) << i;
+  }
+  return value;
+}
+
+// Huffman codes arrive from their first bit
+int readCode(BitReader& in, int count, int code) {
+  for (int i = 0; i < count; i++) {
+    int bit = readBits(in, 1);
+    if (bit < 0) {
+      return -1;
+    }
+    code = (code << 1) | bit;
+  }
+  return code;
+}
+
+int readSymbol(BitReader& in) {
+  int code = readCode(in, 7, 0);
+  if (code >= 0 && code <= 0x17) {
+    return 256 + code;
+  }
+  code = readCode(in, 1, code);
+  if (code >= 0x30 && code <= 0xBF) {
+    return code - 0x30;
+  }
+  if (code >= 0xC0 && code <= 0xC7) {
+    return 280 + code - 0xC0;
+  }
+  code = readCode(in, 1, code);
+  return code >= 0x190 && code <= 0x1FF ? 144 + code - 0x190 : -1;
+}
+
+// Inflate a zlib stream of deflate.h, false if it is not one or its checksum is wrong
+bool inflateFixed(const uint8_t* stream, size_t length, std::string& output) {
+  static const int lengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+  static const int lengthExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+  static const int distanceBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+                                      1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+  static const int distanceExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+  if (length < 6 || stream[0] != 0x78 || ((stream[0] << 8) | stream[1]) % 31 != 0) {
+    return false;
+  }
+  BitReader in = { stream, length - 4, 16 };
+  output.clear();
+
+  int final = 0;
+  while (!final) {
+    final = readBits(in, 1);
+    if (final < 0 || readBits(in, 2) != 1) {
+      return false;
+    }
+    for (;;) {
+      int symbol = readSymbol(in);
+      if (symbol < 0 || symbol > 285) {
+        return false;
+      }
+      if (symbol < 256) {
+        output += (char)symbol;
+        continue;
+      }
+      if (symbol == 256) {
+        break;
+      }
+      int matchLength = lengthBase[symbol - 257] + readBits(in, lengthExtra[symbol - 257]);
+      int distanceCode = readCode(in, 5, 0);
+      if (distanceCode < 0 || distanceCode >= 30) {
+        return false;
+      }
+      size_t distance = distanceBase[distanceCode] + readBits(in, distanceExtra[distanceCode]);
+      if (distance > output.size()) {
+        return false;
+      }
+      for (int i = 0; i < matchLength; i++) {
+        output += output[output.size() - distance];
+      }
+    }
+  }
+
+  const uint8_t* trailer = stream + length - 4;
+  uint32_t checksum = (trailer[0] << 24) | (trailer[1] << 16) | (trailer[2] << 8) | trailer[3];
+  return checksum == adler32((const uint8_t*)output.data(), output.size());
+}
+
+#endif
@@ -0,0 +1,135 @@
+/*****************************************
+*   LCD Snapshot Test
+      - gg_main_m7/lcd_functions.h drawn on the host 20x4 frame buffer, each
+        frame compared with a snapshot of the whole screen
+      - In the snapshots the CGRAM characters are the digits 0 - 7 (4 and 5
+        are the arrows, 3 the line under the title) and the ROM full block is #
+      - Value pages with one and two rows, a zoned page, a shorter value over a
+        longer one, the trend page and its glyph swap, and the boot screen
+*****************************************/
+
+#include <string>
+
+#include <LiquidCrystal_I2C.h>
+#include "check.h"
+
+LiquidCrystal_I2C lcd(0x27, 20, 4);
+
+#include "../../gg_main_m7/custom_char.h"
+#include "../../gg_main_m7/trend_functions.h"
+#include "../../gg_main_m7/lcd_functions.h"
+
+float roomTemp = 21.5;
+float zoneTemp[2] = { 19.25, 23.75 };
+float zoneTarget[2] = { 20, 24 };
+float alertRate = -0.75;
+
+const char* zoneTitle(int zone) {
+  return zone == 0 ? "Heater #1" : "Heater #2";
+}
+
+const LcdValue noValue = { NULL, NULL, NULL, 0 };
+
+const LcdPage roomPage = { "Room Temperature", NULL, { { "Temperature: ", &roomTemp, " C", 2 }, noValue }, -1, NULL, 0, 0, NULL, 0, false };
+const LcdPage heaterPage = { NULL, zoneTitle, { { "Temp: ", zoneTemp, " C", 2 }, { "Target: ", zoneTarget, " C", 2 } }, 0, NULL, 0, 0, NULL, 1, true };
+const LcdPage ratePage = { "Anomaly", NULL, { { "Rate: ", &alertRate, " /min", 2 }, noValue }, -1, NULL, 0, 0, NULL, 0, false };
+const LcdPage trendPage = { "Grow Temp Trend", NULL, { noValue, noValue }, -1, NULL, 0, 0, &growTempTrend, 0, false };
+
+// The whole screen, one line per row
+std::string snapshot() {
+  std::string text;
+  for (int row = 0; row < 4; row++) {
+    for (char c : lcd.hostRow(row)) {
+      unsigned char code = (unsigned char)c;
+      text += code < 8 ? (char)('0' + code) : code == SPARK_FULL_BLOCK ? '#' : c;
+    }
+    text += '\n';
+  }
+  return text;
+}
+
+bool matches(const char* expected) {
+  std::string frame = snapshot();
+  if (frame != expected) {
+    printf("Frame:\n%sExpected:\n%s", frame.c_str(), expected);
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  useLCD();
+  CHECK(lcd.backlightOn);
+
+  //Boot screen ends cleared, the heart and shield blink at column 17 on the way
+  unsigned long start = millis();
+  bootScreen();
+  CHECK(millis() - start == 7000);
+  CHECK(matches("                    \n"
+                "                    \n"
+                "                    \n"
+                "                    \n"));
+
+  //Value page with one row
+  renderPage(roomPage, 0);
+  CHECK(matches("4 Room Temperature 5\n"
+                "33333333333333333333\n"
+                "Temperature: 21.50 C\n"
+                "                    \n"));
+
+  //Zoned page shows the slot of its zone
+  renderPage(heaterPage, 1);
+  CHECK(matches("4    Heater #2     5\n"
+                "33333333333333333333\n"
+                "Temp: 23.75 C       \n"
+                "Target: 24.00 C     \n"));
+
+  //Redrawn without a clear, a shorter value leaves nothing of the longer one
+  unsigned long clears = lcd.clears;
+  zoneTemp[1] = 5;
+  renderPage(heaterPage, 1);
+  CHECK(lcd.clears == clears);
+  CHECK(matches("4    Heater #2     5\n"
+                "33333333333333333333\n"
+                "Temp: 5.00 C        \n"
+                "Target: 24.00 C     \n"));
+
+  //Negative value and a longer unit
+  renderPage(ratePage, 0);
+  CHECK(matches("4     Anomaly      5\n"
+                "33333333333333333333\n"
+                "Rate: -0.75 /min    \n"
+                "                    \n"));
+
+  //Trend page without data, plain arrows and the sparkline glyphs loaded
+  renderPage(trendPage, 0);
+  CHECK(matches("< Grow Temp Trend  >\n"
+                "1h No Data          \n"
+                "                    \n"
+                "1d No Data          \n"));
+  CHECK(memcmp(lcd.glyphs[4], arrowleft, 8) != 0);
+
+  //A rising hour: one sparkline column per 3 minutes, the newest at the right
+  for (int i = 0; i < 20; i++) {
+    hostAdvance(TREND_HOUR_BUCKET_SECONDS * 1000UL);
+    addTrendSample(growTempTrend, 18 + i * 0.2f);
+  }
+  renderPage(trendPage, 0);
+  std::string frame = snapshot();
+  CHECK(frame.compare(0, 21, "< Grow Temp Trend  >\n") == 0);
+  CHECK(frame.compare(21, 21, "1h L18.0 A19.9 H21.8\n") == 0);
+  CHECK(frame[42] != '#' && frame[42 + 19] == '#');
+  CHECK(frame.compare(63, 21, "1d L18.0 A19.9 H21.8\n") == 0);
+  CHECK(lcd.overflows == 0);
+
+  //Leaving the trend page puts the arrows back
+  renderPage(roomPage, 0);
+  CHECK(memcmp(lcd.glyphs[4], arrowleft, 8) == 0 && memcmp(lcd.glyphs[5], arrowright, 8) == 0);
+  CHECK(matches("4 Room Temperature 5\n"
+                "33333333333333333333\n"
+                "Temperature: 21.50 C\n"
+                "                    \n"));
+
+  CHECK(lcd.overflows == 0);
+  return checkResult("lcd_test");
+}
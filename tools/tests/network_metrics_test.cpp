@@ -0,0 +1,391 @@
+/*****************************************
+*   Network Metrics Test
+      - gg_main_m7/network_metrics.h driven as the request functions of
+        gg_main_m7.ino drive it (netRequestStart(), netRequestConnected(),
+        netRequestFirstByte(), netRequestDone()), against a loopback stub
+        whose answers are scripted: connect time, time to first byte, then
+        the HTTP response text
+      - Every failure cause once at least: a refused connect, no answer
+        within the 5 s timeout, a response without a status line, a 500 and
+        an ack of another upload. Uploads that failed go again as retries
+      - The counters by cause, the retries, the bytes sent and received and
+        the histogram buckets are checked against the script, then the
+        /metrics text and the Heartbeat query made from them
+      - serveMetrics() answers a scraper on the host WiFi shim: the body is
+        the formatMetrics() text with its Content-Length, any other path is
+        a 404 and a full arena a 503
+*****************************************/
+
+#include <string>
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "check.h"
+#include "fake_json.h"
+
+void idleFor(unsigned long ms) {
+  hostAdvance(ms);
+}
+
+#include "../../gg_main_m7/upload_arena.h"
+#include "../../gg_main_m7/network_metrics.h"
+
+#define TEST_RESPONSE_TIMEOUT 5000  // waitForResponse() of gg_main_m7.ino
+#define TEST_METRICS_SIZE METRICS_TEXT_SIZE
+
+// One answer of the loopback stub
+struct StubAnswer {
+  bool connects;
+  unsigned long connectMs;    // Connect and send the request
+  unsigned long firstByteMs;  // Connected to the first byte, over TEST_RESPONSE_TIMEOUT never comes
+  unsigned long readMs;       // First byte to the end of the response
+  std::string response;       // Status line, headers and body as the server sends them
+};
+
+// A response with its Content-Length
+std::string stubResponse(int status, const char* reason, const std::string& body) {
+  char header[128];
+  snprintf(header, sizeof(header), "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %u\r\n\r\n",
+           status, reason, (unsigned int)body.size());
+  return header + body;
+}
+
+std::string ackBody(unsigned long sequence) {
+  return "{\"ack\":" + std::to_string(sequence) + ",\"encodings\":[\"deflate\"]}";
+}
+
+StubAnswer answered(unsigned long connectMs, unsigned long firstByteMs, const std::string& response) {
+  return { true, connectMs, firstByteMs, 2, response };
+}
+
+// Status, Content-Length and ack (-1 if none) of a response, false without a status line
+bool readStubResponse(const std::string& response, int& status, long& contentLength, long& ack) {
+  if (sscanf(response.c_str(), "HTTP/1.%*d %d", &status) != 1) {
+    return false;
+  }
+
+  size_t at = response.find("Content-Length: ");
+  contentLength = at != std::string::npos ? atol(response.c_str() + at + 16) : 0;
+  at = response.find("\"ack\":");
+  ack = at != std::string::npos ? atol(response.c_str() + at + 6) : -1;
+  return true;
+}
+
+// One request through the stub, the steps of makeGetRequest() and postSensorData()
+//  - sequence is the Sequence of an upload (0 for any other request), an ack of another one is not_acked
+NetFailure runRequest(NetEndpointId endpoint, size_t bytesSent, bool retry, const StubAnswer& answer, unsigned long sequence = 0) {
+  NetRequest request;
+  netRequestStart(request, endpoint, bytesSent, retry);
+
+  hostAdvance(answer.connectMs);
+  if (!answer.connects) {
+    netRequestDone(request, NET_FAIL_CONNECT);
+    return NET_FAIL_CONNECT;
+  }
+  netRequestConnected(request);
+
+  if (answer.firstByteMs > TEST_RESPONSE_TIMEOUT) {
+    hostAdvance(TEST_RESPONSE_TIMEOUT + 1);
+    netRequestDone(request, NET_FAIL_TIMEOUT);
+    return NET_FAIL_TIMEOUT;
+  }
+  hostAdvance(answer.firstByteMs);
+  netRequestFirstByte(request);
+  hostAdvance(answer.readMs);
+
+  int status;
+  long contentLength, ack;
+  if (!readStubResponse(answer.response, status, contentLength, ack)) {
+    netRequestDone(request, NET_FAIL_BAD_RESPONSE);
+    return NET_FAIL_BAD_RESPONSE;
+  }
+
+  NetFailure failure = status >= 200 && status < 300 ? NET_OK : NET_FAIL_HTTP_ERROR;
+  if (failure == NET_OK && sequence != 0 && ack >= 0 && (unsigned long)ack != sequence) {
+    failure = NET_FAIL_NOT_ACKED;
+  }
+  netRequestDone(request, failure, contentLength);
+  return failure;
+}
+
+void resetNetStats() {
+  memset(netStats, 0, sizeof(netStats));
+}
+
+// Value of the line of text that starts with prefix, -1 if there is none
+long long metricValue(const std::string& text, const std::string& prefix) {
+  size_t at = text.find("\n" + prefix + " ");
+  if (at == std::string::npos) {
+    return -1;
+  }
+  return atoll(text.c_str() + at + 1 + prefix.size() + 1);
+}
+
+//The script: uploads with every failure and their retries, pings, one test connection
+#define UPLOAD_BYTES 1200
+#define PING_BYTES 96
+
+long expectedReceived = 0;
+
+void runScript() {
+  resetNetStats();
+  expectedReceived = 0;
+
+  //Upload 1 goes through
+  std::string ok1 = stubResponse(200, "OK", ackBody(1));
+  CHECK(runRequest(NET_SEND_DATA, UPLOAD_BYTES, false, answered(3, 40, ok1), 1) == NET_OK);
+  expectedReceived += ackBody(1).size();
+
+  //Upload 2: a 500 without an ack, then the retry goes through
+  std::string error = stubResponse(500, "Internal Server Error", "{\"error\":\"db\"}");
+  CHECK(runRequest(NET_SEND_DATA, UPLOAD_BYTES, false, answered(5, 120, error), 2) == NET_FAIL_HTTP_ERROR);
+  CHECK(runRequest(NET_SEND_DATA, UPLOAD_BYTES, true, answered(3, 35, stubResponse(200, "OK", ackBody(2))), 2) == NET_OK);
+  expectedReceived += 14 + ackBody(2).size();
+
+  //Upload 3: the ack of upload 2, then no answer at all, then the second retry goes through
+  CHECK(runRequest(NET_SEND_DATA, UPLOAD_BYTES, false, answered(4, 60, stubResponse(200, "OK", ackBody(2))), 3) == NET_FAIL_NOT_ACKED);
+  CHECK(runRequest(NET_SEND_DATA, UPLOAD_BYTES, true, answered(6, 9000, ""), 3) == NET_FAIL_TIMEOUT);
+  CHECK(runRequest(NET_SEND_DATA, UPLOAD_BYTES, true, answered(3, 300, stubResponse(200, "OK", ackBody(3))), 3) == NET_OK);
+  expectedReceived += ackBody(2).size() + ackBody(3).size();
+
+  //Upload 4: the connect is refused after 2 s, then garbage instead of a status line, then through
+  CHECK(runRequest(NET_SEND_DATA, UPLOAD_BYTES, false, { false, 2000, 0, 0, "" }, 4) == NET_FAIL_CONNECT);
+  CHECK(runRequest(NET_SEND_DATA, UPLOAD_BYTES, true, answered(3, 20, "HTPT/1.1 2OO\r\n\r\n"), 4) == NET_FAIL_BAD_RESPONSE);
+  CHECK(runRequest(NET_SEND_DATA, UPLOAD_BYTES, true, answered(0, 0, stubResponse(204, "No Content", "")), 4) == NET_OK);
+
+  //Pings: three through, one 404
+  std::string pong = stubResponse(200, "OK", "{\"ok\":true}");
+  for (int ping = 0; ping < 3; ping++) {
+    CHECK(runRequest(NET_PING, PING_BYTES, false, answered(2, 15, pong)) == NET_OK);
+  }
+  CHECK(runRequest(NET_PING, PING_BYTES, false, answered(2, 10, stubResponse(404, "Not Found", ""))) == NET_FAIL_HTTP_ERROR);
+  expectedReceived += 3 * 11;
+
+  //The connection test at boot
+  CHECK(runRequest(NET_TEST, 40, false, answered(1, 8, stubResponse(200, "OK", "ok"))) == NET_OK);
+}
+
+void testCounters() {
+  runScript();
+  const NetEndpointStats& up = netStats[NET_SEND_DATA];
+  const NetEndpointStats& pingStats = netStats[NET_PING];
+
+  CHECK(up.requests == 9);
+  CHECK(up.successes == 4);
+  CHECK(up.retries == 5);
+  CHECK(up.failures[NET_FAIL_CONNECT] == 1);
+  CHECK(up.failures[NET_FAIL_TIMEOUT] == 1);
+  CHECK(up.failures[NET_FAIL_BAD_RESPONSE] == 1);
+  CHECK(up.failures[NET_FAIL_HTTP_ERROR] == 1);
+  CHECK(up.failures[NET_FAIL_NOT_ACKED] == 1);
+  CHECK(netFailureCount(up) == up.requests - up.successes);
+  CHECK(up.bytesSent == 9 * UPLOAD_BYTES);
+  CHECK((long)(up.bytesReceived + pingStats.bytesReceived) == expectedReceived);
+
+  CHECK(pingStats.requests == 4);
+  CHECK(pingStats.successes == 3);
+  CHECK(pingStats.retries == 0);
+  CHECK(pingStats.failures[NET_FAIL_HTTP_ERROR] == 1);
+  CHECK(netFailureCount(pingStats) == 1);
+  CHECK(pingStats.bytesSent == 4 * PING_BYTES);
+
+  CHECK(netStats[NET_TEST].requests == 1 && netStats[NET_TEST].successes == 1);
+  CHECK(netStats[NET_TEST].bytesReceived == 2);
+  CHECK(netStats[NET_ALARM].requests == 0 && netStats[NET_OTHER].requests == 0);
+}
+
+void testHistograms() {
+  //One bucket per power of two ms, 0 ms in the first and everything past the last in the last
+  NetHistogram histogram;
+  memset(&histogram, 0, sizeof(histogram));
+  uint32_t samples[] = { 0, 1, 2, 3, 4, 7, 8, 1023, 1024, 1u << 20 };
+  for (uint32_t ms : samples) {
+    netHistogramAdd(histogram, ms);
+  }
+  CHECK(histogram.count == 10);
+  CHECK(histogram.buckets[0] == 2);
+  CHECK(histogram.buckets[1] == 2);
+  CHECK(histogram.buckets[2] == 2);
+  CHECK(histogram.buckets[3] == 1);
+  CHECK(histogram.buckets[9] == 1);
+  CHECK(histogram.buckets[10] == 1);
+  CHECK(histogram.buckets[NET_BUCKETS - 1] == 1);
+  CHECK(histogram.maxMs == 1u << 20);
+  CHECK(histogram.totalMs == 0 + 1 + 2 + 3 + 4 + 7 + 8 + 1023 + 1024 + (1u << 20));
+
+  //The uploads of the script: a connect each except the refused one, a first byte for the seven with a response
+  runScript();
+  const NetEndpointStats& up = netStats[NET_SEND_DATA];
+  CHECK(up.connect.count == 8);
+  CHECK(up.connect.buckets[0] == 1);  // 0 ms
+  CHECK(up.connect.buckets[1] == 4);  // 3 ms
+  CHECK(up.connect.buckets[2] == 3);  // 4, 5 and 6 ms
+  CHECK(up.connect.maxMs == 6);
+
+  CHECK(up.firstByte.count == 7);
+  CHECK(up.firstByte.buckets[0] == 1);  // 0 ms
+  CHECK(up.firstByte.buckets[4] == 1);  // 23 ms
+  CHECK(up.firstByte.buckets[5] == 2);  // 38 and 43 ms
+  CHECK(up.firstByte.buckets[6] == 2);  // 64 and 125 ms
+  CHECK(up.firstByte.buckets[8] == 1);  // 303 ms
+
+  //Every request ends in the total, the timeout and the refused connect are the longest
+  CHECK(up.total.count == up.requests);
+  CHECK(up.total.maxMs == 6 + TEST_RESPONSE_TIMEOUT + 1);
+  CHECK(up.total.buckets[12] == 1);  // 5007 ms
+  CHECK(up.total.buckets[10] == 1);  // 2000 ms
+  CHECK(netHistogramAvg(up.total) == up.total.totalMs / up.requests);
+}
+
+void testMetricsText() {
+  runScript();
+  WiFi.rssi = -67;
+  static char text[TEST_METRICS_SIZE];
+  size_t length = formatMetrics(text, sizeof(text));
+  CHECK(length > 0 && length < sizeof(text) - 1);
+  CHECK(strlen(text) == length);
+  std::string metrics = "\n" + std::string(text, length);
+
+  CHECK(metricValue(metrics, "gg_wifi_rssi_dbm") == -67);
+  CHECK(metricValue(metrics, "gg_http_requests_total{endpoint=\"sendData\"}") == 9);
+  CHECK(metricValue(metrics, "gg_http_successes_total{endpoint=\"sendData\"}") == 4);
+  CHECK(metricValue(metrics, "gg_http_retries_total{endpoint=\"sendData\"}") == 5);
+  CHECK(metricValue(metrics, "gg_http_requests_total{endpoint=\"alarm\"}") == 0);
+  for (int cause = 0; cause < NET_FAILURE_CAUSES; cause++) {
+    std::string prefix = std::string("gg_http_failures_total{endpoint=\"sendData\",cause=\"") + netFailureNames[cause] + "\"}";
+    CHECK(metricValue(metrics, prefix) == 1);
+  }
+  CHECK(metricValue(metrics, "gg_http_failures_total{endpoint=\"ping\",cause=\"http_error\"}") == 1);
+  CHECK(metricValue(metrics, "gg_http_failures_total{endpoint=\"ping\",cause=\"timeout\"}") == 0);
+  CHECK(metricValue(metrics, "gg_http_sent_bytes_total{endpoint=\"sendData\"}") == 9 * UPLOAD_BYTES);
+  CHECK(metricValue(metrics, "gg_http_received_bytes_total{endpoint=\"ping\"}") == 33);
+
+  //Histograms: cumulative buckets, +Inf is the count, only for endpoints with requests
+  const NetEndpointStats& up = netStats[NET_SEND_DATA];
+  CHECK(metricValue(metrics, "gg_http_connect_ms_bucket{endpoint=\"sendData\",le=\"2\"}") == 1);
+  CHECK(metricValue(metrics, "gg_http_connect_ms_bucket{endpoint=\"sendData\",le=\"4\"}") == 5);
+  CHECK(metricValue(metrics, "gg_http_connect_ms_bucket{endpoint=\"sendData\",le=\"8\"}") == 8);
+  CHECK(metricValue(metrics, "gg_http_connect_ms_bucket{endpoint=\"sendData\",le=\"+Inf\"}") == 8);
+  CHECK(metricValue(metrics, "gg_http_duration_ms_bucket{endpoint=\"sendData\",le=\"+Inf\"}") == 9);
+  CHECK(metricValue(metrics, "gg_http_duration_ms_sum{endpoint=\"sendData\"}") == (long long)up.total.totalMs);
+  CHECK(metricValue(metrics, "gg_http_first_byte_ms_count{endpoint=\"ping\"}") == 4);
+  CHECK(metrics.find("gg_http_connect_ms_bucket{endpoint=\"alarm\"") == std::string::npos);
+
+  long long previous = 0;
+  bool cumulative = true;
+  for (int bucket = 0; bucket < NET_BUCKETS - 1; bucket++) {
+    std::string prefix = "gg_http_duration_ms_bucket{endpoint=\"sendData\",le=\"" + std::to_string(2UL << bucket) + "\"}";
+    long long value = metricValue(metrics, prefix);
+    cumulative = cumulative && value >= previous;
+    previous = value;
+  }
+  CHECK(cumulative);
+
+  //Every line is a TYPE comment or a sample with a value
+  bool wellFormed = true;
+  for (size_t start = 1; start < metrics.size();) {
+    size_t end = metrics.find('\n', start);
+    std::string line = metrics.substr(start, end - start);
+    bool sample = line.rfind("gg_", 0) == 0 && line.find(' ') != std::string::npos;
+    wellFormed = wellFormed && (line.rfind("# TYPE gg_", 0) == 0 || sample);
+    start = end + 1;
+  }
+  CHECK(wellFormed);
+
+  //A short buffer ends the text where it is full, still terminated
+  char small[100];
+  memset(small, 'x', sizeof(small));
+  size_t shortLength = formatMetrics(small, sizeof(small));
+  CHECK(shortLength == sizeof(small) - 1);
+  CHECK(small[shortLength] == '\0');
+  CHECK(strncmp(small, text, shortLength) == 0);
+}
+
+void testHeartbeatQuery() {
+  runScript();
+  WiFi.rssi = -58;
+  char query[512];
+  int length = netMetricsQuery(query, sizeof(query));
+  CHECK(length > 0 && (size_t)length < sizeof(query));
+  CHECK(strncmp(query, "&rssi=-58&", 10) == 0);
+  CHECK(strstr(query, "&upN=9&upOk=4&upRetry=5&upTimeout=1&upFail=5&upTx=10800&") != NULL);
+  CHECK(strstr(query, "&pingN=4&pingOk=3&pingRetry=0&pingTimeout=0&pingFail=1&") != NULL);
+  CHECK(strstr(query, "&testN=1&") != NULL);
+  CHECK(strstr(query, "&alarmN=") == NULL);
+}
+
+void testServeMetrics() {
+  runScript();
+  static uint8_t arenaBuffer[UPLOAD_ARENA_SIZE];
+  initArena(uploadArena, arenaBuffer, sizeof(arenaBuffer));
+  initMetricsServer();
+
+  //No scraper waiting, nothing happens
+  serveMetrics();
+
+  //GET /metrics: the formatted text with its length
+  WiFiClient scraper = metricsServer.hostConnect("GET /metrics HTTP/1.1\r\nHost: gg-board\r\nAccept: text/plain\r\n\r\n");
+  serveMetrics();
+  const std::string& answer = scraper.socket->output;
+  CHECK(!scraper.connected());
+  CHECK(answer.rfind("HTTP/1.1 200 OK\r\n", 0) == 0);
+
+  size_t bodyAt = answer.find("\r\n\r\n");
+  CHECK(bodyAt != std::string::npos);
+  std::string body = answer.substr(bodyAt + 4);
+  unsigned long contentLength = 0;
+  size_t at = answer.find("Content-Length: ");
+  if (at != std::string::npos) {
+    contentLength = strtoul(answer.c_str() + at + 16, NULL, 10);
+  }
+  CHECK(contentLength == body.size());
+
+  static char text[TEST_METRICS_SIZE];
+  size_t length = formatMetrics(text, sizeof(text));
+  CHECK(body == std::string(text, length));
+
+  //Another path gets a 404
+  WiFiClient other = metricsServer.hostConnect("GET /favicon.ico HTTP/1.1\r\n\r\n");
+  serveMetrics();
+  CHECK(other.socket->output.rfind("HTTP/1.1 404", 0) == 0);
+  CHECK(!other.connected());
+
+  //A scraper that never finishes its headers is answered after METRICS_REQUEST_TIMEOUT
+  unsigned long start = millis();
+  WiFiClient slow = metricsServer.hostConnect("GET /metrics HTTP/1.1\r\nHost: gg-board\r\n");
+  serveMetrics();
+  CHECK(millis() - start >= METRICS_REQUEST_TIMEOUT);
+  CHECK(slow.socket->output.rfind("HTTP/1.1 200 OK\r\n", 0) == 0);
+
+  //No room in the arena for the text
+  static uint8_t smallArena[1024];
+  initArena(uploadArena, smallArena, sizeof(smallArena));
+  WiFiClient full = metricsServer.hostConnect("GET /metrics HTTP/1.1\r\n\r\n");
+  serveMetrics();
+  CHECK(full.socket->output.rfind("HTTP/1.1 503", 0) == 0);
+}
+
+void testPrintedTable() {
+  runScript();
+  std::string printed;
+  Serial.capture = &printed;
+  Serial.muted = true;
+  printNetMetrics();
+  Serial.capture = NULL;
+  Serial.muted = false;
+
+  CHECK(printed.find("sendData") != std::string::npos);
+  CHECK(printed.find("Failures: connect 1 timeout 1 bad_response 1 http_error 1 not_acked 1") != std::string::npos);
+  CHECK(printed.find("alarm") == std::string::npos);
+}
+
+int main() {
+  testCounters();
+  testHistograms();
+  testMetricsText();
+  testHeartbeatQuery();
+  testServeMetrics();
+  testPrintedTable();
+
+  return checkResult("network_metrics_test");
+}
@@ -0,0 +1,107 @@
+/*****************************************
+*   Profiler Test
+      - gg_main_m7/profiler.h in its host build: the tick of the cycle
+        counter sections is the monotonic clock in ns (steady_clock), the
+        network sections stay on micros() (The virtual clock)
+      - min / avg / max and the power of two histogram from known tick
+        counts, then from scopes timed on each clock
+      - The profile of an upload carries every section that ran, with its
+        own ticks per us and the histogram up to its highest bucket
+*****************************************/
+
+#include <chrono>
+#include <thread>
+
+#include <Arduino.h>
+#include "check.h"
+#include "fake_json.h"
+#include "../../gg_main_m7/profiler.h"
+
+#define TEST_SLEEP_US 2000
+
+// Ticks of the monotonic clock for now - start, read as the profiler reads it
+uint32_t ticksSince(uint32_t start) {
+  return readCycleCounter() - start;
+}
+
+int main() {
+  initProfiler();
+  CHECK(!cycleCounterRunning);
+  CHECK(profileTicksPerMicro() == 1000.0f);
+  CHECK(sectionTicksPerMicro(PROFILE_DHT) == 1000.0f && sectionTicksPerMicro(PROFILE_NTP) == 1.0f);
+
+  //Known ticks: min, avg, max and one bucket per power of two
+  profileAdd(PROFILE_LCD, 0);
+  profileAdd(PROFILE_LCD, 1);
+  profileAdd(PROFILE_LCD, 3);
+  profileAdd(PROFILE_LCD, 4);
+  profileAdd(PROFILE_LCD, 1000);
+  profileAdd(PROFILE_LCD, 0xFFFFFFFF);
+  const ProfileSection& lcd = profileSections[PROFILE_LCD];
+  CHECK(lcd.count == 6);
+  CHECK(lcd.min == 0 && lcd.max == 0xFFFFFFFF);
+  CHECK(lcd.total == 1008ULL + 0xFFFFFFFFULL);
+  CHECK(lcd.histogram[0] == 2);   // 0 and 1
+  CHECK(lcd.histogram[1] == 1);   // 3 in [2, 4)
+  CHECK(lcd.histogram[2] == 1);   // 4 in [4, 8)
+  CHECK(lcd.histogram[9] == 1);   // 1000 in [512, 1024)
+  CHECK(lcd.histogram[31] == 1);
+
+  //Scopes on the monotonic clock, bounded by the clock read around them
+  uint32_t outerMin = 0xFFFFFFFF;
+  for (int i = 0; i < 5; i++) {
+    uint32_t start = readCycleCounter();
+    {
+      ProfileScope profile(PROFILE_DHT);
+      std::this_thread::sleep_for(std::chrono::microseconds(TEST_SLEEP_US));
+    }
+    outerMin = min(outerMin, ticksSince(start));
+  }
+  const ProfileSection& dht = profileSections[PROFILE_DHT];
+  CHECK(dht.count == 5);
+  CHECK(dht.min >= TEST_SLEEP_US * 1000 && dht.min <= outerMin);
+  CHECK(dht.min <= dht.total / dht.count && dht.total / dht.count <= dht.max);
+  uint32_t buckets = 0;
+  for (int bucket = 0; bucket < PROFILE_BUCKETS; bucket++) {
+    buckets += dht.histogram[bucket];
+    if (dht.histogram[bucket] > 0) {
+      CHECK((1ULL << bucket) <= dht.max && (2ULL << bucket) > dht.min);
+    }
+  }
+  CHECK(buckets == dht.count);
+
+  //An empty scope costs a few clock reads
+  for (int i = 0; i < 1000; i++) {
+    ProfileScope profile(PROFILE_JSON);
+  }
+  const ProfileSection& json = profileSections[PROFILE_JSON];
+  printf("Empty scope on the host: min %u ns, avg %.1f ns, max %u ns\n", json.min, (double)json.total / json.count, json.max);
+  CHECK(json.count == 1000 && json.min < 10000);
+
+  //A network section on micros(): 2.5 ms of virtual time is 2500 ticks, bucket 11
+  {
+    ProfileScope profile(PROFILE_NTP);
+    hostAdvanceMicros(2500);
+  }
+  const ProfileSection& ntp = profileSections[PROFILE_NTP];
+  CHECK(ntp.count == 1 && ntp.min == 2500 && ntp.max == 2500);
+  CHECK(ntp.histogram[11] == 1);
+
+  //The upload profile, sections that never ran are left out
+  FakeJsonDocument doc(512);
+  JsonObject profile = fakeJsonObject(doc);
+  addProfileToJSON(profile);
+  JsonObjectConst root = fakeJsonRoot(doc);
+  CHECK(profile.size() == 4);
+  CHECK(root["http_post"].isNull());
+  CHECK((root["ntp"]["n"] | 0) == 1);
+  CHECK((root["ntp"]["min"] | 0.0) == 2500.0);
+  CHECK((root["ntp"]["ticksPerUs"] | 0.0) == 1.0);
+  CHECK(root["ntp"]["hist"].size() == 12);
+  CHECK((root["dht"]["ticksPerUs"] | 0.0) == 1000.0);
+  CHECK((root["dht"]["min"] | 0.0) >= TEST_SLEEP_US);
+  CHECK(root["lcd"]["hist"].size() == PROFILE_BUCKETS);
+  CHECK(!doc.overflowed());
+
+  return checkResult("profiler_test");
+}
@@ -0,0 +1,219 @@
+/*****************************************
+*   Response Parser Fuzz
+      - gg_main_m7/response_parser.h with the real ArduinoJson (Built only
+        when CMake finds it), the response is read from a fake HttpClient
+      - A known response gives its ack, encodings and config
+      - Then 20k mutations of it: truncated, bytes flipped or inserted, deep
+        nesting, long strings, huge numbers, unknown keys, wrong
+        Content-Length. For every one the body is read to the end, the kept
+        keys stay inside RESPONSE_DOCUMENT_SIZE and the config it carries
+        never leaves an invalid live config (updateConfig())
+      - A 500 without an ack is read whole and does not store the upload
+        (uploadStored() of upload_body.h)
+*****************************************/
+
+#include <string>
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "check.h"
+
+//Logging is not under test
+enum LogFormatId { LOG_HTTP_STATUS, LOG_HTTP_ACK, LOG_HTTP_CONFIG };
+enum EventKind { EVENT_HTTP };
+enum HttpEventState { HTTP_RESPONSE };
+
+template <typename... Args>
+void logEvent(LogFormatId, Args...) {}
+void recordEvent(EventKind, uint8_t = 0, uint16_t = 0) {}
+
+// The part of ArduinoHttpClient the parser uses, the body comes from a string
+class HttpClient {
+public:
+  std::string body;
+  size_t position = 0;
+  int status = 200;
+  long length = -1;  // Content-Length header, -1 for none
+
+  int responseStatusCode() {
+    return status;
+  }
+
+  int skipResponseHeaders() {
+    return 0;
+  }
+
+  long contentLength() {
+    return length;
+  }
+
+  bool endOfBodyReached() {
+    return position >= body.size();
+  }
+
+  bool connected() {
+    return position < body.size();
+  }
+
+  void setTimeout(unsigned long) {}
+
+  int read() {
+    return position < body.size() ? (unsigned char)body[position++] : -1;
+  }
+
+  size_t readBytes(char* buffer, size_t size) {
+    size_t count = 0;
+    while (count < size && position < body.size()) {
+      buffer[count++] = body[position++];
+    }
+    return count;
+  }
+};
+
+#include "../../gg_main_m7/sensor_math.h"
+#include "../../gg_main_m7/zones.h"
+#include "../../gg_main_m7/runtime_config.h"
+#include "../../gg_main_m7/response_parser.h"
+#include "../../gg_main_m7/memory_regions.h"
+#include "../../gg_main_m7/rollup_store.h"
+#include "../../gg_main_m7/sample_columns.h"
+#include "../../gg_main_m7/upload_body.h"
+
+#define FUZZ_RUNS 20000
+
+const char* knownResponse =
+  "{\"status\":\"ok\",\"ack\":42,\"encodings\":[\"gzip\",\"deflate\"],"
+  "\"config\":{\"revision\":7,\"sampleInterval\":15000,\"location\":\"Tunnel\","
+  "\"zones\":[{\"targetTemperature\":21.5},{\"targetTemperature\":18,\"location\":\"Seedlings\"}],\"unknown\":[1,2,3]},"
+  "\"padding\":\"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\"}";
+
+uint32_t fuzzRandom = 5;
+uint32_t nextRandom(uint32_t range) {
+  fuzzRandom = fuzzRandom * 1103515245 + 12345;
+  return (fuzzRandom >> 8) % range;
+}
+
+std::string mutate(const std::string& source) {
+  std::string body = source;
+  if (body.empty()) {
+    return body;
+  }
+
+  //The inserts and replaces need their text, a second mutation may have broken it
+  size_t location = body.find("\"Tunnel\"");
+  size_t interval = body.find("15000");
+  size_t revision = body.find("7,");
+
+  switch (nextRandom(8)) {
+    case 0:
+      body.resize(nextRandom(body.size()));
+      break;
+    case 1:
+      for (int i = nextRandom(8); i >= 0; i--) {
+        body[nextRandom(body.size())] = (char)nextRandom(256);
+      }
+      break;
+    case 2:
+      body.insert(nextRandom(body.size()), 1, "{}[]\",:\\0-e."[nextRandom(12)]);
+      break;
+    case 3:
+      body = std::string(nextRandom(400), '[') + body;
+      break;
+    case 4:
+      if (location != std::string::npos) {
+        body.insert(location, "\"" + std::string(nextRandom(4000), 'L') + "\",\"location\":");
+      }
+      break;
+    case 5:
+      if (interval != std::string::npos) {
+        body.replace(interval, 5, "9999999999999999999999");
+      }
+      break;
+    case 6:
+      body.insert(1, "\"extra" + std::to_string(nextRandom(1000)) + "\":{\"a\":[" + std::string(nextRandom(2000), '1') + "]},");
+      break;
+    default:
+      if (revision != std::string::npos) {
+        body.replace(revision, 1, std::to_string(nextRandom(100)));
+      }
+      break;
+  }
+  return body;
+}
+
+// Read body as the server response, true if the parser saw a status line and read the whole body
+bool parse(const std::string& body, long length, ServerResponse& response, JsonDocument& doc, int status = 200) {
+  HttpClient http;
+  http.status = status;
+  http.body = body;
+  http.length = length;
+  doc.clear();
+  return readServerResponse(http, response, doc) && http.endOfBodyReached();
+}
+
+int main() {
+  hostSerial().muted = true;
+  initRuntimeConfig();
+  DynamicJsonDocument doc(RESPONSE_DOCUMENT_SIZE);
+  ServerResponse response;
+
+  //The known response
+  CHECK(parse(knownResponse, strlen(knownResponse), response, doc));
+  CHECK(response.statusCode == 200);
+  CHECK(response.hasAck && response.ack == 42);
+  CHECK(response.hasEncodings && response.acceptsDeflate);
+  CHECK(!response.config.isNull());
+  CHECK(doc["padding"].isNull() && doc["status"].isNull() && response.config["unknown"].isNull());
+  CHECK(updateConfig(response.config));
+  CHECK(runtimeConfig().revision == 7 && runtimeConfig().sampleInterval == 15000);
+  CHECK(runtimeConfig().zoneTargets[0] == 21.5f && runtimeConfig().zoneTargets[1] == 18);
+  CHECK(strcmp(runtimeConfig().location, "Tunnel") == 0 && strcmp(runtimeConfig().zoneLocations[1], "Seedlings") == 0);
+
+  //Mutations, with and without a Content-Length
+  int parsed = 0;
+  bool alwaysRead = true;
+  bool alwaysValid = true;
+  bool fitsDocument = true;
+  for (int run = 0; run < FUZZ_RUNS; run++) {
+    std::string body = mutate(knownResponse);
+    if (nextRandom(4) == 0) {
+      body = mutate(body);
+    }
+    long length = nextRandom(3) == 0 ? -1 : (long)body.size();
+
+    alwaysRead &= parse(body, length, response, doc);
+    fitsDocument &= doc.memoryUsage() <= RESPONSE_DOCUMENT_SIZE;
+    if (response.hasAck) {
+      parsed++;
+    }
+
+    if (!response.config.isNull()) {
+      defaultConfig(runtimeConfigs[activeConfig]);
+      updateConfig(response.config);
+    }
+    alwaysValid &= validConfig(runtimeConfig());
+  }
+
+  printf("%d mutated responses, %d still gave an ack\n", FUZZ_RUNS, parsed);
+  CHECK(alwaysRead);
+  CHECK(fitsDocument);
+  CHECK(alwaysValid);
+  CHECK(parsed > 0 && parsed < FUZZ_RUNS);
+
+  //An error status without an ack is read whole, and does not store the upload
+  const char* errorResponse = "{\"status\":\"error\",\"message\":\"Database unavailable\"}";
+  UploadBatch batch;
+  initUploadBatch(batch);
+  CHECK(parse(errorResponse, strlen(errorResponse), response, doc, 500));
+  CHECK(response.statusCode == 500 && !response.hasAck);
+  CHECK(!uploadStored(batch, response.statusCode, response.hasAck, response.ack));
+  CHECK(parse("", 0, response, doc, 503));
+  CHECK(!uploadStored(batch, response.statusCode, response.hasAck, response.ack));
+
+  //No status line
+  HttpClient http;
+  http.status = -1;
+  CHECK(!readServerResponse(http, response, doc));
+
+  return checkResult("response_parser_fuzz");
+}
@@ -0,0 +1,162 @@
+/*****************************************
+*   Rollup Week Test
+      - gg_main_m7/rollup_store.h fed 8 days of samples on every channel
+        (Every 30 s, as the sensing task does), then the catch-up uploads of
+        a device that was offline for 7 of them
+      - Closed minute and hour buckets match the samples they cover
+      - Each catch-up upload fits the upload document (JSON_DOCUMENT_SIZE in
+        slots of the fake document), stays under ROLLUP_UPLOAD_MAX and moves
+        forward. Together they cover the offline period with no gap and no
+        bucket sent twice
+      - A document too small for a span fails the build (overflowed(), the
+        period covered does not move) instead of dropping rollups
+      - Built for 1 zone and for 8 zones (20 channels), see CMakeLists.txt
+*****************************************/
+
+#include <map>
+#include <vector>
+
+#include <Arduino.h>
+#include "check.h"
+#include "fake_json.h"
+
+#include "../../gg_main_m7/sensor_math.h"
+#include "../../gg_main_m7/zones.h"
+#include "../../gg_main_m7/runtime_config.h"
+#include "../../gg_main_m7/memory_regions.h"
+#include "../../gg_main_m7/rollup_store.h"
+
+#define TEST_START 1700000017UL  // Not on a minute boundary
+#define TEST_DAYS 8
+#define TEST_SAMPLE_SECONDS 30
+#define UPLOAD_DOCUMENT_SLOTS (32768 / 16)  // JSON_DOCUMENT_SIZE, 16 byte slots on the board
+
+float sampleValue(int channel, unsigned long time) {
+  float value = 20 + channel + 5 * sinf((time % 86400) * 2 * M_PI / 86400) + (time / TEST_SAMPLE_SECONDS % 7) * 0.1f;
+  return roundf(value * 10) / 10;
+}
+
+struct Sent {
+  unsigned long start;
+  unsigned long period;
+};
+
+int main() {
+  initRuntimeConfig();
+  initMemoryRegions();
+
+  initRollupChannel(ROLLUP_DEVICE_TEMP, "Device Temperature", "Sensor 1", "Internal", "Default", "Temperature");
+  for (int zone = 0; zone < GG_ZONES; zone++) {
+    initRollupChannel(rollupZoneChannel(zone, false), "Temperature Sensor", "Sensor 1", "DHT", NULL, "Temperature", zone);
+    initRollupChannel(rollupZoneChannel(zone, true), "Humidity Sensor", "Sensor 1", "DHT", NULL, "Humidity", zone);
+  }
+  initRollupChannel(ROLLUP_WATER_TEMP, "Water Temperature", "Sensor 1", "ds18b20", NULL, "Temperature");
+  initRollupChannel(ROLLUP_PH, "PH", "PH Sensor 1", "BNC PH Probe", NULL, "PH");
+  initRollupChannel(ROLLUP_TDS, "TDS", "TDS Sensor 1", "TDS", NULL, "PPM");
+
+  unsigned long end = TEST_START + TEST_DAYS * 86400UL;
+  for (unsigned long time = TEST_START; time < end; time += TEST_SAMPLE_SECONDS) {
+    for (int id = 0; id < ROLLUP_CHANNELS; id++) {
+      addRollupSample((RollupChannelId)id, time, sampleValue(id, time));
+    }
+  }
+
+  //Rings are full, each closed bucket matches its samples
+  for (int id = 0; id < ROLLUP_CHANNELS; id++) {
+    RollupChannel& channel = rollupChannels[id];
+    CHECK(channel.minuteCount == ROLLUP_MINUTES);
+    CHECK(channel.hourCount == min(ROLLUP_HOURS, TEST_DAYS * 24));  // Part hours at both ends, the last one still open
+
+    for (int i = 0; i < channel.hourCount; i += 17) {
+      const RollupBucket& hour = channel.hours[(channel.hourHead - channel.hourCount + i + ROLLUP_HOURS) % ROLLUP_HOURS];
+      float low = 1e9, high = -1e9;
+      double sum = 0;
+      unsigned int count = 0;
+      for (unsigned long time = TEST_START; time < end; time += TEST_SAMPLE_SECONDS) {
+        if (time >= hour.start && time < hour.start + 3600) {
+          float value = sampleValue(id, time);
+          low = min(low, value);
+          high = max(high, value);
+          sum += value;
+          count++;
+        }
+      }
+      CHECK(hour.start % 3600 == 0);
+      CHECK(hour.count == count && count > 0);
+      CHECK(hour.min == low && hour.max == high);
+      CHECK(fabs(hour.sum - sum) < 0.01 * count);
+    }
+  }
+
+  //Offline since day 1, the raw samples hold the last 50 minutes
+  unsigned long offlineFrom = TEST_START - TEST_START % 3600 + 86400;
+  unsigned long uploadedUntil = offlineFrom;
+  unsigned long gapEnd = end - 50 * 60;
+  std::map<int, std::vector<Sent>> sent;
+  int uploads = 0;
+  size_t mostRollups = 0;
+  size_t mostSlots = 0;
+
+  while (uploadedUntil < gapEnd && uploads < 10000) {
+    FakeJsonDocument doc(UPLOAD_DOCUMENT_SLOTS);
+    JsonArray Rollups = fakeJsonObject(doc).createNestedArray("Rollups");
+    unsigned long covered = addRollupsToJSON(Rollups, uploadedUntil, gapEnd);
+
+    CHECK(!doc.overflowed());
+    CHECK(covered > uploadedUntil);
+    if (covered <= uploadedUntil) {
+      break;
+    }
+    mostRollups = max(mostRollups, Rollups.size());
+    mostSlots = max(mostSlots, doc.used);
+
+    for (size_t i = 0; i < Rollups.size(); i++) {
+      JsonVariantConst rollup(Rollups[i].node);
+      const char* name = rollup["Name"];
+      CHECK(name != NULL);
+      unsigned long start = rollup["Start"] | 0UL;
+      unsigned long period = rollup["Period"] | 0UL;
+      CHECK(start >= uploadedUntil && start + period <= covered);
+
+      //Channel from its name, sensor and location
+      for (int id = 0; id < ROLLUP_CHANNELS; id++) {
+        const RollupChannel& channel = rollupChannels[id];
+        const char* location = rollup["Location"];
+        if (strcmp(channel.name, name) == 0 && strcmp(rollupChannelLocation(channel), location) == 0
+            && strcmp(channel.sensorType, (const char*)rollup["Type"]) == 0 && strcmp(channel.dataType, (const char*)rollup["Field"]) == 0) {
+          sent[id].push_back({ start, period });
+        }
+      }
+    }
+
+    uploadedUntil = covered;
+    uploads++;
+  }
+
+  printf("%d channels: %d catch-up uploads, at most %u rollups and %u of %u document slots in one\n",
+         ROLLUP_CHANNELS, uploads, (unsigned)mostRollups, (unsigned)mostSlots, UPLOAD_DOCUMENT_SLOTS);
+  CHECK(uploadedUntil == gapEnd);
+  CHECK(mostRollups <= ROLLUP_UPLOAD_MAX);
+
+  //Per channel the buckets follow each other from the last upload to the last whole minute before the raw samples
+  CHECK((int)sent.size() == ROLLUP_CHANNELS);
+  for (auto& entry : sent) {
+    std::vector<Sent>& buckets = entry.second;
+    bool contiguous = true;
+    for (size_t i = 1; i < buckets.size(); i++) {
+      contiguous &= buckets[i].start == buckets[i - 1].start + buckets[i - 1].period;
+    }
+    CHECK(contiguous);
+    CHECK(buckets.front().start == offlineFrom);
+    CHECK(buckets.back().start + buckets.back().period == gapEnd - gapEnd % 60);
+  }
+
+  //A document that cannot hold a span fails instead of dropping the rest
+  FakeJsonDocument small(ROLLUP_CHANNELS * 12);
+  JsonArray Rollups = fakeJsonObject(small).createNestedArray("Rollups");
+  unsigned long from = oldestRollupHour();
+  CHECK(addRollupsToJSON(Rollups, from, gapEnd) == from);
+  CHECK(small.overflowed());
+
+  return checkResult("rollup_test");
+}
@@ -0,0 +1,74 @@
+/*****************************************
+*   Sample Columns Test
+      - dropSampleRows() of gg_main_m7/sample_columns.h, used when an upload
+        only had room for the first rows: the rows sent are gone, the rest
+        moved to the front with their values, times and presence bits
+*****************************************/
+
+#include "check.h"
+
+#define GG_ZONES 2
+#include "../../gg_main_m7/sensor_math.h"
+#include "../../gg_main_m7/zones.h"
+#include "../../gg_main_m7/sample_columns.h"
+
+// Channel 1 has no reading in every third row, channel 2 only in a few
+float testValue(int channel, int row) {
+  if (channel == 1 && row % 3 == 0) {
+    return 0;
+  }
+  if (channel == 2 && row % 10 != 7) {
+    return 0;
+  }
+  return 10 + channel + row * 0.5f;
+}
+
+int main() {
+  static SampleColumns columns;
+  clearSampleColumns(columns);
+
+  for (int row = 0; row < 90; row++) {
+    for (int channel = 0; channel < SAMPLE_CHANNELS; channel++) {
+      //Channel 3 fell behind by 5 rows (Failed reads that returned early)
+      if (channel == 3 && row >= 85) {
+        continue;
+      }
+      CHECK(addSample(columns, channel, 1000 + row * 30, testValue(channel, row)));
+    }
+  }
+
+  int dropped = 37;
+  dropSampleRows(columns, dropped);
+
+  CHECK(sampleRowCount(columns) == 90 - dropped);
+  CHECK(columns.count[3] == 85 - dropped);
+  for (int channel = 0; channel < SAMPLE_CHANNELS; channel++) {
+    for (int row = 0; row < columns.count[channel]; row++) {
+      CHECK(columns.time[channel][row] == 1000 + (uint32_t)(row + dropped) * 30);
+      CHECK(sampleValue(columns, channel, row) == testValue(channel, row + dropped));
+    }
+  }
+
+  //Presence bits follow the rows: a row is listed when any channel has a reading in it
+  int listed = 0;
+  for (int row = nextSampleRow(columns, 0); row >= 0; row = nextSampleRow(columns, row + 1)) {
+    bool any = false;
+    for (int channel = 0; channel < SAMPLE_CHANNELS; channel++) {
+      any |= sampleValue(columns, channel, row) != 0;
+    }
+    CHECK(any);
+    listed++;
+  }
+  CHECK(listed == 90 - dropped);
+
+  //New samples land after the kept rows
+  CHECK(addSample(columns, 0, 99999, 42));
+  CHECK(columns.count[0] == 90 - dropped + 1 && columns.value[0][90 - dropped] == 42);
+
+  //Dropping everything empties the columns
+  dropSampleRows(columns, 200);
+  CHECK(sampleRowCount(columns) == 0);
+  CHECK(nextSampleRow(columns, 0) == -1);
+
+  return checkResult("sample_columns_test");
+}
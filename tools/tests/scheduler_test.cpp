@@ -0,0 +1,133 @@
+/*****************************************
+*   Scheduler Test
+      - gg_main_m7/scheduler.h on the virtual clock: idleFor() moves the
+        clock instead of sleeping, interrupts are mbed::Timeout callbacks
+        that fire while the scheduler is idle
+      - Periodic cadence and lateness, deadline order, events running a task
+        before its deadline, missed periods skipped after a long task, the
+        event ring bound, and every post inside a critical section
+*****************************************/
+
+#include <vector>
+#include <string>
+
+#include <mbed.h>
+#include "check.h"
+
+bool idleWoken = false;
+
+// Sleep on the virtual clock, an interrupt calling wakeFromIdle() ends it early
+void idleFor(unsigned long ms) {
+  idleWoken = false;
+  for (unsigned long i = 0; i < ms && !idleWoken; i++) {
+    hostAdvance(1);
+  }
+}
+
+void wakeFromIdle() {
+  idleWoken = true;
+}
+
+#include "../../gg_main_m7/scheduler.h"
+
+std::vector<std::string> started;
+
+void recordTaskEvent(int id, bool start) {
+  if (start) {
+    started.push_back(tasks[id].name);
+  }
+}
+
+void resetScheduler() {
+  taskCount = 0;
+  taskHeapSize = 0;
+  taskEventHead = 0;
+  taskEventTail = 0;
+  started.clear();
+}
+
+void runUntil(unsigned long end) {
+  while (millis() < end) {
+    runScheduler();
+  }
+}
+
+void noWork() {
+}
+
+unsigned long longTaskMillis = 0;
+void slowWork() {
+  hostAdvance(longTaskMillis);
+}
+
+int eventTaskId = -1;
+unsigned long eventRunAt = 0;
+void eventWork() {
+  eventRunAt = millis();
+}
+
+void buttonInterrupt() {
+  postTaskEvent(eventTaskId);
+}
+
+int main() {
+  //Cadence: no lateness when nothing overruns
+  resetScheduler();
+  unsigned long start = millis();
+  int fast = addTask("fast", noWork, 100, 0);
+  int slow = addTask("slow", noWork, 250, 0);
+  runUntil(start + 10000);
+  CHECK(tasks[fast].runs >= 100 && tasks[fast].runs <= 101);
+  CHECK(tasks[slow].runs >= 40 && tasks[slow].runs <= 41);
+  CHECK(tasks[fast].maxLateMillis == 0);
+  CHECK(tasks[slow].maxLateMillis == 0);
+
+  //Deadline order, not registration order
+  resetScheduler();
+  start = millis();
+  addTask("third", noWork, 1000, 30);
+  addTask("first", noWork, 1000, 10);
+  addTask("second", noWork, 1000, 20);
+  runUntil(start + 50);
+  CHECK(started.size() == 3);
+  CHECK(started.size() == 3 && started[0] == "first" && started[1] == "second" && started[2] == "third");
+
+  //An interrupt runs its task at once, not at the 60 s deadline
+  resetScheduler();
+  start = millis();
+  eventTaskId = addTask("event", eventWork, 60000, 60000);
+  mbed::Timeout interrupt;
+  interrupt.attach(buttonInterrupt, std::chrono::milliseconds(1234));
+  runUntil(start + 2000);
+  CHECK(tasks[eventTaskId].runs == 1);
+  CHECK(eventRunAt >= start + 1234 && eventRunAt <= start + 1235);
+
+  //A task overrunning several periods is run once late, then back on a fresh cadence
+  resetScheduler();
+  start = millis();
+  int overrun = addTask("overrun", slowWork, 100, 0);
+  longTaskMillis = 350;
+  runUntil(start + 1);
+  longTaskMillis = 0;
+  unsigned long runs = tasks[overrun].runs;
+  runUntil(start + 451);
+  CHECK(runs == 1);
+  CHECK(tasks[overrun].runs == 2);  // At 450, not at 100, 200 and 300 back to back
+  runUntil(start + 1000);
+  CHECK(tasks[overrun].runs == 7);
+
+  //Event ring holds TASK_EVENT_QUEUE_SIZE - 1, the rest are dropped
+  resetScheduler();
+  int target = addTask("target", noWork, 60000, 60000);
+  unsigned long sections = hostCriticalSections();
+  for (int i = 0; i < TASK_EVENT_QUEUE_SIZE + 4; i++) {
+    postTaskEvent(target);
+  }
+  postTaskEvent(-1);
+  CHECK(hostCriticalSections() - sections == TASK_EVENT_QUEUE_SIZE + 4);
+  CHECK(hostCriticalDepth() == 0);
+  runScheduler();
+  CHECK(tasks[target].runs == TASK_EVENT_QUEUE_SIZE - 1);
+
+  return checkResult("scheduler_test");
+}
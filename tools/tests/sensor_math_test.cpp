@@ -0,0 +1,50 @@
+/*****************************************
+*   Sensor Math Test
+      - gg_main_m7/sensor_math.h against hand computed values: NTC beta
+        equation, pH and TDS scaling, median filter and the heater decision (A reading of 0 C
+        and a failed reading included)
+*****************************************/
+
+#include "check.h"
+#include "../../gg_main_m7/sensor_math.h"
+
+bool near(float value, float expected, float tolerance) {
+  return fabsf(value - expected) <= tolerance;
+}
+
+int main() {
+  //Mid scale is the nominal resistance, 25 C
+  CHECK(near(ntcTemperature(511.5), 25.0, 0.01));
+  //The NTC is the low side of the divider, a higher reading is a higher resistance, colder
+  CHECK(ntcTemperature(700) < ntcTemperature(400));
+
+  CHECK(near(phFromAnalog(0), 0, 0.001));
+  CHECK(near(phFromAnalog(410), 3.5 * 410 * 5.0 / 1024, 0.001));
+
+  //No compensation at 25 C, the polynomial of the probe datasheet
+  float v = 1.0;
+  CHECK(near(tdsFromVoltage(v, 25), (133.42 - 255.86 + 857.39) * 0.5, 0.01));
+  CHECK(tdsFromVoltage(v, 35) < tdsFromVoltage(v, 25));
+
+  int odd[] = { 9, 1, 5, 3, 7 };
+  CHECK(getMedianNum(odd, 5) == 5);
+  CHECK(odd[0] == 9);  // Input untouched
+  int even[] = { 4, 1, 3, 2 };
+  CHECK(getMedianNum(even, 4) == 2);
+
+  //Hysteresis: on at target - 0.5, off at target + 0.5, in between the heater keeps its state
+  CHECK(heaterWanted(18, 20, false));
+  CHECK(!heaterWanted(22, 20, true));
+  CHECK(heaterWanted(19.5, 20, false) && !heaterWanted(19.6, 20, false));
+  CHECK(heaterWanted(20.4, 20, true) && !heaterWanted(20.5, 20, true));
+  CHECK(heaterWanted(20, 20, true) && !heaterWanted(20, 20, false));
+
+  //0 C is a reading (DHT11, whole degrees): a frost protection target heats
+  CHECK(heaterWanted(0, 3, false) && heaterWanted(0, 3, true));
+  CHECK(!heaterWanted(0, -2, true));
+
+  //A failed reading (NAN) keeps the heater as it is
+  CHECK(heaterWanted(NAN, 20, true) && !heaterWanted(NAN, 20, false));
+
+  return checkResult("sensor_math_test");
+}
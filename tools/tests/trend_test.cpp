@@ -0,0 +1,149 @@
+/*****************************************
+*   Trend Test
+      - gg_main_m7/trend_functions.h on the virtual clock: the rolling 1 hour
+        and 24 hour min / max / avg against a plain recomputation of the
+        samples still inside each window, the sparkline levels and the trend
+        rows drawn on the host LCD
+      - Summary rows stay inside the 20 columns for every value range the
+        sensors produce (Humidity 100 %, TDS in the hundreds, below 0 C)
+*****************************************/
+
+#include <vector>
+
+#include <LiquidCrystal_I2C.h>
+#include "check.h"
+
+LiquidCrystal_I2C lcd(0x27, 20, 4);
+
+#include "../../gg_main_m7/trend_functions.h"
+
+struct Sample {
+  unsigned long time;  // s
+  float value;
+};
+
+// Reference: every sample from the buckets still in the window
+TrendSummary recompute(const std::vector<Sample>& samples, unsigned long bucketSeconds, int buckets, unsigned long now) {
+  TrendSummary summary = { 0, 0, 0, 0 };
+  double sum = 0;
+  for (const Sample& sample : samples) {
+    if (now / bucketSeconds - sample.time / bucketSeconds >= (unsigned long)buckets) {
+      continue;
+    }
+    if (summary.count == 0 || sample.value < summary.min) {
+      summary.min = sample.value;
+    }
+    if (summary.count == 0 || sample.value > summary.max) {
+      summary.max = sample.value;
+    }
+    sum += sample.value;
+    summary.count++;
+  }
+  if (summary.count > 0) {
+    summary.avg = sum / summary.count;
+  }
+  return summary;
+}
+
+bool sameSummary(const TrendSummary& a, const TrendSummary& b) {
+  return a.count == b.count && a.min == b.min && a.max == b.max && fabsf(a.avg - b.avg) < 0.01;
+}
+
+// Draw the trend rows and check each one is exactly 20 columns with nothing past the end
+bool rowsFit(const SensorTrend& trend) {
+  lcd.clear();
+  unsigned long overflows = lcd.overflows;
+  renderTrendRows(trend);
+  return lcd.overflows == overflows;
+}
+
+int main() {
+  SensorTrend trend;
+  memset(&trend, 0, sizeof(trend));
+  std::vector<Sample> samples;
+
+  //Two days of a daily cycle, a sample every 30 s
+  uint32_t random = 7;
+  for (int i = 0; i < 2 * 24 * 120; i++) {
+    hostAdvance(30000);
+    random = random * 1103515245 + 12345;
+    float value = 20 + 5 * sinf(i * 2 * M_PI / (24 * 120)) + ((random >> 16) % 100) / 100.0f;
+    value = roundf(value * 10) / 10;
+    addTrendSample(trend, value);
+    samples.push_back({ trendNow(), value });
+
+    if (i % 97 == 0) {
+      CHECK(sameSummary(hourSummary(trend), recompute(samples, TREND_HOUR_BUCKET_SECONDS, TREND_HOUR_BUCKETS, trendNow())));
+      CHECK(sameSummary(daySummary(trend), recompute(samples, TREND_DAY_BUCKET_SECONDS, TREND_DAY_BUCKETS, trendNow())));
+    }
+  }
+
+  //Sparkline: one level per 3 minute column, from the column's average within the hour's range
+  int levels[TREND_HOUR_BUCKETS];
+  sparklineLevels(trend, levels);
+  TrendSummary hour = hourSummary(trend);
+  unsigned long newest = trendNow() / TREND_HOUR_BUCKET_SECONDS;
+  for (int column = 0; column < TREND_HOUR_BUCKETS; column++) {
+    unsigned long bucket = newest - (TREND_HOUR_BUCKETS - 1 - column);
+    double sum = 0;
+    int count = 0;
+    for (const Sample& sample : samples) {
+      if (sample.time / TREND_HOUR_BUCKET_SECONDS == bucket) {
+        sum += sample.value;
+        count++;
+      }
+    }
+    int expected = count == 0 ? -1 : (int)((sum / count - hour.min) / (hour.max - hour.min) * (SPARKLINE_LEVELS - 1) + 0.5);
+    CHECK(levels[column] == expected);
+  }
+
+  //An hour without samples empties the hour window, the day keeps its data
+  hostAdvance(3600 * 1000UL + TREND_HOUR_BUCKET_SECONDS * 1000UL);
+  CHECK(hourSummary(trend).count == 0);
+  CHECK(daySummary(trend).count > 0);
+  sparklineLevels(trend, levels);
+  CHECK(levels[0] == -1 && levels[TREND_HOUR_BUCKETS - 1] == -1);
+
+  lcd.clear();
+  renderTrendRows(trend);
+  CHECK(lcd.hostRow(1) == "1h No Data          ");
+  CHECK(lcd.hostRow(2) == std::string(20, ' '));
+  CHECK(lcd.hostRow(3).compare(0, 4, "1d L") == 0);
+
+  //Every range of values fits the row, with all three values on it
+  const float ranges[][3] = {
+    { 18.2, 21.0, 24.5 },     // Grow temperature
+    { 62.0, 91.4, 100.0 },    // Humidity
+    { 312.5, 640.0, 1480.2 }, // TDS ppm
+    { -12.5, -3.2, 4.0 },     // Unheated greenhouse in winter
+    { 5.8, 6.2, 6.9 },        // pH
+  };
+  for (const auto& range : ranges) {
+    SensorTrend values;
+    memset(&values, 0, sizeof(values));
+    for (float value : range) {
+      addTrendSample(values, value);
+    }
+    CHECK(rowsFit(values));
+
+    std::string row = lcd.hostRow(1);
+    size_t low = row.find('L'), average = row.find(" A"), high = row.find(" H");
+    CHECK(low == 3 && average != std::string::npos && high != std::string::npos);
+    if (high != std::string::npos) {
+      CHECK(fabs(atof(row.c_str() + high + 2) - range[2]) <= (fabsf(range[2]) < 100 ? 0.05 : 0.5));
+    }
+  }
+
+  //Formatting keeps a decimal only while it fits
+  char text[12];
+  formatTrendValue(text, sizeof(text), 99.94);
+  CHECK(strcmp(text, "99.9") == 0);
+  formatTrendValue(text, sizeof(text), 100.0);
+  CHECK(strcmp(text, "100") == 0);
+  formatTrendValue(text, sizeof(text), -4.25);
+  CHECK(strcmp(text, "-4.2") == 0 || strcmp(text, "-4.3") == 0);
+  formatTrendValue(text, sizeof(text), -12.5);
+  CHECK(strcmp(text, "-12") == 0 || strcmp(text, "-13") == 0);
+
+  return checkResult("trend_test");
+}
@@ -0,0 +1,222 @@
+/*****************************************
+*   Upload Body Test
+      - gg_main_m7/upload_body.h on the fake JSON document, as
+        convertToJSON() and postSensorData() of gg_main_m7.ino use it
+      - uploadStored(): only a 2xx with the ack of the upload (or no ack)
+        stores it. An error status never does, ack or not, and neither does
+        the ack of another upload
+      - An upload that was not stored keeps its rows and its Sequence, the
+        same body goes again. A stored one drops the rows it carried
+      - 100 full rows do not fit in one document: the rows that would not
+        fit stay for the next upload, which carries them in order
+      - A device back from being offline sends only rollups (catch-up) and
+        keeps its raw rows until the rollups reach them
+      - A body that does not fit the buffer is refused, never sent cut
+*****************************************/
+
+#include <string>
+
+#include <Arduino.h>
+#include "check.h"
+#include "fake_json.h"
+
+#include "../../gg_main_m7/sensor_math.h"
+#include "../../gg_main_m7/zones.h"
+#include "../../gg_main_m7/runtime_config.h"
+#include "../../gg_main_m7/memory_regions.h"
+#include "../../gg_main_m7/rollup_store.h"
+#include "../../gg_main_m7/sample_columns.h"
+#include "../../gg_main_m7/upload_body.h"
+
+#define TEST_START 1700000000UL
+#define TEST_SAMPLE_SECONDS 30
+#define TEST_BODY_SIZE 65536  // UPLOAD_STAGING_SIZE of gg_main_m7.ino
+
+SampleColumns columns;
+UploadBatch batch;
+char body[TEST_BODY_SIZE];
+
+// A row with a reading on every channel, as a sensing pass with every sensor answering
+void addFullRow(unsigned long time) {
+  for (int channel = 0; channel < SAMPLE_CHANNELS; channel++) {
+    addRollupSample((RollupChannelId)channel, time, 20 + channel);
+    addSample(columns, channel, time, 20 + channel);
+  }
+}
+
+// Build the body the sketch would send now, its length (0 if it did not fit)
+size_t buildBody(unsigned long now) {
+  FakeJsonDocument doc(JSON_DOCUMENT_SIZE / FAKE_JSON_SLOT_SIZE);
+  addUploadRollups(doc, batch, columns, now);
+  addUploadRows(doc, batch, columns, "test-device");
+  return serializeUpload(doc, body, sizeof(body));
+}
+
+// Rows of the body, counted by their Device object
+int bodyRows() {
+  int rows = 0;
+  for (const char* at = strstr(body, "\"Device\""); at != NULL; at = strstr(at + 1, "\"Device\"")) {
+    rows++;
+  }
+  return rows;
+}
+
+void testStoredStatus() {
+  initUploadBatch(batch);
+  batch.sequence = 7;
+
+  CHECK(uploadStored(batch, 200, true, 7));
+  CHECK(uploadStored(batch, 200, false, 0));
+  CHECK(uploadStored(batch, 204, false, 0));
+  CHECK(!uploadStored(batch, 200, true, 6));   // Ack of another upload
+  CHECK(!uploadStored(batch, 500, false, 0));  // Error without an ack
+  CHECK(!uploadStored(batch, 404, false, 0));
+  CHECK(!uploadStored(batch, 500, true, 7));   // Error with the right ack
+  CHECK(!uploadStored(batch, 302, false, 0));
+  CHECK(!uploadStored(batch, 0, false, 0));    // No status line
+}
+
+void testRetryKeepsRows() {
+  clearSampleColumns(columns);
+  initUploadBatch(batch);
+  for (int row = 0; row < 10; row++) {
+    addFullRow(TEST_START + row * TEST_SAMPLE_SECONDS);
+  }
+
+  size_t length = buildBody(TEST_START + 300);
+  CHECK(length > 0);
+  CHECK(bodyRows() == 10);
+  std::string first(body, length);
+
+  //A 500 without an ack: postSensorData() returns false and commits nothing, the same body goes again
+  CHECK(!uploadStored(batch, 500, false, 0));
+  CHECK(batch.sequence == 1);
+  CHECK(sampleRowCount(columns) == 10);
+  CHECK(buildBody(TEST_START + 330) == length);
+  CHECK(first == std::string(body, length));
+
+  //Stored: the Sequence moves on and the rows are gone
+  CHECK(uploadStored(batch, 200, true, 1));
+  commitUpload(batch, columns);
+  CHECK(batch.sequence == 2);
+  CHECK(sampleRowCount(columns) == 0);
+  CHECK(batch.uploadedUntil == TEST_START + 9 * TEST_SAMPLE_SECONDS);
+}
+
+void testRowCap() {
+  clearSampleColumns(columns);
+  initUploadBatch(batch);
+  batch.uploadedUntil = TEST_START - TEST_SAMPLE_SECONDS;  // The server has everything before the rows
+  unsigned long start = TEST_START + 1000;
+  for (int row = 0; row < SAMPLE_ROWS; row++) {
+    addFullRow(start + row * TEST_SAMPLE_SECONDS);
+  }
+
+  //Rows are capped by the document memory, the rest wait
+  size_t length = buildBody(start + SAMPLE_ROWS * TEST_SAMPLE_SECONDS);
+  int firstRows = bodyRows();
+  printf("%d channels: %d of %d full rows in one document (%d bytes a row), body %zu bytes\n",
+         SAMPLE_CHANNELS, firstRows, SAMPLE_ROWS, (int)JSON_ROW_SIZE, length);
+  CHECK(length > 0);
+  CHECK(firstRows > 0 && firstRows < SAMPLE_ROWS);
+  CHECK(batch.rowEnd == firstRows);
+  CHECK(batch.pendingUploadedUntil == start + (firstRows - 1) * TEST_SAMPLE_SECONDS);
+
+  commitUpload(batch, columns);
+  CHECK(sampleRowCount(columns) == SAMPLE_ROWS - firstRows);
+  CHECK(columns.time[0][0] == start + firstRows * TEST_SAMPLE_SECONDS);
+
+  //The next uploads carry the rest in order, until every row went
+  int sent = firstRows;
+  int uploads = 1;
+  while (sampleRowCount(columns) > 0 && uploads < 10) {
+    unsigned long expectFirst = columns.time[0][0];
+    CHECK(buildBody(start + SAMPLE_ROWS * TEST_SAMPLE_SECONDS) > 0);
+    char firstTime[24];
+    snprintf(firstTime, sizeof(firstTime), "\"Time\":%lu", expectFirst);
+    CHECK(strstr(body, firstTime) != NULL);
+    sent += bodyRows();
+    commitUpload(batch, columns);
+    uploads++;
+  }
+  CHECK(sent == SAMPLE_ROWS);
+  CHECK(batch.uploadedUntil == start + (SAMPLE_ROWS - 1) * TEST_SAMPLE_SECONDS);
+}
+
+void testCatchUp() {
+  clearSampleColumns(columns);
+  initUploadBatch(batch);
+
+  //Three hours offline: the rollups hold them, the raw rows start after
+  unsigned long offlineFrom = TEST_START + 100000;
+  offlineFrom -= offlineFrom % 3600;
+  unsigned long back = offlineFrom + 3 * 3600;
+  for (unsigned long time = offlineFrom; time < back; time += TEST_SAMPLE_SECONDS) {
+    for (int channel = 0; channel < ROLLUP_CHANNELS; channel++) {
+      addRollupSample((RollupChannelId)channel, time, 20 + channel);
+    }
+  }
+  for (int row = 0; row < 5; row++) {
+    addFullRow(back + row * TEST_SAMPLE_SECONDS);
+  }
+  batch.uploadedUntil = offlineFrom;
+
+  //Only rollups until they reach the raw rows, which stay
+  int uploads = 0;
+  unsigned long covered = batch.uploadedUntil;
+  while (uploads < 50) {
+    CHECK(buildBody(back + 5 * TEST_SAMPLE_SECONDS) > 0);
+    uploads++;
+    if (!batch.catchingUp) {
+      break;
+    }
+    CHECK(strstr(body, "\"Rollups\"") != NULL);
+    CHECK(bodyRows() == 0);
+    commitUpload(batch, columns);
+    CHECK(sampleRowCount(columns) == 5);
+    CHECK(batch.uploadedUntil > covered);
+    covered = batch.uploadedUntil;
+  }
+  printf("Catch-up of 3 h: %d uploads, the last with the %d raw rows\n", uploads, bodyRows());
+  CHECK(uploads > 1);
+  CHECK(bodyRows() == 5);
+  commitUpload(batch, columns);
+  CHECK(sampleRowCount(columns) == 0);
+}
+
+void testSerializeOverflow() {
+  clearSampleColumns(columns);
+  initUploadBatch(batch);
+  addFullRow(TEST_START);
+
+  //A buffer too small gives 0, never a cut body
+  FakeJsonDocument doc(JSON_DOCUMENT_SIZE / FAKE_JSON_SLOT_SIZE);
+  addUploadRollups(doc, batch, columns, TEST_START);
+  addUploadRows(doc, batch, columns, "test-device");
+  char small[64];
+  CHECK(serializeUpload(doc, small, sizeof(small)) == 0);
+  CHECK(serializeUpload(doc, body, sizeof(body)) > sizeof(small));
+
+  //A document without room for one row sends none and keeps them all
+  FakeJsonDocument tiny(JSON_ROW_SIZE / FAKE_JSON_SLOT_SIZE);
+  addUploadRollups(tiny, batch, columns, TEST_START);
+  addUploadRows(tiny, batch, columns, "test-device");
+  CHECK(serializeUpload(tiny, body, sizeof(body)) > 0);
+  CHECK(bodyRows() == 0);
+  commitUpload(batch, columns);
+  CHECK(sampleRowCount(columns) == 1);
+}
+
+int main() {
+  initRuntimeConfig();
+  initMemoryRegions();
+  initUploadChannels(GG_ZONES);
+
+  testStoredStatus();
+  testRetryKeepsRows();
+  testRowCap();
+  testCatchUp();
+  testSerializeOverflow();
+
+  return checkResult("upload_test");
+}
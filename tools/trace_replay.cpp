@@ -0,0 +1,334 @@
+/*****************************************
+*   Trace Replay on the Host
+      - Replays a trace recorded by a GG_TRACE_RECORD build ("TRACE <hex>"
+        lines, as the Serial Monitor shows them) through the replay loop of
+        gg_main_m7/sensor_trace.h and prints the same "REPLAY" heater, anomaly
+        and payload lines as a GG_TRACE_REPLAY build on the board. Two
+        firmware revisions diff on the host
+      - The sensing pass is readSensors() of gg_main_m7/sensing.h and the
+        payload is built by upload_body.h on the fake JSON document
+        (tools/tests/fake_json.h), the heater decision is controlZones()
+      - Without a file it records a synthetic trace through the same read
+        functions (2 h, heater cycling, a failed DHT reading, a water
+        temperature spike), writes it out as TRACE lines, loads them back and
+        replays them: the records must round trip, the heater lines must
+        match a direct run of controlZones(), the spike must raise one
+        anomaly and every pass must reach its payload. Exits with 1 if a
+        check fails
+
+      g++ -O2 -I tools/host -o trace_replay tools/trace_replay.cpp
+      ./trace_replay                        Self check
+      ./trace_replay trace.txt [target C]   Replay a recorded trace
+*****************************************/
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include <mbed.h>
+#include <LiquidCrystal_I2C.h>
+#include "tests/fake_json.h"
+
+LiquidCrystal_I2C lcd(0x27, 20, 4);  // Trend pages, never drawn here
+
+void idleFor(unsigned long ms) {
+  hostAdvance(ms);
+}
+
+void wakeFromIdle() {}
+
+#include "../gg_main_m7/sensor_math.h"
+#include "../gg_main_m7/zones.h"
+#include "../gg_main_m7/runtime_config.h"
+#include "../gg_main_m7/memory_regions.h"
+#include "../gg_main_m7/scheduler.h"
+#include "../gg_main_m7/event_trace.h"
+#include "../gg_main_m7/trend_functions.h"
+#include "../gg_main_m7/rollup_store.h"
+#include "../gg_main_m7/sample_columns.h"
+#include "../gg_main_m7/sensor_trace.h"
+#include "../gg_main_m7/anomaly_detector.h"
+#include "../gg_main_m7/profiler.h"
+#include "../gg_main_m7/sensing.h"
+#include "../gg_main_m7/upload_body.h"
+
+#define REPLAY_TARGET 20           // DEFAULT_TARGET_TEMPERATURE of runtime_config.h
+#define REPLAY_ALARM_MARGIN 5      // ALARM_TEMPERATURE_MARGIN of gg_main_m7.ino
+#define REPLAY_BODY_SIZE 65536     // UPLOAD_STAGING_SIZE of gg_main_m7.ino
+#define SELF_CHECK_START 1700000000UL
+#define SELF_CHECK_PASSES 240      // 2 h at 30 s
+#define SELF_CHECK_SPIKE 150       // Pass the water temperature jumps, for 10 passes
+#define SELF_CHECK_DHT_FAULT 100   // Pass the DHT does not answer
+
+// Print into a string, for the self check
+class StringPrint : public Print {
+public:
+  using Print::write;
+  std::string text;
+
+  size_t write(uint8_t c) override {
+    text += (char)c;
+    return 1;
+  }
+};
+
+Print* replayOut = &Serial;
+AnomalyChannel anomalyChannels[ANOMALY_CHANNELS];
+UploadBatch uploadBatch;
+char replayBody[REPLAY_BODY_SIZE];
+
+//Inputs of the synthetic trace, the hardware reads of the self check
+uint32_t syntheticClock;
+float syntheticGrowTemp;
+float syntheticWaterTemp;
+std::vector<float> syntheticWaterTemps;
+
+float readZoneTemperature(int) {
+  return syntheticGrowTemp;
+}
+
+float readZoneHumidity(int) {
+  return 60;
+}
+
+int32_t readNtcAdc() {
+  return 512;
+}
+
+float readWaterTemperature() {
+  return syntheticWaterTemp;
+}
+
+int32_t readPhAdc() {
+  return 0;
+}
+
+// As the sketch, without the alarm
+void sensorFault(SensorFaultId id) {
+  recordEvent(EVENT_SENSOR_FAULT, id);
+}
+
+// As the sketch during a replay: the change is printed instead of raising an alarm
+void checkAnomaly(AnomalyChannelId id, float value) {
+  AnomalyChange change = addAnomalySample(anomalyChannels[id], anomalyLimits[id], value, sampleTime);
+  if (change != ANOMALY_UNCHANGED && traceReplaying) {
+    printReplayAnomaly(*replayOut, sampleTime, anomalyChannelNames[id], change == ANOMALY_STARTED, value);
+  }
+}
+
+void replaySensingPass(uint32_t time) {
+  sampleTime = time;
+  readSensors();
+}
+
+void replayControl(uint32_t time) {
+  controlZones(zones, REPLAY_ALARM_MARGIN);
+  printReplayHeaters(*replayOut, zones, time);
+}
+
+// convertToJSON() of the sketch without the Profile and PostMortem (A replay leaves them out), the clock is the last pass
+void replayPayload(uint32_t time) {
+  FakeJsonDocument doc(JSON_DOCUMENT_SIZE / FAKE_JSON_SLOT_SIZE);
+  addUploadRollups(doc, uploadBatch, sampleColumns, sampleTime);
+  addUploadRows(doc, uploadBatch, sampleColumns, runtimeConfig().deviceId);
+  size_t length = serializeUpload(doc, replayBody, sizeof(replayBody));
+
+  replayOut->print("REPLAY ");
+  replayOut->print(time);
+  replayOut->print(" PAYLOAD ");
+  replayOut->write((const uint8_t*)replayBody, length);
+  replayOut->println();
+  resetSensorArray();
+}
+
+// Start the replay state over, targets from the runtime config defaults
+void resetReplay(float target) {
+  const uint8_t relayPins[ZONE_MAX] = { 0 };
+  initZones(zones, GG_ZONES, relayPins);
+  for (int zone = 0; zone < zones.count; zone++) {
+    zones.target[zone] = target;
+  }
+  for (AnomalyChannel& channel : anomalyChannels) {
+    initAnomalyChannel(channel);
+  }
+  memset(replayHeaterKnown, 0, sizeof(replayHeaterKnown));
+  memset(replayInputs, 0, sizeof(replayInputs));
+  initUploadBatch(uploadBatch);
+  resetSensorArray();
+}
+
+// Passes per payload as replayTrace() of the sketch
+void replay(float target) {
+  resetReplay(target);
+  traceRecording = false;
+  traceReplaying = true;
+  const RuntimeConfig& config = runtimeConfig();
+  uint32_t passesPerUpload = max(1UL, (unsigned long)(config.sendDataInterval / config.sampleInterval));
+  const TraceReplayHooks hooks = { NULL, replaySensingPass, replayPayload, replayControl };
+  replayTraceRecords(hooks, passesPerUpload);
+}
+
+// Load every TRACE line of a file, returns the number of records
+uint32_t loadTraceFile(FILE* file) {
+  traceHead = 0;
+  char line[6 + TRACE_RECORDS_PER_LINE * 18 + 2];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line[strcspn(line, "\r\n")] = '\0';
+    parseTraceLine(line);
+  }
+  return traceHead;
+}
+
+// Value of the first reading named name in a payload, NAN if there is none
+float payloadValue(const std::string& json, const char* name) {
+  std::string key = std::string("\"Name\":\"") + name + "\",\"Value\":";
+  size_t at = json.find(key);
+  return at == std::string::npos ? NAN : strtof(json.c_str() + at + key.size(), NULL);
+}
+
+// The payload of a pass carries its readings, a failed DHT reading and pH 0 are left out
+bool payloadMatches(const std::string& json, int pass, float growTemp) {
+  int readings = 0;
+  for (size_t at = json.find("\"Name\":"); at != std::string::npos; at = json.find("\"Name\":", at + 1)) {
+    readings++;
+  }
+  char time[24];
+  snprintf(time, sizeof(time), "\"Time\":%lu,", SELF_CHECK_START + pass * 30UL);
+  float water = payloadValue(json, "Water Temperature");
+  float grow = payloadValue(json, "Temperature Sensor");
+
+  return json.compare(0, 14, "{\"Sequence\":1,") == 0 && json.find(time) != std::string::npos
+         && readings == (isnan(growTemp) ? 3 : 5) && (isnan(growTemp) ? isnan(grow) : fabsf(grow - growTemp) < 0.001f)
+         && fabsf(water - syntheticWaterTemps[pass]) < 0.001f && payloadValue(json, "TDS") == 640;
+}
+
+int selfCheck() {
+  int failures = 0;
+
+  //Record: a pass every 30 s through sensingTask()'s reads
+  resetReplay(REPLAY_TARGET);
+  traceRecording = true;
+  std::vector<float> growTemps;
+  for (int pass = 0; pass < SELF_CHECK_PASSES; pass++) {
+    hostAdvance(30000);
+    syntheticClock = SELF_CHECK_START + pass * 30;
+    syntheticGrowTemp = pass == SELF_CHECK_DHT_FAULT ? NAN : roundf((REPLAY_TARGET + 2 * sinf(pass * 2 * M_PI / 80)) * 10) / 10;
+    syntheticWaterTemp = pass >= SELF_CHECK_SPIKE && pass < SELF_CHECK_SPIKE + 10 ? 30 : 18 + (pass % 3) * 0.05f;
+    growTemps.push_back(syntheticGrowTemp);
+    syntheticWaterTemps.push_back(syntheticWaterTemp);
+
+    tdsValue = 640;
+    sampleTime = tracedInt(TRACE_CLOCK, []() -> int32_t { return syntheticClock; });
+    readSensors();
+  }
+  traceRecording = false;
+
+  //Through the TRACE lines and back
+  std::vector<TraceRecord> recorded(traceRecords, traceRecords + traceHead);
+  StringPrint lines;
+  dumpTrace(lines);
+  traceHead = 0;
+  size_t start = 0;
+  while (start < lines.text.size()) {
+    size_t end = min(lines.text.find('\n', start), lines.text.size());
+    std::string line = lines.text.substr(start, end - start);
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    parseTraceLine(line.c_str());
+    start = end + 1;
+  }
+  bool roundTrip = traceHead == recorded.size();
+  for (uint32_t i = 0; roundTrip && i < traceHead; i++) {
+    roundTrip = traceRecords[i].time == recorded[i].time && traceRecords[i].value == recorded[i].value && traceRecords[i].source == recorded[i].source;
+  }
+  if (!roundTrip) {
+    printf("FAILED: %u records loaded back, %u recorded\n", (unsigned)traceHead, (unsigned)recorded.size());
+    failures++;
+  }
+
+  //Replay
+  StringPrint output;
+  replayOut = &output;
+  replay(REPLAY_TARGET);
+  replayOut = &Serial;
+
+  //The heater lines against controlZones() run directly on the readings, the first
+  //line is the decision before the first reading (No valid reading, as after boot)
+  ZoneTable direct;
+  const uint8_t relayPins[ZONE_MAX] = { 0 };
+  initZones(direct, 1, relayPins);
+  direct.target[0] = REPLAY_TARGET;
+  controlZones(direct, REPLAY_ALARM_MARGIN);
+  int expectedHeaterLines = 1;
+  for (float temperature : growTemps) {
+    direct.temperature[0] = isnan(temperature) ? 0 : temperature;
+    direct.valid[0] = !isnan(temperature);
+    expectedHeaterLines += controlZones(direct, REPLAY_ALARM_MARGIN).changed ? 1 : 0;
+  }
+
+  //One payload per pass at the default intervals: the readings of its pass, pH 0 left out
+  int heaterLines = 0, waterOn = 0, payloads = 0, payloadsWrong = 0;
+  unsigned long waterOnTime = 0;
+  std::string firstPayload;
+  start = 0;
+  while (start < output.text.size()) {
+    size_t end = min(output.text.find('\n', start), output.text.size());
+    std::string line = output.text.substr(start, end - start);
+    unsigned long time = strtoul(line.c_str() + 7, NULL, 10);
+    heaterLines += line.find(" HEATER ") != std::string::npos;
+    if (line.find("ANOMALY Water Temp ON") != std::string::npos) {
+      waterOn++;
+      waterOnTime = time;
+    }
+    size_t payload = line.find(" PAYLOAD ");
+    if (payload != std::string::npos) {
+      std::string json = line.substr(payload + 9);
+      payloadsWrong += payloads >= SELF_CHECK_PASSES || !payloadMatches(json, payloads, growTemps[payloads]);
+      firstPayload = payloads == 0 ? json : firstPayload;
+      payloads++;
+    }
+    start = end + 1;
+  }
+
+  printf("%u records, %d heater lines (%d expected), %d water temperature anomaly, %d payloads (%d wrong)\n",
+         (unsigned)traceHead, heaterLines, expectedHeaterLines, waterOn, payloads, payloadsWrong);
+  printf("First payload: %s\n", firstPayload.c_str());
+  if (heaterLines != expectedHeaterLines || heaterLines < 4) {
+    printf("FAILED: heater lines\n%s", output.text.c_str());
+    failures++;
+  }
+  if (waterOn != 1 || waterOnTime < SELF_CHECK_START + SELF_CHECK_SPIKE * 30 || waterOnTime > SELF_CHECK_START + (SELF_CHECK_SPIKE + 10) * 30) {
+    printf("FAILED: water temperature spike\n%s", output.text.c_str());
+    failures++;
+  }
+  if (payloads != SELF_CHECK_PASSES || payloadsWrong != 0) {
+    printf("FAILED: payloads\n%s", output.text.c_str());
+    failures++;
+  }
+
+  printf(failures == 0 ? "PASS\n" : "FAIL\n");
+  return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  initMemoryRegions();
+  initTrace(false, false);
+  initRuntimeConfig();
+  initUploadChannels(GG_ZONES);
+
+  if (argc < 2) {
+    return selfCheck();
+  }
+
+  FILE* file = strcmp(argv[1], "-") == 0 ? stdin : fopen(argv[1], "r");
+  if (file == NULL) {
+    printf("Cannot open %s\n", argv[1]);
+    return 1;
+  }
+  printf("Trace records loaded: %u\n", (unsigned)loadTraceFile(file));
+  replay(argc > 2 ? atof(argv[2]) : REPLAY_TARGET);
+  printf("REPLAY END\n");
+  return 0;
+}
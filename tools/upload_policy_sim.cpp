@@ -0,0 +1,156 @@
+/*****************************************
+*   Upload Policy Simulation
+      - Runs gg_main_m7/upload_policy.h against link models for a simulated
+        day, next to the fixed sendDataInterval uploader it replaces
+      - A link has an RSSI, a per-request failure chance, a per-KB failure
+        chance (Long posts fail more often on a weak link), a connect time
+        and a throughput. Outages drop every request
+      - Reports requests, failures, radio time and the age of each row when
+        it reached the server (Delivered-data latency)
+
+      g++ -O2 -o upload_policy_sim tools/upload_policy_sim.cpp && ./upload_policy_sim
+*****************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+
+#include "../gg_main_m7/upload_policy.h"
+
+#define SIM_DURATION (24UL * 3600 * 1000)
+#define SIM_SAMPLE_INTERVAL 30000
+#define SIM_SEND_DATA_INTERVAL 30000
+#define SIM_MAX_DATA_AGE 600000
+#define SIM_MAX_ROWS 100      // SAMPLE_ROWS
+#define SIM_ROW_BYTES 900     // One row of six readings in the upload JSON
+#define SIM_REQUEST_BYTES 300  // Headers and the JSON around the rows
+#define SIM_TIMEOUT 5000
+
+struct LinkModel {
+  const char* name;
+  float rssi;
+  float failChance;       // Per request
+  float failChancePerKB;  // Per KB of body
+  uint32_t connectMs;
+  float bytesPerMs;
+  uint32_t outageEvery;   // ms between outages, 0 for none
+  uint32_t outageLength;  // ms
+};
+
+const LinkModel linkModels[] = {
+  { "good", -55, 0.01, 0.0005, 80, 60, 0, 0 },
+  { "fair", -70, 0.05, 0.005, 250, 12, 0, 0 },
+  { "weak", -80, 0.15, 0.02, 700, 3, 0, 0 },
+  { "flaky", -75, 0.05, 0.005, 300, 10, 3600000, 900000 },
+};
+
+struct SimResult {
+  uint32_t requests;
+  uint32_t failures;
+  uint32_t rowsDelivered;
+  uint32_t rowsDropped;  // Overwritten when the arrays filled up (Still covered by the rollups)
+  uint64_t radioMs;
+  std::vector<uint32_t> latencies;  // ms from sampling to delivery, per row
+};
+
+uint32_t simRandom = 1;
+
+float randomUnit() {
+  simRandom = simRandom * 1103515245 + 12345;
+  return ((simRandom >> 8) & 0xFFFF) / 65536.0f;
+}
+
+SimResult simulate(const LinkModel& model, bool adaptive) {
+  SimResult result = {};
+  LinkEstimate link;
+  initLinkEstimate(link);
+  UploadLimits limits = { SIM_SEND_DATA_INTERVAL, SIM_SAMPLE_INTERVAL, SIM_MAX_DATA_AGE, SIM_MAX_ROWS };
+
+  std::vector<uint32_t> rows;  // Sample times of the rows waiting for upload
+  uint32_t nextSample = 0;
+  uint32_t nextUpload = SIM_SEND_DATA_INTERVAL;
+  simRandom = 12345;  // Same link luck for both uploaders
+
+  while (nextUpload < SIM_DURATION) {
+    while (nextSample <= nextUpload) {
+      if (rows.size() >= SIM_MAX_ROWS) {
+        result.rowsDropped += rows.size();  // resetSensorArray() when full
+        rows.clear();
+      }
+      rows.push_back(nextSample);
+      nextSample += SIM_SAMPLE_INTERVAL;
+    }
+
+    uint32_t now = nextUpload;
+    uint32_t bytes = SIM_REQUEST_BYTES + rows.size() * SIM_ROW_BYTES;
+    bool outage = model.outageEvery > 0 && now % model.outageEvery < model.outageLength;
+    float failChance = model.failChance + model.failChancePerKB * bytes / 1024;
+    bool ok = !outage && randomUnit() >= failChance;
+
+    uint32_t duration = model.connectMs + (uint32_t)(bytes / model.bytesPerMs);
+    if (outage || !ok) {
+      duration = outage ? SIM_TIMEOUT : std::min(duration, (uint32_t)SIM_TIMEOUT);
+    }
+    result.requests++;
+    result.radioMs += duration;
+
+    uint32_t rowCount = rows.size();
+    if (ok) {
+      for (uint32_t time : rows) {
+        result.latencies.push_back(now + duration - time);
+      }
+      result.rowsDelivered += rows.size();
+      rows.clear();
+    } else {
+      result.failures++;
+    }
+
+    uint32_t interval = SIM_SEND_DATA_INTERVAL;
+    if (adaptive) {
+      linkNoteRssi(link, outage ? -95 : model.rssi + (randomUnit() - 0.5f) * 6);
+      linkNoteUpload(link, ok, bytes, rowCount, duration);
+      interval = nextUploadInterval(link, limits, rows.empty() ? 0 : now + duration - rows.front());
+    }
+    nextUpload = now + duration + interval;
+  }
+  return result;
+}
+
+uint32_t percentile(std::vector<uint32_t>& values, int percent) {
+  if (values.empty()) {
+    return 0;
+  }
+  size_t index = (values.size() - 1) * percent / 100;
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+void printResult(const char* link, const char* uploader, SimResult& result) {
+  uint64_t total = 0;
+  for (uint32_t latency : result.latencies) {
+    total += latency;
+  }
+  uint32_t mean = result.latencies.empty() ? 0 : total / result.latencies.size();
+  uint32_t p95 = percentile(result.latencies, 95);
+  uint32_t max = percentile(result.latencies, 100);
+
+  printf("%-6s %-9s %8u %8u %9.1f %9u %8u %8.1f %8.1f %8.1f\n",
+         link, uploader, result.requests, result.failures, result.radioMs / 1000.0,
+         result.rowsDelivered, result.rowsDropped, mean / 1000.0, p95 / 1000.0, max / 1000.0);
+}
+
+int main() {
+  printf("Simulated %lu h, a row every %u s, fixed uploader every %u s, max data age %u s\n\n",
+         SIM_DURATION / 3600000, SIM_SAMPLE_INTERVAL / 1000, SIM_SEND_DATA_INTERVAL / 1000, SIM_MAX_DATA_AGE / 1000);
+  printf("%-6s %-9s %8s %8s %9s %9s %8s %8s %8s %8s\n",
+         "Link", "Uploader", "Requests", "Failed", "Radio(s)", "Delivered", "Dropped", "Mean(s)", "P95(s)", "Max(s)");
+
+  for (const LinkModel& model : linkModels) {
+    SimResult fixed = simulate(model, false);
+    SimResult adaptive = simulate(model, true);
+    printResult(model.name, "fixed", fixed);
+    printResult(model.name, "adaptive", adaptive);
+  }
+  return 0;
+}
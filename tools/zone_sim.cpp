@@ -0,0 +1,269 @@
+/*****************************************
+*   Zone Simulation
+      - Runs gg_main_m7/zones.h over 8 simulated greenhouses for a day: each
+        zone has its own target, heat loss and heater power, the room
+        follows a daily cycle. Readings every 30 s (DHT11, whole degrees),
+        one control pass a second, as the sensing and control tasks do
+      - Faults: Zone 4's heater fails from 02:00 to 04:00 (Relay on, no heat),
+        Zone 7's DHT fails at 06:00 (No valid reading from then on), Zone 8 is a cold
+        store with a target below the room (Its heater never runs)
+      - Checks every healthy zone stays in its band with no alarm, every alarm
+        is raised for its own zone only, and each zone switches exactly as it
+        does when it is the only zone of the table
+      - Relay wear: no relay may switch on two readings in a row (The
+        hysteresis of heaterWanted() holds it). The failed DHT must leave its
+        heater as it was and flag the zone on every pass from then on, no
+        other zone may be flagged
+      - Frost: a zone held at 1 C in a freezing room reads 0 C on the way
+        down, the heater must come on and the zone must not be flagged
+        failed. Exits with 1 if a check fails
+      - Times controlZones() per pass of 8 zones on the host, the board figure
+        comes from the controlZones case of a GG_BENCHMARK build
+
+      g++ -O2 -o zone_sim tools/zone_sim.cpp && ./zone_sim
+*****************************************/
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#define GG_ZONES 8
+#include "../gg_main_m7/sensor_math.h"
+#include "../gg_main_m7/zones.h"
+
+#define SIM_DURATION (24 * 3600)   // s
+#define SIM_READ_INTERVAL 30       // s
+#define SIM_SETTLE 3600            // s of warm up before the band and the alarms are checked
+#define SIM_ALARM_MARGIN 5         // C, ALARM_TEMPERATURE_MARGIN of gg_main_m7.ino
+#define SIM_BAND_LOW 1.5           // C below the target a healthy zone may reach
+#define SIM_BAND_HIGH 2.0          // C above, the DHT11 reads whole degrees
+#define SIM_HEATER_FAIL_ZONE 3
+#define SIM_HEATER_FAIL_START (2 * 3600)
+#define SIM_HEATER_FAIL_END (4 * 3600)
+#define SIM_RECOVERY 3600          // s after the heater failure in which its alarms may still be raised
+#define SIM_SENSOR_FAIL_ZONE 6
+#define SIM_SENSOR_FAIL_START (6 * 3600)
+#define SIM_COLD_ZONE 7
+#define SIM_MIN_SWITCH_GAP (2 * SIM_READ_INTERVAL)  // s, a relay flipping on back to back readings chatters
+#define SIM_FROST_TARGET 1         // C, frost protection
+#define SIM_FROST_ROOM -6          // C
+
+struct ZoneModel {
+  const char* name;
+  float target;      // C
+  float lossTime;    // s, time constant of the heat loss to the room
+  float heaterRate;  // C per s while the heater runs
+};
+
+const ZoneModel zoneModels[GG_ZONES] = {
+  { "Seedlings", 24, 1800, 0.020 },
+  { "Tomatoes", 21, 2400, 0.015 },
+  { "Peppers", 23, 1500, 0.025 },
+  { "Herbs", 19, 3000, 0.010 },
+  { "Cuttings", 25, 1200, 0.030 },
+  { "Orchids", 22, 2000, 0.018 },
+  { "Citrus", 16, 3600, 0.008 },
+  { "Cold Store", 4, 2400, 0.015 },
+};
+
+const uint8_t simRelayPins[ZONE_MAX] = { 7, 8, 23, 25, 27, 29, 31, 33 };
+
+// Room temperature, 8 C at 04:00 to 16 C at 16:00
+float roomTemperature(int time) {
+  return 12 - 4 * cosf((time - 4 * 3600) * 2 * (float)M_PI / (24 * 3600));
+}
+
+struct ZoneResult {
+  float minTemperature;  // After SIM_SETTLE, outside its faults
+  float maxTemperature;
+  uint32_t over;         // Passes with the over temperature bit, after SIM_SETTLE
+  uint32_t under;
+  uint32_t overOutside;  // Alarms a healthy zone should not raise
+  uint32_t underOutside;
+  uint32_t switches;
+  std::vector<int> switchTimes;
+  int shortestGap;           // s between two switches, SIM_DURATION if fewer than two
+  uint32_t failed;           // Passes with the failed bit
+  uint32_t failedOutside;    // Failed bit without a failed DHT
+  uint32_t switchedBlind;    // Switches on a failed DHT
+};
+
+// Simulate the zones of first..first+count-1 in one table of count zones
+void simulate(int first, int count, ZoneResult* results) {
+  ZoneTable zones;
+  initZones(zones, count, simRelayPins + first);
+  float trueTemperature[GG_ZONES];
+
+  for (int zone = 0; zone < count; zone++) {
+    const ZoneModel& model = zoneModels[first + zone];
+    zones.target[zone] = model.target;
+    setZoneName(zones, zone, model.name);
+    trueTemperature[zone] = roomTemperature(0);
+
+    ZoneResult& result = results[first + zone];
+    result = ZoneResult();
+    result.minTemperature = 1000;
+    result.maxTemperature = -1000;
+    result.shortestGap = SIM_DURATION;
+  }
+
+  for (int time = 0; time < SIM_DURATION; time++) {
+    //Sensing task
+    if (time % SIM_READ_INTERVAL == 0) {
+      for (int zone = 0; zone < count; zone++) {
+        bool failed = first + zone == SIM_SENSOR_FAIL_ZONE && time >= SIM_SENSOR_FAIL_START;
+        zones.temperature[zone] = failed ? 0 : roundf(trueTemperature[zone]);
+        zones.humidity[zone] = failed ? 0 : 60;
+        zones.valid[zone] = !failed;
+      }
+    }
+
+    //Control task
+    ZoneDecisions decisions = controlZones(zones, SIM_ALARM_MARGIN);
+
+    for (int zone = 0; zone < count; zone++) {
+      int id = first + zone;
+      const ZoneModel& model = zoneModels[id];
+      ZoneResult& result = results[id];
+      uint8_t bit = 1 << zone;
+
+      bool heaterFailed = id == SIM_HEATER_FAIL_ZONE && time >= SIM_HEATER_FAIL_START && time < SIM_HEATER_FAIL_END;
+      bool expected = id == SIM_COLD_ZONE
+                      || (id == SIM_HEATER_FAIL_ZONE && time >= SIM_HEATER_FAIL_START && time < SIM_HEATER_FAIL_END + SIM_RECOVERY);
+
+      if (decisions.changed & bit) {
+        if (!result.switchTimes.empty()) {
+          result.shortestGap = std::min(result.shortestGap, time - result.switchTimes.back());
+        }
+        result.switches++;
+        result.switchTimes.push_back(time);
+      }
+      bool sensorFailed = id == SIM_SENSOR_FAIL_ZONE && time >= SIM_SENSOR_FAIL_START;
+      if (decisions.failed & bit) {
+        result.failed++;
+        result.failedOutside += !sensorFailed;
+      }
+      if (sensorFailed && (decisions.changed & bit)) {
+        result.switchedBlind++;
+      }
+      if ((decisions.over & bit) && time >= SIM_SETTLE) {
+        result.over++;
+        result.overOutside += !expected;
+      }
+      if ((decisions.under & bit) && time >= SIM_SETTLE) {
+        result.under++;
+        result.underOutside += !expected;
+      }
+
+      //Thermal model, one second
+      float heat = zones.heaterOn[zone] && !heaterFailed ? model.heaterRate : 0;
+      trueTemperature[zone] += (roomTemperature(time) - trueTemperature[zone]) / model.lossTime + heat;
+
+      bool healthy = (id == SIM_COLD_ZONE || !expected) && !(id == SIM_SENSOR_FAIL_ZONE && time >= SIM_SENSOR_FAIL_START);
+      if (time >= SIM_SETTLE && healthy) {
+        result.minTemperature = fminf(result.minTemperature, trueTemperature[zone]);
+        result.maxTemperature = fmaxf(result.maxTemperature, trueTemperature[zone]);
+      }
+    }
+  }
+}
+
+int main() {
+  int failures = 0;
+
+  ZoneResult together[GG_ZONES];
+  simulate(0, GG_ZONES, together);
+
+  //The same zones one per table, the switching must not change
+  ZoneResult alone[GG_ZONES];
+  for (int zone = 0; zone < GG_ZONES; zone++) {
+    simulate(zone, 1, alone);
+  }
+
+  printf("Simulated %d h, %d zones, readings every %d s, control every 1 s\n\n", SIM_DURATION / 3600, GG_ZONES, SIM_READ_INTERVAL);
+  printf("%-4s %-10s %6s %7s %7s %8s %7s %7s %7s %7s %8s  %s\n",
+         "Zone", "Name", "Target", "Min(C)", "Max(C)", "Switches", "Gap(s)", "Over", "Under", "Failed", "Alone", "Result");
+
+  for (int zone = 0; zone < GG_ZONES; zone++) {
+    const ZoneModel& model = zoneModels[zone];
+    const ZoneResult& result = together[zone];
+    const char* verdict = "ok";
+
+    bool independent = result.switchTimes == alone[zone].switchTimes && result.over == alone[zone].over && result.under == alone[zone].under
+                       && result.failed == alone[zone].failed;
+    if (!independent) {
+      verdict = "FAIL: switches differently with the other zones";
+    } else if (result.overOutside > 0 || result.underOutside > 0) {
+      verdict = "FAIL: alarm while healthy";
+    } else if (zone == SIM_COLD_ZONE && (result.switches > 0 || result.over == 0 || result.under > 0)) {
+      verdict = "FAIL: cold store heated or no over temperature alarm";
+    } else if (zone == SIM_HEATER_FAIL_ZONE && result.under == 0) {
+      verdict = "FAIL: heater failure raised no under temperature alarm";
+    } else if (zone != SIM_COLD_ZONE
+               && (result.minTemperature < model.target - SIM_BAND_LOW || result.maxTemperature > model.target + SIM_BAND_HIGH)) {
+      verdict = "FAIL: out of its band";
+    } else if (result.switches > 1 && result.shortestGap < SIM_MIN_SWITCH_GAP) {
+      verdict = "FAIL: relay chatter";
+    } else if (result.failedOutside > 0) {
+      verdict = "FAIL: flagged failed with a working DHT";
+    } else if (zone == SIM_SENSOR_FAIL_ZONE && (result.switchedBlind > 0 || result.failed < (uint32_t)(SIM_DURATION - SIM_SENSOR_FAIL_START))) {
+      verdict = "FAIL: heater switched or zone not flagged on a failed DHT";
+    } else if (zone == SIM_SENSOR_FAIL_ZONE) {
+      verdict = "ok (Failed DHT: heater held, zone flagged)";
+    }
+    failures += verdict[0] == 'F';
+
+    printf("%-4d %-10s %6.1f %7.2f %7.2f %8u %7d %7u %7u %7u %8s  %s\n",
+           zone + 1, model.name, model.target, result.minTemperature, result.maxTemperature,
+           result.switches, result.shortestGap, result.over, result.under, result.failed, independent ? "same" : "differs", verdict);
+  }
+
+  //Frost: the zone cools from above its target in a freezing room, the DHT11 reads 0 C before the heater comes on
+  {
+    ZoneTable frost;
+    initZones(frost, 1, simRelayPins);
+    frost.target[0] = SIM_FROST_TARGET;
+    float temperature = SIM_FROST_TARGET + 2;
+    bool heatedAtZero = false;
+    uint32_t flagged = 0;
+    float lowest = temperature;
+    for (int time = 0; time < 4 * 3600; time++) {
+      if (time % SIM_READ_INTERVAL == 0) {
+        frost.temperature[0] = roundf(temperature);
+        frost.valid[0] = true;
+      }
+      ZoneDecisions decisions = controlZones(frost, SIM_ALARM_MARGIN);
+      flagged += decisions.failed != 0;
+      heatedAtZero |= frost.temperature[0] == 0 && frost.heaterOn[0];
+      temperature += (SIM_FROST_ROOM - temperature) / 1800 + (frost.heaterOn[0] ? 0.02f : 0);
+      lowest = fminf(lowest, temperature);
+    }
+    bool ok = heatedAtZero && flagged == 0 && lowest > -SIM_BAND_LOW;
+    printf("\nFrost: target %d C, room %d C, heater on at a 0 C reading %s, lowest %.2f C, %u passes flagged failed  %s\n",
+           SIM_FROST_TARGET, SIM_FROST_ROOM, heatedAtZero ? "yes" : "no", lowest, flagged, ok ? "ok" : "FAIL: 0 C taken for a failed DHT");
+    failures += !ok;
+  }
+
+  //Cost of a control pass over 8 zones
+  ZoneTable zones;
+  initZones(zones, GG_ZONES, simRelayPins);
+  for (int zone = 0; zone < GG_ZONES; zone++) {
+    zones.target[zone] = zoneModels[zone].target;
+  }
+
+  const int passes = 10000000;
+  volatile uint32_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < passes; i++) {
+    zones.temperature[i % GG_ZONES] = 18 + (i % 13) * 0.5f;
+    ZoneDecisions decisions = controlZones(zones, SIM_ALARM_MARGIN);
+    sink = sink + decisions.changed + decisions.over;
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / passes;
+
+  printf("\ncontrolZones: %.1f ns per pass of %d zones (ZoneTable %zu bytes)\n", ns, GG_ZONES, sizeof(ZoneTable));
+  printf("%s\n", failures == 0 ? "All zones passed" : "Some zones FAILED");
+  return failures == 0 ? 0 : 1;
+}